@@ -0,0 +1,1752 @@
+/*
+ * ccut-compile.c
+ *
+ *  Lexer, parser and bytecode generator for the awk subset of ccut expressions:
+ *  numbers, strings, /regex/, @column, $field, variables, the usual awk operators
+ *  including concatenation and ~ !~, builtin and -df user functions with
+ *  if/else, while, do, for, break, continue and return statements.
+ */
+
+#include "ccut.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <setjmp.h>
+
+/* tokens, single-character ones are their own codes */
+enum {
+  T_EOF = 256,
+  T_NEWLINE,
+  T_NUMBER,
+  T_STRING,
+  T_ERE,
+  T_NAME,
+  T_FUNC_NAME,   /*< name immediately followed by '(' */
+  T_BUILTIN,
+  T_COLUMN,      /*< @name */
+  T_FUNCTION,
+  T_IF,
+  T_ELSE,
+  T_WHILE,
+  T_FOR,
+  T_DO,
+  T_BREAK,
+  T_CONTINUE,
+  T_RETURN,
+  T_NF,
+  T_NR,
+  T_FNR,
+  T_FILENAME,
+  T_UNSUPPORTED,
+  T_ADD_ASSIGN,
+  T_SUB_ASSIGN,
+  T_MUL_ASSIGN,
+  T_DIV_ASSIGN,
+  T_MOD_ASSIGN,
+  T_POW_ASSIGN,
+  T_OR,
+  T_AND,
+  T_NOMATCH,
+  T_EQ,
+  T_LE,
+  T_GE,
+  T_NE,
+  T_INCR,
+  T_DECR,
+  T_POW
+};
+
+static const struct {
+  const char * name;
+  int token;
+} keywords[] = {
+  { "function", T_FUNCTION },
+  { "func", T_FUNCTION },
+  { "if", T_IF },
+  { "else", T_ELSE },
+  { "while", T_WHILE },
+  { "for", T_FOR },
+  { "do", T_DO },
+  { "break", T_BREAK },
+  { "continue", T_CONTINUE },
+  { "return", T_RETURN },
+  { "NF", T_NF },
+  { "NR", T_NR },
+  { "FNR", T_FNR },
+  { "FILENAME", T_FILENAME },
+  { "BEGIN", T_UNSUPPORTED },
+  { "END", T_UNSUPPORTED },
+  { "getline", T_UNSUPPORTED },
+  { "print", T_UNSUPPORTED },
+  { "printf", T_UNSUPPORTED },
+  { "next", T_UNSUPPORTED },
+  { "nextfile", T_UNSUPPORTED },
+  { "exit", T_UNSUPPORTED },
+  { "delete", T_UNSUPPORTED },
+  { "in", T_UNSUPPORTED },
+  { NULL, 0 }
+};
+
+static const struct {
+  const char * name;
+  int id;
+  int minargs, maxargs;
+} builtins[] = {
+  { "length", B_LENGTH, 0, 1 },
+  { "substr", B_SUBSTR, 2, 3 },
+  { "index", B_INDEX, 2, 2 },
+  { "tolower", B_TOLOWER, 1, 1 },
+  { "toupper", B_TOUPPER, 1, 1 },
+  { "sprintf", B_SPRINTF, 1, 255 },
+  { "sqrt", B_SQRT, 1, 1 },
+  { "exp", B_EXP, 1, 1 },
+  { "log", B_LOG, 1, 1 },
+  { "sin", B_SIN, 1, 1 },
+  { "cos", B_COS, 1, 1 },
+  { "atan2", B_ATAN2, 2, 2 },
+  { "int", B_INT, 1, 1 },
+  { "abs", B_ABS, 1, 1 },
+  { "hypot", B_HYPOT, 2, 2 },
+  { "and", B_AND, 2, 255 },
+  { "or", B_OR, 2, 255 },
+  { "xor", B_XOR, 2, 255 },
+  { "lshift", B_LSHIFT, 2, 2 },
+  { "rshift", B_RSHIFT, 2, 2 },
+  { "compl", B_COMPL, 1, 1 },
+  { NULL, 0, 0, 0 }
+};
+
+
+/* AST */
+enum {
+  N_NUM,
+  N_STR,
+  N_ERE,
+  N_GLOBAL,
+  N_PARAM,
+  N_COL,
+  N_FIELD,
+  N_NF,
+  N_NR,
+  N_FNR,
+  N_FILENAME,
+  N_UNARY,
+  N_BINARY,
+  N_AND,
+  N_OR,
+  N_COND,
+  N_ASSIGN,
+  N_PREINC,
+  N_POSTINC,
+  N_CALL,
+  N_BUILTIN,
+  S_BLOCK,
+  S_EXPR,
+  S_IF,
+  S_WHILE,
+  S_DO,
+  S_FOR,
+  S_RETURN,
+  S_BREAK,
+  S_CONTINUE,
+  S_NOP
+};
+
+typedef
+struct node {
+  int kind;
+  int op;             /*< OP_xxx of N_UNARY, N_BINARY, N_ASSIGN (-1 for plain =); +1/-1 for increments */
+  int idx;            /*< constant, global, param, column, regex, function or builtin index */
+  struct node * a, * b, * c, * d;
+  struct node ** args;
+  int nargs;
+} node;
+
+typedef
+struct parser {
+  program * p;
+  const char * src;
+  const char * pos;
+  const char * tokpos;
+  int tok, prev;
+  char * text;        /*< NAME, STRING, ERE text */
+  size_t tlen, tcap;
+  double num;
+  int cmode;
+  char ** params;
+  int nparams;
+  jmp_buf jb;
+} parser;
+
+
+/***********************************************************************************************************************
+ * Program tables
+ **********************************************************************************************************************/
+
+static void * xrealloc( void * ptr, size_t size )
+{
+  if ( !(ptr = realloc(ptr, size)) ) {
+    fprintf(stderr, "ccut: out of memory\n");
+    exit(2);
+  }
+  return ptr;
+}
+
+program * program_create( void )
+{
+  program * p = xrealloc(NULL, sizeof(*p));
+  value pi = { V_NUM, 0, 0, NULL, 3.14159265358979323846 };
+
+  memset(p, 0, sizeof(*p));
+
+  /* set by the BEGIN block of the old awk script */
+  p->gnames = xrealloc(NULL, sizeof(*p->gnames));
+  p->globals = xrealloc(NULL, sizeof(*p->globals));
+  p->gnames[0] = strdup("pi");
+  p->globals[0] = pi;
+  p->nglobals = 1;
+
+  return p;
+}
+
+program * program_clone( const program * p )
+{
+  program * c = xrealloc(NULL, sizeof(*c));
+  int i;
+
+  *c = *p;
+
+  c->globals = xrealloc(NULL, (p->nglobals + 1) * sizeof(*c->globals));
+  for ( i = 0; i < p->nglobals; ++i ) {
+    c->globals[i] = p->globals[i];
+    if ( c->globals[i].type == V_STR || c->globals[i].type == V_STRNUM ) {
+      char * s = xrealloc(NULL, c->globals[i].len + 1);
+      memcpy(s, c->globals[i].s, c->globals[i].len + 1);
+      c->globals[i].s = s;
+    }
+  }
+
+  /* glibc regexec() locks the pattern, so each thread gets its own */
+  c->regex = xrealloc(NULL, (p->nregex + 1) * sizeof(*c->regex));
+  for ( i = 0; i < p->nregex; ++i ) {
+    regcomp(&c->regex[i], p->resrc[i], REG_EXTENDED | REG_NOSUB);
+  }
+
+  return c;
+}
+
+int find_function( const program * p, const char * name )
+{
+  int i;
+  for ( i = 0; i < p->nfuncs; ++i ) {
+    if ( strcmp(p->funcs[i]->name, name) == 0 ) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static int get_function( program * p, const char * name )
+{
+  function * f;
+  int i;
+
+  if ( (i = find_function(p, name)) >= 0 ) {
+    return i;
+  }
+
+  f = xrealloc(NULL, sizeof(*f));
+  memset(f, 0, sizeof(*f));
+  f->name = strdup(name);
+  f->nparams = -1;
+
+  p->funcs = xrealloc(p->funcs, (p->nfuncs + 1) * sizeof(*p->funcs));
+  p->funcs[p->nfuncs] = f;
+
+  return p->nfuncs++;
+}
+
+static int get_global( program * p, const char * name )
+{
+  int i;
+
+  for ( i = 0; i < p->nglobals; ++i ) {
+    if ( strcmp(p->gnames[i], name) == 0 ) {
+      return i;
+    }
+  }
+
+  p->gnames = xrealloc(p->gnames, (p->nglobals + 1) * sizeof(*p->gnames));
+  p->globals = xrealloc(p->globals, (p->nglobals + 1) * sizeof(*p->globals));
+  p->gnames[p->nglobals] = strdup(name);
+  memset(&p->globals[p->nglobals], 0, sizeof(*p->globals));
+  p->globals[p->nglobals].type = V_UNINIT;
+  p->globals[p->nglobals].s = "";
+
+  return p->nglobals++;
+}
+
+static int get_column( program * p, const char * name )
+{
+  int i;
+
+  for ( i = 0; i < p->ncols; ++i ) {
+    if ( strcmp(p->cnames[i], name) == 0 ) {
+      return i;
+    }
+  }
+
+  p->cnames = xrealloc(p->cnames, (p->ncols + 1) * sizeof(*p->cnames));
+  p->cfield = xrealloc(p->cfield, (p->ncols + 1) * sizeof(*p->cfield));
+  p->cnames[p->ncols] = strdup(name);
+  p->cfield[p->ncols] = -1;
+
+  return p->ncols++;
+}
+
+/* constant operand: -1 - index */
+static int add_const( program * p, const value * v )
+{
+  p->consts = xrealloc(p->consts, (p->nconsts + 1) * sizeof(*p->consts));
+  p->consts[p->nconsts] = *v;
+  return -1 - p->nconsts++;
+}
+
+static int const_num( program * p, double x )
+{
+  value v = { V_NUM, 0, 0, NULL, x };
+  int i;
+
+  for ( i = 0; i < p->nconsts; ++i ) {
+    if ( p->consts[i].type == V_NUM && p->consts[i].num == x ) {
+      return -1 - i;
+    }
+  }
+
+  return add_const(p, &v);
+}
+
+static int const_str( program * p, const char * s, size_t len )
+{
+  value v = { V_STR, 0, len, NULL, 0 };
+  char * c = xrealloc(NULL, len + 1);
+
+  memcpy(c, s, len);
+  c[len] = 0;
+  v.s = c;
+
+  return add_const(p, &v);
+}
+
+
+/***********************************************************************************************************************
+ * Lexer
+ **********************************************************************************************************************/
+
+static void syntax_error( parser * ps, const char * msg )
+{
+  fprintf(stderr, "ccut: %s in '%s' near '%.24s'\n", msg, ps->src, ps->tokpos ? ps->tokpos : ps->pos);
+  longjmp(ps->jb, 1);
+}
+
+static void text_put( parser * ps, char c )
+{
+  if ( ps->tlen + 1 >= ps->tcap ) {
+    ps->text = xrealloc(ps->text, ps->tcap = ps->tcap ? 2 * ps->tcap : 64);
+  }
+  ps->text[ps->tlen++] = c;
+  ps->text[ps->tlen] = 0;
+}
+
+static int is_builtin( const char * name )
+{
+  int i;
+  for ( i = 0; builtins[i].name; ++i ) {
+    if ( strcmp(builtins[i].name, name) == 0 ) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/* may '/' start a regex here: not after an operand */
+static int regex_allowed( int prev )
+{
+  switch ( prev ) {
+  case T_NAME:
+  case T_NUMBER:
+  case T_STRING:
+  case T_ERE:
+  case T_COLUMN:
+  case T_BUILTIN:
+  case T_NF:
+  case T_NR:
+  case T_FNR:
+  case T_FILENAME:
+  case T_INCR:
+  case T_DECR:
+  case ')':
+  case '$':
+    return 0;
+  }
+  return 1;
+}
+
+static void string_escape( parser * ps, int regex )
+{
+  int c = *ps->pos++, n, k;
+
+  if ( regex ) {
+    /* the regex engine handles escapes itself, only \/ is ours */
+    if ( c != '/' ) {
+      text_put(ps, '\\');
+    }
+    text_put(ps, c);
+    return;
+  }
+
+  switch ( c ) {
+  case 'n':
+    text_put(ps, '\n');
+    break;
+  case 't':
+    text_put(ps, '\t');
+    break;
+  case 'r':
+    text_put(ps, '\r');
+    break;
+  case 'a':
+    text_put(ps, '\a');
+    break;
+  case 'b':
+    text_put(ps, '\b');
+    break;
+  case 'f':
+    text_put(ps, '\f');
+    break;
+  case 'v':
+    text_put(ps, '\v');
+    break;
+  case '0' ... '7':
+    for ( n = c - '0', k = 1; k < 3 && *ps->pos >= '0' && *ps->pos <= '7'; ++k ) {
+      n = n * 8 + *ps->pos++ - '0';
+    }
+    text_put(ps, n);
+    break;
+  case 0:
+    --ps->pos;
+    syntax_error(ps, "unterminated string");
+    break;
+  default:
+    text_put(ps, c);
+    break;
+  }
+}
+
+static int lex( parser * ps )
+{
+  const char * s;
+  int c, i;
+
+again:
+  while ( *ps->pos == ' ' || *ps->pos == '\t' || *ps->pos == '\r' ) {
+    ++ps->pos;
+  }
+
+  if ( ps->pos[0] == '\\' && (ps->pos[1] == '\n' || (ps->pos[1] == '\r' && ps->pos[2] == '\n')) ) {
+    ps->pos += ps->pos[1] == '\n' ? 2 : 3;
+    goto again;
+  }
+
+  if ( *ps->pos == '#' ) {
+    while ( *ps->pos && *ps->pos != '\n' ) {
+      ++ps->pos;
+    }
+  }
+
+  ps->tokpos = s = ps->pos;
+  ps->tlen = 0;
+  text_put(ps, 0);
+  ps->tlen = 0;
+
+  if ( !(c = *ps->pos) ) {
+    return T_EOF;
+  }
+
+  ++ps->pos;
+
+  if ( c == '\n' ) {
+    return T_NEWLINE;
+  }
+
+  if ( isdigit(c) || (c == '.' && isdigit(*ps->pos)) ) {
+    char * e;
+    ps->num = strtod(s, &e);
+    ps->pos = e;
+    return T_NUMBER;
+  }
+
+  if ( isalpha(c) || c == '_' ) {
+    while ( isalnum(*ps->pos) || *ps->pos == '_' ) {
+      ++ps->pos;
+    }
+    for ( ; s < ps->pos; ++s ) {
+      text_put(ps, *s);
+    }
+    for ( i = 0; keywords[i].name; ++i ) {
+      if ( strcmp(keywords[i].name, ps->text) == 0 ) {
+        return keywords[i].token;
+      }
+    }
+    if ( is_builtin(ps->text) >= 0 ) {
+      return T_BUILTIN;
+    }
+    return *ps->pos == '(' ? T_FUNC_NAME : T_NAME;
+  }
+
+  if ( c == '@' ) {
+    if ( !isalpha(*ps->pos) && *ps->pos != '_' ) {
+      syntax_error(ps, "column name expected after @");
+    }
+    while ( isalnum(*ps->pos) || *ps->pos == '_' ) {
+      text_put(ps, *ps->pos++);
+    }
+    return T_COLUMN;
+  }
+
+  if ( c == '"' ) {
+    while ( (c = *ps->pos++) != '"' ) {
+      if ( c == 0 || c == '\n' ) {
+        --ps->pos;
+        syntax_error(ps, "unterminated string");
+      }
+      if ( c == '\\' ) {
+        string_escape(ps, 0);
+      }
+      else {
+        text_put(ps, c);
+      }
+    }
+    return T_STRING;
+  }
+
+  if ( c == '/' && regex_allowed(ps->prev) ) {
+    while ( (c = *ps->pos++) != '/' ) {
+      if ( c == 0 || c == '\n' ) {
+        --ps->pos;
+        syntax_error(ps, "unterminated regular expression");
+      }
+      if ( c == '\\' ) {
+        string_escape(ps, 1);
+      }
+      else {
+        text_put(ps, c);
+      }
+    }
+    return T_ERE;
+  }
+
+#define TWO(c1, c2, t) \
+  if ( c == c1 && *ps->pos == c2 ) { \
+    ++ps->pos; \
+    return t; \
+  }
+
+  if ( c == '*' && ps->pos[0] == '*' && ps->pos[1] == '=' ) {
+    ps->pos += 2;
+    return T_POW_ASSIGN;
+  }
+
+  TWO('*', '*', T_POW);
+  TWO('+', '=', T_ADD_ASSIGN);
+  TWO('-', '=', T_SUB_ASSIGN);
+  TWO('*', '=', T_MUL_ASSIGN);
+  TWO('/', '=', T_DIV_ASSIGN);
+  TWO('%', '=', T_MOD_ASSIGN);
+  TWO('^', '=', T_POW_ASSIGN);
+  TWO('|', '|', T_OR);
+  TWO('&', '&', T_AND);
+  TWO('!', '~', T_NOMATCH);
+  TWO('=', '=', T_EQ);
+  TWO('<', '=', T_LE);
+  TWO('>', '=', T_GE);
+  TWO('!', '=', T_NE);
+  TWO('+', '+', T_INCR);
+  TWO('-', '-', T_DECR);
+
+#undef TWO
+
+  if ( c == '^' ) {
+    return T_POW;
+  }
+
+  if ( strchr("{}(),;+-*/%!<>~?:$=", c) ) {
+    return c;
+  }
+
+  syntax_error(ps, "unexpected character");
+  return T_EOF;
+}
+
+static void next( parser * ps )
+{
+  ps->prev = ps->tok;
+  ps->tok = lex(ps);
+}
+
+static void expect( parser * ps, int tok, const char * what )
+{
+  if ( ps->tok != tok ) {
+    char msg[64];
+    snprintf(msg, sizeof(msg), "syntax error, %s expected", what);
+    syntax_error(ps, msg);
+  }
+  next(ps);
+}
+
+static void skip_newlines( parser * ps )
+{
+  while ( ps->tok == T_NEWLINE ) {
+    next(ps);
+  }
+}
+
+
+/***********************************************************************************************************************
+ * Parser
+ **********************************************************************************************************************/
+
+static node * mknode( int kind, int op, node * a, node * b )
+{
+  node * n = xrealloc(NULL, sizeof(*n));
+  memset(n, 0, sizeof(*n));
+  n->kind = kind;
+  n->op = op;
+  n->a = a;
+  n->b = b;
+  return n;
+}
+
+static void add_arg( node * n, node * a )
+{
+  n->args = xrealloc(n->args, (n->nargs + 1) * sizeof(*n->args));
+  n->args[n->nargs++] = a;
+}
+
+static int is_lvalue( const node * n )
+{
+  return n->kind == N_GLOBAL || n->kind == N_PARAM;
+}
+
+static node * parse_expr( parser * ps );
+static node * parse_unary( parser * ps );
+
+static node * parse_name( parser * ps, const char * name )
+{
+  node * n;
+  int i;
+
+  for ( i = 0; i < ps->nparams; ++i ) {
+    if ( strcmp(ps->params[i], name) == 0 ) {
+      n = mknode(N_PARAM, 0, NULL, NULL);
+      n->idx = i;
+      return n;
+    }
+  }
+
+  if ( ps->cmode ) {
+    n = mknode(N_COL, 0, NULL, NULL);
+    n->idx = get_column(ps->p, name);
+  }
+  else {
+    n = mknode(N_GLOBAL, 0, NULL, NULL);
+    n->idx = get_global(ps->p, name);
+  }
+
+  return n;
+}
+
+static void parse_args( parser * ps, node * n )
+{
+  expect(ps, '(', "'('");
+  skip_newlines(ps);
+  if ( ps->tok != ')' ) {
+    for ( ;; ) {
+      add_arg(n, parse_expr(ps));
+      skip_newlines(ps);
+      if ( ps->tok != ',' ) {
+        break;
+      }
+      next(ps);
+      skip_newlines(ps);
+    }
+  }
+  expect(ps, ')', "')'");
+}
+
+static node * parse_primary( parser * ps )
+{
+  node * n = NULL;
+  int i;
+
+  switch ( ps->tok ) {
+
+  case T_NUMBER:
+    n = mknode(N_NUM, 0, NULL, NULL);
+    n->idx = const_num(ps->p, ps->num);
+    next(ps);
+    break;
+
+  case T_STRING:
+    n = mknode(N_STR, 0, NULL, NULL);
+    n->idx = const_str(ps->p, ps->text, ps->tlen);
+    next(ps);
+    break;
+
+  case T_ERE:
+    n = mknode(N_ERE, 0, NULL, NULL);
+    ps->p->regex = xrealloc(ps->p->regex, (ps->p->nregex + 1) * sizeof(*ps->p->regex));
+    ps->p->resrc = xrealloc(ps->p->resrc, (ps->p->nregex + 1) * sizeof(*ps->p->resrc));
+    if ( regcomp(&ps->p->regex[ps->p->nregex], ps->text, REG_EXTENDED | REG_NOSUB) != 0 ) {
+      syntax_error(ps, "invalid regular expression");
+    }
+    ps->p->resrc[ps->p->nregex] = strdup(ps->text);
+    n->idx = ps->p->nregex++;
+    next(ps);
+    break;
+
+  case T_COLUMN:
+    n = mknode(N_COL, 0, NULL, NULL);
+    n->idx = get_column(ps->p, ps->text);
+    next(ps);
+    break;
+
+  case T_NAME:
+    n = parse_name(ps, ps->text);
+    next(ps);
+    break;
+
+  case T_NF:
+  case T_NR:
+  case T_FNR:
+  case T_FILENAME:
+    n = mknode(ps->tok == T_NF ? N_NF : ps->tok == T_NR ? N_NR : ps->tok == T_FNR ? N_FNR : N_FILENAME, 0, NULL, NULL);
+    next(ps);
+    break;
+
+  case T_FUNC_NAME:
+    n = mknode(N_CALL, 0, NULL, NULL);
+    n->idx = get_function(ps->p, ps->text);
+    next(ps);
+    parse_args(ps, n);
+    break;
+
+  case T_BUILTIN:
+    i = is_builtin(ps->text);
+    n = mknode(N_BUILTIN, 0, NULL, NULL);
+    n->idx = builtins[i].id;
+    next(ps);
+    if ( ps->tok == '(' ) {
+      parse_args(ps, n);
+    }
+    if ( n->idx == B_LENGTH && n->nargs == 0 ) {
+      node * f0 = mknode(N_FIELD, 0, mknode(N_NUM, 0, NULL, NULL), NULL);
+      f0->a->idx = const_num(ps->p, 0);
+      add_arg(n, f0);
+    }
+    if ( n->nargs < builtins[i].minargs || n->nargs > builtins[i].maxargs ) {
+      syntax_error(ps, "wrong number of arguments to builtin function");
+    }
+    break;
+
+  case '(':
+    next(ps);
+    n = parse_expr(ps);
+    expect(ps, ')', "')'");
+    break;
+
+  case '$':
+    next(ps);
+    if ( ps->tok == T_INCR || ps->tok == T_DECR || ps->tok == '-' || ps->tok == '+' || ps->tok == '!' ) {
+      n = mknode(N_FIELD, 0, parse_unary(ps), NULL);
+    }
+    else {
+      n = mknode(N_FIELD, 0, parse_primary(ps), NULL);
+    }
+    break;
+
+  case T_INCR:
+  case T_DECR:
+    i = ps->tok == T_INCR ? 1 : -1;
+    next(ps);
+    n = parse_primary(ps);
+    if ( !is_lvalue(n) ) {
+      syntax_error(ps, "variable expected after ++ or --");
+    }
+    n = mknode(N_PREINC, i, n, NULL);
+    break;
+
+  case T_UNSUPPORTED:
+    syntax_error(ps, "unsupported awk construct");
+    break;
+
+  default:
+    syntax_error(ps, "syntax error");
+    break;
+  }
+
+  if ( (ps->tok == T_INCR || ps->tok == T_DECR) && is_lvalue(n) ) {
+    n = mknode(N_POSTINC, ps->tok == T_INCR ? 1 : -1, n, NULL);
+    next(ps);
+  }
+
+  return n;
+}
+
+static node * parse_pow( parser * ps )
+{
+  node * n = parse_primary(ps);
+
+  if ( ps->tok == T_POW ) {
+    next(ps);
+    /* right associative, the exponent may have unary minus */
+    n = mknode(N_BINARY, OP_POW, n, parse_unary(ps));
+  }
+
+  return n;
+}
+
+static node * parse_unary( parser * ps )
+{
+  switch ( ps->tok ) {
+  case '-':
+    next(ps);
+    return mknode(N_UNARY, OP_NEG, parse_unary(ps), NULL);
+  case '+':
+    next(ps);
+    return mknode(N_UNARY, OP_TONUM, parse_unary(ps), NULL);
+  case '!':
+    next(ps);
+    return mknode(N_UNARY, OP_NOT, parse_unary(ps), NULL);
+  }
+  return parse_pow(ps);
+}
+
+static node * parse_mul( parser * ps )
+{
+  node * n = parse_unary(ps);
+
+  while ( ps->tok == '*' || ps->tok == '/' || ps->tok == '%' ) {
+    int op = ps->tok == '*' ? OP_MUL : ps->tok == '/' ? OP_DIV : OP_MOD;
+    next(ps);
+    n = mknode(N_BINARY, op, n, parse_unary(ps));
+  }
+
+  return n;
+}
+
+static node * parse_add( parser * ps )
+{
+  node * n = parse_mul(ps);
+
+  while ( ps->tok == '+' || ps->tok == '-' ) {
+    int op = ps->tok == '+' ? OP_ADD : OP_SUB;
+    next(ps);
+    n = mknode(N_BINARY, op, n, parse_mul(ps));
+  }
+
+  return n;
+}
+
+static int starts_concat( int tok )
+{
+  switch ( tok ) {
+  case T_NUMBER:
+  case T_STRING:
+  case T_NAME:
+  case T_FUNC_NAME:
+  case T_BUILTIN:
+  case T_COLUMN:
+  case T_NF:
+  case T_NR:
+  case T_FNR:
+  case T_FILENAME:
+  case T_INCR:
+  case T_DECR:
+  case '$':
+  case '(':
+    return 1;
+  }
+  return 0;
+}
+
+static node * parse_concat( parser * ps )
+{
+  node * n = parse_add(ps);
+
+  while ( starts_concat(ps->tok) ) {
+    n = mknode(N_BINARY, OP_CAT, n, parse_add(ps));
+  }
+
+  return n;
+}
+
+static node * parse_relational( parser * ps )
+{
+  node * n = parse_concat(ps);
+  int op;
+
+  switch ( ps->tok ) {
+  case '<':
+    op = OP_LT;
+    break;
+  case T_LE:
+    op = OP_LE;
+    break;
+  case '>':
+    op = OP_GT;
+    break;
+  case T_GE:
+    op = OP_GE;
+    break;
+  case T_EQ:
+    op = OP_EQ;
+    break;
+  case T_NE:
+    op = OP_NE;
+    break;
+  default:
+    return n;
+  }
+
+  next(ps);
+  return mknode(N_BINARY, op, n, parse_concat(ps));
+}
+
+static node * parse_match( parser * ps )
+{
+  node * n = parse_relational(ps);
+
+  while ( ps->tok == '~' || ps->tok == T_NOMATCH ) {
+    int op = ps->tok == '~' ? OP_MATCH : OP_NMATCH;
+    next(ps);
+    n = mknode(N_BINARY, op, n, parse_relational(ps));
+  }
+
+  return n;
+}
+
+static node * parse_and( parser * ps )
+{
+  node * n = parse_match(ps);
+
+  while ( ps->tok == T_AND ) {
+    next(ps);
+    skip_newlines(ps);
+    n = mknode(N_AND, 0, n, parse_match(ps));
+  }
+
+  return n;
+}
+
+static node * parse_or( parser * ps )
+{
+  node * n = parse_and(ps);
+
+  while ( ps->tok == T_OR ) {
+    next(ps);
+    skip_newlines(ps);
+    n = mknode(N_OR, 0, n, parse_and(ps));
+  }
+
+  return n;
+}
+
+static node * parse_ternary( parser * ps )
+{
+  node * n = parse_or(ps);
+
+  if ( ps->tok == '?' ) {
+    node * t;
+    next(ps);
+    skip_newlines(ps);
+    t = parse_ternary(ps);
+    skip_newlines(ps);
+    expect(ps, ':', "':'");
+    skip_newlines(ps);
+    n = mknode(N_COND, 0, n, t);
+    n->c = parse_ternary(ps);
+  }
+
+  return n;
+}
+
+static node * parse_expr( parser * ps )
+{
+  node * n = parse_ternary(ps);
+  int op;
+
+  switch ( ps->tok ) {
+  case '=':
+    op = -1;
+    break;
+  case T_ADD_ASSIGN:
+    op = OP_ADD;
+    break;
+  case T_SUB_ASSIGN:
+    op = OP_SUB;
+    break;
+  case T_MUL_ASSIGN:
+    op = OP_MUL;
+    break;
+  case T_DIV_ASSIGN:
+    op = OP_DIV;
+    break;
+  case T_MOD_ASSIGN:
+    op = OP_MOD;
+    break;
+  case T_POW_ASSIGN:
+    op = OP_POW;
+    break;
+  default:
+    return n;
+  }
+
+  if ( !is_lvalue(n) ) {
+    syntax_error(ps, n->kind == N_FIELD || n->kind == N_COL ? "assignment to fields is not supported" :
+        "assignment to non-variable");
+  }
+
+  next(ps);
+  skip_newlines(ps);
+
+  return mknode(N_ASSIGN, op, n, parse_expr(ps));
+}
+
+static void end_statement( parser * ps )
+{
+  if ( ps->tok == ';' || ps->tok == T_NEWLINE ) {
+    next(ps);
+  }
+  else if ( ps->tok != '}' && ps->tok != T_EOF ) {
+    syntax_error(ps, "syntax error, end of statement expected");
+  }
+}
+
+static node * parse_statement( parser * ps );
+
+static node * parse_block( parser * ps )
+{
+  node * n = mknode(S_BLOCK, 0, NULL, NULL);
+
+  expect(ps, '{', "'{'");
+
+  for ( ;; ) {
+    while ( ps->tok == T_NEWLINE || ps->tok == ';' ) {
+      next(ps);
+    }
+    if ( ps->tok == '}' ) {
+      break;
+    }
+    add_arg(n, parse_statement(ps));
+  }
+
+  next(ps);
+
+  return n;
+}
+
+static node * parse_simple_or_empty( parser * ps, int terminator )
+{
+  node * n = NULL;
+  if ( ps->tok != terminator ) {
+    n = parse_expr(ps);
+  }
+  expect(ps, terminator, terminator == ';' ? "';'" : "')'");
+  return n;
+}
+
+static node * parse_statement( parser * ps )
+{
+  node * n;
+
+  switch ( ps->tok ) {
+
+  case '{':
+    return parse_block(ps);
+
+  case ';':
+    next(ps);
+    return mknode(S_NOP, 0, NULL, NULL);
+
+  case T_IF:
+    next(ps);
+    expect(ps, '(', "'('");
+    n = mknode(S_IF, 0, parse_expr(ps), NULL);
+    expect(ps, ')', "')'");
+    skip_newlines(ps);
+    n->b = parse_statement(ps);
+    /* else may follow the statement terminator and newlines */
+    {
+      const char * pos = ps->pos, * tokpos = ps->tokpos;
+      int tok = ps->tok, prev = ps->prev;
+      while ( ps->tok == T_NEWLINE || ps->tok == ';' ) {
+        next(ps);
+      }
+      if ( ps->tok == T_ELSE ) {
+        next(ps);
+        skip_newlines(ps);
+        n->c = parse_statement(ps);
+      }
+      else {
+        ps->pos = pos, ps->tokpos = tokpos, ps->tok = tok, ps->prev = prev;
+      }
+    }
+    return n;
+
+  case T_WHILE:
+    next(ps);
+    expect(ps, '(', "'('");
+    n = mknode(S_WHILE, 0, parse_expr(ps), NULL);
+    expect(ps, ')', "')'");
+    if ( ps->tok == ';' ) {
+      next(ps);
+      n->b = mknode(S_NOP, 0, NULL, NULL);
+    }
+    else {
+      skip_newlines(ps);
+      n->b = parse_statement(ps);
+    }
+    return n;
+
+  case T_DO:
+    next(ps);
+    skip_newlines(ps);
+    n = mknode(S_DO, 0, NULL, parse_statement(ps));
+    while ( ps->tok == T_NEWLINE || ps->tok == ';' ) {
+      next(ps);
+    }
+    expect(ps, T_WHILE, "'while'");
+    expect(ps, '(', "'('");
+    n->a = parse_expr(ps);
+    expect(ps, ')', "')'");
+    end_statement(ps);
+    return n;
+
+  case T_FOR:
+    next(ps);
+    expect(ps, '(', "'('");
+    n = mknode(S_FOR, 0, NULL, NULL);
+    n->c = parse_simple_or_empty(ps, ';');
+    n->a = parse_simple_or_empty(ps, ';');
+    n->d = parse_simple_or_empty(ps, ')');
+    skip_newlines(ps);
+    n->b = parse_statement(ps);
+    return n;
+
+  case T_BREAK:
+  case T_CONTINUE:
+    n = mknode(ps->tok == T_BREAK ? S_BREAK : S_CONTINUE, 0, NULL, NULL);
+    next(ps);
+    end_statement(ps);
+    return n;
+
+  case T_RETURN:
+    next(ps);
+    n = mknode(S_RETURN, 0, NULL, NULL);
+    if ( ps->tok != ';' && ps->tok != T_NEWLINE && ps->tok != '}' && ps->tok != T_EOF ) {
+      n->a = parse_expr(ps);
+    }
+    end_statement(ps);
+    return n;
+  }
+
+  n = mknode(S_EXPR, 0, parse_expr(ps), NULL);
+  end_statement(ps);
+
+  return n;
+}
+
+
+/***********************************************************************************************************************
+ * Code generator
+ **********************************************************************************************************************/
+
+typedef
+struct loop {
+  int * brk, nbrk;
+  int * cont, ncont;
+  struct loop * outer;
+} loop;
+
+typedef
+struct cgen {
+  program * p;
+  function * f;
+  int nreg;
+  loop * loop;
+} cgen;
+
+static int emit( cgen * cg, int op, int a, int b, int c, int d )
+{
+  function * f = cg->f;
+  insn * i;
+
+  if ( f->ncode == f->maxcode ) {
+    f->code = xrealloc(f->code, (f->maxcode = f->maxcode ? 2 * f->maxcode : 32) * sizeof(*f->code));
+  }
+
+  i = &f->code[f->ncode];
+  i->op = op, i->a = a, i->b = b, i->c = c, i->d = d;
+
+  return f->ncode++;
+}
+
+static int newreg( cgen * cg )
+{
+  int r = cg->nreg++;
+  if ( cg->nreg > cg->f->nregs ) {
+    cg->f->nregs = cg->nreg;
+  }
+  return r;
+}
+
+static void patch_list( cgen * cg, int ** list, int * n, int target )
+{
+  int i;
+  for ( i = 0; i < *n; ++i ) {
+    cg->f->code[(*list)[i]].a = target;
+  }
+  free(*list);
+  *list = NULL;
+  *n = 0;
+}
+
+static void push_patch( int ** list, int * n, int pc )
+{
+  *list = xrealloc(*list, (*n + 1) * sizeof(**list));
+  (*list)[(*n)++] = pc;
+}
+
+static int gen_expr( cgen * cg, const node * n );
+
+static int load( cgen * cg, const node * lv )
+{
+  int r;
+
+  if ( lv->kind == N_PARAM ) {
+    return lv->idx;
+  }
+
+  r = newreg(cg);
+  emit(cg, OP_LOADG, r, lv->idx, 0, 0);
+
+  return r;
+}
+
+static int store( cgen * cg, const node * lv, int v )
+{
+  if ( lv->kind == N_PARAM ) {
+    if ( v != lv->idx ) {
+      emit(cg, OP_MOVE, lv->idx, v, 0, 0);
+    }
+    return lv->idx;
+  }
+
+  emit(cg, OP_STOREG, lv->idx, v, 0, 0);
+
+  return v;
+}
+
+static int gen_args( cgen * cg, const node * n )
+{
+  int base = cg->nreg, i, v;
+
+  for ( i = 0; i < n->nargs; ++i ) {
+    newreg(cg);
+  }
+
+  for ( i = 0; i < n->nargs; ++i ) {
+    v = gen_expr(cg, n->args[i]);
+    if ( v != base + i ) {
+      emit(cg, OP_MOVE, base + i, v, 0, 0);
+    }
+  }
+
+  cg->nreg = base + n->nargs;
+
+  return base;
+}
+
+static int gen_expr( cgen * cg, const node * n )
+{
+  int a, b, d, j1, j2;
+
+  switch ( n->kind ) {
+
+  case N_NUM:
+  case N_STR:
+    return n->idx;
+
+  case N_ERE:
+    /* bare /re/ is $0 ~ /re/ */
+    d = newreg(cg);
+    emit(cg, OP_FIELDK, d, 0, 0, 0);
+    emit(cg, OP_MATCHK, d, d, n->idx, 0);
+    return d;
+
+  case N_PARAM:
+  case N_GLOBAL:
+    return load(cg, n);
+
+  case N_COL:
+    d = newreg(cg);
+    emit(cg, OP_COL, d, n->idx, 0, 0);
+    return d;
+
+  case N_FIELD:
+    if ( n->a->kind == N_NUM && cg->p->consts[-1 - n->a->idx].num >= 0 ) {
+      d = newreg(cg);
+      emit(cg, OP_FIELDK, d, (int) cg->p->consts[-1 - n->a->idx].num, 0, 0);
+      return d;
+    }
+    a = gen_expr(cg, n->a);
+    d = newreg(cg);
+    emit(cg, OP_FIELD, d, a, 0, 0);
+    return d;
+
+  case N_NF:
+  case N_NR:
+  case N_FNR:
+  case N_FILENAME:
+    d = newreg(cg);
+    emit(cg, n->kind == N_NF ? OP_NF : n->kind == N_NR ? OP_NR : n->kind == N_FNR ? OP_FNR : OP_FILENAME, d, 0, 0, 0);
+    return d;
+
+  case N_UNARY:
+    a = gen_expr(cg, n->a);
+    d = newreg(cg);
+    emit(cg, n->op, d, a, 0, 0);
+    return d;
+
+  case N_BINARY:
+    a = gen_expr(cg, n->a);
+    if ( (n->op == OP_MATCH || n->op == OP_NMATCH) && n->b->kind == N_ERE ) {
+      d = newreg(cg);
+      emit(cg, n->op == OP_MATCH ? OP_MATCHK : OP_NMATCHK, d, a, n->b->idx, 0);
+      return d;
+    }
+    b = gen_expr(cg, n->b);
+    d = newreg(cg);
+    emit(cg, n->op, d, a, b, 0);
+    return d;
+
+  case N_AND:
+  case N_OR:
+    d = newreg(cg);
+    a = gen_expr(cg, n->a);
+    emit(cg, OP_BOOL, d, a, 0, 0);
+    j1 = emit(cg, n->kind == N_AND ? OP_JF : OP_JT, d, 0, 0, 0);
+    b = gen_expr(cg, n->b);
+    emit(cg, OP_BOOL, d, b, 0, 0);
+    cg->f->code[j1].b = cg->f->ncode;
+    return d;
+
+  case N_COND:
+    d = newreg(cg);
+    a = gen_expr(cg, n->a);
+    j1 = emit(cg, OP_JF, a, 0, 0, 0);
+    emit(cg, OP_MOVE, d, gen_expr(cg, n->b), 0, 0);
+    j2 = emit(cg, OP_JMP, 0, 0, 0, 0);
+    cg->f->code[j1].b = cg->f->ncode;
+    emit(cg, OP_MOVE, d, gen_expr(cg, n->c), 0, 0);
+    cg->f->code[j2].a = cg->f->ncode;
+    return d;
+
+  case N_ASSIGN:
+    if ( n->op < 0 ) {
+      return store(cg, n->a, gen_expr(cg, n->b));
+    }
+    a = load(cg, n->a);
+    b = gen_expr(cg, n->b);
+    d = newreg(cg);
+    emit(cg, n->op, d, a, b, 0);
+    return store(cg, n->a, d);
+
+  case N_PREINC:
+    a = load(cg, n->a);
+    d = newreg(cg);
+    emit(cg, OP_ADD, d, a, const_num(cg->p, n->op), 0);
+    return store(cg, n->a, d);
+
+  case N_POSTINC:
+    a = load(cg, n->a);
+    b = newreg(cg);
+    emit(cg, OP_TONUM, b, a, 0, 0);
+    d = newreg(cg);
+    emit(cg, OP_ADD, d, b, const_num(cg->p, n->op), 0);
+    store(cg, n->a, d);
+    return b;
+
+  case N_CALL:
+    d = newreg(cg);
+    b = gen_args(cg, n);
+    emit(cg, OP_CALL, d, b, n->idx, n->nargs);
+    return d;
+
+  case N_BUILTIN:
+    d = newreg(cg);
+    b = gen_args(cg, n);
+    emit(cg, OP_BUILTIN, d, b, n->idx, n->nargs);
+    return d;
+  }
+
+  return const_num(cg->p, 0);
+}
+
+static int gen_cond( cgen * cg, const node * n, int jump )
+{
+  const int mark = cg->nreg;
+  const int v = gen_expr(cg, n);
+  const int pc = emit(cg, jump, v, 0, 0, 0);
+  cg->nreg = mark;
+  return pc;
+}
+
+static void gen_statement( cgen * cg, const node * n )
+{
+  loop lp, * outer;
+  int i, j1, j2, top;
+
+  switch ( n->kind ) {
+
+  case S_NOP:
+    break;
+
+  case S_BLOCK:
+    for ( i = 0; i < n->nargs; ++i ) {
+      gen_statement(cg, n->args[i]);
+    }
+    break;
+
+  case S_EXPR:
+    gen_expr(cg, n->a);
+    cg->nreg = cg->f->nparams;
+    break;
+
+  case S_IF:
+    j1 = gen_cond(cg, n->a, OP_JF);
+    gen_statement(cg, n->b);
+    if ( n->c ) {
+      j2 = emit(cg, OP_JMP, 0, 0, 0, 0);
+      cg->f->code[j1].b = cg->f->ncode;
+      gen_statement(cg, n->c);
+      cg->f->code[j2].a = cg->f->ncode;
+    }
+    else {
+      cg->f->code[j1].b = cg->f->ncode;
+    }
+    break;
+
+  case S_WHILE:
+  case S_DO:
+  case S_FOR:
+    memset(&lp, 0, sizeof(lp));
+    outer = lp.outer = cg->loop;
+    cg->loop = &lp;
+
+    if ( n->kind == S_FOR && n->c ) {
+      gen_expr(cg, n->c);
+      cg->nreg = cg->f->nparams;
+    }
+
+    top = cg->f->ncode;
+
+    if ( n->kind == S_DO ) {
+      gen_statement(cg, n->b);
+      patch_list(cg, &lp.cont, &lp.ncont, cg->f->ncode);
+      j1 = gen_cond(cg, n->a, OP_JT);
+      cg->f->code[j1].b = top;
+    }
+    else {
+      j1 = n->a ? gen_cond(cg, n->a, OP_JF) : -1;
+      gen_statement(cg, n->b);
+      patch_list(cg, &lp.cont, &lp.ncont, cg->f->ncode);
+      if ( n->kind == S_FOR && n->d ) {
+        gen_expr(cg, n->d);
+        cg->nreg = cg->f->nparams;
+      }
+      emit(cg, OP_JMP, top, 0, 0, 0);
+      if ( j1 >= 0 ) {
+        cg->f->code[j1].b = cg->f->ncode;
+      }
+    }
+
+    patch_list(cg, &lp.brk, &lp.nbrk, cg->f->ncode);
+    cg->loop = outer;
+    break;
+
+  case S_BREAK:
+  case S_CONTINUE:
+    if ( !cg->loop ) {
+      fprintf(stderr, "ccut: %s outside a loop in function %s\n", n->kind == S_BREAK ? "break" : "continue",
+          cg->f->name);
+      exit(1);
+    }
+    j1 = emit(cg, OP_JMP, 0, 0, 0, 0);
+    if ( n->kind == S_BREAK ) {
+      push_patch(&cg->loop->brk, &cg->loop->nbrk, j1);
+    }
+    else {
+      push_patch(&cg->loop->cont, &cg->loop->ncont, j1);
+    }
+    break;
+
+  case S_RETURN:
+    if ( n->a ) {
+      emit(cg, OP_RET, gen_expr(cg, n->a), 0, 0, 0);
+    }
+    else {
+      emit(cg, OP_RETU, 0, 0, 0, 0);
+    }
+    cg->nreg = cg->f->nparams;
+    break;
+  }
+}
+
+static function * begin_function( program * p, const char * name, int nparams, cgen * cg )
+{
+  const int i = get_function(p, name);
+  function * f = p->funcs[i];
+
+  if ( f->defined ) {
+    fprintf(stderr, "ccut: function `%s' previously defined\n", name);
+    return NULL;
+  }
+
+  f->defined = 1;
+  f->nparams = nparams;
+  f->nregs = nparams;
+
+  memset(cg, 0, sizeof(*cg));
+  cg->p = p;
+  cg->f = f;
+  cg->nreg = nparams;
+
+  return f;
+}
+
+static void init_parser( parser * ps, program * p, const char * src, int cmode )
+{
+  memset(ps, 0, sizeof(*ps));
+  ps->p = p;
+  ps->src = src;
+  ps->pos = src;
+  ps->cmode = cmode;
+  ps->tok = T_NEWLINE;
+}
+
+
+/***********************************************************************************************************************
+ * Public API
+ **********************************************************************************************************************/
+
+int compile_expr( program * p, const char * fname, const char * src, int cmode )
+{
+  parser ps;
+  cgen cg;
+  node * n;
+
+  init_parser(&ps, p, src, cmode);
+
+  if ( setjmp(ps.jb) ) {
+    free(ps.text);
+    return -1;
+  }
+
+  next(&ps);
+  skip_newlines(&ps);
+  n = parse_expr(&ps);
+  skip_newlines(&ps);
+  if ( ps.tok != T_EOF ) {
+    syntax_error(&ps, "syntax error, end of expression expected");
+  }
+
+  free(ps.text);
+
+  if ( !begin_function(p, fname, 0, &cg) ) {
+    return -1;
+  }
+
+  emit(&cg, OP_RET, gen_expr(&cg, n), 0, 0, 0);
+
+  return 0;
+}
+
+int compile_column( program * p, const char * fname, const char * column )
+{
+  cgen cg;
+  int r;
+
+  if ( !begin_function(p, fname, 0, &cg) ) {
+    return -1;
+  }
+
+  r = newreg(&cg);
+  emit(&cg, OP_COL, r, get_column(p, column), 0, 0);
+  emit(&cg, OP_RET, r, 0, 0, 0);
+
+  return 0;
+}
+
+int compile_functions( program * p, const char * src )
+{
+  parser ps;
+  cgen cg;
+  node * body;
+  char * name;
+
+  init_parser(&ps, p, src, 0);
+
+  if ( setjmp(ps.jb) ) {
+    free(ps.text);
+    return -1;
+  }
+
+  next(&ps);
+
+  for ( ;; ) {
+
+    while ( ps.tok == T_NEWLINE || ps.tok == ';' ) {
+      next(&ps);
+    }
+
+    if ( ps.tok == T_EOF ) {
+      break;
+    }
+
+    if ( ps.tok == T_FUNCTION ) {
+      next(&ps);
+    }
+
+    if ( ps.tok != T_FUNC_NAME && ps.tok != T_NAME ) {
+      syntax_error(&ps, ps.tok == T_BUILTIN ? "function name is a builtin" : "function name expected");
+    }
+
+    name = strdup(ps.text);
+    next(&ps);
+
+    ps.nparams = 0;
+    ps.params = NULL;
+
+    expect(&ps, '(', "'('");
+    while ( ps.tok == T_NAME ) {
+      ps.params = xrealloc(ps.params, (ps.nparams + 1) * sizeof(*ps.params));
+      ps.params[ps.nparams++] = strdup(ps.text);
+      next(&ps);
+      if ( ps.tok != ',' ) {
+        break;
+      }
+      next(&ps);
+      skip_newlines(&ps);
+    }
+    expect(&ps, ')', "')'");
+    skip_newlines(&ps);
+
+    body = parse_block(&ps);
+
+    if ( !begin_function(p, name, ps.nparams, &cg) ) {
+      free(ps.text);
+      return -1;
+    }
+
+    gen_statement(&cg, body);
+    emit(&cg, OP_RETU, 0, 0, 0, 0);
+
+    free(name);
+  }
+
+  free(ps.text);
+
+  return 0;
+}
+
+int link_program( program * p )
+{
+  int i, j, k;
+
+  for ( i = 0; i < p->nfuncs; ++i ) {
+    if ( !p->funcs[i]->defined ) {
+      fprintf(stderr, "ccut: function `%s' called but never defined\n", p->funcs[i]->name);
+      return -1;
+    }
+  }
+
+  for ( i = 0; i < p->nfuncs; ++i ) {
+    const function * f = p->funcs[i];
+    for ( j = 0; j < f->ncode; ++j ) {
+      if ( f->code[j].op == OP_CALL && f->code[j].d > p->funcs[k = f->code[j].c]->nparams ) {
+        fprintf(stderr, "ccut: function `%s' called with %d args, accepts only %d\n", p->funcs[k]->name,
+            f->code[j].d, p->funcs[k]->nparams);
+        return -1;
+      }
+    }
+  }
+
+  return 0;
+}
+
+int set_variable( program * p, const char * assignment )
+{
+  const char * eq = strchr(assignment, '=');
+  const char * s;
+  parser ps;
+  value v;
+  char * name;
+
+  if ( !eq || eq == assignment || (!isalpha(*assignment) && *assignment != '_') ) {
+    fprintf(stderr, "ccut: invalid -v argument '%s', var=value expected\n", assignment);
+    return -1;
+  }
+
+  for ( s = assignment; s < eq; ++s ) {
+    if ( !isalnum(*s) && *s != '_' ) {
+      fprintf(stderr, "ccut: invalid variable name in -v '%s'\n", assignment);
+      return -1;
+    }
+  }
+
+  /* value gets string escapes processed */
+  memset(&ps, 0, sizeof(ps));
+  ps.src = ps.pos = eq + 1;
+  text_put(&ps, 0);
+  ps.tlen = 0;
+  if ( setjmp(ps.jb) ) {
+    free(ps.text);
+    return -1;
+  }
+  while ( *ps.pos ) {
+    int c = *ps.pos++;
+    if ( c == '\\' && *ps.pos ) {
+      string_escape(&ps, 0);
+    }
+    else {
+      text_put(&ps, c);
+    }
+  }
+
+  /* -v values are strnum like input fields */
+  memset(&v, 0, sizeof(v));
+  v.type = V_STR;
+  v.s = ps.text;
+  v.len = ps.tlen;
+  vm_classify(&v);
+
+  name = strndup(assignment, eq - assignment);
+  vm_setglobal(p, get_global(p, name), NULL, &v);
+  free(name);
+  free(ps.text);
+
+  return 0;
+}
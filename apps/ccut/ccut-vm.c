@@ -0,0 +1,1063 @@
+/*
+ * ccut-vm.c
+ *
+ *  Bytecode interpreter, awk value semantics, lazy field splitter and builtins.
+ *
+ *  Registers of the active calls live on one value stack, strings produced
+ *  while evaluating a row are bump-allocated and released by vm_reset(),
+ *  input fields are referenced in place and converted to numbers at most once per row.
+ *  All of this state is thread-local, so ccut -j workers each run their own interpreter.
+ */
+
+#define _GNU_SOURCE
+#include "ccut.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <math.h>
+
+/** Size of per-row string arena blocks */
+#define ARENA_BLOCK   (64 * 1024)
+
+/** Max nesting of user function calls */
+#define MAX_DEPTH     10000
+
+/** Dynamic regex cache size */
+#define MAX_DYNREGEX  16
+
+static __thread value * stack;
+static __thread size_t stacksize;
+static __thread int depth;
+
+static __thread struct {
+  char ** blk;
+  size_t * cap;
+  int n, cur;
+  size_t used;
+} arena;
+
+/* replaced string values of globals, still referenced by registers until the end of row */
+static __thread char ** graveyard;
+static __thread int ngrave, maxgrave;
+
+static __thread struct {
+  char * src;
+  size_t len;
+  regex_t re;
+} dynregex[MAX_DYNREGEX];
+static __thread int ndynregex, nextdynregex;
+
+/* sprintf() output buffer */
+static __thread char * obuf;
+static __thread size_t olen, ocap;
+
+static const value uninit = { V_UNINIT, 0, 0, "", 0 };
+
+
+static void * xrealloc( void * ptr, size_t size )
+{
+  if ( !(ptr = realloc(ptr, size)) ) {
+    fprintf(stderr, "ccut: out of memory\n");
+    exit(2);
+  }
+  return ptr;
+}
+
+static void fatal( const char * msg )
+{
+  fflush(stdout);
+  fprintf(stderr, "ccut: %s\n", msg);
+  exit(2);
+}
+
+static char * arena_alloc( size_t n )
+{
+  char * s;
+
+  while ( arena.cur < arena.n && arena.used + n > arena.cap[arena.cur] ) {
+    ++arena.cur;
+    arena.used = 0;
+  }
+
+  if ( arena.cur == arena.n ) {
+    const size_t cap = n > ARENA_BLOCK ? n : ARENA_BLOCK;
+    arena.blk = xrealloc(arena.blk, (arena.n + 1) * sizeof(*arena.blk));
+    arena.cap = xrealloc(arena.cap, (arena.n + 1) * sizeof(*arena.cap));
+    arena.blk[arena.n] = xrealloc(NULL, cap);
+    arena.cap[arena.n] = cap;
+    ++arena.n;
+    arena.used = 0;
+  }
+
+  s = arena.blk[arena.cur] + arena.used;
+  arena.used += n;
+
+  return s;
+}
+
+static const char * arena_strndup( const char * s, size_t len )
+{
+  char * c = arena_alloc(len + 1);
+  memcpy(c, s, len);
+  c[len] = 0;
+  return c;
+}
+
+void vm_reset( void )
+{
+  int i;
+
+  arena.cur = 0;
+  arena.used = 0;
+
+  for ( i = 0; i < ngrave; ++i ) {
+    free(graveyard[i]);
+  }
+  ngrave = 0;
+}
+
+void vm_init( program * p )
+{
+  (void) p;
+  stack = xrealloc(stack, (stacksize = 256) * sizeof(*stack));
+}
+
+static inline void ensure_stack( size_t n )
+{
+  if ( n > stacksize ) {
+    stack = xrealloc(stack, (stacksize = 2 * n) * sizeof(*stack));
+  }
+}
+
+
+/***********************************************************************************************************************
+ * Records and awk number/string conversions
+ **********************************************************************************************************************/
+
+static inline int is_blank( int c )
+{
+  return c == ' ' || c == '\t' || c == '\n';
+}
+
+void record_set( record * r, const char * line, size_t len )
+{
+  if ( r->maxf < 64 ) {
+    r->f = xrealloc(r->f, (r->maxf = 64) * sizeof(*r->f));
+  }
+
+  r->line = line;
+  r->len = len;
+  r->pos = line;
+  r->nf = 0;
+  r->complete = 0;
+
+  r->f[0].s = line;
+  r->f[0].len = len;
+  r->f[0].type = V_FIELD;
+}
+
+static int split_next( record * r )
+{
+  const char * s = r->pos, * e = r->line + r->len;
+  field * f;
+
+  while ( s < e && is_blank(*s) ) {
+    ++s;
+  }
+
+  if ( s == e ) {
+    r->pos = s;
+    r->complete = 1;
+    return 0;
+  }
+
+  if ( ++r->nf == r->maxf ) {
+    r->f = xrealloc(r->f, (r->maxf *= 2) * sizeof(*r->f));
+  }
+
+  f = &r->f[r->nf];
+  f->s = s;
+  while ( s < e && !is_blank(*s) ) {
+    ++s;
+  }
+  f->len = s - f->s;
+  f->type = V_FIELD;
+
+  r->pos = s;
+
+  return 1;
+}
+
+int record_nf( record * r )
+{
+  while ( !r->complete ) {
+    split_next(r);
+  }
+  return r->nf;
+}
+
+const char * record_field( record * r, int k, size_t * len )
+{
+  if ( k == 0 ) {
+    *len = r->len;
+    return r->line;
+  }
+
+  while ( r->nf < k && !r->complete ) {
+    split_next(r);
+  }
+
+  if ( k > r->nf ) {
+    *len = 0;
+    return NULL;
+  }
+
+  *len = r->f[k].len;
+  return r->f[k].s;
+}
+
+static inline void load_field( record * r, int k, value * v )
+{
+  if ( k > 0 ) {
+    while ( r->nf < k && !r->complete ) {
+      split_next(r);
+    }
+    if ( k > r->nf ) {
+      *v = uninit;
+      return;
+    }
+  }
+
+  v->type = V_FIELD;
+  v->fld = k;
+  v->s = r->f[k].s;
+  v->len = r->f[k].len;
+}
+
+/**
+ * awk string to number: longest numeric prefix after leading blanks, 0 if none;
+ *  no hex, inf or nan words as in gawk without --non-decimal-data
+ */
+static double prefix_number( const char * s, const char ** end )
+{
+  const char * p = s, * q;
+  char * e;
+  double x;
+
+  while ( isspace((unsigned char) *p) ) {
+    ++p;
+  }
+
+  q = p + (*p == '+' || *p == '-');
+
+  if ( !(isdigit((unsigned char) q[0]) || (q[0] == '.' && isdigit((unsigned char) q[1]))) ) {
+    *end = s;
+    return 0;
+  }
+
+  if ( q[0] == '0' && (q[1] == 'x' || q[1] == 'X') ) {
+    *end = q + 1;
+    return 0;
+  }
+
+  x = strtod(p, &e);
+  *end = e;
+
+  return x;
+}
+
+/* numeric string: the whole string is a number with optional blanks around */
+static int looks_numeric( const char * s, size_t len, double * num )
+{
+  const char * e, * end = s + len;
+
+  *num = prefix_number(s, &e);
+
+  if ( e == s ) {
+    return 0;
+  }
+
+  while ( e < end && isspace((unsigned char) *e) ) {
+    ++e;
+  }
+
+  return e == end;
+}
+
+static inline void classify_field( field * f )
+{
+  f->type = looks_numeric(f->s, f->len, &f->num) ? V_STRNUM : V_STR;
+}
+
+void vm_classify( value * v )
+{
+  if ( v->type == V_STR && looks_numeric(v->s, v->len, &v->num) ) {
+    v->type = V_STRNUM;
+  }
+}
+
+static inline int type_of( record * r, const value * v )
+{
+  if ( v->type == V_FIELD ) {
+    field * f = &r->f[v->fld];
+    if ( f->type == V_FIELD ) {
+      classify_field(f);
+    }
+    return f->type;
+  }
+  return v->type;
+}
+
+static inline double num_of( record * r, const value * v )
+{
+  const char * e;
+
+  switch ( v->type ) {
+  case V_NUM:
+  case V_STRNUM:
+    return v->num;
+  case V_UNINIT:
+    return 0;
+  case V_FIELD:
+    type_of(r, v);
+    return r->f[v->fld].num;
+  }
+
+  return prefix_number(v->s, &e);
+}
+
+/* number to string: integers as such, others by CONVFMT="%+.9f" */
+static size_t format_number( double x, char buf[] )
+{
+  if ( isfinite(x) && x == trunc(x) ) {
+    if ( fabs(x) < 9e18 ) {
+      return sprintf(buf, "%lld", (long long) x);
+    }
+    return sprintf(buf, "%.0f", x);
+  }
+  return sprintf(buf, "%+.9f", x);
+}
+
+const char * vm_tostr( program * p, record * r, const value * v, size_t * len )
+{
+  char buf[400];
+
+  (void) p;
+  (void) r;
+
+  switch ( v->type ) {
+  case V_NUM:
+    *len = format_number(v->num, buf);
+    return arena_strndup(buf, *len);
+  case V_UNINIT:
+    *len = 0;
+    return "";
+  }
+
+  *len = v->len;
+  return v->s;
+}
+
+/* NUL-terminated string of v (fields are terminated by the next separator) */
+static const char * cstr_of( program * p, record * r, const value * v, size_t * len )
+{
+  const char * s = vm_tostr(p, r, v, len);
+  return s[*len] == 0 ? s : arena_strndup(s, *len);
+}
+
+int vm_true( record * r, const value * v )
+{
+  switch ( type_of(r, v) ) {
+  case V_NUM:
+  case V_STRNUM:
+    return num_of(r, v) != 0;
+  case V_STR:
+    return v->len > 0;
+  }
+  return 0;
+}
+
+static inline int is_numeric( int type )
+{
+  return type == V_NUM || type == V_STRNUM || type == V_UNINIT;
+}
+
+static int compare( program * p, record * r, const value * a, const value * b )
+{
+  if ( is_numeric(type_of(r, a)) && is_numeric(type_of(r, b)) ) {
+    const double x = num_of(r, a), y = num_of(r, b);
+    if ( x < y ) {
+      return -1;
+    }
+    if ( x > y ) {
+      return 1;
+    }
+    if ( x == y ) {
+      return 0;
+    }
+    return isnan(x) ? (isnan(y) ? 0 : 1) : -1;
+  }
+  else {
+    size_t la, lb;
+    const char * sa = vm_tostr(p, r, a, &la);
+    const char * sb = vm_tostr(p, r, b, &lb);
+    int c = memcmp(sa, sb, la < lb ? la : lb);
+    return c ? c : (la > lb) - (la < lb);
+  }
+}
+
+void vm_setglobal( program * p, int g, record * r, const value * v )
+{
+  value * gv = &p->globals[g];
+  char * old = gv->type == V_STR || gv->type == V_STRNUM ? (char *) gv->s : NULL;
+  value nv = *v;
+  char * s;
+
+  if ( nv.type == V_FIELD ) {
+    nv.type = type_of(r, v);
+    nv.num = r->f[v->fld].num;
+  }
+
+  if ( nv.type == V_STR || nv.type == V_STRNUM ) {
+    s = xrealloc(NULL, nv.len + 1);
+    memcpy(s, nv.s, nv.len);
+    s[nv.len] = 0;
+    nv.s = s;
+  }
+  else {
+    nv.s = "";
+    nv.len = 0;
+  }
+
+  *gv = nv;
+
+  if ( old ) {
+    if ( ngrave == maxgrave ) {
+      graveyard = xrealloc(graveyard, (maxgrave = maxgrave ? 2 * maxgrave : 16) * sizeof(*graveyard));
+    }
+    graveyard[ngrave++] = old;
+  }
+}
+
+static regex_t * get_dynregex( program * p, record * r, const value * v )
+{
+  size_t len;
+  const char * s = cstr_of(p, r, v, &len);
+  int i;
+
+  for ( i = 0; i < ndynregex; ++i ) {
+    if ( dynregex[i].len == len && memcmp(dynregex[i].src, s, len) == 0 ) {
+      return &dynregex[i].re;
+    }
+  }
+
+  if ( ndynregex < MAX_DYNREGEX ) {
+    i = ndynregex++;
+  }
+  else {
+    i = nextdynregex++ % MAX_DYNREGEX;
+    regfree(&dynregex[i].re);
+    free(dynregex[i].src);
+  }
+
+  if ( regcomp(&dynregex[i].re, s, REG_EXTENDED | REG_NOSUB) != 0 ) {
+    fprintf(stderr, "ccut: invalid regular expression /%s/\n", s);
+    exit(2);
+  }
+
+  dynregex[i].src = strdup(s);
+  dynregex[i].len = len;
+
+  return &dynregex[i].re;
+}
+
+static int match( program * p, record * r, const value * v, const regex_t * re )
+{
+  size_t len;
+  return regexec(re, cstr_of(p, r, v, &len), 0, NULL, 0) == 0;
+}
+
+/* x^y as gawk does: repeated squaring for integer exponents */
+static double power( double x, double y )
+{
+  if ( fabs(y) < 4e18 && y == trunc(y) ) {
+    long long n = (long long) fabs(y);
+    double m = 1;
+
+    if ( n == 0 ) {
+      return 1;
+    }
+
+    while ( n > 1 ) {
+      if ( n % 2 == 1 ) {
+        m *= x;
+      }
+      x *= x;
+      n /= 2;
+    }
+
+    return y > 0 ? m * x : 1 / (m * x);
+  }
+
+  return pow(x, y);
+}
+
+
+/***********************************************************************************************************************
+ * Builtins
+ **********************************************************************************************************************/
+
+static void oput( const char * s, size_t n )
+{
+  if ( olen + n + 1 > ocap ) {
+    obuf = xrealloc(obuf, ocap = 2 * (olen + n + 1));
+  }
+  memcpy(obuf + olen, s, n);
+  olen += n;
+}
+
+static void oprintf( const char * spec, ... )
+{
+  va_list ap, aq;
+  int n;
+
+  va_start(ap, spec);
+  va_copy(aq, ap);
+  n = vsnprintf(NULL, 0, spec, aq);
+  va_end(aq);
+
+  if ( n > 0 ) {
+    if ( olen + n + 1 > ocap ) {
+      obuf = xrealloc(obuf, ocap = 2 * (olen + n + 1));
+    }
+    vsnprintf(obuf + olen, n + 1, spec, ap);
+    olen += n;
+  }
+
+  va_end(ap);
+}
+
+static void do_sprintf( program * p, record * r, const value * args, int nargs, value * ret )
+{
+  size_t flen, len;
+  const char * fmt = vm_tostr(p, r, &args[0], &flen);
+  const char * end = fmt + flen, * start, * s;
+  char spec[64];
+  int ai = 1, sl, c;
+  double x;
+
+  olen = 0;
+
+  while ( fmt < end )
+  {
+    if ( *fmt != '%' ) {
+      for ( start = fmt; fmt < end && *fmt != '%'; ++fmt ) {
+      }
+      oput(start, fmt - start);
+      continue;
+    }
+
+    start = fmt++;
+
+    if ( fmt < end && *fmt == '%' ) {
+      oput("%", 1);
+      ++fmt;
+      continue;
+    }
+
+    spec[0] = '%';
+    sl = 1;
+
+    while ( fmt < end && strchr("-+ #0", *fmt) && sl < 8 ) {
+      spec[sl++] = *fmt++;
+    }
+
+    if ( fmt < end && *fmt == '*' ) {
+      sl += sprintf(spec + sl, "%d", (int) num_of(r, ai < nargs ? &args[ai++] : &uninit));
+      ++fmt;
+    }
+    else {
+      while ( fmt < end && isdigit((unsigned char) *fmt) && sl < 24 ) {
+        spec[sl++] = *fmt++;
+      }
+    }
+
+    if ( fmt < end && *fmt == '.' ) {
+      spec[sl++] = *fmt++;
+      if ( fmt < end && *fmt == '*' ) {
+        sl += sprintf(spec + sl, "%d", (int) num_of(r, ai < nargs ? &args[ai++] : &uninit));
+        ++fmt;
+      }
+      else {
+        while ( fmt < end && isdigit((unsigned char) *fmt) && sl < 48 ) {
+          spec[sl++] = *fmt++;
+        }
+      }
+    }
+
+    if ( fmt >= end ) {
+      oput(start, end - start);
+      break;
+    }
+
+    c = *fmt++;
+
+    switch ( c ) {
+
+    case 'd':
+    case 'i':
+      x = trunc(num_of(r, ai < nargs ? &args[ai++] : &uninit));
+      if ( fabs(x) < 9e18 ) {
+        strcpy(spec + sl, "lld");
+        oprintf(spec, (long long) x);
+      }
+      else {
+        strcpy(spec + sl, ".0f");
+        oprintf(spec, x);
+      }
+      break;
+
+    case 'o':
+    case 'u':
+    case 'x':
+    case 'X':
+      x = trunc(num_of(r, ai < nargs ? &args[ai++] : &uninit));
+      spec[sl++] = 'l';
+      spec[sl++] = 'l';
+      spec[sl++] = c;
+      spec[sl] = 0;
+      oprintf(spec, (unsigned long long) (long long) x);
+      break;
+
+    case 'c':
+      spec[sl++] = 'c';
+      spec[sl] = 0;
+      if ( ai < nargs && is_numeric(type_of(r, &args[ai])) ) {
+        oprintf(spec, (int) (unsigned char) (int) num_of(r, &args[ai]));
+      }
+      else {
+        s = vm_tostr(p, r, ai < nargs ? &args[ai] : &uninit, &len);
+        oprintf(spec, len > 0 ? (unsigned char) s[0] : 0);
+      }
+      ++ai;
+      break;
+
+    case 's':
+      spec[sl++] = 's';
+      spec[sl] = 0;
+      oprintf(spec, cstr_of(p, r, ai < nargs ? &args[ai++] : &uninit, &len));
+      break;
+
+    case 'e':
+    case 'E':
+    case 'f':
+    case 'F':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A':
+      spec[sl++] = c;
+      spec[sl] = 0;
+      oprintf(spec, num_of(r, ai < nargs ? &args[ai++] : &uninit));
+      break;
+
+    default:
+      oput(start, fmt - start);
+      break;
+    }
+  }
+
+  ret->type = V_STR;
+  ret->len = olen;
+  ret->s = arena_strndup(obuf ? obuf : "", olen);
+}
+
+static uint64_t bits_of( record * r, const value * v, const char * fn )
+{
+  const double x = trunc(num_of(r, v));
+
+  if ( x < 0 ) {
+    char msg[64];
+    snprintf(msg, sizeof(msg), "%s: negative values are not allowed", fn);
+    fatal(msg);
+  }
+
+  return x < 18446744073709551616.0 ? (uint64_t) x : UINT64_MAX;
+}
+
+static void builtin( program * p, record * r, int id, const value * args, int nargs, value * ret )
+{
+  size_t len, len2;
+  const char * s, * t;
+  uint64_t u;
+  double m, n;
+  char * c;
+  int i;
+
+  ret->type = V_NUM;
+
+  switch ( id ) {
+
+  case B_LENGTH:
+    vm_tostr(p, r, &args[0], &len);
+    ret->num = len;
+    break;
+
+  case B_SUBSTR:
+    s = vm_tostr(p, r, &args[0], &len);
+    m = num_of(r, &args[1]);
+    n = nargs > 2 ? num_of(r, &args[2]) : INFINITY;
+    ret->type = V_STR;
+    ret->s = "";
+    ret->len = 0;
+    if ( isnan(m) || isnan(n) ) {
+      break;
+    }
+    /* characters from round(m) to round(m) + round(n) - 1, 1-based */
+    m = floor(m + 0.5);
+    n = m + (isinf(n) ? n : floor(n + 0.5));
+    if ( m < 1 ) {
+      m = 1;
+    }
+    if ( n > (double) len + 1 ) {
+      n = (double) len + 1;
+    }
+    if ( n > m ) {
+      ret->len = (size_t) (n - m);
+      ret->s = arena_strndup(s + (size_t) m - 1, ret->len);
+    }
+    break;
+
+  case B_INDEX:
+    s = vm_tostr(p, r, &args[0], &len);
+    t = vm_tostr(p, r, &args[1], &len2);
+    ret->num = 0;
+    if ( len2 > 0 && (c = memmem(s, len, t, len2)) ) {
+      ret->num = c - s + 1;
+    }
+    break;
+
+  case B_TOLOWER:
+  case B_TOUPPER:
+    s = vm_tostr(p, r, &args[0], &len);
+    c = arena_alloc(len + 1);
+    for ( i = 0; i < (int) len; ++i ) {
+      c[i] = id == B_TOLOWER ? tolower((unsigned char) s[i]) : toupper((unsigned char) s[i]);
+    }
+    c[len] = 0;
+    ret->type = V_STR;
+    ret->s = c;
+    ret->len = len;
+    break;
+
+  case B_SPRINTF:
+    do_sprintf(p, r, args, nargs, ret);
+    break;
+
+  case B_SQRT:
+    ret->num = sqrt(num_of(r, &args[0]));
+    break;
+
+  case B_EXP:
+    ret->num = exp(num_of(r, &args[0]));
+    break;
+
+  case B_LOG:
+    ret->num = log(num_of(r, &args[0]));
+    break;
+
+  case B_SIN:
+    ret->num = sin(num_of(r, &args[0]));
+    break;
+
+  case B_COS:
+    ret->num = cos(num_of(r, &args[0]));
+    break;
+
+  case B_ATAN2:
+    ret->num = atan2(num_of(r, &args[0]), num_of(r, &args[1]));
+    break;
+
+  case B_INT:
+    ret->num = trunc(num_of(r, &args[0]));
+    break;
+
+  case B_ABS:
+    m = num_of(r, &args[0]);
+    ret->num = m < 0 ? -m : m;
+    break;
+
+  case B_HYPOT:
+    /* as the old script defined it */
+    m = num_of(r, &args[0]);
+    n = num_of(r, &args[1]);
+    ret->num = sqrt(m * m + n * n);
+    break;
+
+  case B_AND:
+  case B_OR:
+  case B_XOR:
+    u = bits_of(r, &args[0], id == B_AND ? "and" : id == B_OR ? "or" : "xor");
+    for ( i = 1; i < nargs; ++i ) {
+      const uint64_t v = bits_of(r, &args[i], id == B_AND ? "and" : id == B_OR ? "or" : "xor");
+      u = id == B_AND ? u & v : id == B_OR ? u | v : u ^ v;
+    }
+    ret->num = (double) u;
+    break;
+
+  case B_LSHIFT:
+    ret->num = (double) (bits_of(r, &args[0], "lshift") << (bits_of(r, &args[1], "lshift") & 63));
+    break;
+
+  case B_RSHIFT:
+    ret->num = (double) (bits_of(r, &args[0], "rshift") >> (bits_of(r, &args[1], "rshift") & 63));
+    break;
+
+  case B_COMPL:
+    ret->num = (double) ~bits_of(r, &args[0], "compl");
+    break;
+  }
+}
+
+
+/***********************************************************************************************************************
+ * Interpreter
+ **********************************************************************************************************************/
+
+static void exec( program * p, record * r, const function * f, size_t base, value * ret )
+{
+  const insn * code = f->code, * ip = code;
+  value * regs;
+
+  ensure_stack(base + f->nregs);
+  regs = stack + base;
+
+#define OPND(x)       ((x) >= 0 ? &regs[x] : &p->consts[-1 - (x)])
+#define SETNUM(x, v)  do { value * d_ = &regs[x]; d_->num = (v); d_->type = V_NUM; } while ( 0 )
+
+  for ( ;; )
+  {
+    const insn * i = ip++;
+
+    switch ( i->op ) {
+
+    case OP_MOVE:
+      regs[i->a] = *OPND(i->b);
+      break;
+
+    case OP_LOADG:
+      regs[i->a] = p->globals[i->b];
+      break;
+
+    case OP_STOREG:
+      vm_setglobal(p, i->a, r, OPND(i->b));
+      break;
+
+    case OP_COL:
+      load_field(r, p->cfield[i->b], &regs[i->a]);
+      break;
+
+    case OP_FIELD: {
+      const double x = num_of(r, OPND(i->b));
+      if ( x < 0 ) {
+        char msg[64];
+        snprintf(msg, sizeof(msg), "attempt to access field %d", (int) x);
+        fatal(msg);
+      }
+      load_field(r, x < 1e9 ? (int) x : 1000000000, &regs[i->a]);
+      break;
+    }
+
+    case OP_FIELDK:
+      load_field(r, i->b, &regs[i->a]);
+      break;
+
+    case OP_NF:
+      SETNUM(i->a, record_nf(r));
+      break;
+
+    case OP_NR:
+      SETNUM(i->a, r->nr);
+      break;
+
+    case OP_FNR:
+      SETNUM(i->a, r->fnr);
+      break;
+
+    case OP_FILENAME:
+      regs[i->a].type = V_STR;
+      regs[i->a].s = r->filename ? r->filename : "";
+      regs[i->a].len = strlen(regs[i->a].s);
+      break;
+
+    case OP_NEG:
+      SETNUM(i->a, -num_of(r, OPND(i->b)));
+      break;
+
+    case OP_TONUM:
+      SETNUM(i->a, num_of(r, OPND(i->b)));
+      break;
+
+    case OP_NOT:
+      SETNUM(i->a, !vm_true(r, OPND(i->b)));
+      break;
+
+    case OP_BOOL:
+      SETNUM(i->a, vm_true(r, OPND(i->b)));
+      break;
+
+    case OP_ADD:
+      SETNUM(i->a, num_of(r, OPND(i->b)) + num_of(r, OPND(i->c)));
+      break;
+
+    case OP_SUB:
+      SETNUM(i->a, num_of(r, OPND(i->b)) - num_of(r, OPND(i->c)));
+      break;
+
+    case OP_MUL:
+      SETNUM(i->a, num_of(r, OPND(i->b)) * num_of(r, OPND(i->c)));
+      break;
+
+    case OP_DIV: {
+      const double y = num_of(r, OPND(i->c));
+      if ( y == 0 ) {
+        fatal("division by zero attempted");
+      }
+      SETNUM(i->a, num_of(r, OPND(i->b)) / y);
+      break;
+    }
+
+    case OP_MOD: {
+      const double y = num_of(r, OPND(i->c));
+      if ( y == 0 ) {
+        fatal("division by zero attempted in `%'");
+      }
+      SETNUM(i->a, fmod(num_of(r, OPND(i->b)), y));
+      break;
+    }
+
+    case OP_POW:
+      SETNUM(i->a, power(num_of(r, OPND(i->b)), num_of(r, OPND(i->c))));
+      break;
+
+    case OP_CAT: {
+      size_t la, lb;
+      const char * sa = vm_tostr(p, r, OPND(i->b), &la);
+      const char * sb = vm_tostr(p, r, OPND(i->c), &lb);
+      char * s = arena_alloc(la + lb + 1);
+      memcpy(s, sa, la);
+      memcpy(s + la, sb, lb);
+      s[la + lb] = 0;
+      regs[i->a].type = V_STR;
+      regs[i->a].s = s;
+      regs[i->a].len = la + lb;
+      break;
+    }
+
+    case OP_LT:
+      SETNUM(i->a, compare(p, r, OPND(i->b), OPND(i->c)) < 0);
+      break;
+
+    case OP_LE:
+      SETNUM(i->a, compare(p, r, OPND(i->b), OPND(i->c)) <= 0);
+      break;
+
+    case OP_GT:
+      SETNUM(i->a, compare(p, r, OPND(i->b), OPND(i->c)) > 0);
+      break;
+
+    case OP_GE:
+      SETNUM(i->a, compare(p, r, OPND(i->b), OPND(i->c)) >= 0);
+      break;
+
+    case OP_EQ:
+      SETNUM(i->a, compare(p, r, OPND(i->b), OPND(i->c)) == 0);
+      break;
+
+    case OP_NE:
+      SETNUM(i->a, compare(p, r, OPND(i->b), OPND(i->c)) != 0);
+      break;
+
+    case OP_MATCH:
+      SETNUM(i->a, match(p, r, OPND(i->b), get_dynregex(p, r, OPND(i->c))));
+      break;
+
+    case OP_NMATCH:
+      SETNUM(i->a, !match(p, r, OPND(i->b), get_dynregex(p, r, OPND(i->c))));
+      break;
+
+    case OP_MATCHK:
+      SETNUM(i->a, match(p, r, OPND(i->b), &p->regex[i->c]));
+      break;
+
+    case OP_NMATCHK:
+      SETNUM(i->a, !match(p, r, OPND(i->b), &p->regex[i->c]));
+      break;
+
+    case OP_JMP:
+      ip = code + i->a;
+      break;
+
+    case OP_JF:
+      if ( !vm_true(r, OPND(i->a)) ) {
+        ip = code + i->b;
+      }
+      break;
+
+    case OP_JT:
+      if ( vm_true(r, OPND(i->a)) ) {
+        ip = code + i->b;
+      }
+      break;
+
+    case OP_CALL: {
+      const function * g = p->funcs[i->c];
+      const size_t cb = base + f->nregs;
+      value v;
+      int k;
+
+      if ( ++depth > MAX_DEPTH ) {
+        fatal("function call nesting is too deep");
+      }
+
+      ensure_stack(cb + g->nregs);
+      regs = stack + base;
+
+      for ( k = 0; k < g->nparams; ++k ) {
+        stack[cb + k] = k < i->d ? regs[i->b + k] : uninit;
+      }
+
+      exec(p, r, g, cb, &v);
+
+      --depth;
+      regs = stack + base;
+      regs[i->a] = v;
+      break;
+    }
+
+    case OP_BUILTIN:
+      builtin(p, r, i->c, &regs[i->b], i->d, &regs[i->a]);
+      break;
+
+    case OP_RET:
+      *ret = *OPND(i->a);
+      return;
+
+    case OP_RETU:
+      *ret = uninit;
+      return;
+    }
+  }
+
+#undef OPND
+#undef SETNUM
+}
+
+void vm_call( program * p, record * r, int func, value * ret )
+{
+  depth = 0;
+  exec(p, r, p->funcs[func], 0, ret);
+}
@@ -0,0 +1,714 @@
+/*
+ * ccut.c
+ *
+ *  Cut named columns and computed expressions out of TSV files with a header line,
+ *  optionally filtering rows by a condition:
+ *
+ *    ccut -f coma,delimited,list,of,columns [-x 'condition-expression'] [-v var=value ...]
+ *         [-df 'user-function-definition'] [FILE ...]
+ *
+ *  Column items are 'name' (copied from input) or 'name:expression', expressions are awk
+ *  with @name referring to input columns. This is the native replacement of the old
+ *  bash script which generated an awk program: the expressions are compiled once
+ *  into bytecode (ccut-compile.c) and evaluated per row (ccut-vm.c) over lazily split fields.
+ *
+ *  Input is cut into chunks of whole lines; with -j N the chunks are evaluated by N worker
+ *  threads and their output is written in input order. Each worker has its own copy
+ *  of the awk global variables, so values assigned to globals are not carried across chunks.
+ */
+
+#define _GNU_SOURCE
+#include "ccut.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+/** Input read size */
+#define READ_SIZE   (256 * 1024)
+
+/** Lines are processed in chunks of about this size */
+#define CHUNK_SIZE  (4 * 1024 * 1024)
+
+/** Chunks in flight per worker thread */
+#define CHUNKS_PER_THREAD 4
+
+/** Name of the internal condition function, not a valid awk name */
+#define COND_FUNC   "<condition>"
+
+
+/** Output column */
+typedef
+struct ocolumn {
+  char * name;
+  int func;     /*< compiled get<name> function */
+  int slot;     /*< column slot for plain copies, -1 for expressions */
+} ocolumn;
+
+static ocolumn * ocols;
+static int nocols;
+
+
+/** Buffered line reader */
+typedef
+struct reader {
+  int fd;
+  char * buf;
+  size_t cap, beg, end;
+  int eof;
+} reader;
+
+/** Growable output buffer */
+typedef
+struct outbuf {
+  char * s;
+  size_t len, cap;
+} outbuf;
+
+/** Chunk of whole input lines and its output */
+typedef
+struct chunk {
+  char * buf;
+  size_t len, cap;
+  outbuf out;
+  double nr, fnr;           /*< NR and FNR before the first line */
+  const char * filename;
+  int done;
+} chunk;
+
+/** Worker threads state, chunks are a ring indexed by sequence number */
+static struct {
+  pthread_mutex_t mtx;
+  pthread_cond_t cond;
+  chunk * chunks;
+  int nchunks;
+  long nready;              /*< chunks filled by the reader */
+  long nnext;               /*< next chunk to take by a worker */
+  int eof;
+} pool = {
+  .mtx = PTHREAD_MUTEX_INITIALIZER,
+  .cond = PTHREAD_COND_INITIALIZER
+};
+
+/** Condition function or -1 */
+static int cond = -1;
+
+
+static void showhelp( void )
+{
+  fprintf(stderr, "Usage:\n  ccut -f coma,delimited,list,of,columns [-x 'condition-expression'] [-v var=value ...] "
+      "[-df 'user-function-definition'] [-j threads] [FILE]\n");
+}
+
+static void * xrealloc( void * ptr, size_t size )
+{
+  if ( !(ptr = realloc(ptr, size)) ) {
+    fprintf(stderr, "ccut: out of memory\n");
+    exit(2);
+  }
+  return ptr;
+}
+
+/* copy of s[0..n) with leading and trailing blanks removed */
+static char * strip( const char * s, size_t n )
+{
+  while ( n > 0 && isspace((unsigned char) *s) ) {
+    ++s, --n;
+  }
+  while ( n > 0 && isspace((unsigned char) s[n - 1]) ) {
+    --n;
+  }
+  return strndup(s, n);
+}
+
+static int column_slot( const program * p, const char * name )
+{
+  int i;
+  for ( i = 0; i < p->ncols; ++i ) {
+    if ( strcmp(p->cnames[i], name) == 0 ) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/* parse -f argument, items are split by commas outside of () */
+static int parse_columns( program * p, const char * arg )
+{
+  char * tmp = strdup(arg), * s, * c, * item;
+  char fname[1024];
+  int scope = 0, status = 0;
+
+  /* literal \t and \n sequences are allowed for readability */
+  for ( s = c = tmp; *s; ++s ) {
+    if ( s[0] == '\\' && (s[1] == 't' || s[1] == 'n') ) {
+      *c++ = ' ';
+      ++s;
+    }
+    else {
+      *c++ = *s;
+    }
+  }
+  *c = 0;
+
+  for ( s = tmp; *s; ++s ) {
+    scope += (*s == '(') - (*s == ')');
+  }
+
+  if ( scope != 0 ) {
+    fprintf(stderr, "ccut: unballansed () braces in %s\n", tmp);
+    free(tmp);
+    return -1;
+  }
+
+  for ( s = tmp; *s && status == 0; )
+  {
+    const char * colon;
+    char * name;
+    size_t n;
+
+    for ( n = 0, scope = 0; s[n] && (scope > 0 || s[n] != ','); ++n ) {
+      scope += (s[n] == '(') - (s[n] == ')');
+    }
+
+    item = strndup(s, n);
+    s += n + (s[n] == ',');
+
+    colon = strchr(item, ':');
+    name = strip(item, colon ? (size_t) (colon - item) : strlen(item));
+
+    if ( !*name ) {
+      if ( colon ) {
+        fprintf(stderr, "ccut: syntax error:%s\n", arg);
+        status = -1;
+      }
+      free(name);
+    }
+    else {
+      snprintf(fname, sizeof(fname), "get%s", name);
+      status = colon ? compile_expr(p, fname, colon + 1, 0) : compile_column(p, fname, name);
+      if ( status == 0 ) {
+        ocols = xrealloc(ocols, (nocols + 1) * sizeof(*ocols));
+        ocols[nocols].name = name;
+        ocols[nocols].func = find_function(p, fname);
+        ocols[nocols].slot = colon ? -1 : column_slot(p, name);
+        ++nocols;
+      }
+      else {
+        free(name);
+      }
+    }
+
+    free(item);
+  }
+
+  free(tmp);
+
+  return status;
+}
+
+/* map referenced column names to field numbers from the header line, last duplicate wins */
+static int resolve_columns( program * p, record * r )
+{
+  const int nf = record_nf(r);
+  const char * s;
+  size_t len;
+  int i, k;
+
+  for ( i = 0; i < p->ncols; ++i )
+  {
+    p->cfield[i] = -1;
+
+    for ( k = nf; k >= 1; --k ) {
+      s = record_field(r, k, &len);
+      if ( len == strlen(p->cnames[i]) && memcmp(s, p->cnames[i], len) == 0 ) {
+        p->cfield[i] = k;
+        break;
+      }
+    }
+
+    if ( p->cfield[i] < 0 ) {
+      fflush(stdout);
+      fprintf(stderr, "Column %s not found in file header\n", p->cnames[i]);
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+static int reader_open( reader * rd, const char * fname )
+{
+  if ( strcmp(fname, "-") == 0 ) {
+    rd->fd = 0;
+  }
+  else if ( (rd->fd = open(fname, O_RDONLY)) == -1 ) {
+    return -1;
+  }
+
+  if ( !rd->buf ) {
+    rd->buf = xrealloc(NULL, rd->cap = 2 * READ_SIZE);
+  }
+
+  rd->beg = rd->end = 0;
+  rd->eof = 0;
+
+  return 0;
+}
+
+static void reader_close( reader * rd )
+{
+  if ( rd->fd > 0 ) {
+    close(rd->fd);
+  }
+  rd->fd = -1;
+}
+
+/* append next block of input to the buffer */
+static void reader_fill( reader * rd )
+{
+  ssize_t cb;
+
+  if ( rd->beg > 0 ) {
+    memmove(rd->buf, rd->buf + rd->beg, rd->end - rd->beg);
+    rd->end -= rd->beg;
+    rd->beg = 0;
+  }
+
+  if ( rd->cap - rd->end < READ_SIZE + 1 ) {
+    rd->buf = xrealloc(rd->buf, rd->cap *= 2);
+  }
+
+  while ( (cb = read(rd->fd, rd->buf + rd->end, READ_SIZE)) == -1 && errno == EINTR ) {
+  }
+
+  if ( cb < 0 ) {
+    fprintf(stderr, "ccut: read error: %s\n", strerror(errno));
+    rd->eof = 1;
+  }
+  else if ( cb == 0 ) {
+    rd->eof = 1;
+  }
+  else {
+    rd->end += cb;
+  }
+}
+
+/* next line, NUL-terminated in place of '\n'; NULL at end of file */
+static char * reader_getline( reader * rd, size_t * len )
+{
+  char * s, * e;
+
+  for ( ;; )
+  {
+    s = rd->buf + rd->beg;
+
+    if ( (e = memchr(s, '\n', rd->end - rd->beg)) ) {
+      *e = 0;
+      *len = e - s;
+      rd->beg += *len + 1;
+      return s;
+    }
+
+    if ( rd->eof ) {
+      if ( rd->beg == rd->end ) {
+        return NULL;
+      }
+      *len = rd->end - rd->beg;
+      s[*len] = 0;
+      rd->beg = rd->end;
+      return s;
+    }
+
+    reader_fill(rd);
+  }
+}
+
+/* move about CHUNK_SIZE bytes of whole lines into c, counting them; 0 at end of file */
+static int reader_getchunk( reader * rd, chunk * c, double * nlines )
+{
+  const char * s, * e;
+  size_t n;
+
+  while ( !rd->eof && rd->end - rd->beg < CHUNK_SIZE ) {
+    reader_fill(rd);
+  }
+
+  while ( !(e = memrchr(rd->buf + rd->beg, '\n', rd->end - rd->beg)) && !rd->eof ) {
+    reader_fill(rd);
+  }
+
+  if ( rd->beg == rd->end ) {
+    return 0;
+  }
+
+  s = rd->buf + rd->beg;
+  n = e ? (size_t) (e - s + 1) : rd->end - rd->beg;
+
+  if ( c->cap < n + 1 ) {
+    c->buf = xrealloc(c->buf, c->cap = n + 1);
+  }
+
+  memcpy(c->buf, s, n);
+  c->len = n;
+  rd->beg += n;
+
+  for ( *nlines = 0, e = s; (e = memchr(e, '\n', s + n - e)); ++e ) {
+    ++*nlines;
+  }
+  if ( s[n - 1] != '\n' ) {
+    ++*nlines;
+  }
+
+  return 1;
+}
+
+static inline void out_put( outbuf * o, const char * s, size_t n )
+{
+  if ( o->len + n > o->cap ) {
+    o->s = xrealloc(o->s, o->cap = 2 * (o->len + n) + 4096);
+  }
+  memcpy(o->s + o->len, s, n);
+  o->len += n;
+}
+
+static inline void out_char( outbuf * o, char c )
+{
+  if ( o->len == o->cap ) {
+    o->s = xrealloc(o->s, o->cap = 2 * o->cap + 4096);
+  }
+  o->s[o->len++] = c;
+}
+
+/* evaluate condition and output columns of current record */
+static void process_row( program * p, record * r, outbuf * o )
+{
+  const char * s;
+  size_t len;
+  value v;
+  int i;
+
+  if ( cond >= 0 ) {
+    vm_call(p, r, cond, &v);
+    if ( !vm_true(r, &v) ) {
+      return;
+    }
+  }
+
+  if ( nocols == 0 ) {
+    out_put(o, r->line, r->len);
+    out_char(o, '\n');
+    return;
+  }
+
+  for ( i = 0; i < nocols; ++i ) {
+    if ( ocols[i].slot >= 0 ) {
+      s = record_field(r, p->cfield[ocols[i].slot], &len);
+    }
+    else {
+      vm_call(p, r, ocols[i].func, &v);
+      s = vm_tostr(p, r, &v, &len);
+    }
+    if ( s ) {
+      out_put(o, s, len);
+    }
+    out_char(o, i < nocols - 1 ? '\t' : '\n');
+  }
+}
+
+static void process_chunk( program * p, record * r, chunk * c )
+{
+  char * s, * e, * end = c->buf + c->len;
+  double nr = c->nr, fnr = c->fnr;
+
+  c->out.len = 0;
+  r->filename = c->filename;
+
+  for ( s = c->buf; s < end; s = e + 1 )
+  {
+    if ( !(e = memchr(s, '\n', end - s)) ) {
+      e = end;
+    }
+    *e = 0;
+
+    record_set(r, s, e - s);
+    r->nr = ++nr;
+    r->fnr = ++fnr;
+
+    vm_reset();
+    process_row(p, r, &c->out);
+  }
+}
+
+static void * worker( void * arg )
+{
+  program * p = arg;
+  record r;
+  chunk * c;
+
+  memset(&r, 0, sizeof(r));
+  vm_init(p);
+
+  pthread_mutex_lock(&pool.mtx);
+
+  for ( ;; )
+  {
+    while ( pool.nnext == pool.nready && !pool.eof ) {
+      pthread_cond_wait(&pool.cond, &pool.mtx);
+    }
+
+    if ( pool.nnext == pool.nready ) {
+      break;
+    }
+
+    c = &pool.chunks[pool.nnext++ % pool.nchunks];
+    pthread_mutex_unlock(&pool.mtx);
+
+    process_chunk(p, &r, c);
+
+    pthread_mutex_lock(&pool.mtx);
+    c->done = 1;
+    pthread_cond_broadcast(&pool.cond);
+  }
+
+  pthread_mutex_unlock(&pool.mtx);
+
+  return NULL;
+}
+
+/* write out finished chunks in order, waiting until fewer than maxpending remain */
+static void write_chunks( long * nwritten, long maxpending )
+{
+  chunk * c;
+
+  for ( ;; )
+  {
+    pthread_mutex_lock(&pool.mtx);
+    while ( pool.nready - *nwritten > maxpending && !pool.chunks[*nwritten % pool.nchunks].done ) {
+      pthread_cond_wait(&pool.cond, &pool.mtx);
+    }
+    c = &pool.chunks[*nwritten % pool.nchunks];
+    if ( *nwritten == pool.nready || !c->done ) {
+      pthread_mutex_unlock(&pool.mtx);
+      break;
+    }
+    c->done = 0;
+    pthread_mutex_unlock(&pool.mtx);
+
+    fwrite(c->out.s, 1, c->out.len, stdout);
+    ++*nwritten;
+  }
+}
+
+static void print_header( const char * line, size_t len )
+{
+  int i;
+
+  if ( nocols == 0 ) {
+    fwrite(line, 1, len, stdout);
+    putchar('\n');
+  }
+  else {
+    for ( i = 0; i < nocols; ++i ) {
+      fputs(ocols[i].name, stdout);
+      putchar(i < nocols - 1 ? '\t' : '\n');
+    }
+  }
+}
+
+int main( int argc, char * argv[] )
+{
+  program * p = program_create();
+  pthread_t * tids = NULL;
+  record r;
+  reader rd;
+  chunk * c;
+  char * line;
+  size_t len;
+  const char ** files = NULL;
+  int nfiles = 0, nthreads = 1;
+  int condset = 0, header = 0;
+  double nr = 0, fnr, nlines;
+  long nwritten = 0;
+  int status = 0;
+  int i, j;
+
+  memset(&r, 0, sizeof(r));
+  memset(&rd, 0, sizeof(rd));
+
+  for ( i = 1; i < argc; ++i )
+  {
+    const char * opt = argv[i];
+
+    if ( strcmp(opt, "--help") == 0 ) {
+      showhelp();
+      return 0;
+    }
+
+    if ( strcmp(opt, "-f") == 0 || strcmp(opt, "-c") == 0 || strcmp(opt, "-x") == 0 || strcmp(opt, "-v") == 0
+        || strcmp(opt, "-df") == 0 || strcmp(opt, "-j") == 0 ) {
+
+      if ( ++i >= argc ) {
+        fprintf(stderr, "ccut: missing argument for %s\n", opt);
+        showhelp();
+        return 1;
+      }
+
+      if ( strcmp(opt, "-f") == 0 ) {
+        if ( parse_columns(p, argv[i]) != 0 ) {
+          return 1;
+        }
+      }
+      else if ( strcmp(opt, "-c") == 0 || strcmp(opt, "-x") == 0 ) {
+        if ( condset ) {
+          fprintf(stderr, "ccut: multiple conditions not allowed.%s\n",
+              opt[1] == 'c' ? " Note that -c switch is depreceated, use -x instead" : "");
+          return 1;
+        }
+        condset = 1;
+        if ( *argv[i] ) {
+          if ( compile_expr(p, COND_FUNC, argv[i], opt[1] == 'c') != 0 ) {
+            return 1;
+          }
+          cond = find_function(p, COND_FUNC);
+        }
+      }
+      else if ( strcmp(opt, "-v") == 0 ) {
+        if ( set_variable(p, argv[i]) != 0 ) {
+          return 1;
+        }
+      }
+      else if ( strcmp(opt, "-j") == 0 ) {
+        /* 0 means all online CPUs */
+        if ( sscanf(argv[i], "%d", &nthreads) != 1 || nthreads < 0 ) {
+          fprintf(stderr, "ccut: invalid thread count '%s'\n", argv[i]);
+          return 1;
+        }
+        if ( nthreads == 0 && (nthreads = sysconf(_SC_NPROCESSORS_ONLN)) < 1 ) {
+          nthreads = 1;
+        }
+      }
+      else if ( compile_functions(p, argv[i]) != 0 ) {
+        return 1;
+      }
+    }
+    else {
+      files = xrealloc(files, (nfiles + 1) * sizeof(*files));
+      files[nfiles++] = opt;
+    }
+  }
+
+  if ( link_program(p) != 0 ) {
+    return 1;
+  }
+
+  vm_init(p);
+
+  if ( nfiles == 0 ) {
+    files = xrealloc(files, sizeof(*files));
+    files[nfiles++] = "-";
+  }
+
+  pool.nchunks = nthreads > 1 ? CHUNKS_PER_THREAD * nthreads : 1;
+  pool.chunks = xrealloc(NULL, pool.nchunks * sizeof(*pool.chunks));
+  memset(pool.chunks, 0, pool.nchunks * sizeof(*pool.chunks));
+
+  if ( nthreads > 1 ) {
+    tids = xrealloc(NULL, nthreads * sizeof(*tids));
+    for ( i = 0; i < nthreads; ++i ) {
+      if ( (errno = pthread_create(&tids[i], NULL, worker, program_clone(p))) ) {
+        fprintf(stderr, "ccut: pthread_create() fails: %s\n", strerror(errno));
+        return 2;
+      }
+    }
+  }
+
+  for ( j = 0; j < nfiles; ++j )
+  {
+    if ( reader_open(&rd, files[j]) != 0 ) {
+      fflush(stdout);
+      fprintf(stderr, "ccut: cannot open file `%s' for reading: %s\n", files[j], strerror(errno));
+      status = 2;
+      continue;
+    }
+
+    fnr = 0;
+
+    /* the very first line is the header */
+    if ( !header ) {
+
+      if ( !(line = reader_getline(&rd, &len)) ) {
+        reader_close(&rd);
+        continue;
+      }
+
+      record_set(&r, line, len);
+      nr = fnr = 1;
+      header = 1;
+
+      if ( resolve_columns(p, &r) != 0 ) {
+        return 1;
+      }
+
+      print_header(line, len);
+    }
+
+    for ( ;; )
+    {
+      if ( nthreads > 1 ) {
+        /* make room in the ring */
+        write_chunks(&nwritten, pool.nchunks - 1);
+      }
+
+      c = &pool.chunks[pool.nready % pool.nchunks];
+
+      if ( !reader_getchunk(&rd, c, &nlines) ) {
+        break;
+      }
+
+      c->filename = strcmp(files[j], "-") == 0 ? "" : files[j];
+      c->nr = nr;
+      c->fnr = fnr;
+      nr += nlines;
+      fnr += nlines;
+
+      if ( nthreads > 1 ) {
+        pthread_mutex_lock(&pool.mtx);
+        ++pool.nready;
+        pthread_cond_broadcast(&pool.cond);
+        pthread_mutex_unlock(&pool.mtx);
+        write_chunks(&nwritten, pool.nchunks);
+      }
+      else {
+        process_chunk(p, &r, c);
+        fwrite(c->out.s, 1, c->out.len, stdout);
+      }
+    }
+
+    reader_close(&rd);
+  }
+
+  if ( nthreads > 1 ) {
+    pthread_mutex_lock(&pool.mtx);
+    pool.eof = 1;
+    pthread_cond_broadcast(&pool.cond);
+    pthread_mutex_unlock(&pool.mtx);
+
+    write_chunks(&nwritten, 0);
+
+    for ( i = 0; i < nthreads; ++i ) {
+      pthread_join(tids[i], NULL);
+    }
+  }
+
+  if ( fflush(stdout) != 0 ) {
+    fprintf(stderr, "ccut: write error: %s\n", strerror(errno));
+    status = 2;
+  }
+
+  return status;
+}
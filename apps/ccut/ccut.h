@@ -0,0 +1,228 @@
+/*
+ * ccut.h
+ *
+ *  Native ccut: the awk subset used by ccut -f/-x/-c/-df expressions,
+ *  compiled once into register-based bytecode and evaluated per input row.
+ *
+ *  Value semantics follow awk: numbers, strings, and "strnum" input fields
+ *  which compare numerically when they look numeric; numbers convert to strings
+ *  as integers when integral, otherwise with CONVFMT="%+.9f" as set by the old
+ *  ccut script.
+ */
+
+#ifndef __ccut_h__
+#define __ccut_h__
+
+#include <stddef.h>
+#include <regex.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/** Value types */
+enum {
+  V_UNINIT,   /*< uninitialized variable or nonexistent field: "" and 0 */
+  V_NUM,
+  V_STR,
+  V_STRNUM,   /*< string that looks numeric, num is valid */
+  V_FIELD     /*< input field, classified lazily by the record */
+};
+
+typedef
+struct value {
+  int type;
+  int fld;            /*< V_FIELD: field number */
+  size_t len;
+  const char * s;     /*< always NUL-terminated or followed by field separator */
+  double num;
+} value;
+
+
+/** Bytecode. Operands >= 0 are frame registers, < 0 are constants: consts[-1 - operand] */
+enum {
+  OP_MOVE,      /*< a <- b */
+  OP_LOADG,     /*< a <- globals[b] */
+  OP_STOREG,    /*< globals[a] <- b */
+  OP_COL,       /*< a <- field of column slot b */
+  OP_FIELD,     /*< a <- $b */
+  OP_FIELDK,    /*< a <- $b, b is field number */
+  OP_NF,        /*< a <- NF */
+  OP_NR,        /*< a <- NR */
+  OP_FNR,       /*< a <- FNR */
+  OP_FILENAME,  /*< a <- FILENAME */
+  OP_NEG,       /*< a <- -b */
+  OP_TONUM,     /*< a <- +b */
+  OP_NOT,       /*< a <- !b */
+  OP_BOOL,      /*< a <- b ? 1 : 0 */
+  OP_ADD,       /*< a <- b + c */
+  OP_SUB,
+  OP_MUL,
+  OP_DIV,
+  OP_MOD,
+  OP_POW,
+  OP_CAT,       /*< a <- b c */
+  OP_LT,
+  OP_LE,
+  OP_GT,
+  OP_GE,
+  OP_EQ,
+  OP_NE,
+  OP_MATCH,     /*< a <- b ~ c */
+  OP_NMATCH,    /*< a <- b !~ c */
+  OP_MATCHK,    /*< a <- b ~ regex[c] */
+  OP_NMATCHK,   /*< a <- b !~ regex[c] */
+  OP_JMP,       /*< goto a */
+  OP_JF,        /*< if !a goto b */
+  OP_JT,        /*< if a goto b */
+  OP_CALL,      /*< a <- funcs[c](regs b .. b+d-1) */
+  OP_BUILTIN,   /*< a <- builtin c(regs b .. b+d-1) */
+  OP_RET,       /*< return a */
+  OP_RETU       /*< return uninitialized */
+};
+
+typedef
+struct insn {
+  int op, a, b, c, d;
+} insn;
+
+typedef
+struct function {
+  char * name;
+  int nparams;
+  int nregs;          /*< frame size including params */
+  int defined;
+  insn * code;
+  int ncode, maxcode;
+} function;
+
+/** Compiled program: functions, constants, globals and column references */
+typedef
+struct program {
+  function ** funcs;
+  int nfuncs;
+
+  value * consts;
+  int nconsts;
+
+  char ** gnames;
+  value * globals;    /*< string values point to malloc()-ed copies */
+  int nglobals;
+
+  char ** cnames;     /*< referenced column names */
+  int * cfield;       /*< their field numbers, set by resolve_columns() */
+  int ncols;
+
+  regex_t * regex;
+  char ** resrc;      /*< regex sources */
+  int nregex;
+} program;
+
+
+/** Input record with lazily split fields (awk default FS: runs of blanks) */
+typedef
+struct field {
+  const char * s;
+  size_t len;
+  int type;           /*< V_FIELD if not yet classified, then V_STRNUM or V_STR */
+  double num;
+} field;
+
+typedef
+struct record {
+  const char * line;
+  size_t len;
+  const char * pos;   /*< where splitting continues */
+  field * f;          /*< f[0] is $0 */
+  int nf;             /*< fields split so far */
+  int maxf;
+  int complete;       /*< all fields split, nf is NF */
+  double nr, fnr;
+  const char * filename;
+} record;
+
+
+/** Builtin functions */
+enum {
+  B_LENGTH,
+  B_SUBSTR,
+  B_INDEX,
+  B_TOLOWER,
+  B_TOUPPER,
+  B_SPRINTF,
+  B_SQRT,
+  B_EXP,
+  B_LOG,
+  B_SIN,
+  B_COS,
+  B_ATAN2,
+  B_INT,
+  B_ABS,
+  B_HYPOT,
+  B_AND,
+  B_OR,
+  B_XOR,
+  B_LSHIFT,
+  B_RSHIFT,
+  B_COMPL
+};
+
+
+/* ccut-compile.c */
+
+program * program_create(void);
+
+/** Copy for a worker thread: own globals and compiled regexes, code and constants shared */
+program * program_clone(const program * p);
+
+/** Compile expression src into zero-parameter function fname; cmode: bare names are columns (-c) */
+int compile_expr(program * p, const char * fname, const char * src, int cmode);
+
+/** Compile -df 'name(params) { body }' definitions */
+int compile_functions(program * p, const char * src);
+
+/** Compile output column: function get<name> returning field of column name */
+int compile_column(program * p, const char * fname, const char * column);
+
+/** Check that all called functions are defined */
+int link_program(program * p);
+
+int find_function(const program * p, const char * name);
+
+/** Set global variable from -v var=value */
+int set_variable(program * p, const char * assignment);
+
+
+/* ccut-vm.c, interpreter state is per thread */
+
+void vm_init(program * p);
+
+/** Prepare r for next line (line must be NUL-terminated) */
+void record_set(record * r, const char * line, size_t len);
+
+int record_nf(record * r);
+const char * record_field(record * r, int k, size_t * len);
+
+/** Run function, result into *ret (valid until next vm_reset()) */
+void vm_call(program * p, record * r, int func, value * ret);
+
+/** Release per-row temporaries */
+void vm_reset(void);
+
+/** Value to string, numbers by CONVFMT */
+const char * vm_tostr(program * p, record * r, const value * v, size_t * len);
+
+int vm_true(record * r, const value * v);
+
+/** Turn V_STR that looks numeric into V_STRNUM */
+void vm_classify(value * v);
+
+/** Store v into global g, copying string data */
+void vm_setglobal(program * p, int g, record * r, const value * v);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ccut_h__ */
@@ -0,0 +1,392 @@
+/*
+ * ccarray-psort.h
+ *
+ *  Multithreaded stable sort for ccarray_t.
+ *
+ *  The range is split into one chunk per thread, chunks are sorted concurrently
+ *  (merge sort for comparator, radix sort for key extractor) and then merged
+ *  pairwise in log2(nthreads) rounds. Each merge of a round is split between
+ *  threads along the merge path, so that all threads stay busy up to the final merge.
+ *  Needs scratch buffer of the size of the sorted range.
+ *  Link with -lpthread.
+ */
+
+#ifndef __ccarray_psort_h__
+#define __ccarray_psort_h__
+
+#include "ccarray.h"
+#include <pthread.h>
+#include <unistd.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/** internal comparator with context, ctx is either cmpfunc_t or ccarray_psort_keys_t */
+typedef int (*ccarray_psort_cmp_t)( const void * v1, const void * v2, const void * ctx );
+
+typedef struct {
+  const ccarray_sortkey_t * keys;
+  int nkeys;
+} ccarray_psort_keys_t;
+
+typedef struct {
+  cmpfunc_t cmp;
+} ccarray_psort_func_t;
+
+static inline int ccarray_psort_cmpfunc( const void * v1, const void * v2, const void * ctx )
+{
+  return ((const ccarray_psort_func_t *) ctx)->cmp(v1, v2);
+}
+
+static inline int ccarray_psort_cmpkeys( const void * v1, const void * v2, const void * ctx )
+{
+  const ccarray_psort_keys_t * k = (const ccarray_psort_keys_t *) ctx;
+  uint64_t k1, k2;
+  int i;
+
+  for ( i = 0; i < k->nkeys; ++i ) {
+    if ( (k1 = ccarray_radix_key(v1, &k->keys[i])) != (k2 = ccarray_radix_key(v2, &k->keys[i])) ) {
+      return k1 < k2 ? -1 : +1;
+    }
+  }
+
+  return 0;
+}
+
+
+/** stable merge of sorted a[0..na) and b[0..nb) into dst, ties are taken from a */
+static inline void ccarray_psort_merge( const uint8_t * a, size_t na, const uint8_t * b, size_t nb,
+    uint8_t * dst, size_t size, ccarray_psort_cmp_t cmp, const void * ctx )
+{
+  const uint8_t * const aend = a + na * size;
+  const uint8_t * const bend = b + nb * size;
+
+  while ( a < aend && b < bend )
+  {
+    if ( cmp(b, a, ctx) < 0 ) {
+      memcpy(dst, b, size), b += size;
+    }
+    else {
+      memcpy(dst, a, size), a += size;
+    }
+    dst += size;
+  }
+
+  if ( a < aend ) {
+    memcpy(dst, a, aend - a);
+  }
+  else if ( b < bend ) {
+    memcpy(dst, b, bend - b);
+  }
+}
+
+/**
+ * Number of items taken from a[] among the first k items of stable merge of a[0..na) and b[0..nb)
+ */
+static inline size_t ccarray_psort_corank( size_t k, const uint8_t * a, size_t na, const uint8_t * b, size_t nb,
+    size_t size, ccarray_psort_cmp_t cmp, const void * ctx )
+{
+  size_t lo = k > nb ? k - nb : 0;
+  size_t hi = k < na ? k : na;
+
+  while ( lo < hi )
+  {
+    const size_t i = lo + (hi - lo) / 2;
+    const size_t j = k - i;
+
+    if ( j > 0 && cmp(a + i * size, b + (j - 1) * size, ctx) <= 0 ) {
+      lo = i + 1; /* a[i] precedes b[j-1], take more from a */
+    }
+    else {
+      hi = i;
+    }
+  }
+
+  return lo;
+}
+
+/** stable sequential merge sort of base[0..n) using tmp[0..n) as scratch */
+static inline void ccarray_psort_msort( uint8_t * base, uint8_t * tmp, size_t n, size_t size,
+    ccarray_psort_cmp_t cmp, const void * ctx )
+{
+  enum { RUN = 16 };
+  uint8_t * src = base, * dst = tmp, * t;
+  size_t i, j, w;
+
+  /* insertion sort of short runs */
+  for ( i = 0; i < n; i += RUN )
+  {
+    const size_t e = i + RUN < n ? i + RUN : n;
+
+    for ( j = i + 1; j < e; ++j )
+    {
+      size_t m = j;
+
+      if ( cmp(base + (m - 1) * size, base + j * size, ctx) <= 0 ) {
+        continue;
+      }
+
+      memcpy(tmp, base + j * size, size);
+      do {
+        --m;
+      } while ( m > i && cmp(base + (m - 1) * size, tmp, ctx) > 0 );
+
+      memmove(base + (m + 1) * size, base + m * size, (j - m) * size);
+      memcpy(base + m * size, tmp, size);
+    }
+  }
+
+  /* bottom-up merge passes */
+  for ( w = RUN; w < n; w *= 2 )
+  {
+    for ( i = 0; i < n; i += 2 * w )
+    {
+      const size_t na = i + w < n ? w : n - i;
+      const size_t nb = i + na + w < n ? w : n - i - na;
+      ccarray_psort_merge(src + i * size, na, src + (i + na) * size, nb, dst + i * size, size, cmp, ctx);
+    }
+
+    t = src, src = dst, dst = t;
+  }
+
+  if ( src != base ) {
+    memcpy(base, src, n * size);
+  }
+}
+
+
+typedef struct {
+  ccarray_t * c;
+  uint8_t * src, * dst;
+  size_t size;
+  ccarray_psort_cmp_t cmp;
+  const void * ctx;
+  const ccarray_psort_keys_t * keys;
+
+  /* chunk sort task */
+  size_t beg, end;
+
+  /* merge slice task: output items [k0, k1) of merge of src[abeg..aend) and src[aend..bend) */
+  size_t abeg, aend, bend, k0, k1;
+
+  int status;
+} ccarray_psort_task_t;
+
+static inline void * ccarray_psort_chunk_thread( void * arg )
+{
+  ccarray_psort_task_t * t = (ccarray_psort_task_t *) arg;
+
+  if ( t->keys ) {
+    t->status = ccarray_radix_sort(t->c, t->beg, t->end, t->keys->keys, t->keys->nkeys);
+  }
+  else {
+    ccarray_psort_msort(t->src + t->beg * t->size, t->dst + t->beg * t->size, t->end - t->beg, t->size,
+        t->cmp, t->ctx);
+    t->status = 0;
+  }
+
+  return NULL;
+}
+
+static inline void * ccarray_psort_merge_thread( void * arg )
+{
+  ccarray_psort_task_t * t = (ccarray_psort_task_t *) arg;
+  const size_t size = t->size;
+  const uint8_t * a = t->src + t->abeg * size;
+  const uint8_t * b = t->src + t->aend * size;
+  const size_t na = t->aend - t->abeg;
+  const size_t nb = t->bend - t->aend;
+  const size_t i0 = ccarray_psort_corank(t->k0, a, na, b, nb, size, t->cmp, t->ctx);
+  const size_t i1 = ccarray_psort_corank(t->k1, a, na, b, nb, size, t->cmp, t->ctx);
+
+  ccarray_psort_merge(a + i0 * size, i1 - i0, b + (t->k0 - i0) * size, (t->k1 - i1) - (t->k0 - i0),
+      t->dst + (t->abeg + t->k0) * size, size, t->cmp, t->ctx);
+
+  return NULL;
+}
+
+/** run tasks on threads, falls back to the calling thread if a thread can not be created */
+static inline void ccarray_psort_run( ccarray_psort_task_t * tasks, int ntasks, void * (*func)( void * ) )
+{
+  pthread_t * threads = NULL;
+  char * started = NULL;
+  int i;
+
+  if ( ntasks > 1 && (threads = (pthread_t *) calloc(ntasks, sizeof(*threads) + 1)) ) {
+    started = (char *) (threads + ntasks);
+  }
+
+  for ( i = 0; i < ntasks; ++i ) {
+    if ( !threads || !(started[i] = (pthread_create(&threads[i], NULL, func, &tasks[i]) == 0)) ) {
+      func(&tasks[i]);
+    }
+  }
+
+  if ( threads )
+  {
+    for ( i = 0; i < ntasks; ++i ) {
+      if ( started[i] ) {
+        pthread_join(threads[i], NULL);
+      }
+    }
+    free(threads);
+  }
+}
+
+static inline int ccarray_psort( ccarray_t * c, size_t beg, size_t end, ccarray_psort_cmp_t cmp,
+    const void * ctx, const ccarray_psort_keys_t * keys, int nthreads )
+{
+  const size_t n = end - beg;
+  const size_t size = c->item_size;
+  ccarray_psort_task_t * tasks;
+  size_t * bounds;
+  uint8_t * items, * scratch, * src, * dst, * t;
+  size_t nchunks, i, j, step;
+  int status = 0;
+
+  if ( nthreads < 1 && (nthreads = sysconf(_SC_NPROCESSORS_ONLN)) < 1 ) {
+    nthreads = 1;
+  }
+
+  /* do not bother threads for small arrays */
+  if ( (size_t) nthreads > n / 4096 ) {
+    nthreads = n / 4096 > 0 ? n / 4096 : 1;
+  }
+
+  if ( n < 2 ) {
+    return 0;
+  }
+
+  if ( nthreads == 1 && keys ) {
+    return ccarray_radix_sort(c, beg, end, keys->keys, keys->nkeys);
+  }
+
+  items = (uint8_t *) c->items + beg * size;
+
+  /* quick exit for already ordered input */
+  for ( i = 1; i < n && cmp(items + (i - 1) * size, items + i * size, ctx) <= 0; ++i ) {
+  }
+
+  if ( i == n ) {
+    return 0;
+  }
+
+  if ( !(scratch = (uint8_t *) malloc(n * size)) ) {
+    /* the radix sort needs no copy of large items */
+    return keys ? ccarray_radix_sort(c, beg, end, keys->keys, keys->nkeys) : -1;
+  }
+
+  if ( !(tasks = (ccarray_psort_task_t *) calloc(nthreads, sizeof(*tasks))) ) {
+    free(scratch);
+    return -1;
+  }
+
+  if ( !(bounds = (size_t *) malloc((nthreads + 1) * sizeof(*bounds))) ) {
+    free(tasks);
+    free(scratch);
+    return -1;
+  }
+
+  /* sort chunks concurrently, items are addressed relative to beg */
+  nchunks = nthreads;
+  for ( i = 0; i <= nchunks; ++i ) {
+    bounds[i] = n * i / nchunks;
+  }
+
+  for ( i = 0; i < nchunks; ++i ) {
+    tasks[i].c = c;
+    tasks[i].src = items;
+    tasks[i].dst = scratch;
+    tasks[i].size = size;
+    tasks[i].cmp = cmp;
+    tasks[i].ctx = ctx;
+    tasks[i].keys = keys;
+    tasks[i].beg = (keys ? beg : 0) + bounds[i];
+    tasks[i].end = (keys ? beg : 0) + bounds[i + 1];
+  }
+
+  ccarray_psort_run(tasks, nchunks, ccarray_psort_chunk_thread);
+
+  for ( i = 0; i < nchunks; ++i ) {
+    if ( tasks[i].status != 0 ) {
+      status = -1;
+    }
+  }
+
+  /* merge rounds: each round halves the number of sorted runs */
+  src = items, dst = scratch;
+
+  for ( step = 1; status == 0 && step < nchunks; step *= 2 )
+  {
+    int ntasks = 0;
+
+    for ( i = 0; i < nchunks; i += 2 * step )
+    {
+      const size_t abeg = bounds[i];
+      const size_t aend = bounds[i + step < nchunks ? i + step : nchunks];
+      const size_t bend = bounds[i + 2 * step < nchunks ? i + 2 * step : nchunks];
+      const size_t nthr = (i + 2 * step < nchunks ? 2 * step : nchunks - i);
+
+      /* split this merge between the threads which sorted its chunks */
+      for ( j = 0; j < nthr; ++j )
+      {
+        ccarray_psort_task_t * tk = &tasks[ntasks++];
+        tk->src = src;
+        tk->dst = dst;
+        tk->abeg = abeg;
+        tk->aend = aend;
+        tk->bend = bend;
+        tk->k0 = (bend - abeg) * j / nthr;
+        tk->k1 = (bend - abeg) * (j + 1) / nthr;
+      }
+    }
+
+    ccarray_psort_run(tasks, ntasks, ccarray_psort_merge_thread);
+
+    t = src, src = dst, dst = t;
+  }
+
+  if ( status == 0 && src != items ) {
+    memcpy(items, src, n * size);
+  }
+
+  free(bounds);
+  free(tasks);
+  free(scratch);
+
+  return status;
+}
+
+
+/**
+ * Stable multithreaded sort of items [beg, end) using comparator.
+ * If nthreads < 1 then the number of online CPUs is used.
+ * Returns 0 on success, -1 if memory allocation fails (array is left unchanged then)
+ */
+static inline int ccarray_sort_parallel( ccarray_t * c, size_t beg, size_t end, cmpfunc_t cmp, int nthreads )
+{
+  const ccarray_psort_func_t ctx = { cmp };
+  return ccarray_psort(c, beg, end, ccarray_psort_cmpfunc, &ctx, NULL, nthreads);
+}
+
+/**
+ * Stable multithreaded sort of items [beg, end) by the keys, keys[0] is the most significant,
+ * see ccarray_radix_sort().
+ * If nthreads < 1 then the number of online CPUs is used.
+ * Returns 0 on success, -1 if memory allocation fails (array is not sorted then)
+ */
+static inline int ccarray_sort_parallel_keys( ccarray_t * c, size_t beg, size_t end,
+    const ccarray_sortkey_t keys[], int nkeys, int nthreads )
+{
+  const ccarray_psort_keys_t ctx = { keys, nkeys };
+  return ccarray_psort(c, beg, end, ccarray_psort_cmpkeys, &ctx, &ctx, nthreads);
+}
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ccarray_psort_h__ */
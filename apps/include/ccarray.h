@@ -16,6 +16,10 @@
 # include <malloc.h>
 #endif
 
+#ifdef __linux__
+# include <sys/mman.h>
+#endif
+
 
 
 #ifdef __cplusplus
@@ -28,8 +32,20 @@ typedef struct {
   size_t item_size;
   size_t items_count;
   void * items;
+  unsigned flags;
 } ccarray_t;
 
+/** ccarray_t.flags: items are allocated by mmap() */
+#define CCARRAY_MMAPPED   0x1
+
+/** blocks of this size and larger are allocated by mmap() and grown by mremap() */
+#ifndef CCARRAY_MMAP_THRESHOLD
+# define CCARRAY_MMAP_THRESHOLD   (32UL << 20)
+#endif
+
+/** mmap()-ed blocks are rounded to the huge page size */
+#define CCARRAY_HUGEPAGE_SIZE     (2UL << 20)
+
 typedef int (*cmpfunc_t)( const void * v1, const void * v2 );
 
 static inline int cmp_int( const void * intvalue1, const void * intvalue2 )
@@ -45,19 +61,125 @@ static inline int cmp_int( const void * intvalue1, const void * intvalue2 )
 }
 
 
+/**
+ * Change capacity of storage to exactly new_capacity items (must be not less than items_count).
+ * Large blocks are moved to anonymous mmap() and grown with mremap() so that
+ * reallocation does not copy the data and untouched capacity consumes no memory.
+ * Returns 0 on success, -1 on allocation failure (the array is left unchanged then)
+ */
+static inline int ccarray_realloc( ccarray_t * c, size_t new_capacity )
+{
+  size_t new_bytes = new_capacity * c->item_size;
+  void * p;
+
+#ifdef __linux__
+  if ( new_bytes >= CCARRAY_MMAP_THRESHOLD )
+  {
+    const size_t old_bytes = c->capacity * c->item_size;
+
+    new_bytes = (new_bytes + CCARRAY_HUGEPAGE_SIZE - 1) & ~(CCARRAY_HUGEPAGE_SIZE - 1);
+
+    if ( !(c->flags & CCARRAY_MMAPPED) )
+    {
+      if ( (p = mmap(NULL, new_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED ) {
+        return -1;
+      }
+      if ( c->items ) {
+        memcpy(p, c->items, c->items_count * c->item_size);
+        free(c->items);
+      }
+      c->flags |= CCARRAY_MMAPPED;
+    }
+# ifdef MREMAP_MAYMOVE
+    else if ( (p = mremap(c->items, old_bytes, new_bytes, MREMAP_MAYMOVE)) == MAP_FAILED ) {
+      return -1;
+    }
+# else
+    else if ( (p = mmap(NULL, new_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED ) {
+      return -1;
+    }
+    else {
+      memcpy(p, c->items, c->items_count * c->item_size);
+      munmap(c->items, old_bytes);
+    }
+# endif
+
+# ifdef MADV_HUGEPAGE
+    madvise(p, new_bytes, MADV_HUGEPAGE);
+# endif
+
+    c->items = p;
+    c->capacity = new_bytes / c->item_size;
+    return 0;
+  }
+
+  if ( c->flags & CCARRAY_MMAPPED )
+  {
+    /* shrinking below the threshold: move back to heap */
+    if ( !(p = malloc(new_bytes ? new_bytes : 1)) ) {
+      return -1;
+    }
+    memcpy(p, c->items, c->items_count * c->item_size);
+    munmap(c->items, c->capacity * c->item_size);
+    c->flags &= ~CCARRAY_MMAPPED;
+    c->items = p;
+    c->capacity = new_capacity;
+    return 0;
+  }
+#endif
+
+  if ( !(p = realloc(c->items, new_bytes ? new_bytes : 1)) ) {
+    return -1;
+  }
+
+  c->items = p;
+  c->capacity = new_capacity;
+  return 0;
+}
+
+/**
+ * Ensure capacity for at least 'capacity' items, growing geometrically.
+ * Returns 0 on success, -1 on allocation failure
+ */
+static inline int ccarray_reserve( ccarray_t * c, size_t capacity )
+{
+  size_t new_capacity;
+
+  if ( capacity <= c->capacity ) {
+    return 0;
+  }
+
+  if ( (new_capacity = c->capacity + c->capacity / 2) < capacity ) {
+    new_capacity = capacity;
+  }
+
+  if ( new_capacity < 16 ) {
+    new_capacity = 16;
+  }
+
+  return ccarray_realloc(c, new_capacity);
+}
+
+/** Release unused capacity */
+static inline int ccarray_shrink_to_fit( ccarray_t * c )
+{
+  return c->items_count < c->capacity ? ccarray_realloc(c, c->items_count) : 0;
+}
+
+/**
+ * Create array with initial capacity (the hint only, the array grows on demand).
+ * Note that unlike of old versions the items are not zero-initialized.
+ */
 static inline ccarray_t * ccarray_create( size_t capacity, size_t item_size )
 {
   ccarray_t * c = (ccarray_t * )calloc(1, sizeof(ccarray_t));
   if ( c )
   {
-    if ( !( c->items = calloc(capacity, item_size) ) ) {
+    c->item_size = item_size;
+
+    if ( ccarray_realloc(c, capacity) != 0 ) {
       free(c), c = 0;
     }
-    else {
-      c->capacity = capacity;
-      c->items_count = 0;
-      c->item_size = item_size;
-    }
   }
 
   return c;
@@ -67,6 +189,12 @@ static inline void ccarray_destroy( ccarray_t * c )
 {
   if ( c )
   {
+#ifdef __linux__
+    if ( c->flags & CCARRAY_MMAPPED ) {
+      munmap(c->items, c->capacity * c->item_size);
+    }
+    else
+#endif
     if ( c->items ) {
       free(c->items);
     }
@@ -87,7 +215,7 @@ static inline size_t ccarray_capacity( const ccarray_t * c )
 
 static inline size_t ccarray_push_back( ccarray_t * c, const void * data )
 {
-  if ( c->items_count < c->capacity )
+  if ( c->items_count < c->capacity || ccarray_reserve(c, c->items_count + 1) == 0 )
   {
     size_t pos = c->items_count++;
     memcpy((uint8_t*)c->items + pos * c->item_size, data, c->item_size);
@@ -98,9 +226,9 @@ static inline size_t ccarray_push_back( ccarray_t * c, const void * data )
 
 static inline size_t ccarray_push_front( ccarray_t * c, const void * data )
 {
-  if ( c->items_count < c->capacity )
+  if ( c->items_count < c->capacity || ccarray_reserve(c, c->items_count + 1) == 0 )
   {
-    memmove((uint8_t*)c->items + c->item_size, c->items, c->items_count * c->item_size);
+    memmove((uint8_t*)c->items + c->item_size, c->items, c->items_count++ * c->item_size);
     memcpy(c->items, data, c->item_size);
     return 0;
   }
@@ -109,7 +237,7 @@ static inline size_t ccarray_push_front( ccarray_t * c, const void * data )
 
 static inline size_t ccarray_insert( ccarray_t * c, size_t pos, const void * data )
 {
-  if ( c->items_count < c->capacity )
+  if ( c->items_count < c->capacity || ccarray_reserve(c, c->items_count + 1) == 0 )
   {
     memmove((uint8_t*)c->items + ( pos + 1 ) * c->item_size, (uint8_t*)c->items + pos * c->item_size,
       ( c->items_count++ - pos ) * c->item_size);
@@ -142,14 +270,14 @@ static inline size_t ccarray_pop_front( ccarray_t * c, void * data )
     memcpy(data, c->items, c->item_size);
   }
 
-  memcpy(c->items, (uint8_t*)c->items + c->item_size, --c->items_count * c->item_size);
+  memmove(c->items, (uint8_t*)c->items + c->item_size, --c->items_count * c->item_size);
   return c->items_count;
 }
 
 static inline size_t ccarray_erase( ccarray_t * c, size_t pos )
 {
   if ( pos < c->items_count ) {
-    memcpy((uint8_t*)c->items + pos * c->item_size, (uint8_t*)c->items + ( pos + 1 ) * c->item_size,
+    memmove((uint8_t*)c->items + pos * c->item_size, (uint8_t*)c->items + ( pos + 1 ) * c->item_size,
       ( --c->items_count - pos ) * c->item_size);
   }
 
@@ -209,26 +337,463 @@ static inline void ccarray_sort( ccarray_t * c, size_t beg, size_t end, cmpfunc_
   qsort(((uint8_t*) c->items) + beg * c->item_size, end - beg, c->item_size, cmp);
 }
 
-static inline void ccarray_unique( ccarray_t * c, cmpfunc_t cmp)
+
+
+/*
+ * Key-extracting radix sorts.
+ *  The sort key is a field at given byte offset inside of item.
+ *  Keys are mapped to uint64 with order-preserving bit transforms and sorted
+ *  as (key, index) pairs using stable LSD radix sort, 11 bits per pass.
+ *  The passes where all keys share the same digit are skipped.
+ */
+
+typedef enum {
+  ccarray_key_int32,
+  ccarray_key_int64,
+  ccarray_key_uint64,
+  ccarray_key_float,
+  ccarray_key_double,
+} ccarray_key_type;
+
+typedef struct {
+  size_t offset;          /*< byte offset of the key field inside of item */
+  ccarray_key_type type;  /*< key field type */
+} ccarray_sortkey_t;
+
+typedef struct {
+  uint64_t key;
+  size_t index;
+} ccarray_radix_pair_t;
+
+
+/**
+ * map signed integer or IEEE-754 value to uint64 preserving the order;
+ * -0.0 is mapped as +0.0 so that zeros compare equal as with '<' and '>'
+ */
+static inline uint64_t ccarray_radix_key( const void * item, const ccarray_sortkey_t * k )
 {
-  if ( c->items_count > 1 )
+  const uint8_t * p = (const uint8_t *) item + k->offset;
+  uint64_t u;
+  uint32_t u32;
+
+  switch ( k->type )
   {
-    size_t pos;
+  case ccarray_key_int32:
+    memcpy(&u32, p, sizeof(u32));
+    return u32 ^ 0x80000000U;
+
+  case ccarray_key_int64:
+    memcpy(&u, p, sizeof(u));
+    return u ^ 0x8000000000000000ULL;
+
+  case ccarray_key_uint64:
+    memcpy(&u, p, sizeof(u));
+    return u;
+
+  case ccarray_key_float:
+    memcpy(&u32, p, sizeof(u32));
+    if ( u32 == 0x80000000U ) {
+      u32 = 0;
+    }
+    return (u32 & 0x80000000U) ? ~u32 : (u32 ^ 0x80000000U);
 
-    qsort(c->items, c->items_count, c->item_size, cmp);
+  case ccarray_key_double:
+    memcpy(&u, p, sizeof(u));
+    if ( u == 0x8000000000000000ULL ) {
+      u = 0;
+    }
+    return (u & 0x8000000000000000ULL) ? ~u : (u ^ 0x8000000000000000ULL);
+  }
+
+  return 0;
+}
+
+/** stable LSD radix sort of (key,index) pairs, tmp must have room for n pairs */
+static inline int ccarray_radix_pairs( ccarray_radix_pair_t * a, ccarray_radix_pair_t * tmp, size_t n )
+{
+  enum {
+    RADIX_BITS = 11,
+    RADIX_SIZE = 1 << RADIX_BITS,
+    RADIX_MASK = RADIX_SIZE - 1,
+    RADIX_PASSES = (64 + RADIX_BITS - 1) / RADIX_BITS
+  };
+
+  size_t (*hist)[RADIX_SIZE];
+  ccarray_radix_pair_t * src = a, * dst = tmp, * t;
+  size_t i, sum, cnt;
+  int pass;
+
+  if ( !(hist = (size_t (*)[RADIX_SIZE]) calloc(RADIX_PASSES, sizeof(*hist))) ) {
+    return -1;
+  }
+
+  for ( i = 0; i < n; ++i ) {
+    const uint64_t key = a[i].key;
+    for ( pass = 0; pass < RADIX_PASSES; ++pass ) {
+      ++hist[pass][(key >> (pass * RADIX_BITS)) & RADIX_MASK];
+    }
+  }
+
+  for ( pass = 0; pass < RADIX_PASSES; ++pass )
+  {
+    const int shift = pass * RADIX_BITS;
+    size_t * h = hist[pass];
+
+    /* skip the pass if all keys have the same digit */
+    if ( h[(src[0].key >> shift) & RADIX_MASK] == n ) {
+      continue;
+    }
+
+    for ( i = 0, sum = 0; i < RADIX_SIZE; ++i ) {
+      cnt = h[i], h[i] = sum, sum += cnt;
+    }
 
-    pos = 0;
-    while ( pos < c->items_count - 1 )
+    for ( i = 0; i < n; ++i ) {
+      dst[h[(src[i].key >> shift) & RADIX_MASK]++] = src[i];
+    }
+
+    t = src, src = dst, dst = t;
+  }
+
+  if ( src != a ) {
+    memcpy(a, src, n * sizeof(*a));
+  }
+
+  free(hist);
+
+  return 0;
+}
+
+/**
+ * Sort (key,index) pairs by keys[0], then refine the runs of equal keys using keys[1..nkeys-1].
+ * Short runs are finished with insertion sort, long ones recursively with the next key.
+ */
+static inline int ccarray_radix_keys( ccarray_radix_pair_t * pairs, ccarray_radix_pair_t * tmp, size_t n,
+    const uint8_t * items, size_t item_size, const ccarray_sortkey_t keys[], int nkeys )
+{
+  size_t i, j, run;
+  int sorted = 1;
+
+  for ( i = 0; i < n; ++i ) {
+    pairs[i].key = ccarray_radix_key(items + pairs[i].index * item_size, &keys[0]);
+    sorted &= (i == 0 || pairs[i].key >= pairs[i - 1].key);
+  }
+
+  /* typical plate files are already ordered */
+  if ( !sorted && ccarray_radix_pairs(pairs, tmp, n) != 0 ) {
+    return -1;
+  }
+
+  if ( nkeys < 2 ) {
+    return 0;
+  }
+
+  for ( i = 0; i < n; i += run )
+  {
+    for ( run = 1; i + run < n && pairs[i + run].key == pairs[i].key; ++run ) {
+    }
+
+    if ( run < 2 ) {
+      continue;
+    }
+
+    if ( run > 16 ) {
+      if ( ccarray_radix_keys(pairs + i, tmp, run, items, item_size, keys + 1, nkeys - 1) != 0 ) {
+        return -1;
+      }
+      continue;
+    }
+
+    for ( j = i + 1; j < i + run; ++j )
     {
-      if ( cmp(c->items + pos * c->item_size, c->items + (pos + 1) * c->item_size) != 0 ) {
-        ++pos;
+      const ccarray_radix_pair_t p = pairs[j];
+      size_t m = j;
+      int k;
+
+      while ( m > i )
+      {
+        const uint8_t * x = items + p.index * item_size;
+        const uint8_t * y = items + pairs[m - 1].index * item_size;
+        uint64_t kx = 0, ky = 0;
+
+        for ( k = 1; k < nkeys && (kx = ccarray_radix_key(x, &keys[k])) == (ky = ccarray_radix_key(y, &keys[k])); ++k ) {
+        }
+
+        if ( k == nkeys || kx >= ky ) {
+          break;
+        }
+
+        pairs[m] = pairs[m - 1], --m;
       }
-      else {
-        memcpy(c->items + (pos + 1) * c->item_size, c->items + (pos + 2) * c->item_size,
-            c->item_size * (--c->items_count - pos - 1));
+
+      pairs[m] = p;
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * Compute stable sorted permutation of items [beg, end) using lexicographic
+ * order of keys[0], keys[1], ... keys[nkeys-1].
+ * On return perm[i] is the index (relative to beg) of the item which must be placed at position beg + i.
+ * Returns 0 on success, -1 if memory allocation fails
+ */
+static inline int ccarray_radix_perm( const ccarray_t * c, size_t beg, size_t end,
+    const ccarray_sortkey_t keys[], int nkeys, size_t perm[] )
+{
+  const size_t n = end - beg;
+  const uint8_t * items = (const uint8_t *) c->items + beg * c->item_size;
+  ccarray_radix_pair_t * pairs;
+  size_t i;
+
+  if ( n < 2 ) {
+    if ( n ) {
+      perm[0] = 0;
+    }
+    return 0;
+  }
+
+  if ( !(pairs = (ccarray_radix_pair_t *) malloc(2 * n * sizeof(*pairs))) ) {
+    return -1;
+  }
+
+  for ( i = 0; i < n; ++i ) {
+    pairs[i].index = i;
+  }
+
+  if ( ccarray_radix_keys(pairs, pairs + n, n, items, c->item_size, keys, nkeys) != 0 ) {
+    free(pairs);
+    return -1;
+  }
+
+  for ( i = 0; i < n; ++i ) {
+    perm[i] = pairs[i].index;
+  }
+
+  free(pairs);
+
+  return 0;
+}
+
+/**
+ * Reorder items [beg, end) in place according to permutation computed by ccarray_radix_perm().
+ *  Follows the permutation cycles using single item of temporary storage,
+ *  the content of perm[] is destroyed.
+ */
+static inline int ccarray_apply_perm( ccarray_t * c, size_t beg, size_t end, size_t perm[] )
+{
+  const size_t n = end - beg;
+  const size_t item_size = c->item_size;
+  uint8_t * items = (uint8_t *) c->items + beg * item_size;
+  uint8_t * tmp;
+  size_t i, j, next;
+
+  if ( !(tmp = (uint8_t *) malloc(item_size)) ) {
+    return -1;
+  }
+
+  for ( i = 0; i < n; ++i )
+  {
+    if ( perm[i] == i ) {
+      continue;
+    }
+
+    memcpy(tmp, items + i * item_size, item_size);
+
+    for ( j = i; (next = perm[j]) != i; j = next ) {
+      memcpy(items + j * item_size, items + next * item_size, item_size);
+      perm[j] = j;
+    }
+
+    memcpy(items + j * item_size, tmp, item_size);
+    perm[j] = j;
+  }
+
+  free(tmp);
+
+  return 0;
+}
+
+/**
+ * Stable radix sort of items [beg, end) by the keys, keys[0] is the most significant.
+ * Returns 0 on success, -1 if memory allocation fails (array is left unchanged then)
+ */
+static inline int ccarray_radix_sort( ccarray_t * c, size_t beg, size_t end,
+    const ccarray_sortkey_t keys[], int nkeys )
+{
+  size_t * perm;
+  int status;
+
+  if ( end - beg < 2 ) {
+    return 0;
+  }
+
+  if ( !(perm = (size_t *) malloc((end - beg) * sizeof(*perm))) ) {
+    return -1;
+  }
+
+  if ( (status = ccarray_radix_perm(c, beg, end, keys, nkeys, perm)) == 0 )
+  {
+    const size_t n = end - beg;
+    const size_t item_size = c->item_size;
+    uint8_t * items = (uint8_t *) c->items + beg * item_size;
+    uint8_t * scratch;
+    size_t i;
+
+    for ( i = 0; i < n && perm[i] == i; ++i ) {
+    }
+
+    if ( i == n ) {
+      /* already sorted */
+    }
+    /* small items are gathered into scratch copy, large ones are moved in place along the cycles */
+    else if ( item_size > 64 || !(scratch = (uint8_t *) malloc(n * item_size)) ) {
+      status = ccarray_apply_perm(c, beg, end, perm);
+    }
+    else {
+      for ( i = 0; i < n; ++i ) {
+        memcpy(scratch + i * item_size, items + perm[i] * item_size, item_size);
       }
+      memcpy(items, scratch, n * item_size);
+      free(scratch);
+    }
+  }
+
+  free(perm);
+
+  return status;
+}
+
+/** Stable radix sort of items [beg, end) by int64 field at key_offset */
+static inline int ccarray_sort_int64( ccarray_t * c, size_t beg, size_t end, size_t key_offset )
+{
+  const ccarray_sortkey_t key = { key_offset, ccarray_key_int64 };
+  return ccarray_radix_sort(c, beg, end, &key, 1);
+}
+
+/** Stable radix sort of items [beg, end) by double field at key_offset */
+static inline int ccarray_sort_double( ccarray_t * c, size_t beg, size_t end, size_t key_offset )
+{
+  const ccarray_sortkey_t key = { key_offset, ccarray_key_double };
+  return ccarray_radix_sort(c, beg, end, &key, 1);
+}
+
+
+
+
+/*
+ * Bulk in-place removal.
+ *  Kept items are moved towards the array begin in a single pass,
+ *  contiguous runs of kept items are moved by single memmove().
+ */
+
+/** predicate for ccarray_remove_if(), returns nonzero for items to remove */
+typedef int (*ccarray_pred_t)( const void * item, void * ctx );
+
+/** move run of items [beg, end) to position pos <= beg */
+static inline void ccarray_move_run( ccarray_t * c, size_t pos, size_t beg, size_t end )
+{
+  if ( pos != beg && end > beg ) {
+    memmove((uint8_t*)c->items + pos * c->item_size, (uint8_t*)c->items + beg * c->item_size,
+        (end - beg) * c->item_size);
+  }
+}
+
+/**
+ * Keep only items whose bits are set in keep bitmap: item i is kept if bit (i & 7) of keep[i >> 3] is set.
+ * Relative order of kept items is preserved. Returns new size.
+ */
+static inline size_t ccarray_compact( ccarray_t * c, const uint8_t keep[] )
+{
+  const size_t n = c->items_count;
+  size_t pos = 0, i = 0, beg;
+
+  while ( i < n )
+  {
+    /* skip removed items, whole zero bytes at once */
+    while ( i < n && !(keep[i >> 3] & (1 << (i & 7))) ) {
+      i = ((i & 7) == 0 && keep[i >> 3] == 0) ? i + 8 : i + 1;
+    }
+
+    if ( i >= n ) {
+      break;
+    }
+
+    for ( beg = i; i < n && (keep[i >> 3] & (1 << (i & 7))); ++i ) {
+    }
+
+    ccarray_move_run(c, pos, beg, i);
+    pos += i - beg;
+  }
+
+  return (c->items_count = pos);
+}
+
+/**
+ * Remove items for which pred(item, ctx) returns nonzero.
+ * Relative order of kept items is preserved. Returns new size.
+ */
+static inline size_t ccarray_remove_if( ccarray_t * c, ccarray_pred_t pred, void * ctx )
+{
+  const size_t n = c->items_count;
+  size_t pos = 0, i = 0, beg;
+
+  /* pred is called once per item: each run of kept items ends on an already tested removed one */
+  while ( i < n )
+  {
+    while ( i < n && pred((uint8_t*)c->items + i * c->item_size, ctx) ) {
+      ++i;
+    }
+
+    if ( i >= n ) {
+      break;
+    }
+
+    for ( beg = i++; i < n && !pred((uint8_t*)c->items + i * c->item_size, ctx); ++i ) {
+    }
+
+    ccarray_move_run(c, pos, beg, i);
+    pos += i - beg;
+    ++i;
+  }
+
+  return (c->items_count = pos);
+}
+
+/**
+ * Remove adjacent duplicates (items comparing equal to the last kept one) in single sweep,
+ * the array is expected to be sorted with the same comparator.
+ * Returns new size.
+ */
+static inline size_t ccarray_unique_sorted( ccarray_t * c, cmpfunc_t cmp )
+{
+  const size_t n = c->items_count;
+  const size_t size = c->item_size;
+  uint8_t * items = (uint8_t *) c->items;
+  size_t pos, i;
+
+  if ( n < 2 ) {
+    return n;
+  }
+
+  for ( pos = 0, i = 1; i < n; ++i )
+  {
+    if ( cmp(items + pos * size, items + i * size) != 0 && ++pos != i ) {
+      memcpy(items + pos * size, items + i * size, size);
     }
   }
+
+  return (c->items_count = pos + 1);
+}
+
+/** Sort the array and remove duplicates */
+static inline void ccarray_unique( ccarray_t * c, cmpfunc_t cmp)
+{
+  if ( c->items_count > 1 ) {
+    qsort(c->items, c->items_count, c->item_size, cmp);
+    ccarray_unique_sorted(c, cmp);
+  }
 }
 
 static inline size_t ccarray_lowerbound(const ccarray_t * c, size_t beg, size_t end, cmpfunc_t cmp, const void * value)
@@ -276,6 +841,7 @@ static inline int ccarray_create_slots( ccarray_t ** a, ccarray_t ** apool, size
     return -1;
   }
 
+  memset(( *apool )->items, 0, num_slots * item_size);
   ( *apool )->items_count = num_slots;
 
   return 0;
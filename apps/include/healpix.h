@@ -0,0 +1,132 @@
+/*
+ * healpix.h
+ *
+ *  HEALPix sphere partition in NESTED numbering (Gorski et al. 2005, ApJ 622, 759),
+ *  only the point to pixel mapping needed to partition catalogs into sky tiles.
+ *  The pixel of resolution order k (nside = 2^k) has 4^k sub-pixels at order 2k,
+ *  so tiles of nested orders can be refined by shifting pixel numbers.
+ */
+
+#ifndef __healpix_h__
+#define __healpix_h__
+
+#include <stdint.h>
+#include <math.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Max supported order, nside = 2^29 */
+#define HEALPIX_MAX_ORDER   29
+
+
+static inline int64_t healpix_nside( int order )
+{
+  return (int64_t) 1 << order;
+}
+
+static inline int64_t healpix_npix( int order )
+{
+  return 12 * ((int64_t) 1 << (2 * order));
+}
+
+
+/** interleaves bits of v with zeroes: bit i goes to bit 2i */
+static inline uint64_t healpix_spread_bits( uint64_t v )
+{
+  v &= 0xffffffffULL;
+  v = (v | (v << 16)) & 0x0000ffff0000ffffULL;
+  v = (v | (v << 8))  & 0x00ff00ff00ff00ffULL;
+  v = (v | (v << 4))  & 0x0f0f0f0f0f0f0f0fULL;
+  v = (v | (v << 2))  & 0x3333333333333333ULL;
+  v = (v | (v << 1))  & 0x5555555555555555ULL;
+  return v;
+}
+
+
+/**
+ * NESTED pixel of the point with z = cos(colatitude) and longitude phi (radians)
+ */
+static inline int64_t healpix_ang2pix_nest_z_phi( int order, double z, double phi )
+{
+  const int64_t nside = healpix_nside(order);
+  const double za = fabs(z);
+  double tt;
+  int64_t ix, iy;
+  int face;
+
+  tt = fmod(phi, 2 * M_PI);
+  if ( tt < 0 ) {
+    tt += 2 * M_PI;
+  }
+  tt *= 2 / M_PI; /* in [0, 4) */
+
+  if ( za <= 2. / 3 )
+  {
+    /* equatorial region */
+    const double t1 = nside * (0.5 + tt);
+    const double t2 = nside * (z * 0.75);
+    const int64_t jp = (int64_t) (t1 - t2); /* index of ascending edge line */
+    const int64_t jm = (int64_t) (t1 + t2); /* index of descending edge line */
+    const int64_t ifp = jp >> order;        /* in {0, 4} */
+    const int64_t ifm = jm >> order;
+
+    face = (int) (ifp == ifm ? (ifp | 4) : (ifp < ifm ? ifp : ifm + 8));
+    ix = jm & (nside - 1);
+    iy = nside - (jp & (nside - 1)) - 1;
+  }
+  else
+  {
+    /* polar caps */
+    int ntt = (int) tt;
+    double tp, tmp;
+    int64_t jp, jm;
+
+    if ( ntt >= 4 ) {
+      ntt = 3;
+    }
+
+    tp = tt - ntt;
+    tmp = nside * sqrt(3 * (1 - za));
+
+    jp = (int64_t) (tp * tmp);
+    jm = (int64_t) ((1.0 - tp) * tmp);
+
+    /* points too close to the boundary */
+    if ( jp >= nside ) {
+      jp = nside - 1;
+    }
+    if ( jm >= nside ) {
+      jm = nside - 1;
+    }
+
+    if ( z >= 0 ) {
+      face = ntt;
+      ix = nside - jm - 1;
+      iy = nside - jp - 1;
+    }
+    else {
+      face = ntt + 8;
+      ix = jp;
+      iy = jm;
+    }
+  }
+
+  return ((int64_t) face << (2 * order)) + (int64_t) (healpix_spread_bits(ix) | (healpix_spread_bits(iy) << 1));
+}
+
+
+/**
+ * NESTED pixel of equatorial (ra, dec), radians
+ */
+static inline int64_t healpix_radec2pix_nest( int order, double ra, double dec )
+{
+  return healpix_ang2pix_nest_z_phi(order, sin(dec), ra);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __healpix_h__ */
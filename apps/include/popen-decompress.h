@@ -0,0 +1,53 @@
+/*
+ * popen-decompress.h
+ *
+ *  Reading of compressed files through the decompressor pipe,
+ *  shared by apps and octave-scosmos (lib/install.sh copies it into the package).
+ */
+
+#ifndef __popen_decompress_h__
+#define __popen_decompress_h__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * popen() of "program -dc 'fname'" for reading, single quotes in fname are escaped for the shell.
+ *  Returns NULL with errno set on error, the stream must be closed with pclose().
+ */
+static inline FILE * popen_decompress( const char * program, const char * fname )
+{
+  char * cmd, * p;
+  FILE * fp;
+
+  if ( !(cmd = (char *) malloc(strlen(program) + 4 * strlen(fname) + 8)) ) {
+    return NULL;
+  }
+
+  p = cmd + sprintf(cmd, "%s -dc '", program);
+  for ( ; *fname; ++fname ) {
+    if ( *fname == '\'' ) {
+      memcpy(p, "'\\''", 4), p += 4;
+    }
+    else {
+      *p++ = *fname;
+    }
+  }
+  *p++ = '\'', *p = 0;
+
+  fp = popen(cmd, "r");
+  free(cmd);
+
+  return fp;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __popen_decompress_h__ */
@@ -0,0 +1,153 @@
+/*
+ * ssa-junk.h
+ *
+ *  Junk (spurious image) filter for ssa_detection2 plate records,
+ *  shared by ssa-plate-dump and the octave-scosmos plate reader.
+ */
+
+#ifndef __ssa_junk_h__
+#define __ssa_junk_h__
+
+#include <math.h>
+#include "ssa-detection.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Image quality bits,
+ * see http://surveys.roe.ac.uk/ssa/dboverview.html
+ */
+typedef
+enum QualityFlags {
+  QF_OCF  =    1,     /*<  Orientation calculation failed       0     1  Information   Image perfectly round */
+  QF_ECF  =    2,     /*<  Ellipticity calculation failed       1     2  Information   Image perfectly straight */
+  QF_TMD  =    4,     /*<  Image too multiple for deblending    2     4  Warning   Image split into too many fragments */
+  QF_BI   =   16,     /*<  Bright image                         4    16  Information   Image has pixels brighter than highest areal profile level */
+  QF_LI   =   64,     /*<  Large image                          6    64  Warning   Image has area greater than maximum specified for deblending */
+  QF_PBI  =  128,     /*<  Possible bad image                   7   128  Warning   Image is in step-wedge/label region */
+  QF_NVBS = 1024,     /*<  Image near very bright star         10  1024  Warning   Image may be spurious due to bright star artifact */
+  QF_HA   = 2048,     /*<  Halo artifact                       11  2048  Strong warning  Image is likely spurious result of bright star halo */
+  QF_DSA  = 8192,     /*<  Diffraction spike artifact          13  8192  Strong warning  Image is likely spurious result of a bright star diffraction spike */
+  QF_TA   =16384,     /*<  Track artifact                      14 16384  Strong warning  Image is likely spurious result of satellite/'plane/scratch track */
+  QF_ITB  =65536,     /*<  Image touches boundary              16 65536  Severe defect   Image pixels partially missing */
+} QualityFlags;
+
+
+/** compare pair of objects using objID as key */
+static inline int ssa_cmp_objid( const void * p1, const void * p2 )
+{
+  const ssa_detection2 * obj1 = (const ssa_detection2 *) p1;
+  const ssa_detection2 * obj2 = (const ssa_detection2 *) p2;
+
+  if ( obj1->objID < obj2->objID ) {
+    return -1;
+  }
+  if ( obj1->objID > obj2->objID ) {
+    return +1;
+  }
+  return 0;
+}
+
+
+/** lower bound of obj->parentID in objects[] sorted by objID, NULL for parents and undeblended images */
+static inline const ssa_detection2 * ssa_find_parent( const ssa_detection2 * obj,
+    const ssa_detection2 objects[], size_t size )
+{
+  size_t beg = 0, end = size, mid;
+
+  if ( obj->parentID == obj->objID ) {
+    return NULL;
+  }
+
+  while ( beg < end ) {
+    if ( objects[mid = (beg + end) / 2].objID < obj->parentID ) {
+      beg = mid + 1;
+    }
+    else {
+      end = mid;
+    }
+  }
+
+  return beg < size ? &objects[beg] : NULL;
+}
+
+
+/** Sophisticated junk tester. The 'objects' array MUST be sorted using ssa_cmp_objid() comparator */
+static inline int ssa_isjunk( const ssa_detection2 * obj, const ssa_detection2 objects[], size_t size )
+{
+  const ssa_detection2 * parent;
+
+  /* Image is definitely invalid or image pixels partially missing: */
+  if ( (obj->quality & (QF_ITB | QF_ECF)) ) {
+    return 1;
+  }
+
+  /* too faint image */
+  if ( obj->ap3 < 3 || obj->cosmag > -19.5 ) {
+    return 1;
+  }
+
+  /* Failt track artifact but not a very brigt star */
+  if ( obj->class == 1  )
+  {
+    if ( (obj->quality & QF_TA) && !(obj->quality & QF_BI) && obj->ap7 == 0 ) {
+      return 1;
+    }
+
+    /* Track artifact */
+    if ( ((obj->quality & (QF_TA | QF_NVBS)) == (QF_TA | QF_NVBS)) ) {
+      return 1;
+    }
+
+    /* Track artifact */
+    if ( ((obj->quality & (QF_BI | QF_NVBS)) == (QF_BI | QF_NVBS)) ) {
+      if ( (parent = ssa_find_parent(obj, objects, size)) && ( parent->cosmag < -27 ) ) {
+        if ( hypot(parent->xCen - obj->xCen, parent->yCen - obj->yCen) < 650) {
+          return 1;
+        }
+      }
+    }
+  }
+
+  /* faint halo artifacts */
+  if ( (obj->quality & (QF_HA | QF_DSA)) && obj->ap5 == 0 ) {
+    return 1;
+  }
+
+
+  /* bright spike artifacts */
+  if ( (obj->quality & (QF_DSA | QF_NVBS)) == (QF_DSA | QF_NVBS) ) {
+    return 1;
+  }
+
+
+  /* childs of bright parents */
+  if ( ((obj->quality & (QF_NVBS | QF_HA)) == (QF_NVBS | QF_HA)) && (obj->ap4 == 0) ) {
+    return 1;
+  }
+
+  if ( (obj->blend > 0) && (parent = ssa_find_parent(obj, objects, size)) )
+  {
+    if ( parent->cosmag < -27 )
+    {
+      if ( (obj->quality & (QF_NVBS | QF_HA)) && (obj->ap7 == 0) ) {
+        return 1;
+      }
+
+      if ( (obj->ap8 == 0 && hypot(parent->xCen - obj->xCen, parent->yCen - obj->yCen) < 650) ) {
+        return 1;
+      }
+    }
+  }
+
+
+  return 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ssa_junk_h__ */
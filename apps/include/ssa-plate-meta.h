@@ -0,0 +1,279 @@
+/*
+ * ssa-plate-meta.h
+ *
+ *  Local snapshot of the ssa_plates table (see ssa-plates.sql) for per-plate metadata
+ *  lookups without database access. The file is written once by 'ssa-plate-meta export'
+ *  and mmap()-ed by readers: a header followed by fixed size records sorted by plateID.
+ */
+
+#ifndef __ssa_plate_meta_h__
+#define __ssa_plate_meta_h__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** File used if the SSA_PLATE_META environment variable is not set */
+#ifndef SSA_PLATE_META_DEFAULT
+# define SSA_PLATE_META_DEFAULT   "/usr/local/lib/scosmos/ssa-plates.meta"
+#endif
+
+#define SSA_PLATE_META_MAGIC      "SSAPMETA"
+#define SSA_PLATE_META_VERSION    1
+
+
+#pragma pack(push,1)
+/**
+ * Selected columns of ssa_plates
+ */
+typedef
+struct ssa_plate_meta_s {
+  int32_t plateID;    /*<         Unique identifier of the plate */
+  int16_t surveyID;   /*<         Survey of the plate */
+  int32_t fieldID;    /*<         Unique survey field identifier */
+  float   raPnt;      /*< degrees Mean plate centre RA */
+  float   decPnt;     /*< degrees Mean plate centre Dec */
+  float   equinox;    /*< year    Equinox of raPnt and decPnt */
+  float   epoch;      /*< years   Epoch of observation */
+  double  mjd;        /*< days    Modified Julian Date at mid exposure */
+  float   expLength;  /*< minutes Exposure time */
+  float   xPnt;       /*< microns Centre of scan area in X */
+  float   yPnt;       /*< microns Centre of scan area in Y */
+  float   aXmin;      /*< microns XMIN of measured area */
+  float   aXmax;      /*< microns XMAX of measured area */
+  float   aYmin;      /*< microns YMIN of measured area */
+  float   aYmax;      /*< microns YMAX of measured area */
+  double  obsRaPnt;   /*< radians Observed plate centre RA */
+  double  obsDecPnt;  /*< radians Observed plate centre Dec */
+  int32_t objNum;     /*<         No. of objects detected on plate */
+} ssa_plate_meta;
+
+typedef
+struct ssa_plate_meta_header_s {
+  char     magic[8];
+  uint32_t version;
+  uint32_t recsize;
+  uint64_t count;
+} ssa_plate_meta_header;
+#pragma pack(pop)
+
+
+/** ssa_plate_meta fields by ssa_plates column name */
+typedef
+enum ssa_plate_meta_type_t {
+  ssa_plate_meta_int16,
+  ssa_plate_meta_int32,
+  ssa_plate_meta_float4,
+  ssa_plate_meta_float8,
+} ssa_plate_meta_type_t;
+
+typedef
+struct ssa_plate_meta_field_s {
+  const char * name;
+  size_t offset;
+  ssa_plate_meta_type_t type;
+  int deg;            /*< nonzero for angles stored in degrees */
+} ssa_plate_meta_field;
+
+#define SSA_PLATE_META_FIELD(member, type, deg) \
+  { #member, offsetof(ssa_plate_meta, member), ssa_plate_meta_##type, deg }
+
+static const ssa_plate_meta_field ssa_plate_meta_fields[] = {
+  SSA_PLATE_META_FIELD(plateID,   int32,  0),
+  SSA_PLATE_META_FIELD(surveyID,  int16,  0),
+  SSA_PLATE_META_FIELD(fieldID,   int32,  0),
+  SSA_PLATE_META_FIELD(raPnt,     float4, 1),
+  SSA_PLATE_META_FIELD(decPnt,    float4, 1),
+  SSA_PLATE_META_FIELD(equinox,   float4, 0),
+  SSA_PLATE_META_FIELD(epoch,     float4, 0),
+  SSA_PLATE_META_FIELD(mjd,       float8, 0),
+  SSA_PLATE_META_FIELD(expLength, float4, 0),
+  SSA_PLATE_META_FIELD(xPnt,      float4, 0),
+  SSA_PLATE_META_FIELD(yPnt,      float4, 0),
+  SSA_PLATE_META_FIELD(aXmin,     float4, 0),
+  SSA_PLATE_META_FIELD(aXmax,     float4, 0),
+  SSA_PLATE_META_FIELD(aYmin,     float4, 0),
+  SSA_PLATE_META_FIELD(aYmax,     float4, 0),
+  SSA_PLATE_META_FIELD(obsRaPnt,  float8, 0),
+  SSA_PLATE_META_FIELD(obsDecPnt, float8, 0),
+  SSA_PLATE_META_FIELD(objNum,    int32,  0),
+};
+
+#define SSA_PLATE_META_NFIELDS   (sizeof(ssa_plate_meta_fields) / sizeof(ssa_plate_meta_fields[0]))
+
+
+/** field by column name, case insensitive as in SQL; NULL if unknown */
+static inline const ssa_plate_meta_field * ssa_plate_meta_find_field( const char * name )
+{
+  size_t i;
+
+  for ( i = 0; i < SSA_PLATE_META_NFIELDS; ++i ) {
+    if ( strcasecmp(ssa_plate_meta_fields[i].name, name) == 0 ) {
+      return &ssa_plate_meta_fields[i];
+    }
+  }
+
+  return NULL;
+}
+
+/** field value of record as double */
+static inline double ssa_plate_meta_value( const ssa_plate_meta * rec, const ssa_plate_meta_field * field )
+{
+  const uint8_t * p = (const uint8_t *) rec + field->offset;
+  int16_t i16;
+  int32_t i32;
+  float f4;
+  double f8;
+
+  switch ( field->type ) {
+  case ssa_plate_meta_int16:
+    memcpy(&i16, p, sizeof(i16));
+    return i16;
+  case ssa_plate_meta_int32:
+    memcpy(&i32, p, sizeof(i32));
+    return i32;
+  case ssa_plate_meta_float4:
+    memcpy(&f4, p, sizeof(f4));
+    return f4;
+  case ssa_plate_meta_float8:
+    memcpy(&f8, p, sizeof(f8));
+    return f8;
+  }
+
+  return 0;
+}
+
+
+/** mmap()-ed snapshot */
+typedef
+struct ssa_plate_meta_db_s {
+  void * map;
+  size_t mapsize;
+  const ssa_plate_meta * recs;
+  size_t count;
+  dev_t dev;
+  ino_t ino;
+  time_t mtime;
+} ssa_plate_meta_db;
+
+
+/** snapshot file name: SSA_PLATE_META environment variable or SSA_PLATE_META_DEFAULT */
+static inline const char * ssa_plate_meta_path( void )
+{
+  const char * path = getenv("SSA_PLATE_META");
+  return path && *path ? path : SSA_PLATE_META_DEFAULT;
+}
+
+/** maps snapshot file (NULL for ssa_plate_meta_path()), returns NULL with errno set on error */
+static inline ssa_plate_meta_db * ssa_plate_meta_open( const char * fname )
+{
+  ssa_plate_meta_db * db = NULL;
+  const ssa_plate_meta_header * hdr;
+  struct stat st;
+  void * map;
+  int fd;
+
+  if ( !fname ) {
+    fname = ssa_plate_meta_path();
+  }
+
+  if ( (fd = open(fname, O_RDONLY)) == -1 ) {
+    return NULL;
+  }
+
+  if ( fstat(fd, &st) == -1 ) {
+    close(fd);
+    return NULL;
+  }
+
+  if ( (size_t) st.st_size < sizeof(*hdr) ) {
+    close(fd);
+    errno = EINVAL;
+    return NULL;
+  }
+
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if ( map == MAP_FAILED ) {
+    return NULL;
+  }
+
+  hdr = (const ssa_plate_meta_header *) map;
+
+  if ( memcmp(hdr->magic, SSA_PLATE_META_MAGIC, sizeof(hdr->magic)) != 0 || hdr->version != SSA_PLATE_META_VERSION
+      || hdr->recsize != sizeof(ssa_plate_meta) || sizeof(*hdr) + hdr->count * sizeof(ssa_plate_meta) > (size_t) st.st_size ) {
+    munmap(map, st.st_size);
+    errno = EINVAL;
+    return NULL;
+  }
+
+  if ( !(db = (ssa_plate_meta_db *) calloc(1, sizeof(*db))) ) {
+    munmap(map, st.st_size);
+    return NULL;
+  }
+
+  db->map = map;
+  db->mapsize = st.st_size;
+  db->recs = (const ssa_plate_meta *) (hdr + 1);
+  db->count = hdr->count;
+  db->dev = st.st_dev;
+  db->ino = st.st_ino;
+  db->mtime = st.st_mtime;
+
+  return db;
+}
+
+static inline void ssa_plate_meta_close( ssa_plate_meta_db * db )
+{
+  if ( db ) {
+    munmap(db->map, db->mapsize);
+    free(db);
+  }
+}
+
+/** nonzero if the snapshot file was replaced since ssa_plate_meta_open() */
+static inline int ssa_plate_meta_changed( const ssa_plate_meta_db * db, const char * fname )
+{
+  struct stat st;
+
+  if ( stat(fname ? fname : ssa_plate_meta_path(), &st) == -1 ) {
+    return 1;
+  }
+
+  return st.st_dev != db->dev || st.st_ino != db->ino || st.st_mtime != db->mtime;
+}
+
+/** record of plateid (binary search), NULL if not found */
+static inline const ssa_plate_meta * ssa_plate_meta_lookup( const ssa_plate_meta_db * db, int32_t plateid )
+{
+  size_t beg = 0, end = db->count, mid;
+
+  while ( beg < end ) {
+    if ( db->recs[mid = (beg + end) / 2].plateID < plateid ) {
+      beg = mid + 1;
+    }
+    else {
+      end = mid;
+    }
+  }
+
+  return beg < db->count && db->recs[beg].plateID == plateid ? &db->recs[beg] : NULL;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ssa_plate_meta_h__ */
@@ -0,0 +1,366 @@
+/*
+ * ssa-refcat.h
+ *
+ *  Local reference catalog store written by 'ssa-refcat import': a single file with
+ *  fixed size records partitioned into HEALPix NESTED tiles (healpix.h) and sorted by Dec
+ *  inside each tile. Readers mmap() the file and visit only the records of the tiles whose
+ *  bounding caps overlap the requested cone.
+ *
+ *  Layout:
+ *    ssa_refcat_header
+ *    ssa_refcat_column [ncols]
+ *    records           [nrecs]  recsize bytes each, ra and dec (radians, float8) first
+ *    ssa_refcat_tile   [ntiles] non-empty tiles in pixel order
+ */
+
+#ifndef __ssa_refcat_h__
+#define __ssa_refcat_h__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <math.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Catalog directory used if the SSA_REFCAT environment variable is not set */
+#ifndef SSA_REFCAT_DEFAULT
+# define SSA_REFCAT_DEFAULT     "/usr/local/lib/scosmos/refcat"
+#endif
+
+#define SSA_REFCAT_SUFFIX       ".rcat"
+#define SSA_REFCAT_MAGIC        "SSARCAT"
+#define SSA_REFCAT_VERSION      1
+#define SSA_REFCAT_NAME_MAX     32
+
+/** NULL values of integer columns, NULL floats are NaN */
+#define SSA_REFCAT_NULL_INT2    INT16_MIN
+#define SSA_REFCAT_NULL_INT4    INT32_MIN
+#define SSA_REFCAT_NULL_INT8    INT64_MIN
+
+
+/** column storage types, named as PostgreSQL ones */
+typedef
+enum ssa_refcat_type_t {
+  ssa_refcat_int2,
+  ssa_refcat_int4,
+  ssa_refcat_int8,
+  ssa_refcat_float4,
+  ssa_refcat_float8,
+} ssa_refcat_type_t;
+
+
+#pragma pack(push,1)
+typedef
+struct ssa_refcat_header_s {
+  char     magic[8];
+  uint32_t version;
+  uint32_t order;         /*< HEALPix order of tiles */
+  uint32_t ncols;
+  uint32_t recsize;
+  uint64_t nrecs;
+  uint64_t ntiles;
+  uint64_t data_offset;
+  uint64_t tiles_offset;
+} ssa_refcat_header;
+
+typedef
+struct ssa_refcat_column_s {
+  char     name[SSA_REFCAT_NAME_MAX];
+  uint32_t type;          /*< ssa_refcat_type_t */
+  uint32_t offset;        /*< in record */
+} ssa_refcat_column;
+
+typedef
+struct ssa_refcat_tile_s {
+  int64_t  pix;           /*< NESTED pixel number */
+  uint64_t first;         /*< index of the first record */
+  uint64_t count;
+  double   cx, cy, cz;    /*< unit vector of bounding cap centre */
+  double   radius;        /*< bounding cap radius, radians */
+} ssa_refcat_tile;
+#pragma pack(pop)
+
+
+/** type size in bytes */
+static inline size_t ssa_refcat_type_size( ssa_refcat_type_t type )
+{
+  switch ( type ) {
+  case ssa_refcat_int2:
+    return 2;
+  case ssa_refcat_int4:
+  case ssa_refcat_float4:
+    return 4;
+  case ssa_refcat_int8:
+  case ssa_refcat_float8:
+    return 8;
+  }
+  return 0;
+}
+
+/** type by name (int2, int4, int8, float4, float8, or smallint, int, bigint, real, double), -1 if unknown */
+static inline int ssa_refcat_type_by_name( const char * name )
+{
+  static const struct {
+    const char * name;
+    ssa_refcat_type_t type;
+  } types[] = {
+    { "int2", ssa_refcat_int2 },
+    { "smallint", ssa_refcat_int2 },
+    { "int4", ssa_refcat_int4 },
+    { "int", ssa_refcat_int4 },
+    { "int8", ssa_refcat_int8 },
+    { "bigint", ssa_refcat_int8 },
+    { "float4", ssa_refcat_float4 },
+    { "real", ssa_refcat_float4 },
+    { "float8", ssa_refcat_float8 },
+    { "double", ssa_refcat_float8 },
+  };
+
+  size_t i;
+
+  for ( i = 0; i < sizeof(types) / sizeof(types[0]); ++i ) {
+    if ( strcmp(types[i].name, name) == 0 ) {
+      return types[i].type;
+    }
+  }
+
+  return -1;
+}
+
+static inline const char * ssa_refcat_type_name( ssa_refcat_type_t type )
+{
+  static const char * names[] = { "int2", "int4", "int8", "float4", "float8" };
+  return (unsigned) type < sizeof(names) / sizeof(names[0]) ? names[type] : "?";
+}
+
+/** column value of record as double, NaN for NULL */
+static inline double ssa_refcat_value( const void * rec, const ssa_refcat_column * col )
+{
+  const uint8_t * p = (const uint8_t *) rec + col->offset;
+  int16_t i2;
+  int32_t i4;
+  int64_t i8;
+  float f4;
+  double f8;
+
+  switch ( col->type ) {
+  case ssa_refcat_int2:
+    memcpy(&i2, p, sizeof(i2));
+    return i2 == SSA_REFCAT_NULL_INT2 ? NAN : i2;
+  case ssa_refcat_int4:
+    memcpy(&i4, p, sizeof(i4));
+    return i4 == SSA_REFCAT_NULL_INT4 ? NAN : i4;
+  case ssa_refcat_int8:
+    memcpy(&i8, p, sizeof(i8));
+    return i8 == SSA_REFCAT_NULL_INT8 ? NAN : (double) i8;
+  case ssa_refcat_float4:
+    memcpy(&f4, p, sizeof(f4));
+    return f4;
+  case ssa_refcat_float8:
+    memcpy(&f8, p, sizeof(f8));
+    return f8;
+  }
+
+  return 0;
+}
+
+/** ra and dec of record, radians */
+static inline void ssa_refcat_radec( const void * rec, double * ra, double * dec )
+{
+  memcpy(ra, rec, sizeof(*ra));
+  memcpy(dec, (const uint8_t *) rec + sizeof(*ra), sizeof(*dec));
+}
+
+
+/** mmap()-ed catalog */
+typedef
+struct ssa_refcat_s {
+  void * map;
+  size_t mapsize;
+  const ssa_refcat_header * hdr;
+  const ssa_refcat_column * cols;
+  const ssa_refcat_tile * tiles;
+  const uint8_t * data;
+} ssa_refcat;
+
+
+/**
+ * Catalog file name of catalog name or path: names without '/' are looked up as
+ *  $SSA_REFCAT/<name>.rcat (SSA_REFCAT_DEFAULT if not set)
+ */
+static inline const char * ssa_refcat_path( const char * name, char * path, size_t size )
+{
+  const char * dir;
+
+  if ( strchr(name, '/') ) {
+    snprintf(path, size, "%s", name);
+  }
+  else {
+    if ( !(dir = getenv("SSA_REFCAT")) || !*dir ) {
+      dir = SSA_REFCAT_DEFAULT;
+    }
+    snprintf(path, size, "%s/%s%s", dir, name, SSA_REFCAT_SUFFIX);
+  }
+
+  return path;
+}
+
+/** maps catalog file, returns NULL with errno set on error */
+static inline ssa_refcat * ssa_refcat_open( const char * fname )
+{
+  ssa_refcat * cat = NULL;
+  const ssa_refcat_header * hdr;
+  struct stat st;
+  void * map;
+  int fd;
+
+  if ( (fd = open(fname, O_RDONLY)) == -1 ) {
+    return NULL;
+  }
+
+  if ( fstat(fd, &st) == -1 ) {
+    close(fd);
+    return NULL;
+  }
+
+  if ( (size_t) st.st_size < sizeof(*hdr) ) {
+    close(fd);
+    errno = EINVAL;
+    return NULL;
+  }
+
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if ( map == MAP_FAILED ) {
+    return NULL;
+  }
+
+  hdr = (const ssa_refcat_header *) map;
+
+  if ( memcmp(hdr->magic, SSA_REFCAT_MAGIC, sizeof(SSA_REFCAT_MAGIC)) != 0 || hdr->version != SSA_REFCAT_VERSION
+      || hdr->ncols < 2 || hdr->recsize < 2 * sizeof(double)
+      || sizeof(*hdr) + hdr->ncols * sizeof(ssa_refcat_column) > hdr->data_offset
+      || hdr->data_offset + hdr->nrecs * hdr->recsize > hdr->tiles_offset
+      || hdr->tiles_offset + hdr->ntiles * sizeof(ssa_refcat_tile) > (size_t) st.st_size ) {
+    munmap(map, st.st_size);
+    errno = EINVAL;
+    return NULL;
+  }
+
+  if ( !(cat = (ssa_refcat *) calloc(1, sizeof(*cat))) ) {
+    munmap(map, st.st_size);
+    return NULL;
+  }
+
+  cat->map = map;
+  cat->mapsize = st.st_size;
+  cat->hdr = hdr;
+  cat->cols = (const ssa_refcat_column *) (hdr + 1);
+  cat->tiles = (const ssa_refcat_tile *) ((const uint8_t *) map + hdr->tiles_offset);
+  cat->data = (const uint8_t *) map + hdr->data_offset;
+
+  return cat;
+}
+
+static inline void ssa_refcat_close( ssa_refcat * cat )
+{
+  if ( cat ) {
+    munmap(cat->map, cat->mapsize);
+    free(cat);
+  }
+}
+
+/** column index by name, -1 if not found */
+static inline int ssa_refcat_find_column( const ssa_refcat * cat, const char * name )
+{
+  uint32_t i;
+
+  for ( i = 0; i < cat->hdr->ncols; ++i ) {
+    if ( strncmp(cat->cols[i].name, name, SSA_REFCAT_NAME_MAX) == 0 ) {
+      return (int) i;
+    }
+  }
+
+  return -1;
+}
+
+/** record by index */
+static inline const void * ssa_refcat_record( const ssa_refcat * cat, uint64_t i )
+{
+  return cat->data + i * cat->hdr->recsize;
+}
+
+
+/**
+ * Calls fn(rec, arg) for every record within radius (radians) of (ra, dec);
+ *  tiles whose bounding caps do not overlap the cone are not touched.
+ *  Stops and returns the first nonzero value returned by fn, 0 otherwise.
+ */
+static inline int ssa_refcat_cone( const ssa_refcat * cat, double ra, double dec, double radius,
+    int (*fn)(const void * rec, void * arg), void * arg )
+{
+  const double cx = cos(dec) * cos(ra), cy = cos(dec) * sin(ra), cz = sin(dec);
+  const double cosr = cos(radius);
+  const size_t recsize = cat->hdr->recsize;
+  uint64_t t, beg, end, mid;
+  double d, r, rdec;
+  int status;
+
+  for ( t = 0; t < cat->hdr->ntiles; ++t )
+  {
+    const ssa_refcat_tile * tile = &cat->tiles[t];
+
+    /* angle between cone and tile cap centres, with margin for rounding */
+    d = acos(fmax(-1, fmin(1, cx * tile->cx + cy * tile->cy + cz * tile->cz)));
+    if ( d > radius + tile->radius + 1e-9 ) {
+      continue;
+    }
+
+    /* first record with dec >= dec - radius */
+    beg = tile->first;
+    end = tile->first + tile->count;
+    while ( beg < end ) {
+      ssa_refcat_radec(cat->data + (mid = (beg + end) / 2) * recsize, &r, &rdec);
+      if ( rdec < dec - radius ) {
+        beg = mid + 1;
+      }
+      else {
+        end = mid;
+      }
+    }
+
+    for ( end = tile->first + tile->count; beg < end; ++beg )
+    {
+      const void * rec = cat->data + beg * recsize;
+
+      ssa_refcat_radec(rec, &r, &rdec);
+
+      if ( rdec > dec + radius ) {
+        break;
+      }
+
+      if ( cos(rdec) * (cx * cos(r) + cy * sin(r)) + cz * sin(rdec) >= cosr && (status = fn(rec, arg)) ) {
+        return status;
+      }
+    }
+  }
+
+  return 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ssa_refcat_h__ */
@@ -0,0 +1,665 @@
+/*
+ * ogm-fit.c
+ *
+ *  Streamed linear least-squares fit of TSV columns,
+ *  the C counterpart of lib/scripts/scosmos-linear-regression.
+ *
+ *  Rows are parsed and accumulated into libogm normal equations on the fly,
+ *  so the memory use does not depend on the number of rows.
+ *  K-sigma passes re-read the input when it is seekable;
+ *  for pipes the rows are retained in memory and clipped by ogm_solve_kclip().
+ */
+
+#define _FILE_OFFSET_BITS 64
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "libogm.h"
+
+/** Rows per block passed to ogm_solver_append_block() */
+#define FIT_BLOCK_ROWS  1024
+
+/** Max number of input columns */
+#define MAX_COLUMNS     1024
+
+
+/** Input description */
+typedef
+struct fit_input {
+  FILE * fp;
+  const char * fname;
+  off_t body;             /*< offset of the first data row, -1 if not seekable */
+  int binary;             /*< body is raw native doubles, nc per row */
+  int nc;                 /*< number of input columns */
+  char * names[MAX_COLUMNS];
+  int slot[MAX_COLUMNS];  /*< input column -> regressor index, nx for target, -1 if unused */
+  int nx;                 /*< number of regressors */
+  int Z;                  /*< no zero point term */
+} fit_input;
+
+/** Previous passes rejecting rows of the current one */
+typedef
+struct fit_filter {
+  int npass;
+  const double * p;       /*< solutions of previous passes, np each */
+  const double * thr;     /*< K * sigma of previous passes */
+} fit_filter;
+
+
+static void show_usage( FILE * stream )
+{
+  fprintf(stream, "ogm-fit\n");
+  fprintf(stream, "  Streamed linear reduction of data in TSV columns\n");
+  fprintf(stream, "  By default beginning columns are arguments (factors), last column is target to be approximated.\n");
+  fprintf(stream, "\n");
+  fprintf(stream, "Usage:\n");
+  fprintf(stream, "  ogm-fit [OPTIONS] [FILE]\n");
+  fprintf(stream, "\n");
+  fprintf(stream, "OPTIONS:\n");
+  fprintf(stream, " -x {c1,c2,...} : names of argument columns, default all columns but target\n");
+  fprintf(stream, " -y {c}    : name of target column, default last column\n");
+  fprintf(stream, " -bin      : the header line is followed by raw native doubles, one per column, row by row\n");
+  fprintf(stream, " -v        : print some diagnostic to stderr\n");
+  fprintf(stream, " -K {K}    : drop large residuals above K*sigma (implies K>0 and NP>0)\n");
+  fprintf(stream, " -NP {NP}  : max number of passes while dropping large residuals. Set NP=0 or K=0 to disable dropping\n");
+  fprintf(stream, " -Z        : force zero point\n");
+  fprintf(stream, " -opt      : output solution in tsv (usefull for batch processing)\n");
+  fprintf(stream, " -oet      : output solution errors in tsv\n");
+  fprintf(stream, " -ost      : output final stddev in tsv\n");
+  fprintf(stream, " -ofn      : output solution as function definition\n");
+  fprintf(stream, " -opo      : output solution as octave vector\n");
+  fprintf(stream, " -oeo      : output solution errors as octave vector\n");
+  fprintf(stream, " -os       : output final stddev\n");
+  fprintf(stream, "\n");
+  fprintf(stream, " FILE      : input TSV file with header.\n");
+  fprintf(stream, "  If no input FILE given then stdin is assumed\n");
+  fprintf(stream, "\n");
+  fprintf(stream, "Example:\n");
+  fprintf(stream, "  ssa-detection-dump ... | ogm-fit -x xi,eta -y dmag -K 3 -NP 5 -opt -ost\n");
+  fprintf(stream, "\n");
+}
+
+/* strip leading and trailing white spaces in place */
+static char * strtrim( char * s )
+{
+  char * e;
+
+  while ( *s == ' ' || *s == '\t' || *s == '\r' || *s == '\n' ) {
+    ++s;
+  }
+  for ( e = s + strlen(s); e > s && (e[-1] == ' ' || e[-1] == '\t' || e[-1] == '\r' || e[-1] == '\n'); ) {
+    *--e = 0;
+  }
+
+  return s;
+}
+
+static int find_column( const fit_input * in, const char * name )
+{
+  int i;
+  for ( i = 0; i < in->nc; ++i ) {
+    if ( strcmp(in->names[i], name) == 0 ) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/**
+ * Read the header, select columns and remember where the data rows begin
+ */
+static int open_input( fit_input * in, const char * xnames, const char * yname )
+{
+  char * line = NULL, * s, * tok;
+  size_t size = 0;
+  struct stat st;
+  int i, c, ty;
+
+  if ( getline(&line, &size, in->fp) < 1 ) {
+    fprintf(stderr, "ogm-fit: can not read header line from %s\n", in->fname);
+    free(line);
+    return -1;
+  }
+
+  for ( s = line, in->nc = 0; (tok = strsep(&s, "\t")) != NULL; ) {
+    if ( in->nc == MAX_COLUMNS ) {
+      fprintf(stderr, "ogm-fit: too many columns, max %d supported\n", MAX_COLUMNS);
+      free(line);
+      return -1;
+    }
+    in->names[in->nc++] = strdup(strtrim(tok));
+  }
+
+  free(line);
+
+  for ( i = 0; i < in->nc; ++i ) {
+    in->slot[i] = -1;
+  }
+
+  if ( !yname ) {
+    ty = in->nc - 1;
+  }
+  else if ( (ty = find_column(in, yname)) < 0 ) {
+    fprintf(stderr, "ogm-fit: target column '%s' not found in header\n", yname);
+    return -1;
+  }
+
+  in->nx = 0;
+
+  if ( !xnames ) {
+    for ( i = 0; i < in->nc; ++i ) {
+      if ( i != ty ) {
+        in->slot[i] = in->nx++;
+      }
+    }
+  }
+  else {
+    char * list = strdup(xnames);
+    for ( s = list; (tok = strsep(&s, ",")) != NULL; ) {
+      if ( (c = find_column(in, strtrim(tok))) < 0 ) {
+        fprintf(stderr, "ogm-fit: argument column '%s' not found in header\n", tok);
+        free(list);
+        return -1;
+      }
+      if ( c == ty || in->slot[c] >= 0 ) {
+        fprintf(stderr, "ogm-fit: column '%s' is used twice\n", tok);
+        free(list);
+        return -1;
+      }
+      in->slot[c] = in->nx++;
+    }
+    free(list);
+  }
+
+  if ( in->nx + !in->Z < 1 ) {
+    fprintf(stderr, "ogm-fit: nothing to fit, no argument columns\n");
+    return -1;
+  }
+
+  in->slot[ty] = in->nx;
+
+  in->body = -1;
+  if ( fstat(fileno(in->fp), &st) == 0 && S_ISREG(st.st_mode) ) {
+    in->body = ftello(in->fp);
+  }
+
+  return 0;
+}
+
+/**
+ * Parse one TSV line into v[nx + 1] (regressors then target)
+ */
+static int parse_line( const fit_input * in, char * line, double v[] )
+{
+  char * s = line, * e;
+  int c, k, n = 0;
+
+  for ( c = 0; c < in->nc; ++c )
+  {
+    if ( (k = in->slot[c]) >= 0 ) {
+      /* strtod() skips leading whitespace including the delimiter,
+       * so an empty field would silently read the next column */
+      if ( *s == '\t' || *s == '\n' || *s == '\r' || *s == 0 ) {
+        return -1;
+      }
+      v[k] = strtod(s, &e);
+      if ( e == s || memchr(s, '\t', e - s) ) {
+        return -1;
+      }
+      ++n;
+      s = e;
+    }
+
+    if ( n == in->nx + 1 ) {
+      return 0;
+    }
+
+    if ( !(s = strchr(s, '\t')) ) {
+      return -1;
+    }
+    ++s;
+  }
+
+  return -1;
+}
+
+/**
+ * Read next row into v[nx + 1]: 1 on success, 0 on end of input, -1 on error
+ */
+static int read_row( const fit_input * in, char ** line, size_t * size, size_t * lineno, double v[] )
+{
+  ssize_t len;
+
+  if ( in->binary ) {
+    double r[in->nc];
+    int c;
+
+    if ( fread(r, sizeof(*r), in->nc, in->fp) != (size_t) in->nc ) {
+      return ferror(in->fp) ? -1 : 0;
+    }
+    for ( c = 0; c < in->nc; ++c ) {
+      if ( in->slot[c] >= 0 ) {
+        v[in->slot[c]] = r[c];
+      }
+    }
+    ++*lineno;
+    return 1;
+  }
+
+  while ( (len = getline(line, size, in->fp)) > 0 )
+  {
+    ++*lineno;
+
+    if ( (*line)[0] == '\n' || ((*line)[0] == '\r' && (*line)[1] == '\n') ) {
+      continue; /* empty lines */
+    }
+
+    if ( parse_line(in, *line, v) != 0 ) {
+      fprintf(stderr, "ogm-fit: syntax error in %s line %zu\n", in->fname, *lineno + 1);
+      return -1;
+    }
+
+    return 1;
+  }
+
+  return ferror(in->fp) ? -1 : 0;
+}
+
+static double residual( size_t np, const double a[], double y, const double p[] )
+{
+  size_t j;
+  for ( j = 0; j < np; ++j ) {
+    y -= a[j] * p[j];
+  }
+  return y;
+}
+
+/**
+ * One pass over the input: accumulate the rows passing the filter into ctx.
+ *  *nrej receives the number of rows dropped by the last pass of the filter.
+ */
+static int feed( const fit_input * in, ogmctx_t * ctx, const fit_filter * f, size_t * nrej )
+{
+  const size_t np = in->nx + !in->Z;
+  const size_t nv = in->nx + 1;
+  double * a, * y;
+  double v[nv];
+  char * line = NULL;
+  size_t size = 0, lineno = 0, m = 0;
+  int status, q, keep;
+
+  *nrej = 0;
+
+  if ( !(a = malloc(FIT_BLOCK_ROWS * (np + 1) * sizeof(*a))) ) {
+    fprintf(stderr, "ogm-fit: malloc() fails\n");
+    return -1;
+  }
+  y = a + FIT_BLOCK_ROWS * np;
+
+  while ( (status = read_row(in, &line, &size, &lineno, v)) > 0 )
+  {
+    double * ak = a + m * np;
+
+    if ( !in->Z ) {
+      *ak++ = 1;
+    }
+    memcpy(ak, v, in->nx * sizeof(*v));
+
+    for ( keep = 1, q = 0; q < f->npass && keep; ++q ) {
+      if ( !(fabs(residual(np, a + m * np, v[in->nx], f->p + q * np)) < f->thr[q]) ) {
+        keep = 0;
+        if ( q == f->npass - 1 ) {
+          ++*nrej;
+        }
+      }
+    }
+
+    if ( !keep ) {
+      continue;
+    }
+
+    y[m] = v[in->nx];
+
+    if ( ++m == FIT_BLOCK_ROWS ) {
+      if ( (status = ogm_solver_append_block(ctx, a, y, m, OGM_ROW_MAJOR)) ) {
+        fprintf(stderr, "ogm-fit: ogm_solver_append_block() fails: status=%d\n", status);
+        free(line);
+        free(a);
+        return -1;
+      }
+      m = 0;
+    }
+  }
+
+  free(line);
+
+  if ( status < 0 ) {
+    if ( ferror(in->fp) ) {
+      fprintf(stderr, "ogm-fit: read error on %s: %s\n", in->fname, strerror(errno));
+    }
+  }
+  else if ( m > 0 && (status = ogm_solver_append_block(ctx, a, y, m, OGM_ROW_MAJOR)) ) {
+    fprintf(stderr, "ogm-fit: ogm_solver_append_block() fails: status=%d\n", status);
+    status = -1;
+  }
+
+  free(a);
+
+  return status < 0 ? -1 : 0;
+}
+
+/**
+ * K-sigma passes by re-reading seekable input: a row is kept in pass p
+ *  if its residuals of all previous passes are below their K*sigma,
+ *  the same as the row subsetting of scosmos-linear-regression.
+ */
+static int fit_seekable( fit_input * in, double K, int NP, int verb, double P[], double E[], double * sigma )
+{
+  const size_t np = in->nx + !in->Z;
+  double p[NP * np], thr[NP];
+  fit_filter f = { 0, p, thr };
+  ogmctx_t * ctx = NULL;
+  size_t nrej;
+  double s2;
+  int pass, status;
+
+  for ( pass = 1; pass <= NP; ++pass )
+  {
+    if ( !(ctx = ogm_solver_create(np)) ) {
+      fprintf(stderr, "ogm-fit: ogm_solver_create(%zu) fails\n", np);
+      return -1;
+    }
+
+    if ( pass > 1 && fseeko(in->fp, in->body, SEEK_SET) != 0 ) {
+      fprintf(stderr, "ogm-fit: fseeko(%s) fails: %s\n", in->fname, strerror(errno));
+      ogm_solver_destroy(ctx);
+      return -1;
+    }
+
+    if ( feed(in, ctx, &f, &nrej) != 0 ) {
+      ogm_solver_destroy(ctx);
+      return -1;
+    }
+
+    /* nothing dropped: the previous solution is final */
+    if ( pass > 1 && nrej == 0 ) {
+      ogm_solver_destroy(ctx);
+      break;
+    }
+
+    if ( (status = ogm_solve(ctx, P, E, NULL, NULL, &s2)) ) {
+      fprintf(stderr, "ogm-fit: ogm_solve() fails: status=%d N=%zu\n", status, ogm_solver_get_n(ctx));
+      ogm_solver_destroy(ctx);
+      return -1;
+    }
+
+    *sigma = sqrt(s2);
+
+    if ( verb ) {
+      fprintf(stderr, "sigma:%g N=%zu\n", *sigma, ogm_solver_get_n(ctx));
+    }
+
+    ogm_solver_destroy(ctx);
+
+    /* exact fit has nothing to clip */
+    if ( K <= 0 || *sigma == 0 ) {
+      break;
+    }
+
+    memcpy(p + f.npass * np, P, np * sizeof(*P));
+    thr[f.npass++] = K * *sigma;
+  }
+
+  return 0;
+}
+
+/**
+ * Single read of non-seekable input, rows retained for ogm_solve_kclip()
+ */
+static int fit_stream( fit_input * in, double K, int NP, int verb, double P[], double E[], double * sigma )
+{
+  const size_t np = in->nx + !in->Z;
+  const fit_filter f = { 0, NULL, NULL };
+  ogmctx_t * ctx;
+  size_t nrej;
+  double s2;
+  int status, passes = 1;
+
+  if ( !(ctx = ogm_solver_create_ex(np, 1, K > 0 && NP > 1 ? OGM_RETAIN_ROWS : 0)) ) {
+    fprintf(stderr, "ogm-fit: ogm_solver_create_ex(%zu) fails\n", np);
+    return -1;
+  }
+
+  if ( feed(in, ctx, &f, &nrej) != 0 ) {
+    ogm_solver_destroy(ctx);
+    return -1;
+  }
+
+  if ( K > 0 && NP > 1 ) {
+    status = ogm_solve_kclip(ctx, K, NP, P, E, NULL, NULL, &s2, &passes);
+  }
+  else {
+    status = ogm_solve(ctx, P, E, NULL, NULL, &s2);
+  }
+
+  if ( status ) {
+    fprintf(stderr, "ogm-fit: solve fails: status=%d N=%zu\n", status, ogm_solver_get_n(ctx));
+    ogm_solver_destroy(ctx);
+    return -1;
+  }
+
+  *sigma = sqrt(s2);
+
+  if ( verb ) {
+    fprintf(stderr, "sigma:%g N=%zu passes=%d\n", *sigma, ogm_solver_get_n(ctx), passes);
+  }
+
+  ogm_solver_destroy(ctx);
+
+  return 0;
+}
+
+
+int main( int argc, char * argv[] )
+{
+  fit_input in;
+  const char * xnames = NULL, * yname = NULL;
+  double K = 3, sigma = 0;
+  int NP = 2, verb = 0;
+  int opt = 0, oet = 0, ofn = 0, opo = 0, oeo = 0, os = 0, ost = 0;
+  size_t np, i;
+  int a, c, status;
+
+  memset(&in, 0, sizeof(in));
+  in.fp = stdin;
+  in.fname = "stdin";
+
+  for ( a = 1; a < argc; ++a )
+  {
+    if ( strcmp(argv[a], "-help") == 0 || strcmp(argv[a], "--help") == 0 ) {
+      show_usage(stdout);
+      return 0;
+    }
+
+    if ( strcmp(argv[a], "-K") == 0 || strcmp(argv[a], "-NP") == 0 || strcmp(argv[a], "-x") == 0
+        || strcmp(argv[a], "-y") == 0 ) {
+
+      if ( a + 1 >= argc ) {
+        fprintf(stderr, "Missing argument after %s switch\n", argv[a]);
+        show_usage(stderr);
+        return 1;
+      }
+
+      if ( strcmp(argv[a], "-x") == 0 ) {
+        xnames = argv[++a];
+      }
+      else if ( strcmp(argv[a], "-y") == 0 ) {
+        yname = argv[++a];
+      }
+      else if ( strcmp(argv[a], "-K") == 0 ? sscanf(argv[a + 1], "%lf", &K) != 1 :
+          sscanf(argv[a + 1], "%d", &NP) != 1 ) {
+        fprintf(stderr, "Syntax error in argument: %s\n", argv[a + 1]);
+        show_usage(stderr);
+        return 1;
+      }
+      else {
+        ++a;
+      }
+    }
+    else if ( strcmp(argv[a], "-bin") == 0 ) {
+      in.binary = 1;
+    }
+    else if ( strcmp(argv[a], "-v") == 0 ) {
+      verb = 1;
+    }
+    else if ( strcmp(argv[a], "-Z") == 0 ) {
+      in.Z = 1;
+    }
+    else if ( strcmp(argv[a], "-opt") == 0 ) {
+      opt = 1;
+    }
+    else if ( strcmp(argv[a], "-oet") == 0 ) {
+      oet = 1;
+    }
+    else if ( strcmp(argv[a], "-ofn") == 0 ) {
+      ofn = 1;
+    }
+    else if ( strcmp(argv[a], "-opo") == 0 ) {
+      opo = 1;
+    }
+    else if ( strcmp(argv[a], "-oeo") == 0 ) {
+      oeo = 1;
+    }
+    else if ( strcmp(argv[a], "-ost") == 0 ) {
+      ost = 1;
+    }
+    else if ( strcmp(argv[a], "-os") == 0 ) {
+      os = 1;
+    }
+    else if ( in.fp == stdin ) {
+      if ( !(in.fp = fopen(in.fname = argv[a], "r")) ) {
+        fprintf(stderr, "Can not read %s: %s\n", argv[a], strerror(errno));
+        return 1;
+      }
+    }
+    else {
+      fprintf(stderr, "Invalid argument: %s\n", argv[a]);
+      show_usage(stderr);
+      return 1;
+    }
+  }
+
+  if ( !opt && !ofn && !opo && !oeo ) {
+    opo = 1;
+  }
+
+  if ( NP < 1 ) {
+    NP = 1;
+  }
+
+  setvbuf(in.fp, NULL, _IOFBF, 1 << 20);
+
+  if ( open_input(&in, xnames, yname) != 0 ) {
+    return 1;
+  }
+
+  np = in.nx + !in.Z;
+
+  double P[np], E[np];
+
+  if ( in.body >= 0 ) {
+    status = fit_seekable(&in, K, NP, verb, P, E, &sigma);
+  }
+  else {
+    status = fit_stream(&in, K, NP, verb, P, E, &sigma);
+  }
+
+  if ( in.fp != stdin ) {
+    fclose(in.fp);
+  }
+
+  if ( status != 0 ) {
+    return 1;
+  }
+
+  /* Apply requested output formatings */
+
+  if ( opt ) {
+    for ( i = 0; i + 1 < np; ++i ) {
+      printf("%+g\t", P[i]);
+    }
+    printf("%+g", P[np - 1]);
+    printf(oet || ost ? "\t" : "\n");
+  }
+
+  if ( ost ) {
+    printf("%+g", sigma);
+    printf(oet ? "\t" : "\n");
+  }
+
+  if ( oet ) {
+    for ( i = 0; i + 1 < np; ++i ) {
+      printf("%+g\t", E[i]);
+    }
+    printf("%+g\n", E[np - 1]);
+  }
+
+  if ( opo ) {
+    printf("P = [\n");
+    for ( i = 0; i < np; ++i ) {
+      printf("%+g\n", P[i]);
+    }
+    printf("]\n");
+  }
+
+  if ( oeo ) {
+    printf("E = [\n");
+    for ( i = 0; i < np; ++i ) {
+      printf("%+g\n", E[i]);
+    }
+    printf("]\n");
+  }
+
+  if ( os ) {
+    printf("S = %+g\n", sigma);
+  }
+
+  if ( ofn ) {
+    const char * x[in.nx];
+    const char * y = NULL;
+
+    for ( c = 0; c < in.nc; ++c ) {
+      if ( in.slot[c] == in.nx ) {
+        y = in.names[c];
+      }
+      else if ( in.slot[c] >= 0 ) {
+        x[in.slot[c]] = in.names[c];
+      }
+    }
+
+    printf("%s(", y);
+    for ( c = 0; c < in.nx; ++c ) {
+      printf(c + 1 < in.nx ? "%s," : "%s", x[c]);
+    }
+    printf(") = ");
+
+    if ( !in.Z ) {
+      printf("%+.6f", P[0]);
+    }
+    for ( c = 0; c < in.nx; ++c ) {
+      printf(" %+.6f*%s", P[c + !in.Z], x[c]);
+    }
+    printf("\n");
+  }
+
+  for ( c = 0; c < in.nc; ++c ) {
+    free(in.names[c]);
+  }
+
+  return 0;
+}
@@ -13,7 +13,9 @@
 #include <errno.h>
 #include <math.h>
 #include <unistd.h>
-#include "ccarray.h"
+#include <stddef.h>
+#include "ccarray-psort.h"
+#include "popen-decompress.h"
 
 #define UNUSED(x)               ((void)(x))
 #define MAX_HEADER_LENGTH       2048
@@ -64,7 +66,6 @@ struct pair_t {
 /** uses fopen() if input file seems to be uncompresssed, and popen() if input file seems compressed */
 static FILE * open_file( const char * fname, compression_t * compression )
 {
-  char cmd[PATH_MAX] = {0};
   FILE * input = NULL;
 
   if ( *compression == compression_unknown )
@@ -88,16 +89,14 @@ static FILE * open_file( const char * fname, compression_t * compression )
   switch ( *compression )
   {
   case compression_bzip:
-    snprintf(cmd, sizeof(cmd) - 1, "bzip2 -dc '%s'", fname);
-    if ( !(input = popen(cmd, "r"))) {
-      fprintf(stderr, "popen('%s') fails: %s\n", cmd, strerror(errno));
+    if ( !(input = popen_decompress("bzip2", fname)) ) {
+      fprintf(stderr, "popen('bzip2 -dc %s') fails: %s\n", fname, strerror(errno));
     }
     break;
 
   case compression_gzip:
-    snprintf(cmd, sizeof(cmd) - 1, "gzip -dc '%s'", fname);
-    if ( !(input = popen(cmd, "r"))) {
-      fprintf(stderr, "popen('%s') fails: %s\n", cmd, strerror(errno));
+    if ( !(input = popen_decompress("gzip", fname)) ) {
+      fprintf(stderr, "popen('gzip -dc %s') fails: %s\n", fname, strerror(errno));
     }
     break;
 
@@ -136,7 +135,6 @@ static int load_objects(FILE * input, int rc, int dc, int ru, int du, char heade
   int ic;
   char * pc;
   size_t size;
-  size_t capacity;
 
   obj_t * obj;
 
@@ -158,10 +156,14 @@ static int load_objects(FILE * input, int rc, int dc, int ru, int du, char heade
 
 
   size = ccarray_size(objects);
-  capacity = ccarray_capacity(objects);
 
-  while ( size < capacity && !feof(input) )
+  while ( !feof(input) )
   {
+    if ( size == ccarray_capacity(objects) && ccarray_reserve(objects, size + 1) != 0 ) {
+      fprintf(stderr,"ccarray_reserve(%zu) fails: %d (%s)\n", size + 1, errno, strerror(errno));
+      return -1;
+    }
+
     obj = ccarray_peek(objects, size);
 
     line[MAX_INPUT_LINE_LENGTH-1] = 0;
@@ -245,6 +247,12 @@ static int cmpradec( const void * p1, const void * p2 )
   return 0;
 }
 
+/** radix sort keys equivalent to cmpradec() for non-NaN coordinates (-0.0 and +0.0 keys are equal) */
+static const ccarray_sortkey_t radec_keys[2] = {
+  { offsetof(obj_t, ra), ccarray_key_double },
+  { offsetof(obj_t, dec), ccarray_key_double },
+};
+
 static int cmpra( const void * p1, const void * p2 )
 {
   const obj_t * obj1 = p1;
@@ -303,8 +311,7 @@ static void show_usage( FILE * output, int argc, char * argv[] )
   fprintf(output, "  du1={radian|deg}   DC unit\n");
   fprintf(output, "  ru2={radian|deg}   RA unit\n");
   fprintf(output, "  du2={radian|deg}   DC unit\n");
-  fprintf(output, "  cap1=<size_t>      set initial capacity of first star list\n");
-  fprintf(output, "  cap2=<size_t>      set initial capacity of second star list\n");
+  fprintf(output, "  threads=<int>      number of threads for sorting (default is number of CPUs)\n");
   fprintf(output, "  s1=suffix1         Suffix to add to all column names of first file\n");
   fprintf(output, "  s2=suffix2         Suffix to add to all column names of second file\n");
   fprintf(output, "  dups={keep,drop}   What to do with multiple detections?\n");
@@ -368,7 +375,7 @@ int main(int argc, char *argv[])
     { NULL, NULL };
 
   size_t capacity[2] =
-    { 15000000, 15000000 };
+    { 0, 0 };
 
   char suffix[2][64] =
     { {0}, {0} };
@@ -380,6 +387,7 @@ int main(int argc, char *argv[])
   int dups_mode = dups_drop;
   int beverbose = 0;
   int invert_match = 0;
+  int nthreads = 0;
 
   double r = -1;
 
@@ -460,6 +468,7 @@ int main(int argc, char *argv[])
     }
     else if ( strncmp(argv[i], "cap1=", 5) == 0 )
     {
+      /* obsolete: lists grow on demand, cap1= and cap2= are used as initial capacity hints */
       if ( sscanf(argv[i] + 5, "%zu", &capacity[0]) != 1 ) {
         fprintf(stderr,"Invalid value of %s\n", argv[i]);
         return 1;
@@ -472,6 +481,13 @@ int main(int argc, char *argv[])
         return 1;
       }
     }
+    else if ( strncmp(argv[i], "threads=", 8) == 0 )
+    {
+      if ( sscanf(argv[i] + 8, "%d", &nthreads) != 1 || nthreads < 1 ) {
+        fprintf(stderr,"Invalid value of %s\n", argv[i]);
+        return 1;
+      }
+    }
     else if ( strncmp(argv[i], "s1=", 3) == 0 )
     {
       strncpy(suffix[0], argv[i] + 3, sizeof(suffix[0]) - 1);
@@ -614,12 +630,6 @@ int main(int argc, char *argv[])
     if ( beverbose ) {
       fprintf(stderr,"%s: %zu rows\n", fname[i], ccarray_size(list[i]));
     }
-
-    if ( ccarray_size(list[i]) == capacity[i] && !feof(fp[i]) ) {
-      fprintf(stderr, "load_objects() fails for %s: Too many objects. Try increase capacity (currently %zu)\n",
-          fname[i], capacity[i]);
-      return 1;
-    }
   }
 
 
@@ -636,7 +646,9 @@ int main(int argc, char *argv[])
     if ( beverbose ) {
       fprintf(stderr, "sort %s....\n", fname[i]);
     }
-    ccarray_sort(list[i], 0, ccarray_size(list[i]), cmpradec);
+    if ( ccarray_sort_parallel_keys(list[i], 0, ccarray_size(list[i]), radec_keys, 2, nthreads) != 0 ) {
+      ccarray_sort(list[i], 0, ccarray_size(list[i]), cmpradec);
+    }
   }
 
 
@@ -18,8 +18,11 @@
 #include <unistd.h>
 #include <inttypes.h>
 #include <limits.h>
+#include <stddef.h>
 #include "ssa-detection.h"
-#include "ccarray.h"
+#include "ssa-junk.h"
+#include "ccarray-psort.h"
+#include "popen-decompress.h"
 
 /** Supported file compression types */
 typedef
@@ -37,26 +40,6 @@ struct sbox_s {
 } sbox_s;
 
 
-/**
- * Image quality bits,
- * see http://surveys.roe.ac.uk/ssa/dboverview.html
- */
-typedef
-enum QualityFlags {
-  QF_OCF  =    1,     /*<  Orientation calculation failed       0     1  Information   Image perfectly round */
-  QF_ECF  =    2,     /*<  Ellipticity calculation failed       1     2  Information   Image perfectly straight */
-  QF_TMD  =    4,     /*<  Image too multiple for deblending    2     4  Warning   Image split into too many fragments */
-  QF_BI   =   16,     /*<  Bright image                         4    16  Information   Image has pixels brighter than highest areal profile level */
-  QF_LI   =   64,     /*<  Large image                          6    64  Warning   Image has area greater than maximum specified for deblending */
-  QF_PBI  =  128,     /*<  Possible bad image                   7   128  Warning   Image is in step-wedge/label region */
-  QF_NVBS = 1024,     /*<  Image near very bright star         10  1024  Warning   Image may be spurious due to bright star artifact */
-  QF_HA   = 2048,     /*<  Halo artifact                       11  2048  Strong warning  Image is likely spurious result of bright star halo */
-  QF_DSA  = 8192,     /*<  Diffraction spike artifact          13  8192  Strong warning  Image is likely spurious result of a bright star diffraction spike */
-  QF_TA   =16384,     /*<  Track artifact                      14 16384  Strong warning  Image is likely spurious result of satellite/'plane/scratch track */
-  QF_ITB  =65536,     /*<  Image touches boundary              16 65536  Severe defect   Image pixels partially missing */
-} QualityFlags;
-
-
 /**
  * Output control bits
  */
@@ -83,7 +66,7 @@ static void show_usage( FILE * output )
   fprintf(output,"   -j  treat input file as compressed by bzip2\n");
   fprintf(output,"   -z  treat input file as compressed by gzip\n");
   fprintf(output,"   -v  print some diagnostics to stderr\n");
-  fprintf(output,"   capacity=size_t  set internal array capacity\n");
+  fprintf(output,"   threads=int  number of threads for sorting (default is number of CPUs)\n");
   fprintf(output,"\n");
   fprintf(output,"OUTPUT CONTROL:\n");
   fprintf(output,"   -h  include columns header\n");
@@ -109,7 +92,6 @@ static void show_usage( FILE * output )
 /** uses fopen() for uncompressed streams, and popen() for compressed ones */
 static FILE * open_file( const char * fname, compression_t * compression )
 {
-  char cmd[PATH_MAX] = {0};
   FILE * input = NULL;
 
   if ( *compression == compression_unknown )
@@ -133,16 +115,14 @@ static FILE * open_file( const char * fname, compression_t * compression )
   switch ( *compression )
   {
   case compression_bzip:
-    snprintf(cmd, sizeof(cmd) - 1, "bzip2 -dc '%s'", fname);
-    if ( !(input = popen(cmd, "r"))) {
-      fprintf(stderr, "popen('%s') fails: %s\n", cmd, strerror(errno));
+    if ( !(input = popen_decompress("bzip2", fname)) ) {
+      fprintf(stderr, "popen('bzip2 -dc %s') fails: %s\n", fname, strerror(errno));
     }
     break;
 
   case compression_gzip:
-    snprintf(cmd, sizeof(cmd) - 1, "gzip -dc '%s'", fname);
-    if ( !(input = popen(cmd, "r"))) {
-      fprintf(stderr, "popen('%s') fails: %s\n", cmd, strerror(errno));
+    if ( !(input = popen_decompress("gzip", fname)) ) {
+      fprintf(stderr, "popen('gzip -dc %s') fails: %s\n", fname, strerror(errno));
     }
     break;
 
@@ -176,126 +156,52 @@ static void close_file( FILE * input, compression_t compression )
 /** load objects into array from input stream */
 static int load_objects(FILE * input, ccarray_t * objects)
 {
-  size_t size;
+  struct stat st;
+  size_t size, want, count;
+  int c;
 
-  while ( (size = ccarray_size(objects)) < ccarray_capacity(objects) )
-  {
-    ssa_detection2 * obj = ccarray_peek_end(objects);
-    if ( fread(obj, sizeof(*obj), 1, input) != 1 ) {
-      break;
+  /* plain files are loaded into exactly sized array */
+  if ( fstat(fileno(input), &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 ) {
+    if ( ccarray_reserve(objects, ccarray_size(objects) + st.st_size / sizeof(ssa_detection2)) != 0 ) {
+      return -1;
     }
-    ccarray_set_size(objects, size + 1);
   }
 
-  return feof(input) ? 0 : -1;
-}
-
-
-/** compare pair of objects using objID as key */
-static int cmp_objid( const void * p1, const void * p2 )
-{
-  const ssa_detection2 * obj1 = p1;
-  const ssa_detection2 * obj2 = p2;
-
-  if ( obj1->objID < obj2->objID ) {
-    return -1;
-  }
-  if ( obj1->objID > obj2->objID ) {
-    return +1;
-  }
-  return 0;
-}
-
-static int sbox_hittest( const sbox_s * sbox, double ra, double dec )
-{
-  return ra >= sbox->ramin && ra <= sbox->ramax && dec >= sbox->decmin && dec <= sbox->decmax;
-}
-
-
-static ssa_detection2 * find_parent( const ssa_detection2 * obj, const ccarray_t * objects )
-{
-  if ( obj->parentID != obj->objID ) {
-    const size_t size = ccarray_size(objects);
-    const size_t pos = ccarray_lowerbound(objects, 0, size, cmp_objid, &obj->parentID);
-    if ( pos < size ) {
-      return ccarray_peek(objects, pos);
-    }
-  }
-  return NULL;
-}
-
-/** Sophisticated junk tester. The 'objects' array MUST be sorted using cmp_objid() comparator */
-static int isjunk(const ssa_detection2 * obj, const ccarray_t * objects)
-{
-  const ssa_detection2 * parent;
-
-  /* Image is definitely invalid or image pixels partially missing: */
-  if ( (obj->quality & (QF_ITB | QF_ECF)) ) {
-    return 1;
-  }
-
-  /* too faint image */
-  if ( obj->ap3 < 3 || obj->cosmag > -19.5 ) {
-    return 1;
-  }
-
-  /* Failt track artifact but not a very brigt star */
-  if ( obj->class == 1  )
+  while ( 1 )
   {
-    if ( (obj->quality & QF_TA) && !(obj->quality & QF_BI) && obj->ap7 == 0 ) {
-      return 1;
-    }
-
-    /* Track artifact */
-    if ( ((obj->quality & (QF_TA | QF_NVBS)) == (QF_TA | QF_NVBS)) ) {
-      return 1;
-    }
+    size = ccarray_size(objects);
 
-    /* Track artifact */
-    if ( ((obj->quality & (QF_BI | QF_NVBS)) == (QF_BI | QF_NVBS)) ) {
-      if ( (parent = find_parent(obj, objects)) && ( parent->cosmag < -27 ) ) {
-        if ( hypot(parent->xCen - obj->xCen, parent->yCen - obj->yCen) < 650) {
-          return 1;
-        }
+    /* full array grows only if there is more to read */
+    if ( size == ccarray_capacity(objects) ) {
+      if ( (c = getc(input)) == EOF ) {
+        break;
+      }
+      ungetc(c, input);
+      if ( ccarray_reserve(objects, size + 1) != 0 ) {
+        return -1;
       }
     }
-  }
 
-  /* faint halo artifacts */
-  if ( (obj->quality & (QF_HA | QF_DSA)) && obj->ap5 == 0 ) {
-    return 1;
-  }
-
-
-  /* bright spike artifacts */
-  if ( (obj->quality & (QF_DSA | QF_NVBS)) == (QF_DSA | QF_NVBS) ) {
-    return 1;
-  }
+    want = ccarray_capacity(objects) - size;
+    count = fread(ccarray_peek_end(objects), sizeof(ssa_detection2), want, input);
+    ccarray_set_size(objects, size + count);
 
-
-  /* childs of bright parents */
-  if ( ((obj->quality & (QF_NVBS | QF_HA)) == (QF_NVBS | QF_HA)) && (obj->ap4 == 0) ) {
-    return 1;
-  }
-
-  if ( (obj->blend > 0) && (parent = find_parent(obj, objects)) )
-  {
-    if ( parent->cosmag < -27 )
-    {
-      if ( (obj->quality & (QF_NVBS | QF_HA)) && (obj->ap7 == 0) ) {
-        return 1;
-      }
-
-      if ( (obj->ap8 == 0 && hypot(parent->xCen - obj->xCen, parent->yCen - obj->yCen) < 650) ) {
-        return 1;
-      }
+    /* short read is end of file or error */
+    if ( count < want ) {
+      break;
     }
   }
 
+  return ferror(input) ? -1 : 0;
+}
 
-  return 0;
+
+static int sbox_hittest( const sbox_s * sbox, double ra, double dec )
+{
+  return ra >= sbox->ramin && ra <= sbox->ramax && dec >= sbox->decmin && dec <= sbox->decmax;
 }
 
+
 /** print header line if acceptable */
 static int dump_header_line( FILE * output, int output_opts )
 {
@@ -460,13 +366,14 @@ int main(int argc, char *argv[])
 
   compression_t compression = compression_unknown;
   ccarray_t * objects = NULL;
-  size_t capacity = 15000000;
+  size_t capacity = 0;
 
   int output_opts = 0;
 
   double minmag = -10;
   double maxmag = +30;
-  size_t i, size;
+  int nthreads = 0;
+  size_t i, n, size;
 
   sbox_s sbox =
     { 0, 0, 0, 0 };
@@ -519,11 +426,18 @@ int main(int argc, char *argv[])
 
     }
     else if ( strncmp(argv[i],"capacity=",9) == 0 ) {
+      /* obsolete: the array grows on demand, value is used as initial capacity hint */
       if ( sscanf(argv[i] + 9, "%zu", &capacity) != 1 ) {
         fprintf(stderr, "invalid argument value %s\n", argv[i]);
         return 1;
       }
     }
+    else if ( strncmp(argv[i],"threads=",8) == 0 ) {
+      if ( sscanf(argv[i] + 8, "%d", &nthreads) != 1 || nthreads < 1 ) {
+        fprintf(stderr, "invalid argument value %s\n", argv[i]);
+        return 1;
+      }
+    }
     else if ( *argv[i] == '-' )
     {
       const char * opt = argv[i] + 1;
@@ -682,12 +596,7 @@ int main(int argc, char *argv[])
 
     /* load objects */
     if ( load_objects(input, objects) != 0 ) {
-      if ( ccarray_size(objects) == capacity && !feof(input) ) {
-        fprintf(stderr, "load_objects() fails: Too many objects. Try increase capacity (currently %zu)\n", capacity);
-      }
-      else {
-        fprintf(stderr, "load_objects() fails: %d (%s)\n", errno, strerror(errno));
-      }
+      fprintf(stderr, "load_objects() fails: %d (%s)\n", errno, strerror(errno));
       return 1;
     }
 
@@ -703,7 +612,10 @@ int main(int argc, char *argv[])
 
     /* sort by objid if junk filter requested */
     if ( output_opts & OUTPUT_FJUNK ) {
-      ccarray_sort(objects, 0, ccarray_size(objects), cmp_objid);
+      static const ccarray_sortkey_t objid_key = { offsetof(ssa_detection2, objID), ccarray_key_int64 };
+      if ( ccarray_sort_parallel_keys(objects, 0, ccarray_size(objects), &objid_key, 1, nthreads) != 0 ) {
+        ccarray_sort(objects, 0, ccarray_size(objects), ssa_cmp_objid);
+      }
     }
 
 
@@ -714,7 +626,7 @@ int main(int argc, char *argv[])
 
     /* process the list */
     size = ccarray_size(objects);
-    for ( i = 0; i < size; ++i )
+    for ( i = 0, n = 0; i < size; ++i )
     {
       ssa_detection2 * obj = ccarray_peek(objects, i);
 
@@ -722,7 +634,7 @@ int main(int argc, char *argv[])
         continue;
       }
 
-      if ( (output_opts & OUTPUT_FJUNK) && isjunk(obj, objects) ) {
+      if ( (output_opts & OUTPUT_FJUNK) && ssa_isjunk(obj, ccarray_peek(objects, 0), ccarray_size(objects)) ) {
         continue;
       }
 
@@ -743,6 +655,12 @@ int main(int argc, char *argv[])
         fprintf(stderr,"dump_object() fails\n");
         return 1;
       }
+
+      ++n;
+    }
+
+    if ( output_opts & OUTPUT_VERBOSE ) {
+      fprintf(stderr, "%zu objects is kept\n", n);
     }
 
   }
@@ -0,0 +1,452 @@
+/*
+ * ssa-plate-meta.c
+ *
+ *  Export ssa_plates table into local snapshot file (ssa-plate-meta.h)
+ *  and query plate metadata from it without database access.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include "ssa-plate-meta.h"
+
+
+/** show usage info. */
+static void show_usage( FILE * output )
+{
+  fprintf(output, "Local snapshot of SuperCOSMOS ssa_plates table\n");
+  fprintf(output, "USAGE:\n");
+  fprintf(output, "   ssa-plate-meta export [db=wsdb] [-i TSV-FILE] [-o FILE]\n");
+  fprintf(output, "   ssa-plate-meta [-f FILE] [-h] [-u deg|rad] [-c COLUMNS] [survey=N] [PLATEID ...]\n");
+  fprintf(output, "\n");
+  fprintf(output, "export:\n");
+  fprintf(output, "   runs psql on database 'db' and writes the snapshot into FILE.\n");
+  fprintf(output, "   -i reads tab separated 'copy ... to stdout' output of the export query from TSV-FILE\n");
+  fprintf(output, "      ('-' for stdin) instead, the query is printed by 'ssa-plate-meta sql'\n");
+  fprintf(output, "\n");
+  fprintf(output, "query:\n");
+  fprintf(output, "   prints COLUMNS (comma separated, default all) of given plates, or of all plates of survey N,\n");
+  fprintf(output, "   or of all plates if none is given\n");
+  fprintf(output, "   -h  include columns header\n");
+  fprintf(output, "   -u  units of raPnt and decPnt: deg (default) or rad\n");
+  fprintf(output, "\n");
+  fprintf(output, "FILE defaults to $SSA_PLATE_META or %s\n", SSA_PLATE_META_DEFAULT);
+  fprintf(output, "Columns: ");
+  for ( size_t i = 0; i < SSA_PLATE_META_NFIELDS; ++i ) {
+    fprintf(output, "%s%s", i ? "," : "", ssa_plate_meta_fields[i].name);
+  }
+  fprintf(output, "\n\n");
+  fprintf(output, "Examples:\n");
+  fprintf(output, "  ssa-plate-meta export\n");
+  fprintf(output, "  ssa-plate-meta -c plateid survey=1\n");
+  fprintf(output, "  ssa-plate-meta -u rad -c rapnt,decpnt,epoch 65537\n");
+}
+
+
+/** export query, columns in ssa_plate_meta_fields[] order */
+static const char * export_sql( void )
+{
+  static char sql[1024];
+  size_t n = 0;
+
+  n += snprintf(sql + n, sizeof(sql) - n, "select ");
+  for ( size_t i = 0; i < SSA_PLATE_META_NFIELDS; ++i ) {
+    n += snprintf(sql + n, sizeof(sql) - n, "%s%s", i ? ", " : "", ssa_plate_meta_fields[i].name);
+  }
+  snprintf(sql + n, sizeof(sql) - n, " from ssa_plates order by plateid");
+
+  return sql;
+}
+
+
+static int cmp_plateid( const void * p1, const void * p2 )
+{
+  const ssa_plate_meta * r1 = p1;
+  const ssa_plate_meta * r2 = p2;
+  return r1->plateID < r2->plateID ? -1 : r1->plateID > r2->plateID;
+}
+
+
+/** parses one line of copy output into rec, NULL (\N) numbers are stored as NaN or 0 */
+static int parse_record( char * line, ssa_plate_meta * rec )
+{
+  char * s = line, * e;
+  size_t i;
+
+  for ( i = 0; i < SSA_PLATE_META_NFIELDS; ++i )
+  {
+    const ssa_plate_meta_field * field = &ssa_plate_meta_fields[i];
+    uint8_t * p = (uint8_t *) rec + field->offset;
+    double v;
+    int16_t i16;
+    int32_t i32;
+    float f4;
+
+    if ( !s ) {
+      return -1;
+    }
+
+    if ( (e = strchr(s, '\t')) ) {
+      *e++ = 0;
+    }
+
+    if ( strcmp(s, "\\N") == 0 ) {
+      v = field->type == ssa_plate_meta_int16 || field->type == ssa_plate_meta_int32 ? 0 : NAN;
+    }
+    else {
+      char * end;
+      v = strtod(s, &end);
+      if ( end == s || *end ) {
+        return -1;
+      }
+    }
+
+    switch ( field->type ) {
+    case ssa_plate_meta_int16:
+      i16 = (int16_t) v;
+      memcpy(p, &i16, sizeof(i16));
+      break;
+    case ssa_plate_meta_int32:
+      i32 = (int32_t) v;
+      memcpy(p, &i32, sizeof(i32));
+      break;
+    case ssa_plate_meta_float4:
+      f4 = (float) v;
+      memcpy(p, &f4, sizeof(f4));
+      break;
+    case ssa_plate_meta_float8:
+      memcpy(p, &v, sizeof(v));
+      break;
+    }
+
+    s = e;
+  }
+
+  return 0;
+}
+
+
+/** reads copy output and writes snapshot file, via temporary file and rename() */
+static int export_plates( FILE * input, const char * outputfilename )
+{
+  ssa_plate_meta_header hdr;
+  ssa_plate_meta * recs = NULL, * tmp;
+  size_t count = 0, capacity = 0, lineno = 0;
+  char tmpname[PATH_MAX] = "";
+  char * line = NULL;
+  size_t linesize = 0;
+  ssize_t n;
+  FILE * output = NULL;
+  int status = -1;
+
+  while ( (n = getline(&line, &linesize, input)) > 0 )
+  {
+    ++lineno;
+
+    if ( line[n - 1] == '\n' ) {
+      line[--n] = 0;
+    }
+
+    if ( count == capacity ) {
+      if ( !(tmp = realloc(recs, (capacity = 2 * capacity + 1024) * sizeof(*recs))) ) {
+        fprintf(stderr, "realloc() fails: %s\n", strerror(errno));
+        goto end;
+      }
+      recs = tmp;
+    }
+
+    if ( parse_record(line, &recs[count]) != 0 ) {
+      fprintf(stderr, "invalid record at line %zu\n", lineno);
+      goto end;
+    }
+
+    ++count;
+  }
+
+  if ( count == 0 ) {
+    fprintf(stderr, "no plates read\n");
+    goto end;
+  }
+
+  qsort(recs, count, sizeof(*recs), cmp_plateid);
+
+  memcpy(hdr.magic, SSA_PLATE_META_MAGIC, sizeof(hdr.magic));
+  hdr.version = SSA_PLATE_META_VERSION;
+  hdr.recsize = sizeof(ssa_plate_meta);
+  hdr.count = count;
+
+  snprintf(tmpname, sizeof(tmpname), "%s.tmp", outputfilename);
+
+  if ( !(output = fopen(tmpname, "wb")) ) {
+    fprintf(stderr, "Can't create '%s': %s\n", tmpname, strerror(errno));
+    *tmpname = 0;
+    goto end;
+  }
+
+  if ( fwrite(&hdr, sizeof(hdr), 1, output) != 1 || fwrite(recs, sizeof(*recs), count, output) != count ) {
+    fprintf(stderr, "Can't write '%s': %s\n", tmpname, strerror(errno));
+    goto end;
+  }
+
+  if ( fclose(output) != 0 ) {
+    output = NULL;
+    fprintf(stderr, "Can't write '%s': %s\n", tmpname, strerror(errno));
+    goto end;
+  }
+
+  output = NULL;
+
+  if ( rename(tmpname, outputfilename) != 0 ) {
+    fprintf(stderr, "Can't write '%s': %s\n", outputfilename, strerror(errno));
+    goto end;
+  }
+
+  fprintf(stderr, "%zu plates saved into %s\n", count, outputfilename);
+  status = 0;
+
+end:
+  if ( output ) {
+    fclose(output);
+  }
+
+  if ( status != 0 && *tmpname ) {
+    unlink(tmpname);
+  }
+
+  free(line);
+  free(recs);
+
+  return status;
+}
+
+
+static void print_record( const ssa_plate_meta * rec, const ssa_plate_meta_field * columns[], size_t ncolumns,
+    int radians )
+{
+  for ( size_t i = 0; i < ncolumns; ++i )
+  {
+    const ssa_plate_meta_field * field = columns[i];
+    double v = ssa_plate_meta_value(rec, field);
+
+    if ( i > 0 ) {
+      putchar('\t');
+    }
+
+    if ( field->type == ssa_plate_meta_int16 || field->type == ssa_plate_meta_int32 ) {
+      printf("%.0f", v);
+    }
+    else if ( field->deg && radians ) {
+      printf("%.9f", v * M_PI / 180);
+    }
+    else if ( field->type == ssa_plate_meta_float4 ) {
+      printf("%.7g", v);
+    }
+    else {
+      printf("%.15g", v);
+    }
+  }
+
+  putchar('\n');
+}
+
+
+/** main() */
+int main( int argc, char *argv[] )
+{
+  const char * fname = NULL;
+  const char * inputfilename = NULL;
+  const char * dbname = "wsdb";
+  const ssa_plate_meta_field * columns[SSA_PLATE_META_NFIELDS * 4];
+  size_t ncolumns = 0;
+  int32_t * plateids = NULL;
+  size_t nplateids = 0;
+  int surveyid = 0;
+  int header = 0;
+  int radians = 0;
+  int export = 0;
+  int status = 0;
+  ssa_plate_meta_db * db;
+  size_t i;
+
+  for ( i = 1; i < (size_t) argc; ++i )
+  {
+    if ( strcmp(argv[i], "--help") == 0 ) {
+      show_usage(stdout);
+      return 0;
+    }
+
+    if ( strcmp(argv[i], "sql") == 0 ) {
+      printf("%s\n", export_sql());
+      return 0;
+    }
+
+    if ( strcmp(argv[i], "export") == 0 ) {
+      export = 1;
+    }
+    else if ( strncmp(argv[i], "db=", 3) == 0 ) {
+      dbname = argv[i] + 3;
+    }
+    else if ( strncmp(argv[i], "survey=", 7) == 0 ) {
+      if ( sscanf(argv[i] + 7, "%d", &surveyid) != 1 || surveyid < 1 ) {
+        fprintf(stderr, "Invalid value %s\n", argv[i]);
+        return 1;
+      }
+    }
+    else if ( strcmp(argv[i], "-h") == 0 ) {
+      header = 1;
+    }
+    else if ( strcmp(argv[i], "-f") == 0 || strcmp(argv[i], "-o") == 0 || strcmp(argv[i], "-i") == 0
+        || strcmp(argv[i], "-u") == 0 || strcmp(argv[i], "-c") == 0 )
+    {
+      const char opt = argv[i][1];
+
+      if ( (int) ++i >= argc ) {
+        fprintf(stderr, "ERROR: argument expected after '-%c' command line switch\n", opt);
+        return 1;
+      }
+
+      switch ( opt ) {
+      case 'f':
+      case 'o':
+        fname = argv[i];
+        break;
+      case 'i':
+        inputfilename = argv[i];
+        break;
+      case 'u':
+        if ( strncmp(argv[i], "rad", 3) == 0 ) {
+          radians = 1;
+        }
+        else if ( strncmp(argv[i], "deg", 3) == 0 ) {
+          radians = 0;
+        }
+        else {
+          fprintf(stderr, "ERROR: Invalid unit name after '-u' switch. One of rad or deg is expected\n");
+          return 1;
+        }
+        break;
+      case 'c':
+        for ( char * s = strtok(argv[i], ", "); s; s = strtok(NULL, ", ") ) {
+          if ( ncolumns == sizeof(columns) / sizeof(columns[0]) ) {
+            fprintf(stderr, "Too many columns\n");
+            return 1;
+          }
+          if ( !(columns[ncolumns++] = ssa_plate_meta_find_field(s)) ) {
+            fprintf(stderr, "Unknown column '%s'\n", s);
+            return 1;
+          }
+        }
+        break;
+      }
+    }
+    else
+    {
+      char * end;
+      long plateid = strtol(argv[i], &end, 10);
+
+      if ( *end || plateid < 1 || plateid > INT32_MAX ) {
+        fprintf(stderr, "Invalid argument %s\n", argv[i]);
+        show_usage(stderr);
+        return 1;
+      }
+
+      if ( !(plateids = realloc(plateids, (nplateids + 1) * sizeof(*plateids))) ) {
+        fprintf(stderr, "realloc() fails: %s\n", strerror(errno));
+        return 1;
+      }
+
+      plateids[nplateids++] = plateid;
+    }
+  }
+
+  if ( !fname ) {
+    fname = ssa_plate_meta_path();
+  }
+
+
+  if ( export )
+  {
+    FILE * input;
+    char cmd[4096];
+
+    if ( !inputfilename ) {
+      snprintf(cmd, sizeof(cmd), "psql %s -c \"copy(%s) to stdout\"", dbname, export_sql());
+      if ( !(input = popen(cmd, "r")) ) {
+        fprintf(stderr, "popen('%s') fails: %s\n", cmd, strerror(errno));
+        return 1;
+      }
+    }
+    else if ( strcmp(inputfilename, "-") == 0 ) {
+      input = stdin;
+    }
+    else if ( !(input = fopen(inputfilename, "r")) ) {
+      fprintf(stderr, "fopen('%s') fails: %s\n", inputfilename, strerror(errno));
+      return 1;
+    }
+
+    status = export_plates(input, fname);
+
+    if ( !inputfilename ) {
+      if ( pclose(input) != 0 && status == 0 ) {
+        fprintf(stderr, "'%s' fails\n", cmd);
+        status = -1;
+      }
+    }
+    else if ( input != stdin ) {
+      fclose(input);
+    }
+
+    return status == 0 ? 0 : 1;
+  }
+
+
+  if ( !(db = ssa_plate_meta_open(fname)) ) {
+    fprintf(stderr, "Can't open plate metadata snapshot '%s': %s\n"
+        "Use 'ssa-plate-meta export' to create it\n", fname, strerror(errno));
+    return 1;
+  }
+
+  if ( ncolumns == 0 ) {
+    for ( ncolumns = 0; ncolumns < SSA_PLATE_META_NFIELDS; ++ncolumns ) {
+      columns[ncolumns] = &ssa_plate_meta_fields[ncolumns];
+    }
+  }
+
+  if ( header ) {
+    for ( i = 0; i < ncolumns; ++i ) {
+      printf("%s%s", i ? "\t" : "", columns[i]->name);
+    }
+    putchar('\n');
+  }
+
+  if ( nplateids > 0 )
+  {
+    for ( i = 0; i < nplateids; ++i )
+    {
+      const ssa_plate_meta * rec = ssa_plate_meta_lookup(db, plateids[i]);
+      if ( !rec ) {
+        fprintf(stderr, "plateid %d not found in %s\n", plateids[i], fname);
+        status = 1;
+      }
+      else if ( !surveyid || rec->surveyID == surveyid ) {
+        print_record(rec, columns, ncolumns, radians);
+      }
+    }
+  }
+  else
+  {
+    for ( i = 0; i < db->count; ++i ) {
+      if ( !surveyid || db->recs[i].surveyID == surveyid ) {
+        print_record(&db->recs[i], columns, ncolumns, radians);
+      }
+    }
+  }
+
+  ssa_plate_meta_close(db);
+  free(plateids);
+
+  return status;
+}
@@ -0,0 +1,967 @@
+/*
+ * ssa-plate-reduce.c
+ *
+ *  Astrometric reduction of SuperCOSMOS plate, the C counterpart of
+ *  lib/scripts/scosmos-make-plate-reduction.
+ *
+ *  Reference stars of prepared tables (refs/<surveyid>/<refname>/<plateid>.dat) are projected
+ *  onto the tangential plane of the plate centre, polynomial plate models x,y -> xtan and
+ *  x,y -> ytan are fitted by libogm with the K-sigma rejection of cxy2tan.m, and the solution
+ *  is applied to all objects of the binary plate file. The reduced catalog is formatted
+ *  block by block as the objects are converted, no per-column copies of the plate are made.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <inttypes.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "libogm.h"
+#include "platemodel.h"
+#include "sctrans.h"
+#include "tsvread.h"
+#include "ssaplate.h"
+#include "ssa-detection.h"
+#include "ssa-plate-meta.h"
+
+/** Max number of -r reference tables */
+#define MAX_REFTABLES   64
+
+/** Max number of plate model terms */
+#define MAX_TERMS       64
+
+/** Objects per model evaluation block */
+#define REDUCE_BLOCK    4096
+
+/** Objects formatted by one thread per batch */
+#define THREAD_BLOCK    (8 * REDUCE_BLOCK)
+
+/** Max number of threads */
+#define MAX_THREADS     64
+
+/** radians to arcsec */
+#define RAD2ARCSEC      (180 * 3600 / M_PI)
+
+
+/** Plate model terms x^px[i] * y^py[i] */
+typedef
+struct model_terms {
+  size_t nterms;
+  unsigned px[MAX_TERMS];
+  unsigned py[MAX_TERMS];
+} model_terms;
+
+/** The xy2tan.m model */
+static const model_terms xy2tan_x = {
+  11,
+  { 0, 0, 0, 0, 1, 1, 1, 1, 2, 3, 3 },
+  { 0, 1, 2, 3, 0, 1, 2, 4, 0, 0, 2 },
+};
+
+static const model_terms xy2tan_y = {
+  11,
+  { 0, 0, 0, 0, 1, 1, 2, 2, 2, 3, 4 },
+  { 0, 1, 2, 3, 0, 1, 0, 1, 3, 0, 1 },
+};
+
+/** Reference table given by -r */
+typedef
+struct reftable {
+  const char * fname;
+  double minmag, maxmag;
+} reftable;
+
+/** Reference stars of all tables, x and y are referred to plate centre X0, Y0 */
+typedef
+struct refstars {
+  size_t size, capacity;
+  double * ra, * dec, * mag, * x, * y, * xtan, * ytan;
+  int * cid;
+} refstars;
+
+/** Plate tangent point and scan centre */
+typedef
+struct plate_info {
+  int32_t plateid;
+  double A0, D0, epoch, X0, Y0;
+} plate_info;
+
+
+static void show_usage( FILE * output )
+{
+  fprintf(output, "Astrometric reduction of SuperCOSMOS plate\n");
+  fprintf(output, "  Fits plate model x,y -> xtan,ytan over reference stars and applies it to the binary plate file\n");
+  fprintf(output, "\n");
+  fprintf(output, "USAGE:\n");
+  fprintf(output, "   ssa-plate-reduce [OPTIONS] -p PLATEID -r REFTABLE[:MINMAG[:MAXMAG]] [-r ...] [PLATE-FILE]\n");
+  fprintf(output, "\n");
+  fprintf(output, "OPTIONS:\n");
+  fprintf(output, "   -p PLATEID  plate centre, epoch and scan centre are taken from ssa-plate-meta snapshot\n");
+  fprintf(output, "   -M FILE     ssa-plate-meta snapshot (default $SSA_PLATE_META or %s)\n", SSA_PLATE_META_DEFAULT);
+  fprintf(output, "   -r FILE[:MINMAG[:MAXMAG]]\n");
+  fprintf(output, "               reference stars table with ra,dec (radians),x,y,class,sMag,gMag columns,\n");
+  fprintf(output, "               as prepared by scosmos-prepare-reference-stars; sMag (gMag for galaxies)\n");
+  fprintf(output, "               outside of MINMAG..MAXMAG is rejected. May be repeated.\n");
+  fprintf(output, "   -m MODEL    plate model: xy2tan (default), polyN (all terms up to degree N)\n");
+  fprintf(output, "               or list of exponent pairs 'px:py,px:py,...'; XMODEL/YMODEL sets different\n");
+  fprintf(output, "               models for xtan and ytan\n");
+  fprintf(output, "   -K k        K-sigma threshold for rejection of reference stars, 0 to disable (default 3)\n");
+  fprintf(output, "   -NP n       number of fit passes (default 2)\n");
+  fprintf(output, "   -n N        minimal number of reference stars (default 150)\n");
+  fprintf(output, "   -F FILTER   plate filter, ssa-plate-dump options: 'f' junk filter, 'c' drop parents of deblends,\n");
+  fprintf(output, "               '-' none. Default is 'c' for original plates and none for *.clean.dat*\n");
+  fprintf(output, "   -R FILE     save reference residuals table\n");
+  fprintf(output, "   -o FILE     save reduced catalog into FILE instead of stdout\n");
+  fprintf(output, "   -j N        threads for parsing reference tables and formatting output (default is number of CPUs)\n");
+  fprintf(output, "   -v          print fit diagnostics to stderr\n");
+  fprintf(output, "\n");
+  fprintf(output, "Without PLATE-FILE only the fit is made (use -R to save residuals).\n");
+  fprintf(output, "\n");
+  fprintf(output, "Examples:\n");
+  fprintf(output, "  ssa-plate-reduce -v -p 66378 -r refs/1/ucac4/66378.dat -R reduction-residuals/66378.dat \\\n");
+  fprintf(output, "     -o scosmos/66378.dat SERC-J/plates/66378.dat.bz2\n");
+  fprintf(output, "  ssa-plate-reduce -p 66378 -r refs/1/ucac4/66378.dat -r refs/1/xsc/66378.dat:15:22 -m poly3 66378.clean.dat\n");
+}
+
+
+static double elapsed( const struct timespec * t0 )
+{
+  struct timespec t1;
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  return (t1.tv_sec - t0->tv_sec) + 1e-9 * (t1.tv_nsec - t0->tv_nsec);
+}
+
+
+/** parses single model spec into terms */
+static int parse_model_terms( const char * s, size_t len, model_terms * t, int ytan )
+{
+  unsigned deg, px, py;
+  int n;
+
+  t->nterms = 0;
+
+  if ( len == 6 && strncmp(s, "xy2tan", 6) == 0 ) {
+    *t = ytan ? xy2tan_y : xy2tan_x;
+    return 0;
+  }
+
+  if ( len > 4 && strncmp(s, "poly", 4) == 0 )
+  {
+    if ( sscanf(s + 4, "%u%n", &deg, &n) != 1 || (size_t) n != len - 4 || deg > PM_MAX_POWER ) {
+      return -1;
+    }
+
+    for ( px = 0; px <= deg; ++px ) {
+      for ( py = 0; px + py <= deg; ++py ) {
+        if ( t->nterms == MAX_TERMS ) {
+          return -1;
+        }
+        t->px[t->nterms] = px;
+        t->py[t->nterms++] = py;
+      }
+    }
+
+    return 0;
+  }
+
+  while ( len > 0 )
+  {
+    if ( t->nterms == MAX_TERMS || sscanf(s, "%u:%u%n", &px, &py, &n) != 2 || (size_t) n > len ) {
+      return -1;
+    }
+
+    t->px[t->nterms] = px;
+    t->py[t->nterms++] = py;
+
+    s += n, len -= n;
+
+    if ( len > 0 ) {
+      if ( *s != ',' ) {
+        return -1;
+      }
+      ++s, --len;
+    }
+  }
+
+  return t->nterms > 0 ? 0 : -1;
+}
+
+/** parses -m argument: MODEL or XMODEL/YMODEL */
+static int parse_model( const char * s, model_terms * tx, model_terms * ty )
+{
+  const char * slash = strchr(s, '/');
+
+  if ( !slash ) {
+    return parse_model_terms(s, strlen(s), tx, 0) == 0 && parse_model_terms(s, strlen(s), ty, 1) == 0 ? 0 : -1;
+  }
+
+  return parse_model_terms(s, slash - s, tx, 0) == 0 && parse_model_terms(slash + 1, strlen(slash + 1), ty, 1) == 0 ?
+      0 : -1;
+}
+
+
+/** parses -r argument FILE[:MINMAG[:MAXMAG]] */
+static int parse_reftable( char * s, reftable * r )
+{
+  char * p;
+
+  r->fname = s;
+  r->minmag = -10;
+  r->maxmag = +24;
+
+  if ( (p = strchr(s, ':')) ) {
+    *p++ = 0;
+    if ( sscanf(p, "%lf", &r->minmag) != 1 ) {
+      return -1;
+    }
+    if ( (p = strchr(p, ':')) && sscanf(p + 1, "%lf", &r->maxmag) != 1 ) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+
+static int refstars_reserve( refstars * refs, size_t capacity )
+{
+  double ** columns[] = { &refs->ra, &refs->dec, &refs->mag, &refs->x, &refs->y, &refs->xtan, &refs->ytan };
+  size_t i;
+  void * p;
+
+  if ( capacity <= refs->capacity ) {
+    return 0;
+  }
+
+  for ( i = 0; i < sizeof(columns) / sizeof(columns[0]); ++i ) {
+    if ( !(p = realloc(*columns[i], capacity * sizeof(double))) ) {
+      return -1;
+    }
+    *columns[i] = p;
+  }
+
+  if ( !(p = realloc(refs->cid, capacity * sizeof(int))) ) {
+    return -1;
+  }
+  refs->cid = p;
+
+  refs->capacity = capacity;
+  return 0;
+}
+
+static void refstars_free( refstars * refs )
+{
+  free(refs->ra);
+  free(refs->dec);
+  free(refs->mag);
+  free(refs->x);
+  free(refs->y);
+  free(refs->xtan);
+  free(refs->ytan);
+  free(refs->cid);
+}
+
+
+/**
+ * Appends stars of reference table within magnitude limits to refs,
+ *  as load_reference_stars.m does. Returns number of stars loaded or -1 on error.
+ */
+static ssize_t load_reftable( const reftable * r, int cid, const plate_info * plate, int nthreads, refstars * refs )
+{
+  static const char * names[] = { "ra", "dec", "x", "y", "class", "sMag", "gMag" };
+  enum { RA, DEC, X, Y, CLASS, SMAG, GMAG, NCOLS };
+
+  int fields[NCOLS];
+  double * c[NCOLS] = { NULL };
+  double minra = HUGE_VAL, maxra = -HUGE_VAL;
+  size_t nrows, i, k, n0, n;
+  tsv_t * tsv;
+  ssize_t status = -1;
+
+  if ( !(tsv = tsv_open(r->fname)) ) {
+    fprintf(stderr, "Can not read %s: %s\n", r->fname, strerror(errno));
+    return -1;
+  }
+
+  for ( k = 0; k < NCOLS; ++k ) {
+    if ( (fields[k] = tsv_column(tsv, names[k])) < 0 ) {
+      fprintf(stderr, "%s: no '%s' column\n", r->fname, names[k]);
+      goto end;
+    }
+  }
+
+  nrows = tsv_nrows(tsv, nthreads);
+
+  for ( k = 0; k < NCOLS; ++k ) {
+    if ( !(c[k] = malloc((nrows + 1) * sizeof(double))) ) {
+      fprintf(stderr, "malloc() fails: %s\n", strerror(errno));
+      goto end;
+    }
+  }
+
+  if ( tsv_parse(tsv, NCOLS, fields, c) != 0 ) {
+    fprintf(stderr, "%s: parse error: %s\n", r->fname, strerror(errno));
+    goto end;
+  }
+
+  if ( refstars_reserve(refs, refs->size + nrows) != 0 ) {
+    fprintf(stderr, "realloc() fails: %s\n", strerror(errno));
+    goto end;
+  }
+
+  n0 = n = refs->size;
+
+  for ( i = 0; i < nrows; ++i )
+  {
+    const double mag = c[CLASS][i] == 1 ? c[GMAG][i] : c[SMAG][i];
+
+    if ( !(mag >= r->minmag && mag <= r->maxmag) ) {
+      continue;
+    }
+
+    refs->ra[n] = c[RA][i];
+    refs->dec[n] = c[DEC][i];
+    refs->mag[n] = mag;
+    refs->x[n] = c[X][i] - plate->X0;
+    refs->y[n] = c[Y][i] - plate->Y0;
+    refs->cid[n] = cid;
+
+    if ( refs->ra[n] < minra ) {
+      minra = refs->ra[n];
+    }
+    if ( refs->ra[n] > maxra ) {
+      maxra = refs->ra[n];
+    }
+
+    ++n;
+  }
+
+  /* plates across RA = 0 */
+  if ( maxra - minra > M_PI ) {
+    for ( i = n0; i < n; ++i ) {
+      if ( refs->ra[i] > M_PI ) {
+        refs->ra[i] -= 2 * M_PI;
+      }
+    }
+  }
+
+  sc_cs2tan(plate->A0, plate->D0, n - n0, refs->ra + n0, refs->dec + n0, refs->xtan + n0, refs->ytan + n0);
+
+  refs->size = n;
+  status = n - n0;
+
+end:
+  for ( k = 0; k < NCOLS; ++k ) {
+    free(c[k]);
+  }
+  tsv_close(tsv);
+
+  return status;
+}
+
+
+/** least squares solution of one model over n points */
+static int solve_model( const platemodel * pm, size_t n, const double x[], const double y[], const double rhs[],
+    double coeffs[], double * sigma )
+{
+  ogmctx_t * ctx;
+  int status;
+
+  if ( !(ctx = ogm_solver_create(pm_get_nterms(pm))) ) {
+    return OGM_MALLOC;
+  }
+
+  if ( (status = pm_append(pm, ctx, n, x, y, rhs)) == OGM_SUCCESS ) {
+    status = ogm_solve(ctx, coeffs, NULL, NULL, NULL, sigma);
+  }
+
+  ogm_solver_destroy(ctx);
+
+  return status;
+}
+
+
+/**
+ * Fits xtan and ytan models with the rejection of cxy2tan.m: after each pass but the last
+ *  the stars with |dx| >= K * sigmax or |dy| >= K * sigmay are dropped and the fit is repeated,
+ *  stopping early when nothing is rejected. sigma[] receives the variances of the final pass.
+ */
+static int fit_plate( const platemodel * pmx, const platemodel * pmy, const refstars * refs, double K, int NP,
+    double cx[], double cy[], double sigma[2], size_t * nused, int * npasses )
+{
+  double * x = NULL, * y = NULL, * xtan = NULL, * ytan = NULL, * dx = NULL, * dy = NULL;
+  size_t n = refs->size, m, i;
+  int pass, status = OGM_MALLOC;
+
+  if ( !(x = malloc(n * sizeof(double))) || !(y = malloc(n * sizeof(double)))
+      || !(xtan = malloc(n * sizeof(double))) || !(ytan = malloc(n * sizeof(double)))
+      || !(dx = malloc(n * sizeof(double))) || !(dy = malloc(n * sizeof(double))) ) {
+    goto end;
+  }
+
+  memcpy(x, refs->x, n * sizeof(double));
+  memcpy(y, refs->y, n * sizeof(double));
+  memcpy(xtan, refs->xtan, n * sizeof(double));
+  memcpy(ytan, refs->ytan, n * sizeof(double));
+
+  for ( pass = 1; ; ++pass )
+  {
+    if ( n <= pm_get_nterms(pmx) || n <= pm_get_nterms(pmy) ) {
+      status = OGM_INVALID_ARGUMENT;
+      break;
+    }
+
+    if ( (status = solve_model(pmx, n, x, y, xtan, cx, &sigma[0])) != OGM_SUCCESS ) {
+      break;
+    }
+
+    if ( (status = solve_model(pmy, n, x, y, ytan, cy, &sigma[1])) != OGM_SUCCESS ) {
+      break;
+    }
+
+    if ( K <= 0 || pass >= NP ) {
+      break;
+    }
+
+    pm_eval(pmx, cx, n, x, y, dx);
+    pm_eval(pmy, cy, n, x, y, dy);
+
+    const double tx = K * sqrt(sigma[0]);
+    const double ty = K * sqrt(sigma[1]);
+
+    for ( i = 0, m = 0; i < n; ++i )
+    {
+      if ( fabs(xtan[i] - dx[i]) < tx && fabs(ytan[i] - dy[i]) < ty )
+      {
+        x[m] = x[i];
+        y[m] = y[i];
+        xtan[m] = xtan[i];
+        ytan[m] = ytan[i];
+        ++m;
+      }
+    }
+
+    if ( m == n ) {
+      break;
+    }
+
+    n = m;
+  }
+
+  *nused = n;
+  *npasses = pass;
+
+end:
+  free(x);
+  free(y);
+  free(xtan);
+  free(ytan);
+  free(dx);
+  free(dy);
+
+  return status;
+}
+
+
+/** writes reference residuals table as scosmos-make-plate-reduction does */
+static int save_residuals( const char * fname, const platemodel * pmx, const platemodel * pmy, const double cx[],
+    const double cy[], const refstars * refs )
+{
+  const size_t n = refs->size;
+  double * mx = NULL, * my = NULL;
+  FILE * fp = NULL;
+  size_t i;
+  int status = -1;
+
+  if ( !(mx = malloc(n * sizeof(double))) || !(my = malloc(n * sizeof(double))) ) {
+    fprintf(stderr, "malloc() fails: %s\n", strerror(errno));
+    goto end;
+  }
+
+  if ( !(fp = fopen(fname, "w")) ) {
+    fprintf(stderr, "Can not write %s: %s\n", fname, strerror(errno));
+    goto end;
+  }
+
+  pm_eval(pmx, cx, n, refs->x, refs->y, mx);
+  pm_eval(pmy, cy, n, refs->x, refs->y, my);
+
+  fprintf(fp, "ra\tdec\tmag\tx\ty\txtan\tytan\tdx\tdy\tcid\n");
+
+  for ( i = 0; i < n; ++i ) {
+    fprintf(fp, "%+15.9f\t%+15.9f\t%+8.3f\t%+12.2f\t%+12.2f\t%+20.15E\t%+20.15E\t%+8.3f\t%+8.3f\t%d\n",
+        refs->ra[i], refs->dec[i], refs->mag[i], refs->x[i], refs->y[i], refs->xtan[i], refs->ytan[i],
+        (refs->xtan[i] - mx[i]) * RAD2ARCSEC, (refs->ytan[i] - my[i]) * RAD2ARCSEC, refs->cid[i]);
+  }
+
+  if ( fclose(fp) != 0 ) {
+    fprintf(stderr, "Write error on %s: %s\n", fname, strerror(errno));
+  }
+  else {
+    status = 0;
+  }
+
+end:
+  free(mx);
+  free(my);
+
+  return status;
+}
+
+
+/** Objects of one thread per batch, formatted into memory */
+typedef
+struct reduce_block {
+  const ssa_detection2 * objs;
+  size_t size;
+  const plate_info * plate;
+  const platemodel * pmx, * pmy;
+  const double * cx, * cy;
+  char * text;
+  size_t length;
+  int status;
+} reduce_block;
+
+
+/** applies plate solution to objects and formats catalog rows */
+static int format_objects( FILE * output, const ssa_detection2 * objs, size_t size, const plate_info * plate,
+    const platemodel * pmx, const platemodel * pmy, const double cx[], const double cy[] )
+{
+  double x[REDUCE_BLOCK], y[REDUCE_BLOCK], xtan[REDUCE_BLOCK], ytan[REDUCE_BLOCK];
+  double ra[REDUCE_BLOCK], dec[REDUCE_BLOCK];
+  const double X0 = plate->X0, Y0 = plate->Y0;
+  size_t b, n, i;
+
+  for ( b = 0; b < size; b += n )
+  {
+    const ssa_detection2 * obj = objs + b;
+
+    n = size - b < REDUCE_BLOCK ? size - b : REDUCE_BLOCK;
+
+    for ( i = 0; i < n; ++i ) {
+      x[i] = obj[i].xCen - X0;
+      y[i] = obj[i].yCen - Y0;
+    }
+
+    if ( pm_eval(pmx, cx, n, x, y, xtan) != OGM_SUCCESS || pm_eval(pmy, cy, n, x, y, ytan) != OGM_SUCCESS ) {
+      return -1;
+    }
+
+    sc_tan2cs(plate->A0, plate->D0, n, xtan, ytan, ra, dec);
+
+    for ( i = 0; i < n; ++i ) {
+      fprintf(output, "%9"PRId64"\t%+15.9f\t%+15.9f\t%+9.3f\t%+10.2f\t%+10.2f\t%+10.2f\t%+10.2f\t%6d\t%10.0f\t%+8.3f"
+          "\t%10.0f\t%+10.2f\t%+10.2f\t%8.2f\t%8.2f\t%3d\t%8.2f\t%8.2f\t%3d\t%1u\t%3d\t%4d\t%4d\t%4d\t%4d\t%4d\t%4d"
+          "\t%4d\t%4d\t%3d\t%6d\t%+9.3f\t%+9.3f\t%+9.3f\t%+9.3f\n",
+          obj[i].objID, ra[i], dec[i], plate->epoch,
+          obj[i].xmin - X0, obj[i].xmax - X0, obj[i].ymin - Y0, obj[i].ymax - Y0,
+          obj[i].area, obj[i].ipeak, obj[i].cosmag, obj[i].isky, x[i], y[i],
+          obj[i].aU, obj[i].bU, obj[i].thetaU, obj[i].aI, obj[i].bI, obj[i].thetaI, obj[i].class, obj[i].pa,
+          obj[i].ap1, obj[i].ap2, obj[i].ap3, obj[i].ap4, obj[i].ap5, obj[i].ap6, obj[i].ap7, obj[i].ap8,
+          obj[i].blend, obj[i].quality, obj[i].prfStat, obj[i].prfMag, obj[i].gMag, obj[i].sMag);
+    }
+
+    if ( ferror(output) ) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+static void * reduce_thread( void * arg )
+{
+  reduce_block * blk = arg;
+  FILE * fp;
+
+  blk->status = -1;
+
+  if ( (fp = open_memstream(&blk->text, &blk->length)) ) {
+    blk->status = format_objects(fp, blk->objs, blk->size, blk->plate, blk->pmx, blk->pmy, blk->cx, blk->cy);
+    if ( fclose(fp) != 0 ) {
+      blk->status = -1;
+    }
+  }
+
+  return NULL;
+}
+
+
+/**
+ * Writes the reduced catalog. Formatting the rows dominates the run time, so the objects go
+ *  in batches of nthreads blocks converted and formatted concurrently, written out in plate order.
+ */
+static int reduce_objects( FILE * output, const ssa_detection2 * objs, size_t size, const plate_info * plate,
+    const platemodel * pmx, const platemodel * pmy, const double cx[], const double cy[], int nthreads )
+{
+  reduce_block blocks[MAX_THREADS];
+  pthread_t tids[MAX_THREADS];
+  size_t b, i, n;
+  int k, nblocks, status = 0;
+
+  fprintf(output, "objID\tra\tdec\tepoch\txmin\txmax\tymin\tymax\tarea\tipeak\tcosmag\tisky\tx\ty\taU\tbU\tthetaU"
+      "\taI\tbI\tthetaI\tclass\tpa\tap1\tap2\tap3\tap4\tap5\tap6\tap7\tap8\tblend\tquality\tprfStat\tprfMag\tgMag\tsMag\n");
+
+  if ( nthreads <= 0 && (nthreads = sysconf(_SC_NPROCESSORS_ONLN)) < 1 ) {
+    nthreads = 1;
+  }
+  if ( nthreads > MAX_THREADS ) {
+    nthreads = MAX_THREADS;
+  }
+
+  if ( nthreads == 1 || size <= THREAD_BLOCK ) {
+    status = format_objects(output, objs, size, plate, pmx, pmy, cx, cy);
+  }
+  else
+  {
+    for ( b = 0; b < size && status == 0; b += n )
+    {
+      n = size - b < (size_t) nthreads * THREAD_BLOCK ? size - b : (size_t) nthreads * THREAD_BLOCK;
+
+      for ( nblocks = 0, i = 0; i < n; i += THREAD_BLOCK, ++nblocks )
+      {
+        reduce_block * blk = &blocks[nblocks];
+
+        blk->objs = objs + b + i;
+        blk->size = n - i < THREAD_BLOCK ? n - i : THREAD_BLOCK;
+        blk->plate = plate;
+        blk->pmx = pmx, blk->pmy = pmy;
+        blk->cx = cx, blk->cy = cy;
+        blk->text = NULL;
+        blk->length = 0;
+
+        if ( (errno = pthread_create(&tids[nblocks], NULL, reduce_thread, blk)) ) {
+          fprintf(stderr, "pthread_create() fails: %s\n", strerror(errno));
+          reduce_thread(blk);
+          tids[nblocks] = 0;
+        }
+      }
+
+      for ( k = 0; k < nblocks; ++k )
+      {
+        if ( tids[k] ) {
+          pthread_join(tids[k], NULL);
+        }
+
+        if ( blocks[k].status != 0 ) {
+          status = -1;
+        }
+        else if ( status == 0 && fwrite(blocks[k].text, 1, blocks[k].length, output) != blocks[k].length ) {
+          status = -1;
+        }
+
+        free(blocks[k].text);
+      }
+    }
+  }
+
+  if ( status != 0 || ferror(output) ) {
+    fprintf(stderr, "Write error: %s\n", strerror(errno));
+    return -1;
+  }
+
+  return 0;
+}
+
+
+int main( int argc, char * argv[] )
+{
+  reftable reftables[MAX_REFTABLES];
+  model_terms tx = xy2tan_x, ty = xy2tan_y;
+  plate_info plate = { 0 };
+  refstars refs = { 0 };
+  platemodel * pmx = NULL, * pmy = NULL;
+  ssa_plate_meta_db * db;
+  const ssa_plate_meta * rec;
+  ssa_plate_t * objects = NULL;
+  FILE * output = stdout;
+
+  const char * metafile = NULL;
+  const char * platefile = NULL;
+  const char * filter = NULL;
+  const char * resfile = NULL;
+  const char * outfile = NULL;
+  int nrefs = 0, plateid = 0, nthreads = 0, NP = 2, minrefs = 150, verb = 0;
+  double K = 3;
+
+  double cx[MAX_TERMS], cy[MAX_TERMS], sigma[2];
+  size_t nused = 0;
+  int npasses = 0, flags = 0;
+  struct timespec t0;
+  ssize_t n;
+  int a, i, status = 1;
+
+  for ( a = 1; a < argc; ++a )
+  {
+    if ( strcmp(argv[a], "-help") == 0 || strcmp(argv[a], "--help") == 0 ) {
+      show_usage(stdout);
+      return 0;
+    }
+
+    if ( strcmp(argv[a], "-v") == 0 ) {
+      verb = 1;
+      continue;
+    }
+
+    if ( *argv[a] != '-' )
+    {
+      if ( platefile ) {
+        fprintf(stderr, "Only one plate file expected: %s\n", argv[a]);
+        return 1;
+      }
+      platefile = argv[a];
+      continue;
+    }
+
+    if ( a + 1 >= argc ) {
+      fprintf(stderr, "Missing argument after %s switch\n", argv[a]);
+      show_usage(stderr);
+      return 1;
+    }
+
+    if ( strcmp(argv[a], "-p") == 0 ) {
+      if ( sscanf(argv[++a], "%d", &plateid) != 1 || plateid <= 0 ) {
+        fprintf(stderr, "Invalid plateid: %s\n", argv[a]);
+        return 1;
+      }
+    }
+    else if ( strcmp(argv[a], "-M") == 0 ) {
+      metafile = argv[++a];
+    }
+    else if ( strcmp(argv[a], "-r") == 0 ) {
+      if ( nrefs == MAX_REFTABLES ) {
+        fprintf(stderr, "Too many reference tables, max %d\n", MAX_REFTABLES);
+        return 1;
+      }
+      if ( parse_reftable(argv[++a], &reftables[nrefs++]) != 0 ) {
+        fprintf(stderr, "Invalid magnitude limits in %s\n", argv[a]);
+        return 1;
+      }
+    }
+    else if ( strcmp(argv[a], "-m") == 0 ) {
+      if ( parse_model(argv[++a], &tx, &ty) != 0 ) {
+        fprintf(stderr, "Invalid plate model: %s\n", argv[a]);
+        return 1;
+      }
+    }
+    else if ( strcmp(argv[a], "-K") == 0 ) {
+      if ( sscanf(argv[++a], "%lf", &K) != 1 ) {
+        fprintf(stderr, "Invalid K threshold: %s\n", argv[a]);
+        return 1;
+      }
+    }
+    else if ( strcmp(argv[a], "-NP") == 0 ) {
+      if ( sscanf(argv[++a], "%d", &NP) != 1 || NP < 1 ) {
+        fprintf(stderr, "Invalid number of passes: %s\n", argv[a]);
+        return 1;
+      }
+    }
+    else if ( strcmp(argv[a], "-n") == 0 ) {
+      if ( sscanf(argv[++a], "%d", &minrefs) != 1 ) {
+        fprintf(stderr, "Invalid number of reference stars: %s\n", argv[a]);
+        return 1;
+      }
+    }
+    else if ( strcmp(argv[a], "-j") == 0 ) {
+      if ( sscanf(argv[++a], "%d", &nthreads) != 1 ) {
+        fprintf(stderr, "Invalid number of threads: %s\n", argv[a]);
+        return 1;
+      }
+    }
+    else if ( strcmp(argv[a], "-F") == 0 ) {
+      filter = argv[++a];
+    }
+    else if ( strcmp(argv[a], "-R") == 0 ) {
+      resfile = argv[++a];
+    }
+    else if ( strcmp(argv[a], "-o") == 0 ) {
+      outfile = argv[++a];
+    }
+    else {
+      fprintf(stderr, "Invalid argument: %s\n", argv[a]);
+      show_usage(stderr);
+      return 1;
+    }
+  }
+
+  if ( !plateid || !nrefs ) {
+    fprintf(stderr, "Plate id and at least one reference table are required\n");
+    show_usage(stderr);
+    return 1;
+  }
+
+  if ( platefile )
+  {
+    if ( !filter ) {
+      filter = strstr(platefile, ".clean.dat") ? "" : "c";
+    }
+
+    for ( ; *filter; ++filter ) {
+      switch ( *filter ) {
+      case 'f':
+        flags |= SSA_PLATE_FJUNK;
+        break;
+      case 'c':
+        flags |= SSA_PLATE_DROP_PARENTS;
+        break;
+      case '-':
+        break;
+      default:
+        fprintf(stderr, "Invalid filter option '%c'\n", *filter);
+        return 1;
+      }
+    }
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+
+
+  /* plate centre */
+
+  if ( !(db = ssa_plate_meta_open(metafile)) ) {
+    fprintf(stderr, "Can't open plate metadata snapshot '%s': %s\n", metafile ? metafile : ssa_plate_meta_path(),
+        strerror(errno));
+    fprintf(stderr, "Use 'ssa-plate-meta export' to create it\n");
+    return 1;
+  }
+
+  if ( !(rec = ssa_plate_meta_lookup(db, plateid)) ) {
+    fprintf(stderr, "plateid %d not found in plate metadata snapshot\n", plateid);
+    ssa_plate_meta_close(db);
+    return 1;
+  }
+
+  plate.plateid = plateid;
+  plate.A0 = rec->raPnt * M_PI / 180;
+  plate.D0 = rec->decPnt * M_PI / 180;
+  plate.epoch = rec->epoch;
+  plate.X0 = rec->xPnt;
+  plate.Y0 = rec->yPnt;
+
+  ssa_plate_meta_close(db);
+
+  if ( verb ) {
+    fprintf(stderr, "plate:  %d\n", plate.plateid);
+    fprintf(stderr, "A0   :  %g\n", plate.A0 * 180 / M_PI);
+    fprintf(stderr, "D0   :  %+g\n", plate.D0 * 180 / M_PI);
+    fprintf(stderr, "EPOCH:  %.3f\n", plate.epoch);
+  }
+
+
+  /* reference stars */
+
+  for ( i = 0; i < nrefs; ++i )
+  {
+    if ( (n = load_reftable(&reftables[i], i + 1, &plate, nthreads, &refs)) < 0 ) {
+      goto end;
+    }
+
+    if ( verb ) {
+      fprintf(stderr, "%s: %zd stars\n", reftables[i].fname, n);
+    }
+
+    if ( n < 1 ) {
+      fprintf(stderr, "No reference stars in %s\n", reftables[i].fname);
+      goto end;
+    }
+  }
+
+  if ( refs.size < (size_t) minrefs ) {
+    fprintf(stderr, "Too small number of reference stars: %zu\n", refs.size);
+    goto end;
+  }
+
+
+  /* fit */
+
+  if ( !(pmx = pm_create(tx.nterms, tx.px, tx.py)) || !(pmy = pm_create(ty.nterms, ty.px, ty.py)) ) {
+    fprintf(stderr, "pm_create() fails: %s\n", strerror(errno));
+    goto end;
+  }
+
+  switch ( fit_plate(pmx, pmy, &refs, K, NP, cx, cy, sigma, &nused, &npasses) ) {
+  case OGM_SUCCESS:
+    break;
+  case OGM_SINGULAR_MATRIX:
+    fprintf(stderr, "Plate model fit fails: singular normal matrix\n");
+    goto end;
+  case OGM_INVALID_ARGUMENT:
+    fprintf(stderr, "Plate model fit fails: too few reference stars left for %zu/%zu terms\n", tx.nterms, ty.nterms);
+    goto end;
+  default:
+    fprintf(stderr, "Plate model fit fails: %s\n", strerror(errno));
+    goto end;
+  }
+
+  if ( verb ) {
+    fprintf(stderr, "fit  :  %zu of %zu stars, %d passes, sigma x: %.3f\" y: %.3f\"  %.3f s\n", nused, refs.size,
+        npasses, sqrt(sigma[0]) * RAD2ARCSEC, sqrt(sigma[1]) * RAD2ARCSEC, elapsed(&t0));
+  }
+
+  if ( resfile ) {
+    if ( save_residuals(resfile, pmx, pmy, cx, cy, &refs) != 0 ) {
+      goto end;
+    }
+    if ( verb ) {
+      fprintf(stderr, "%s saved\n", resfile);
+    }
+  }
+
+
+  /* targets */
+
+  if ( platefile )
+  {
+    if ( !(objects = ssa_plate_load(platefile, flags)) ) {
+      fprintf(stderr, "Can not load plate %s: %s\n", platefile, strerror(errno));
+      goto end;
+    }
+
+    if ( outfile && !(output = fopen(outfile, "w")) ) {
+      fprintf(stderr, "Can not write %s: %s\n", outfile, strerror(errno));
+      goto end;
+    }
+
+    setvbuf(output, NULL, _IOFBF, 1 << 20);
+
+    if ( reduce_objects(output, ssa_plate_objects(objects), ssa_plate_size(objects), &plate, pmx, pmy, cx, cy,
+        nthreads) != 0 ) {
+      goto end;
+    }
+
+    if ( output != stdout ) {
+      FILE * fp = output;
+      output = stdout;
+      if ( fclose(fp) != 0 ) {
+        fprintf(stderr, "Write error on %s: %s\n", outfile, strerror(errno));
+        goto end;
+      }
+    }
+    else if ( fflush(output) != 0 ) {
+      fprintf(stderr, "Write error: %s\n", strerror(errno));
+      goto end;
+    }
+
+    if ( verb ) {
+      fprintf(stderr, "%zu objects reduced  %.3f s\n", ssa_plate_size(objects), elapsed(&t0));
+    }
+  }
+
+  status = 0;
+
+end:
+  if ( output != stdout ) {
+    fclose(output);
+  }
+  ssa_plate_close(objects);
+  pm_destroy(pmx);
+  pm_destroy(pmy);
+  refstars_free(&refs);
+
+  return status;
+}
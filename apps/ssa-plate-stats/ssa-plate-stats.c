@@ -7,29 +7,184 @@
 
 
 #include "ssa-detection.h"
+#include "popen-decompress.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 #include <unistd.h>
 #include <inttypes.h>
 #include <limits.h>
 #include <math.h>
+#include <dirent.h>
+#include <libgen.h>
+#include <pthread.h>
+#include <sys/stat.h>
 
 #define PI M_PI
 
+/** Scan area extent in X and Y used for density grid, microns */
+#define GRID_EXTENT   360000.0
+
+/** Max density grid size */
+#define MAX_GRID      64
+
+/** Quantiles estimated for sMag, isky and cosmag */
+#define NUM_QUANTILES 3
+static const double quantiles[NUM_QUANTILES] = { 0.05, 0.50, 0.95 };
+
+/** Supported file compression types */
+typedef
+enum compression_t {
+  compression_unknown = -1,
+  compression_none,
+  compression_bzip,
+  compression_gzip
+} compression_t;
+
+
+/**
+ * P-square streaming estimator of single quantile,
+ * see Jain R., Chlamtac I. (1985), "The P2 algorithm for dynamic calculation
+ * of quantiles and histograms without storing observations".
+ */
+typedef
+struct p2_s {
+  double p;         /*< quantile to estimate */
+  double q[5];      /*< marker heights */
+  double n[5];      /*< marker positions */
+  double np[5];     /*< desired marker positions */
+  double dn[5];     /*< increments of desired positions */
+  size_t count;
+} p2_s;
+
+/** Per-plate statistics */
+typedef
+struct plate_stats_s {
+  uint32_t numobj;
+
+  /* RA bounds tracked in both [0, 2pi) and (-pi, pi] representations to handle wrapping */
+  double ramin, ramax;
+  double ramin2, ramax2;
+  double decmin, decmax;
+  double xmin, xmax, ymin, ymax;
+  double wx0, wy0;
+
+  /* mean position computed via unit vectors */
+  double sx, sy, sz;
+
+  p2_s smag[NUM_QUANTILES];
+  p2_s isky[NUM_QUANTILES];
+  p2_s cosmag[NUM_QUANTILES];
+
+  uint32_t grid[MAX_GRID * MAX_GRID];
+} plate_stats;
+
+/** Work item of the thread pool */
+typedef
+struct plate_job_s {
+  const char * fname;
+  compression_t compression;
+  plate_stats stats;
+  int status;
+} plate_job;
+
+
+static plate_job * jobs;
+static size_t num_jobs;
+static size_t next_job;
+static pthread_mutex_t jobs_lock = PTHREAD_MUTEX_INITIALIZER;
+static int grid_size = 8;
+static int beverbose = 0;
+
+
 
 static void show_usage( FILE * output )
 {
   fprintf(output,"Gather some SuperCOSMOS plate statistics\n");
   fprintf(output,"USAGE:\n");
-  fprintf(output,"   ssa-plate-stats [OPTIONS] [FILE]\n");
+  fprintf(output,"   ssa-plate-stats [OPTIONS] [FILE|DIRECTORY ...]\n");
   fprintf(output,"OPTIONS:\n");
-  fprintf(output,"   -j  treat input file as compressed by bzip2\n");
-  fprintf(output,"   -z  treat input file as compressed by gzip\n");
+  fprintf(output,"   -j  treat input files as compressed by bzip2\n");
+  fprintf(output,"   -z  treat input files as compressed by gzip\n");
   fprintf(output,"   -h  print headr line\n");
+  fprintf(output,"   -g  print density grid counts as comma-separated GRID column\n");
+  fprintf(output,"   -v  print some progress info to stderr\n");
+  fprintf(output,"   -t  <int> number of worker threads (default is number of CPUs)\n");
+  fprintf(output,"   grid=<int>  size N of NxN density grid over %g microns scan area (default 8)\n", GRID_EXTENT);
+  fprintf(output,"Directories are scanned for *.dat, *.dat.bz2 and *.dat.gz plate files.\n");
+  fprintf(output,"One stats row is printed per plate, in order of input.\n");
   fprintf(output,"If no input file is given then read plate file from stdin (to allow piped processing)\n");
   fprintf(output,"Examples:\n");
   fprintf(output," ssa-plate-stats 1-65537.dat.bz2\n");
+  fprintf(output," ssa-plate-stats -h -t 8 /mnt/catalogs/scosmos/SERC-J/plates\n");
+}
+
+
+/** uses fopen() for uncompressed streams, and popen() for compressed ones */
+static FILE * open_file( const char * fname, compression_t * compression )
+{
+  FILE * input = NULL;
+
+  if ( *compression == compression_unknown )
+  {
+    const char * suffix;
+
+    if ( (suffix = strstr(fname, ".bz2")) && *(suffix + 4) == 0 ) {
+      *compression = compression_bzip;
+    }
+    else if ( (suffix = strstr(fname, ".bz")) && *(suffix + 3) == 0 ) {
+      *compression = compression_bzip;
+    }
+    else if ( (suffix = strstr(fname, ".gz")) && *(suffix + 3) == 0 ) {
+      *compression = compression_gzip;
+    }
+    else {
+      *compression = compression_none;
+    }
+  }
+
+  switch ( *compression )
+  {
+  case compression_bzip:
+    if ( !(input = popen_decompress("bzip2", fname)) ) {
+      fprintf(stderr, "popen('bzip2 -dc %s') fails: %s\n", fname, strerror(errno));
+    }
+    break;
+
+  case compression_gzip:
+    if ( !(input = popen_decompress("gzip", fname)) ) {
+      fprintf(stderr, "popen('gzip -dc %s') fails: %s\n", fname, strerror(errno));
+    }
+    break;
+
+  case compression_none:
+    if ( !(input = fopen(fname, "r"))) {
+      fprintf(stderr, "fopen('%s') fails: %s\n", fname, strerror(errno));
+    }
+    break;
+
+  default:
+    fprintf(stderr, "BUG IN CODE: invalid compression tag=%d\n", *compression);
+    break;
+  }
+
+  return input;
+}
+
+/**
+ * uses fclose() for uncompressed streams, and pclose() for compressed ones;
+ *  returns nonzero if the decompressor fails (truncated or corrupt file)
+ */
+static int close_file( FILE * input, compression_t compression )
+{
+  if ( input && input != stdin ) {
+    if ( compression > compression_none ) {
+      return pclose(input);
+    }
+    return fclose(input);
+  }
+  return 0;
 }
 
 
@@ -43,27 +198,490 @@ static inline void minmax8( float8 v, float8 * vmin, float8 * vmax )
     }
 }
 
-int main(int argc, char *argv[])
+
+static void p2_init( p2_s * p2, double p )
+{
+  memset(p2, 0, sizeof(*p2));
+  p2->p = p;
+  p2->dn[1] = p / 2;
+  p2->dn[2] = p;
+  p2->dn[3] = (1 + p) / 2;
+  p2->dn[4] = 1;
+}
+
+static void p2_add( p2_s * p2, double x )
 {
-  const char * inputfilename = NULL;
-  FILE * input = stdin;
+  int i, k;
+
+  if ( p2->count < 5 )
+  {
+    /* collect first five observations sorted */
+    for ( i = p2->count++; i > 0 && p2->q[i - 1] > x; --i ) {
+      p2->q[i] = p2->q[i - 1];
+    }
+    p2->q[i] = x;
+
+    if ( p2->count == 5 ) {
+      for ( i = 0; i < 5; ++i ) {
+        p2->n[i] = i;
+      }
+      p2->np[0] = 0;
+      p2->np[1] = 2 * p2->p;
+      p2->np[2] = 4 * p2->p;
+      p2->np[3] = 2 + 2 * p2->p;
+      p2->np[4] = 4;
+    }
+    return;
+  }
+
+  ++p2->count;
+
+  /* find cell k such that q[k] <= x < q[k+1], adjust extreme markers */
+  if ( x < p2->q[0] ) {
+    p2->q[0] = x;
+    k = 0;
+  }
+  else if ( x >= p2->q[4] ) {
+    p2->q[4] = x;
+    k = 3;
+  }
+  else {
+    for ( k = 0; k < 3 && x >= p2->q[k + 1]; ++k ) {
+    }
+  }
+
+  for ( i = k + 1; i < 5; ++i ) {
+    p2->n[i] += 1;
+  }
+  for ( i = 0; i < 5; ++i ) {
+    p2->np[i] += p2->dn[i];
+  }
+
+  /* adjust heights of middle markers */
+  for ( i = 1; i < 4; ++i )
+  {
+    const double d = p2->np[i] - p2->n[i];
 
+    if ( (d >= 1 && p2->n[i + 1] - p2->n[i] > 1) || (d <= -1 && p2->n[i - 1] - p2->n[i] < -1) )
+    {
+      const double s = d >= 0 ? 1 : -1;
+
+      /* piecewise-parabolic prediction */
+      double q = p2->q[i] + s / (p2->n[i + 1] - p2->n[i - 1]) *
+          ((p2->n[i] - p2->n[i - 1] + s) * (p2->q[i + 1] - p2->q[i]) / (p2->n[i + 1] - p2->n[i]) +
+              (p2->n[i + 1] - p2->n[i] - s) * (p2->q[i] - p2->q[i - 1]) / (p2->n[i] - p2->n[i - 1]));
+
+      if ( !(p2->q[i - 1] < q && q < p2->q[i + 1]) ) {
+        /* linear prediction */
+        const int j = i + (int) s;
+        q = p2->q[i] + s * (p2->q[j] - p2->q[i]) / (p2->n[j] - p2->n[i]);
+      }
+
+      p2->q[i] = q;
+      p2->n[i] += s;
+    }
+  }
+}
+
+static double p2_result( const p2_s * p2 )
+{
+  if ( p2->count >= 5 ) {
+    return p2->q[2];
+  }
+
+  if ( p2->count > 0 ) {
+    /* few observations: nearest rank of sorted sample */
+    return p2->q[(size_t) (p2->p * (p2->count - 1) + 0.5)];
+  }
+
+  return 0;
+}
+
+
+static void stats_init( plate_stats * st )
+{
+  int i;
+
+  memset(st, 0, sizeof(*st));
+
+  for ( i = 0; i < NUM_QUANTILES; ++i ) {
+    p2_init(&st->smag[i], quantiles[i]);
+    p2_init(&st->isky[i], quantiles[i]);
+    p2_init(&st->cosmag[i], quantiles[i]);
+  }
+}
+
+static void stats_add( plate_stats * st, const ssa_detection2 * obj )
+{
+  const double ra2 = obj->ra > PI ? obj->ra - 2 * PI : obj->ra;
+  const double cd = cos(obj->dec);
+  int gx, gy, i;
+
+  if ( !st->numobj++ )
+  {
+    st->ramin = st->ramax = obj->ra;
+    st->ramin2 = st->ramax2 = ra2;
+    st->decmin = st->decmax = obj->dec;
+    st->xmin = st->xmax = obj->xCen;
+    st->ymin = st->ymax = obj->yCen;
+  }
+  else
+  {
+    minmax8(obj->ra, &st->ramin, &st->ramax);
+    minmax8(ra2, &st->ramin2, &st->ramax2);
+    minmax8(obj->dec, &st->decmin, &st->decmax);
+    minmax8(obj->xCen, &st->xmin, &st->xmax);
+    minmax8(obj->yCen, &st->ymin, &st->ymax);
+  }
+
+  st->wx0 += obj->xCen;
+  st->wy0 += obj->yCen;
+
+  st->sx += cd * cos(obj->ra);
+  st->sy += cd * sin(obj->ra);
+  st->sz += sin(obj->dec);
+
+  for ( i = 0; i < NUM_QUANTILES; ++i ) {
+    p2_add(&st->smag[i], obj->sMag);
+    p2_add(&st->isky[i], obj->isky);
+    p2_add(&st->cosmag[i], obj->cosmag);
+  }
+
+  gx = (int) (obj->xCen * grid_size / GRID_EXTENT);
+  gy = (int) (obj->yCen * grid_size / GRID_EXTENT);
+  gx = gx < 0 ? 0 : gx >= grid_size ? grid_size - 1 : gx;
+  gy = gy < 0 ? 0 : gy >= grid_size ? grid_size - 1 : gy;
+  ++st->grid[gy * grid_size + gx];
+}
+
+/** gather statistics over single plate stream */
+static int process_plate( FILE * input, plate_stats * st )
+{
   ssa_detection2 obj;
+
+  stats_init(st);
+
+  while ( fread(&obj, sizeof(obj), 1, input) == 1 ) {
+    stats_add(st, &obj);
+  }
+
+  return ferror(input) ? -1 : 0;
+}
+
+
+/** worker thread: pull next plate from the job list until exhausted */
+static void * worker_thread( void * arg )
+{
+  plate_job * job;
+  FILE * input;
+  size_t index;
+
+  (void) arg;
+
+  while ( 1 )
+  {
+    pthread_mutex_lock(&jobs_lock);
+    index = next_job < num_jobs ? next_job++ : num_jobs;
+    pthread_mutex_unlock(&jobs_lock);
+
+    if ( index >= num_jobs ) {
+      break;
+    }
+
+    job = &jobs[index];
+
+    if ( !(input = open_file(job->fname, &job->compression)) ) {
+      job->status = -1;
+      continue;
+    }
+
+    if ( (job->status = process_plate(input, &job->stats)) != 0 ) {
+      fprintf(stderr, "Read error in '%s'\n", job->fname);
+    }
+
+    if ( close_file(input, job->compression) != 0 && job->status == 0 ) {
+      fprintf(stderr, "Decompression of '%s' fails\n", job->fname);
+      job->status = -1;
+    }
+
+    if ( beverbose ) {
+      fprintf(stderr, "%s: %u objects\n", job->fname, job->stats.numobj);
+    }
+  }
+
+  return NULL;
+}
+
+
+static int is_plate_file_name( const char * name )
+{
+  static const char * suffixes[] = { ".dat", ".dat.bz2", ".dat.bz", ".dat.gz" };
+  const size_t len = strlen(name);
+  size_t i, slen;
+
+  for ( i = 0; i < sizeof(suffixes) / sizeof(suffixes[0]); ++i ) {
+    if ( len > (slen = strlen(suffixes[i])) && strcmp(name + len - slen, suffixes[i]) == 0 ) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+static int cmpstr( const void * p1, const void * p2 )
+{
+  return strcmp(*(char * const *) p1, *(char * const *) p2);
+}
+
+/** append plate file or all plate files from directory to the job list */
+static int add_input( const char * path, compression_t compression, size_t * capacity )
+{
+  struct stat st;
+  char ** names = NULL;
+  size_t num_names = 0, i;
+  DIR * dir = NULL;
+  struct dirent * e;
+  int status = -1;
+
+  if ( stat(path, &st) != 0 ) {
+    fprintf(stderr, "Can't stat '%s': %s\n", path, strerror(errno));
+    return -1;
+  }
+
+  if ( !S_ISDIR(st.st_mode) )
+  {
+    if ( !(names = malloc(sizeof(*names))) || !(names[0] = strdup(path)) ) {
+      fprintf(stderr, "malloc() fails: %s\n", strerror(errno));
+      goto end;
+    }
+    num_names = 1;
+  }
+  else if ( !(dir = opendir(path)) ) {
+    fprintf(stderr, "Can't open directory '%s': %s\n", path, strerror(errno));
+    return -1;
+  }
+  else
+  {
+    size_t names_capacity = 0;
+
+    while ( (e = readdir(dir)) )
+    {
+      if ( !is_plate_file_name(e->d_name) ) {
+        continue;
+      }
+
+      if ( num_names == names_capacity )
+      {
+        char ** tmp;
+
+        names_capacity = names_capacity ? 2 * names_capacity : 1024;
+        if ( !(tmp = realloc(names, names_capacity * sizeof(*names))) ) {
+          fprintf(stderr, "realloc() fails: %s\n", strerror(errno));
+          goto end;
+        }
+        names = tmp;
+      }
+
+      if ( !(names[num_names] = malloc(strlen(path) + strlen(e->d_name) + 2)) ) {
+        fprintf(stderr, "malloc() fails: %s\n", strerror(errno));
+        goto end;
+      }
+
+      sprintf(names[num_names++], "%s/%s", path, e->d_name);
+    }
+
+    qsort(names, num_names, sizeof(*names), cmpstr);
+  }
+
+  for ( i = 0; i < num_names; ++i )
+  {
+    if ( num_jobs == *capacity )
+    {
+      size_t new_capacity = *capacity ? 2 * *capacity : 1024;
+      plate_job * tmp;
+
+      if ( !(tmp = realloc(jobs, new_capacity * sizeof(*jobs))) ) {
+        fprintf(stderr, "realloc() fails: %s\n", strerror(errno));
+        goto end;
+      }
+
+      jobs = tmp;
+      *capacity = new_capacity;
+    }
+
+    memset(&jobs[num_jobs], 0, sizeof(jobs[num_jobs]));
+    jobs[num_jobs].fname = names[i];
+    jobs[num_jobs].compression = compression;
+    names[i] = NULL; /* owned by job now */
+    ++num_jobs;
+  }
+
+  status = 0;
+
+end:
+  if ( dir ) {
+    closedir(dir);
+  }
+
+  for ( i = 0; i < num_names; ++i ) {
+    free(names[i]);
+  }
+
+  free(names);
+
+  return status;
+}
+
+
+static void print_header( int print_grid )
+{
+  printf("N\tRAMIN\tRAMAX\tRA0\tDECMIN\tDECMAX\tDEC0\tRASZ\tDECSZ\tXMIN\tXMAX\tX0\tWX0\tYMIN\tYMAX\tY0\tWY0\tXSZ\tYSZ\t"
+      "MRA0\tMDEC0\t"
+      "SMAG05\tSMAG50\tSMAG95\t"
+      "ISKY05\tISKY50\tISKY95\t"
+      "COSMAG05\tCOSMAG50\tCOSMAG95\t"
+      "GRIDMIN\tGRIDMAX\tGRIDEMPTY\t"
+      "PLATE");
+
+  if ( print_grid ) {
+    printf("\tGRID");
+  }
+
+  printf("\n");
+}
+
+static void print_stats( const char * fname, const plate_stats * st, int print_grid )
+{
+  double ramin, ramax, ra0, dec0, x0, y0, wx0, wy0;
+  double mra0, mdec0;
+  uint32_t gmin, gmax, gempty;
+  char name[PATH_MAX];
+  char * suffix;
   int i;
 
-  enum {
-    compression_none,
-    compression_bzip,
-    compression_gzip
-  } compression = compression_none;
+  if ( !st->numobj ) {
+    return;
+  }
 
-  int print_header_line = 0;
+  /* select RA representation giving the smallest span */
+  if ( st->ramax2 - st->ramin2 < st->ramax - st->ramin ) {
+    ramin = st->ramin2;
+    ramax = st->ramax2;
+  }
+  else {
+    ramin = st->ramin;
+    ramax = st->ramax;
+  }
+
+  ra0 = (ramin + ramax) / 2;
+  dec0 = (st->decmin + st->decmax) / 2;
+  x0 = (st->xmin + st->xmax) / 2;
+  y0 = (st->ymin + st->ymax) / 2;
+  wx0 = st->wx0 / st->numobj;
+  wy0 = st->wy0 / st->numobj;
+
+  if ( (mra0 = atan2(st->sy, st->sx)) < 0 ) {
+    mra0 += 2 * PI;
+  }
+  mdec0 = atan2(st->sz, hypot(st->sx, st->sy));
+
+  gmin = gmax = st->grid[0];
+  gempty = 0;
+  for ( i = 0; i < grid_size * grid_size; ++i ) {
+    if ( st->grid[i] < gmin ) {
+      gmin = st->grid[i];
+    }
+    if ( st->grid[i] > gmax ) {
+      gmax = st->grid[i];
+    }
+    if ( !st->grid[i] ) {
+      ++gempty;
+    }
+  }
+
+  /* plate name is file base name without extensions */
+  strncpy(name, fname, sizeof(name) - 1);
+  name[sizeof(name) - 1] = 0;
+  fname = basename(name);
+  if ( (suffix = strstr(fname, ".")) ) {
+    *suffix = 0;
+  }
 
-  double ramin=0, ramax=0, decmin=0, decmax=0;
-  double xmin=0, xmax=0, ymin=0, ymax=0;
-  double ra0, dec0, x0, y0, wx0 = 0, wy0 = 0;
+  printf(
+      "%8d\t"
+      "%16.9f\t%16.9f\t%16.9f\t"
+      "%+16.9f\t%+16.9f\t%+16.9f\t"
+      "%6.3f\t%6.3f\t"
+      "%16.2f\t%16.2f\t%16.2f\t%16.2f\t"
+      "%16.2f\t%16.2f\t%16.2f\t%16.2f\t"
+      "%16.2f\t%16.2f\t"
+      "%16.9f\t%+16.9f\t"
+      "%9.3f\t%9.3f\t%9.3f\t"
+      "%9.1f\t%9.1f\t%9.1f\t"
+      "%9.3f\t%9.3f\t%9.3f\t"
+      "%8u\t%8u\t%4u\t"
+      "%s",
+
+      st->numobj,
+
+      ramin,
+      ramax,
+      ra0,
+
+      st->decmin,
+      st->decmax,
+      dec0,
+
+      (ramax - ramin) * 180 / PI,
+      (st->decmax - st->decmin) * 180 / PI,
+
+      st->xmin,
+      st->xmax,
+      x0,
+      wx0,
+
+      st->ymin,
+      st->ymax,
+      y0,
+      wy0,
+
+      st->xmax - st->xmin,
+      st->ymax - st->ymin,
+
+      mra0,
+      mdec0,
+
+      p2_result(&st->smag[0]), p2_result(&st->smag[1]), p2_result(&st->smag[2]),
+      p2_result(&st->isky[0]), p2_result(&st->isky[1]), p2_result(&st->isky[2]),
+      p2_result(&st->cosmag[0]), p2_result(&st->cosmag[1]), p2_result(&st->cosmag[2]),
+
+      gmin,
+      gmax,
+      gempty,
+
+      fname
+      );
+
+  if ( print_grid ) {
+    for ( i = 0; i < grid_size * grid_size; ++i ) {
+      printf("%c%u", i ? ',' : '\t', st->grid[i]);
+    }
+  }
+
+  printf("\n");
+}
 
-  uint32_t numobj = 0;
+
+int main(int argc, char *argv[])
+{
+  compression_t compression = compression_unknown;
+  int print_header_line = 0;
+  int print_grid = 0;
+  int num_threads = 0;
+  size_t capacity = 0;
+  pthread_t * threads;
+  int num_failed = 0;
+  int i;
 
 
   /* parse command line */
@@ -83,169 +701,100 @@ int main(int argc, char *argv[])
     else if ( strcmp(argv[i],"-h") == 0 ) {
       print_header_line = 1;
     }
-    else if ( inputfilename == NULL ) {
-      inputfilename = argv[i];
+    else if ( strcmp(argv[i],"-g") == 0 ) {
+      print_grid = 1;
     }
-    else {
-      fprintf(stderr, "Too many input file names (only one allowed)\n");
-      show_usage(stderr);
+    else if ( strcmp(argv[i],"-v") == 0 ) {
+      beverbose = 1;
+    }
+    else if ( strcmp(argv[i],"-t") == 0 ) {
+      if ( ++i >= argc || sscanf(argv[i], "%d", &num_threads) != 1 || num_threads < 1 ) {
+        fprintf(stderr, "Invalid or missing number of threads after -t switch\n");
+        return 1;
+      }
+    }
+    else if ( strncmp(argv[i],"grid=", 5) == 0 ) {
+      if ( sscanf(argv[i] + 5, "%d", &grid_size) != 1 || grid_size < 1 || grid_size > MAX_GRID ) {
+        fprintf(stderr, "Invalid value of %s (expected 1..%d)\n", argv[i], MAX_GRID);
+        return 1;
+      }
+    }
+    else if ( add_input(argv[i], compression, &capacity) != 0 ) {
       return 1;
     }
   }
 
-  if ( compression && !inputfilename ) {
-    fprintf(stderr,"error: decompression from stdin is not supported.\n"
-        "Use zcat, bzcat, etc to pipe decompressed data\n");
-    return 1;
+  if ( print_header_line ) {
+    print_header(print_grid);
   }
 
-
-  /* open input file if requested */
-
-  if ( inputfilename )
+  if ( !num_jobs )
   {
-    char cmd[PATH_MAX] = {0};
+    /* read single plate from stdin */
+    plate_stats * st;
 
-    if ( !compression )
-    {
-      const char * suffix;
+    if ( compression > compression_none ) {
+      fprintf(stderr,"error: decompression from stdin is not supported.\n"
+          "Use zcat, bzcat, etc to pipe decompressed data\n");
+      return 1;
+    }
 
-      if ( (suffix = strstr(inputfilename, ".bz2")) && *(suffix + 4) == 0 ) {
-        compression = compression_bzip;
-      }
-      else if ( (suffix = strstr(inputfilename, ".bz")) && *(suffix + 3) == 0 ) {
-        compression = compression_bzip;
-      }
-      else if ( (suffix = strstr(inputfilename, ".gz")) && *(suffix + 3) == 0 ) {
-        compression = compression_gzip;
-      }
+    if ( !(st = malloc(sizeof(*st))) ) {
+      fprintf(stderr, "malloc() fails: %s\n", strerror(errno));
+      return 1;
     }
 
-    switch ( compression )
-    {
-    case compression_bzip:
-      snprintf(cmd, sizeof(cmd) - 1, "bzip2 -dc '%s'", inputfilename);
-      if ( !(input = popen(cmd, "r"))) {
-        fprintf(stderr, "popen('%s') fails: %s\n", cmd, strerror(errno));
-        return errno;
-      }
-      break;
+    if ( process_plate(stdin, st) != 0 ) {
+      fprintf(stderr, "Read error in stdin\n");
+      return 1;
+    }
 
-    case compression_gzip:
-      // snprintf(cmd, sizeof(cmd) - 1, "bash -o pipefail -c \"gzip -dc '%s'\"", inputfilename);
-      snprintf(cmd, sizeof(cmd) - 1, "gzip -dc '%s'", inputfilename);
-      if ( !(input = popen(cmd, "r"))) {
-        fprintf(stderr, "popen('%s') fails: %s\n", cmd, strerror(errno));
-        return errno;
-      }
-      break;
+    print_stats("stdin", st, print_grid);
+    free(st);
+    return 0;
+  }
 
-    case compression_none:
-      if ( !(input = fopen(inputfilename, "r"))) {
-        fprintf(stderr, "fopen('%s') fails: %s\n", inputfilename, strerror(errno));
-        return errno;
-      }
-      break;
 
-    default:
-      fprintf(stderr, "BUG IN CODE: invalid compression tag=%d\n", compression);
-      return 100;
-    }
+  /* process plates on thread pool */
+  if ( num_threads < 1 && (num_threads = sysconf(_SC_NPROCESSORS_ONLN)) < 1 ) {
+    num_threads = 1;
   }
 
+  if ( (size_t) num_threads > num_jobs ) {
+    num_threads = num_jobs;
+  }
 
-  while ( fread(&obj, sizeof(obj), 1, input) == 1 )
-  {
-    if ( !numobj++ )
-    {
-      ramin = ramax = obj.ra;
-      decmin = decmax = obj.dec;
-      wx0 = xmin = xmax = obj.xCen;
-      wy0 = ymin = ymax = obj.yCen;
-    }
-    else
-    {
-      /* special processing for ra wrapping */
-      if ( fabs(obj.ra - ramax) > PI )
-      {
-        if ( ramax > PI ) {
-          ramax -= 2 * PI;
-        }
-        else {
-          obj.ra -= 2 * PI;
-        }
-      }
-
-      minmax8(obj.ra, &ramin, &ramax);
-      minmax8(obj.dec, &decmin, &decmax);
-      minmax8(obj.xCen, &xmin, &xmax);
-      minmax8(obj.yCen, &ymin, &ymax);
+  if ( !(threads = calloc(num_threads, sizeof(*threads))) ) {
+    fprintf(stderr, "calloc() fails: %s\n", strerror(errno));
+    return 1;
+  }
 
-      wx0 += obj.xCen;
-      wy0 += obj.yCen;
+  for ( i = 0; i < num_threads; ++i ) {
+    if ( (errno = pthread_create(&threads[i], NULL, worker_thread, NULL)) ) {
+      fprintf(stderr, "pthread_create() fails: %s\n", strerror(errno));
+      return 1;
     }
   }
 
+  for ( i = 0; i < num_threads; ++i ) {
+    pthread_join(threads[i], NULL);
+  }
 
-  if ( input != stdin ) {
-    if( compression ) {
-      pclose(input);
+  for ( i = 0; i < (int) num_jobs; ++i ) {
+    if ( jobs[i].status == 0 ) {
+      print_stats(jobs[i].fname, &jobs[i].stats, print_grid);
     }
     else {
-      fclose (input);
+      ++num_failed;
     }
   }
 
-  if ( print_header_line ) {
-     printf("N\tRAMIN\tRAMAX\tRA0\tDECMIN\tDECMAX\tDEC0\tRASZ\tDECSZ\tXMIN\tXMAX\tX0\tWX0\tYMIN\tYMAX\tY0\tWY0\tXSZ\tYSZ\n");
-  }
+  free(threads);
 
-  if ( numobj )
-  {
-    ra0 = (ramin + ramax) / 2;
-    dec0 = (decmin + decmax) / 2;
-    x0 = (xmin + xmax) / 2;
-    y0 = (ymin + ymax) / 2;
-    wx0 /= numobj;
-    wy0 /= numobj;
-
-    printf(
-        "%8d\t"
-        "%16.9f\t%16.9f\t%16.9f\t"
-        "%+16.9f\t%+16.9f\t%+16.9f\t"
-        "%6.3f\t%6.3f\t"
-        "%16.2f\t%16.2f\t%16.2f\t%16.2f\t"
-        "%16.2f\t%16.2f\t%16.2f\t%16.2f\t"
-        "%16.2f\t%16.2f\n",
-
-        numobj,
-
-        ramin,
-        ramax,
-        ra0,
-
-        decmin,
-        decmax,
-        dec0,
-
-        (ramax - ramin) * 180 / PI,
-        (decmax - decmin) * 180 / PI,
-
-        xmin,
-        xmax,
-        x0,
-        wx0,
-
-        ymin,
-        ymax,
-        y0,
-        wy0,
-
-        xmax - xmin,
-        ymax - ymin
-        );
+  if ( num_failed ) {
+    fprintf(stderr, "%d of %zu plates failed\n", num_failed, num_jobs);
+    return 1;
   }
 
   return 0;
 }
-
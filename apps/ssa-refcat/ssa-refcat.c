@@ -0,0 +1,1351 @@
+/*
+ * ssa-refcat.c
+ *
+ *  Local reference catalog store (ssa-refcat.h): import of TSV catalog dumps into
+ *  HEALPix-partitioned binary files and cone extraction from them without database access.
+ *
+ *  The import parses rows into fixed size records, sorts them by (tile, dec) in memory chunks
+ *  spilled into temporary runs when the chunk limit is reached, and merges the runs
+ *  into the output file tile by tile, computing the bounding cap of each tile on the way.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <inttypes.h>
+#include "healpix.h"
+#include "ssa-refcat.h"
+#include "popen-decompress.h"
+
+/** Default HEALPix order of tiles: nside 32, 12288 tiles of 1.8 deg */
+#define DEFAULT_ORDER   5
+
+/** Default memory limit of in-memory sort chunk, MB */
+#define DEFAULT_CHUNK   1024
+
+/** Max number of catalog columns */
+#define MAX_COLUMNS     256
+
+
+/** show usage info. */
+static void show_usage( FILE * output )
+{
+  fprintf(output, "Local HEALPix-partitioned reference catalog store\n");
+  fprintf(output, "USAGE:\n");
+  fprintf(output, "   ssa-refcat import [-order N] [-u deg|rad] [ra=NAME] [dec=NAME] [-c NAME[:TYPE],...] [-m MB]\n");
+  fprintf(output, "                     -o CATALOG [TSV-FILE]\n");
+  fprintf(output, "   ssa-refcat cone [-u deg|rad] [-c [ALIAS=]NAME,...] [-e EPOCH [-e0 EPOCH0] -pm MURA,MUDEC]\n");
+  fprintf(output, "                     CATALOG RA DEC RADIUS\n");
+  fprintf(output, "   ssa-refcat info CATALOG\n");
+  fprintf(output, "\n");
+  fprintf(output, "import:\n");
+  fprintf(output, "   converts tab or blank separated table with header line (file, .gz, .bz2 or stdin),\n");
+  fprintf(output, "   e.g. psql 'copy (...) to stdout with csv header delimiter E'\\t'' output, into CATALOG\n");
+  fprintf(output, "   -order N  HEALPix order of tiles (default %d)\n", DEFAULT_ORDER);
+  fprintf(output, "   -u        units of input ra and dec (default rad), they are stored in radians\n");
+  fprintf(output, "   ra=, dec= names of position columns (default ra and dec)\n");
+  fprintf(output, "   -c        other columns to store with their types: int2, int4, int8, float4, float8;\n");
+  fprintf(output, "             all columns by default. Columns without type are int8 if all their values are integers,\n");
+  fprintf(output, "             float8 otherwise. Non-numeric values are errors, empty, NaN, NA, \\N and NULL fields\n");
+  fprintf(output, "             are NULL: NaN for floats and the type minimum for ints, cone prints them as NaN\n");
+  fprintf(output, "   -m MB     memory for in-memory sorting, larger inputs are sorted in temporary runs (default %d)\n",
+      DEFAULT_CHUNK);
+  fprintf(output, "\n");
+  fprintf(output, "cone:\n");
+  fprintf(output, "   prints COLUMNS (default all) of the stars within RADIUS degrees of RA, DEC (radians, or degrees\n");
+  fprintf(output, "   with -u deg; ra and dec are output in the same units). Only the tiles overlapping the cone are read.\n");
+  fprintf(output, "   -e EPOCH  adds rat and dect columns: ra and dec propagated from EPOCH0 (default 2000) to EPOCH\n");
+  fprintf(output, "             with proper motion columns MURA (mu_alpha * cos(dec)) and MUDEC in mas/year\n");
+  fprintf(output, "\n");
+  fprintf(output, "CATALOG is a file name (with '/') or name of $SSA_REFCAT/NAME%s (default directory %s)\n",
+      SSA_REFCAT_SUFFIX, SSA_REFCAT_DEFAULT);
+  fprintf(output, "\n");
+  fprintf(output, "Examples:\n");
+  fprintf(output, "  psql wsdb -c \"copy (select ra,dec,mura,mudec,cdf,objt from ucac4) to stdout with csv header"
+      " delimiter E'\\t'\" \\\n");
+  fprintf(output, "     | ssa-refcat import -c mura:float4,mudec:float4,cdf:int2,objt:int2 -o ucac4\n");
+  fprintf(output, "  ssa-refcat cone -e 1980.25 -pm mura,mudec -c ra=rat,dec=dect,cdf,objt ucac4 0.266 -0.52 6\n");
+}
+
+
+static int has_suffix( const char * s, const char * suffix )
+{
+  size_t n = strlen(s), m = strlen(suffix);
+  return n >= m && strcmp(s + n - m, suffix) == 0;
+}
+
+/** uses fopen() for uncompressed files, and popen() for compressed ones */
+static FILE * open_input( const char * fname, int * piped )
+{
+  const char * program = NULL;
+
+  *piped = 0;
+
+  if ( !fname || strcmp(fname, "-") == 0 ) {
+    return stdin;
+  }
+
+  if ( has_suffix(fname, ".bz2") || has_suffix(fname, ".bz") ) {
+    program = "bzip2";
+  }
+  else if ( has_suffix(fname, ".gz") ) {
+    program = "gzip";
+  }
+
+  *piped = program != NULL;
+
+  return program ? popen_decompress(program, fname) : fopen(fname, "r");
+}
+
+
+/** splits line in place into fields by tabs or by runs of blanks, returns number of fields */
+static int split_fields( char * line, int tabs, char * fields[], int maxfields )
+{
+  char * s = line;
+  int n = 0;
+
+  if ( tabs )
+  {
+    while ( n < maxfields ) {
+      fields[n++] = s;
+      if ( !(s = strpbrk(s, "\t\r\n")) || *s != '\t' ) {
+        if ( s ) {
+          *s = 0;
+        }
+        break;
+      }
+      *s++ = 0;
+    }
+  }
+  else
+  {
+    while ( n < maxfields ) {
+      s += strspn(s, " \t\r\n");
+      if ( !*s ) {
+        break;
+      }
+      fields[n++] = s;
+      s += strcspn(s, " \t\r\n");
+      if ( !*s ) {
+        break;
+      }
+      *s++ = 0;
+    }
+  }
+
+  return n;
+}
+
+
+/***********************************************************************************************************************
+ * import
+ */
+
+/**
+ * Stored column and its input field.
+ *  Import records keep the columns typed with -c as stored, and the columns without type in 16 bytes:
+ *  int64 (SSA_REFCAT_NULL_INT8 unless the field is an integer) and float8 of the same field.
+ *  The stored type of such column, int8 if all its values are integers and float8 otherwise,
+ *  is known only when the whole input is read.
+ */
+typedef
+struct import_column {
+  ssa_refcat_column col;
+  int field;
+  int autotype;         /*< type not given with -c */
+  int nonint;           /*< autotype column has non-integer values */
+  size_t nvalues;       /*< non-NULL values of autotype column */
+  uint32_t offset;      /*< in import record */
+} import_column;
+
+/** sort key of record in chunk */
+typedef
+struct chunk_key {
+  int64_t pix;
+  double dec;
+  size_t idx;
+} chunk_key;
+
+/** sorted run spilled to temporary file */
+typedef
+struct sort_run {
+  FILE * fp;
+  int64_t pix;
+  uint8_t * rec;
+  int eof;
+} sort_run;
+
+/** output catalog being written tile by tile */
+typedef
+struct catalog_writer {
+  FILE * fp;
+  ssa_refcat_header hdr;
+  uint8_t * tile;         /*< records of current tile */
+  size_t tilesize, tilecapacity;
+  int64_t pix;
+  ssa_refcat_tile * tiles;
+  size_t tilescapacity;
+  const import_column * cols;
+  int ncols;
+} catalog_writer;
+
+
+static int cmp_chunk_keys( const void * p1, const void * p2 )
+{
+  const chunk_key * k1 = p1;
+  const chunk_key * k2 = p2;
+
+  if ( k1->pix != k2->pix ) {
+    return k1->pix < k2->pix ? -1 : 1;
+  }
+  if ( k1->dec != k2->dec ) {
+    return k1->dec < k2->dec ? -1 : 1;
+  }
+  return k1->idx < k2->idx ? -1 : k1->idx > k2->idx;
+}
+
+
+/** parses "name[:type],..." list of -c */
+static int parse_import_columns( char * s, import_column cols[], int * ncols )
+{
+  char * name, * type, * save = NULL;
+  int t;
+
+  for ( name = strtok_r(s, ",", &save); name; name = strtok_r(NULL, ",", &save) )
+  {
+    if ( *ncols >= MAX_COLUMNS ) {
+      fprintf(stderr, "Too many columns, max %d\n", MAX_COLUMNS);
+      return -1;
+    }
+
+    t = -1;
+
+    if ( (type = strchr(name, ':')) ) {
+      *type++ = 0;
+      if ( (t = ssa_refcat_type_by_name(type)) < 0 ) {
+        fprintf(stderr, "Unknown column type '%s'\n", type);
+        return -1;
+      }
+    }
+
+    if ( strlen(name) >= SSA_REFCAT_NAME_MAX || !*name ) {
+      fprintf(stderr, "Invalid column name '%s'\n", name);
+      return -1;
+    }
+
+    strcpy(cols[*ncols].col.name, name);
+    cols[*ncols].col.type = t < 0 ? ssa_refcat_float8 : t;
+    cols[*ncols].autotype = t < 0;
+    cols[*ncols].field = -1;
+    ++*ncols;
+  }
+
+  return 0;
+}
+
+
+/** blanks only */
+static int is_blank( const char * s )
+{
+  return s[strspn(s, " \t\r\n")] == 0;
+}
+
+/** NULL field: empty, NaN, NA, \N or NULL */
+static int is_null_field( const char * s )
+{
+  s += strspn(s, " ");
+  return !*s || strcasecmp(s, "nan") == 0 || strcmp(s, "NA") == 0 || strcmp(s, "\\N") == 0
+      || strcasecmp(s, "null") == 0;
+}
+
+/** parses integer in (min, max], min is the NULL value; also accepts integral floats like 1e3 */
+static int parse_int( const char * s, int64_t min, int64_t max, int64_t * v )
+{
+  char * e;
+  double d;
+
+  errno = 0;
+  *v = strtoll(s, &e, 10);
+
+  if ( e != s && is_blank(e) ) {
+    return errno == 0 && *v > min && *v <= max ? 0 : -1;
+  }
+
+  d = strtod(s, &e);
+
+  /* max + 1.0 is exact power of 2 even if max is not representable */
+  if ( e == s || !is_blank(e) || d != floor(d) || !(d > (double) min && d < (double) max + 1.0) ) {
+    return -1;
+  }
+
+  *v = (int64_t) d;
+
+  return 0;
+}
+
+/** stores field text into import record, NULL fields as NaN or SSA_REFCAT_NULL_INT*; -1 if not a valid number */
+static int store_value( uint8_t * rec, import_column * c, const char * s )
+{
+  uint8_t * p = rec + c->offset;
+  int null = is_null_field(s);
+  int64_t i8 = SSA_REFCAT_NULL_INT8;
+  double v = NAN;
+  int32_t i4;
+  int16_t i2;
+  float f4;
+  char * e;
+
+  if ( !null && c->col.type != ssa_refcat_int2 && c->col.type != ssa_refcat_int4
+      && c->col.type != ssa_refcat_int8 ) {
+    v = strtod(s, &e);
+    if ( e == s || !is_blank(e) ) {
+      return -1;
+    }
+  }
+
+  if ( c->autotype ) {
+    if ( !null ) {
+      if ( parse_int(s, SSA_REFCAT_NULL_INT8, INT64_MAX, &i8) != 0 || strpbrk(s, ".eE") ) {
+        i8 = SSA_REFCAT_NULL_INT8;
+        c->nonint = 1;
+      }
+      ++c->nvalues;
+    }
+    memcpy(p, &i8, sizeof(i8));
+    memcpy(p + sizeof(i8), &v, sizeof(v));
+    return 0;
+  }
+
+  switch ( c->col.type ) {
+  case ssa_refcat_int2:
+    if ( !null && parse_int(s, SSA_REFCAT_NULL_INT2, INT16_MAX, &i8) != 0 ) {
+      return -1;
+    }
+    i2 = null ? SSA_REFCAT_NULL_INT2 : (int16_t) i8;
+    memcpy(p, &i2, sizeof(i2));
+    break;
+  case ssa_refcat_int4:
+    if ( !null && parse_int(s, SSA_REFCAT_NULL_INT4, INT32_MAX, &i8) != 0 ) {
+      return -1;
+    }
+    i4 = null ? SSA_REFCAT_NULL_INT4 : (int32_t) i8;
+    memcpy(p, &i4, sizeof(i4));
+    break;
+  case ssa_refcat_int8:
+    if ( !null && parse_int(s, SSA_REFCAT_NULL_INT8, INT64_MAX, &i8) != 0 ) {
+      return -1;
+    }
+    memcpy(p, &i8, sizeof(i8));
+    break;
+  case ssa_refcat_float4:
+    f4 = v;
+    memcpy(p, &f4, sizeof(f4));
+    break;
+  case ssa_refcat_float8:
+    memcpy(p, &v, sizeof(v));
+    break;
+  }
+
+  return 0;
+}
+
+
+/** writes completed tile records and its bounding cap */
+static int flush_tile( catalog_writer * w )
+{
+  const size_t recsize = w->hdr.recsize;
+  const size_t n = w->tilesize;
+  double sx = 0, sy = 0, sz = 0, norm, ra, dec, cosmin = 1, c;
+  ssa_refcat_tile * tile;
+  size_t i;
+
+  if ( n == 0 ) {
+    return 0;
+  }
+
+  if ( w->hdr.ntiles == w->tilescapacity ) {
+    void * p = realloc(w->tiles, (w->tilescapacity = 2 * w->tilescapacity + 1024) * sizeof(*w->tiles));
+    if ( !p ) {
+      return -1;
+    }
+    w->tiles = p;
+  }
+
+  tile = &w->tiles[w->hdr.ntiles++];
+  tile->pix = w->pix;
+  tile->first = w->hdr.nrecs;
+  tile->count = n;
+
+  for ( i = 0; i < n; ++i ) {
+    ssa_refcat_radec(w->tile + i * recsize, &ra, &dec);
+    sx += cos(dec) * cos(ra);
+    sy += cos(dec) * sin(ra);
+    sz += sin(dec);
+  }
+
+  if ( (norm = sqrt(sx * sx + sy * sy + sz * sz)) > 0 ) {
+    tile->cx = sx / norm, tile->cy = sy / norm, tile->cz = sz / norm;
+  }
+  else {
+    ssa_refcat_radec(w->tile, &ra, &dec);
+    tile->cx = cos(dec) * cos(ra), tile->cy = cos(dec) * sin(ra), tile->cz = sin(dec);
+  }
+
+  for ( i = 0; i < n; ++i ) {
+    ssa_refcat_radec(w->tile + i * recsize, &ra, &dec);
+    if ( (c = cos(dec) * (tile->cx * cos(ra) + tile->cy * sin(ra)) + tile->cz * sin(dec)) < cosmin ) {
+      cosmin = c;
+    }
+  }
+
+  tile->radius = acos(fmax(-1, fmin(1, cosmin)));
+
+  if ( fwrite(w->tile, recsize, n, w->fp) != n ) {
+    return -1;
+  }
+
+  w->hdr.nrecs += n;
+  w->tilesize = 0;
+
+  return 0;
+}
+
+/** appends import record of tile pix as stored one, records must come in (pix, dec) order */
+static int write_record( catalog_writer * w, int64_t pix, const uint8_t * rec )
+{
+  const size_t recsize = w->hdr.recsize;
+  uint8_t * dst;
+  int i;
+
+  if ( pix != w->pix ) {
+    if ( flush_tile(w) != 0 ) {
+      return -1;
+    }
+    w->pix = pix;
+  }
+
+  if ( w->tilesize == w->tilecapacity ) {
+    void * p = realloc(w->tile, (w->tilecapacity = 2 * w->tilecapacity + 4096) * recsize);
+    if ( !p ) {
+      return -1;
+    }
+    w->tile = p;
+  }
+
+  dst = w->tile + w->tilesize++ * recsize;
+
+  for ( i = 0; i < w->ncols; ++i ) {
+    const import_column * c = &w->cols[i];
+    /* float8 of autotype column follows its int64 */
+    const size_t skip = c->autotype && c->col.type == ssa_refcat_float8 ? sizeof(int64_t) : 0;
+    memcpy(dst + c->col.offset, rec + c->offset + skip, ssa_refcat_type_size(c->col.type));
+  }
+
+  return 0;
+}
+
+
+/** reads next entry of sorted run */
+static void read_run( sort_run * run, size_t recsize )
+{
+  if ( fread(&run->pix, sizeof(run->pix), 1, run->fp) != 1 || fread(run->rec, recsize, 1, run->fp) != 1 ) {
+    run->eof = 1;
+  }
+}
+
+/** sorts chunk of records and writes them into tmpfile() run (sort_run entries) or straight into catalog */
+static int sort_chunk( const uint8_t * recs, chunk_key * keys, size_t n, size_t recsize, FILE * run,
+    catalog_writer * w )
+{
+  size_t i;
+
+  qsort(keys, n, sizeof(*keys), cmp_chunk_keys);
+
+  for ( i = 0; i < n; ++i )
+  {
+    const uint8_t * rec = recs + keys[i].idx * recsize;
+
+    if ( run ) {
+      if ( fwrite(&keys[i].pix, sizeof(keys[i].pix), 1, run) != 1 || fwrite(rec, recsize, 1, run) != 1 ) {
+        return -1;
+      }
+    }
+    else if ( write_record(w, keys[i].pix, rec) != 0 ) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+
+static int refcat_import( int argc, char * argv[] )
+{
+  import_column cols[MAX_COLUMNS + 2];
+  int ncols = 2;
+  const char * raname = "ra", * decname = "dec";
+  const char * input_name = NULL, * catalog = NULL;
+  int order = DEFAULT_ORDER, degrees = 0, piped = 0, have_columns = 0;
+  size_t chunkmb = DEFAULT_CHUNK;
+
+  char path[PATH_MAX], tmpname[PATH_MAX + 8];
+  catalog_writer w;
+  FILE * input = NULL;
+  char * line = NULL;
+  size_t linecap = 0;
+  ssize_t len;
+
+  char ** header = NULL, ** fields = NULL;
+  size_t maxfields;
+  int nheader = 0, tabs, nf, i, k;
+
+  uint8_t * recs = NULL;
+  chunk_key * keys = NULL;
+  size_t recsize, chunkrecs, n = 0;
+  size_t nrows = 0, nskipped = 0, lineno = 1;
+
+  sort_run * runs = NULL;
+  int nruns = 0;
+
+  int status = 1;
+
+  memset(&w, 0, sizeof(w));
+  memset(cols, 0, sizeof(cols));
+
+  for ( i = 1; i < argc; ++i )
+  {
+    if ( strncmp(argv[i], "ra=", 3) == 0 ) {
+      raname = argv[i] + 3;
+    }
+    else if ( strncmp(argv[i], "dec=", 4) == 0 ) {
+      decname = argv[i] + 4;
+    }
+    else if ( *argv[i] == '-' && argv[i][1] != 0 )
+    {
+      if ( i + 1 >= argc ) {
+        fprintf(stderr, "Missing argument after %s switch\n", argv[i]);
+        return 1;
+      }
+
+      if ( strcmp(argv[i], "-order") == 0 ) {
+        if ( sscanf(argv[++i], "%d", &order) != 1 || order < 0 || order > 13 ) {
+          fprintf(stderr, "Invalid HEALPix order: %s (0..13 expected)\n", argv[i]);
+          return 1;
+        }
+      }
+      else if ( strcmp(argv[i], "-u") == 0 ) {
+        if ( strcmp(argv[++i], "deg") == 0 ) {
+          degrees = 1;
+        }
+        else if ( strcmp(argv[i], "rad") == 0 ) {
+          degrees = 0;
+        }
+        else {
+          fprintf(stderr, "Invalid units: %s\n", argv[i]);
+          return 1;
+        }
+      }
+      else if ( strcmp(argv[i], "-c") == 0 ) {
+        if ( parse_import_columns(argv[++i], cols, &ncols) != 0 ) {
+          return 1;
+        }
+        have_columns = 1;
+      }
+      else if ( strcmp(argv[i], "-m") == 0 ) {
+        if ( sscanf(argv[++i], "%zu", &chunkmb) != 1 || chunkmb < 1 ) {
+          fprintf(stderr, "Invalid memory limit: %s\n", argv[i]);
+          return 1;
+        }
+      }
+      else if ( strcmp(argv[i], "-o") == 0 ) {
+        catalog = argv[++i];
+      }
+      else {
+        fprintf(stderr, "Invalid argument: %s\n", argv[i]);
+        return 1;
+      }
+    }
+    else if ( !input_name ) {
+      input_name = argv[i];
+    }
+    else {
+      fprintf(stderr, "Invalid argument: %s\n", argv[i]);
+      return 1;
+    }
+  }
+
+  if ( !catalog ) {
+    fprintf(stderr, "Output catalog is not specified (-o)\n");
+    return 1;
+  }
+
+  if ( strlen(raname) >= SSA_REFCAT_NAME_MAX || strlen(decname) >= SSA_REFCAT_NAME_MAX ) {
+    fprintf(stderr, "Too long position column name\n");
+    return 1;
+  }
+
+  ssa_refcat_path(catalog, path, sizeof(path));
+  snprintf(tmpname, sizeof(tmpname), "%s.tmp", path);
+
+  if ( !(input = open_input(input_name, &piped)) ) {
+    fprintf(stderr, "Can not read %s: %s\n", input_name, strerror(errno));
+    return 1;
+  }
+
+
+  /* header line defines the fields */
+
+  if ( (len = getline(&line, &linecap, input)) <= 0 ) {
+    fprintf(stderr, "Can not read header line of %s\n", input_name ? input_name : "stdin");
+    goto end;
+  }
+
+  tabs = strchr(line, '\t') != NULL;
+
+  maxfields = len + 1;
+
+  if ( !(header = malloc(len * sizeof(*header))) || !(fields = malloc(maxfields * sizeof(*fields))) ) {
+    fprintf(stderr, "malloc() fails: %s\n", strerror(errno));
+    goto end;
+  }
+
+  nheader = split_fields(line, tabs, fields, len);
+  for ( k = 0; k < nheader; ++k ) {
+    if ( !(header[k] = strdup(fields[k])) ) {
+      fprintf(stderr, "strdup() fails: %s\n", strerror(errno));
+      nheader = k;
+      goto end;
+    }
+  }
+
+  strcpy(cols[0].col.name, raname);
+  strcpy(cols[1].col.name, decname);
+  cols[0].col.type = cols[1].col.type = ssa_refcat_float8;
+  cols[0].field = cols[1].field = -1;
+
+  if ( !have_columns ) {
+    for ( k = 0; k < nheader && ncols < MAX_COLUMNS + 2; ++k ) {
+      if ( strcmp(header[k], raname) != 0 && strcmp(header[k], decname) != 0 ) {
+        if ( strlen(header[k]) >= SSA_REFCAT_NAME_MAX ) {
+          fprintf(stderr, "Too long column name '%s'\n", header[k]);
+          goto end;
+        }
+        strcpy(cols[ncols].col.name, header[k]);
+        cols[ncols].col.type = ssa_refcat_float8;
+        cols[ncols].autotype = 1;
+        cols[ncols++].field = -1;
+      }
+    }
+  }
+
+  for ( i = 0, recsize = 0; i < ncols; ++i )
+  {
+    for ( k = 0; k < nheader; ++k ) {
+      if ( strcmp(header[k], cols[i].col.name) == 0 ) {
+        cols[i].field = k;
+        break;
+      }
+    }
+
+    if ( cols[i].field < 0 ) {
+      fprintf(stderr, "No '%s' column in input\n", cols[i].col.name);
+      goto end;
+    }
+
+    if ( i >= 2 && (cols[i].field == cols[0].field || cols[i].field == cols[1].field) ) {
+      fprintf(stderr, "Position column '%s' is always stored, remove it from -c\n", cols[i].col.name);
+      goto end;
+    }
+
+    cols[i].offset = recsize;
+    recsize += cols[i].autotype ? 2 * sizeof(int64_t) : ssa_refcat_type_size(cols[i].col.type);
+  }
+
+
+  /* output catalog */
+
+  if ( !(w.fp = fopen(tmpname, "w")) ) {
+    fprintf(stderr, "Can not write %s: %s\n", tmpname, strerror(errno));
+    goto end;
+  }
+
+  setvbuf(w.fp, NULL, _IOFBF, 1 << 20);
+
+  memcpy(w.hdr.magic, SSA_REFCAT_MAGIC, sizeof(SSA_REFCAT_MAGIC));
+  w.hdr.version = SSA_REFCAT_VERSION;
+  w.hdr.order = order;
+  w.hdr.ncols = ncols;
+  w.hdr.data_offset = sizeof(w.hdr) + ncols * sizeof(ssa_refcat_column);
+  w.pix = -1;
+  w.cols = cols;
+  w.ncols = ncols;
+
+  /* header and columns are rewritten with the final types when the input is read */
+  if ( fwrite(&w.hdr, sizeof(w.hdr), 1, w.fp) != 1 ) {
+    fprintf(stderr, "Write error on %s: %s\n", tmpname, strerror(errno));
+    goto end;
+  }
+  for ( i = 0; i < ncols; ++i ) {
+    if ( fwrite(&cols[i].col, sizeof(cols[i].col), 1, w.fp) != 1 ) {
+      fprintf(stderr, "Write error on %s: %s\n", tmpname, strerror(errno));
+      goto end;
+    }
+  }
+
+
+  /* parse rows into chunks sorted by (pix, dec) */
+
+  chunkrecs = chunkmb * (1 << 20) / (recsize + sizeof(chunk_key));
+
+  if ( !(recs = malloc(chunkrecs * recsize)) || !(keys = malloc(chunkrecs * sizeof(*keys))) ) {
+    fprintf(stderr, "Can not allocate %zu MB sort chunk: %s\n", chunkmb, strerror(errno));
+    goto end;
+  }
+
+  while ( (len = getline(&line, &linecap, input)) > 0 )
+  {
+    uint8_t * rec = recs + n * recsize;
+    double ra, dec;
+
+    ++lineno;
+
+    if ( (size_t) len + 1 > maxfields ) {
+      void * p = realloc(fields, (maxfields = len + 1) * sizeof(*fields));
+      if ( !p ) {
+        fprintf(stderr, "realloc() fails: %s\n", strerror(errno));
+        goto end;
+      }
+      fields = p;
+    }
+
+    if ( (nf = split_fields(line, tabs, fields, maxfields)) == 0 || (nf == 1 && !*fields[0]) ) {
+      continue;
+    }
+
+    ++nrows;
+
+    for ( i = 0; i < ncols; ++i )
+    {
+      const char * s = cols[i].field < nf ? fields[cols[i].field] : "";
+
+      if ( store_value(rec, &cols[i], s) != 0 ) {
+        if ( cols[i].autotype ) {
+          fprintf(stderr, "Line %zu: non-numeric value '%s' in column '%s'. Text columns can not be stored,"
+              " list the numeric ones with -c\n", lineno, s, cols[i].col.name);
+        }
+        else {
+          fprintf(stderr, "Line %zu: invalid %s value '%s' in column '%s'\n", lineno,
+              ssa_refcat_type_name(cols[i].col.type), s, cols[i].col.name);
+        }
+        goto end;
+      }
+    }
+
+    ssa_refcat_radec(rec, &ra, &dec);
+
+    if ( !isfinite(ra) || !isfinite(dec) ) {
+      ++nskipped;
+      continue;
+    }
+
+    if ( degrees ) {
+      ra *= M_PI / 180, dec *= M_PI / 180;
+      memcpy(rec, &ra, sizeof(ra));
+      memcpy(rec + sizeof(ra), &dec, sizeof(dec));
+    }
+
+    keys[n].pix = healpix_radec2pix_nest(order, ra, dec);
+    keys[n].dec = dec;
+    keys[n].idx = n;
+
+    if ( ++n == chunkrecs )
+    {
+      void * p;
+
+      if ( !(p = realloc(runs, (nruns + 1) * sizeof(*runs))) ) {
+        fprintf(stderr, "realloc() fails: %s\n", strerror(errno));
+        goto end;
+      }
+
+      runs = p;
+      memset(&runs[nruns], 0, sizeof(runs[nruns]));
+
+      if ( !(runs[nruns].fp = tmpfile()) ) {
+        fprintf(stderr, "tmpfile() fails: %s\n", strerror(errno));
+        goto end;
+      }
+
+      if ( sort_chunk(recs, keys, n, recsize, runs[nruns++].fp, &w) != 0 ) {
+        fprintf(stderr, "Write error on temporary file: %s\n", strerror(errno));
+        goto end;
+      }
+
+      n = 0;
+    }
+  }
+
+  if ( ferror(input) ) {
+    fprintf(stderr, "Read error: %s\n", strerror(errno));
+    goto end;
+  }
+
+  /* stored types and layout */
+  for ( i = 0, w.hdr.recsize = 0; i < ncols; ++i ) {
+    if ( cols[i].autotype ) {
+      cols[i].col.type = cols[i].nvalues && !cols[i].nonint ? ssa_refcat_int8 : ssa_refcat_float8;
+    }
+    cols[i].col.offset = w.hdr.recsize;
+    w.hdr.recsize += ssa_refcat_type_size(cols[i].col.type);
+  }
+
+  if ( nruns == 0 ) {
+    if ( sort_chunk(recs, keys, n, recsize, NULL, &w) != 0 ) {
+      fprintf(stderr, "Write error on %s: %s\n", tmpname, strerror(errno));
+      goto end;
+    }
+  }
+  else
+  {
+    /* the last chunk is merged from memory as one more run */
+    uint8_t * last = recs;
+    size_t ilast = 0;
+
+    qsort(keys, n, sizeof(*keys), cmp_chunk_keys);
+
+    for ( k = 0; k < nruns; ++k ) {
+      rewind(runs[k].fp);
+      if ( !(runs[k].rec = malloc(recsize)) ) {
+        fprintf(stderr, "malloc() fails: %s\n", strerror(errno));
+        goto end;
+      }
+      read_run(&runs[k], recsize);
+    }
+
+    while ( 1 )
+    {
+      int best = -1;
+      int64_t bpix = 0;
+      double bdec = 0, dec, ra;
+
+      /* smallest (pix, dec) of run heads and the memory chunk, -2 is the chunk */
+      for ( k = 0; k < nruns; ++k ) {
+        if ( !runs[k].eof ) {
+          ssa_refcat_radec(runs[k].rec, &ra, &dec);
+          if ( best == -1 || runs[k].pix < bpix || (runs[k].pix == bpix && dec < bdec) ) {
+            best = k, bpix = runs[k].pix, bdec = dec;
+          }
+        }
+      }
+
+      if ( ilast < n && (best == -1 || keys[ilast].pix < bpix || (keys[ilast].pix == bpix && keys[ilast].dec < bdec)) ) {
+        best = -2;
+      }
+
+      if ( best == -1 ) {
+        break;
+      }
+
+      if ( best == -2 ) {
+        if ( write_record(&w, keys[ilast].pix, last + keys[ilast].idx * recsize) != 0 ) {
+          fprintf(stderr, "Write error on %s: %s\n", tmpname, strerror(errno));
+          goto end;
+        }
+        ++ilast;
+      }
+      else {
+        if ( write_record(&w, runs[best].pix, runs[best].rec) != 0 ) {
+          fprintf(stderr, "Write error on %s: %s\n", tmpname, strerror(errno));
+          goto end;
+        }
+        read_run(&runs[best], recsize);
+      }
+    }
+
+    for ( k = 0; k < nruns; ++k ) {
+      if ( ferror(runs[k].fp) ) {
+        fprintf(stderr, "Read error on temporary file\n");
+        goto end;
+      }
+    }
+  }
+
+  if ( flush_tile(&w) != 0 ) {
+    fprintf(stderr, "Write error on %s: %s\n", tmpname, strerror(errno));
+    goto end;
+  }
+
+  w.hdr.tiles_offset = w.hdr.data_offset + w.hdr.nrecs * w.hdr.recsize;
+
+  if ( fwrite(w.tiles, sizeof(*w.tiles), w.hdr.ntiles, w.fp) != w.hdr.ntiles || fseek(w.fp, 0, SEEK_SET) != 0
+      || fwrite(&w.hdr, sizeof(w.hdr), 1, w.fp) != 1 ) {
+    fprintf(stderr, "Write error on %s: %s\n", tmpname, strerror(errno));
+    goto end;
+  }
+  for ( i = 0; i < ncols; ++i ) {
+    if ( fwrite(&cols[i].col, sizeof(cols[i].col), 1, w.fp) != 1 ) {
+      fprintf(stderr, "Write error on %s: %s\n", tmpname, strerror(errno));
+      goto end;
+    }
+  }
+
+  if ( fclose(w.fp) != 0 ) {
+    w.fp = NULL;
+    fprintf(stderr, "Write error on %s: %s\n", tmpname, strerror(errno));
+    goto end;
+  }
+
+  w.fp = NULL;
+
+  if ( rename(tmpname, path) != 0 ) {
+    fprintf(stderr, "rename('%s', '%s') fails: %s\n", tmpname, path, strerror(errno));
+    goto end;
+  }
+
+  fprintf(stderr, "%" PRIu64 " stars in %" PRIu64 " tiles saved into %s", w.hdr.nrecs, w.hdr.ntiles, path);
+  if ( nskipped ) {
+    fprintf(stderr, ", %zu of %zu rows without position skipped", nskipped, nrows);
+  }
+  fprintf(stderr, "\n");
+
+  status = 0;
+
+end:
+  if ( input ) {
+    if ( piped ) {
+      if ( pclose(input) != 0 && status == 0 ) {
+        fprintf(stderr, "Input decompression fails\n");
+        unlink(path);
+        status = 1;
+      }
+    }
+    else if ( input != stdin ) {
+      fclose(input);
+    }
+  }
+
+  if ( w.fp ) {
+    fclose(w.fp);
+    unlink(tmpname);
+  }
+
+  for ( k = 0; k < nruns; ++k ) {
+    if ( runs[k].fp ) {
+      fclose(runs[k].fp);
+    }
+    free(runs[k].rec);
+  }
+
+  for ( k = 0; k < nheader; ++k ) {
+    free(header[k]);
+  }
+
+  free(runs);
+  free(recs);
+  free(keys);
+  free(header);
+  free(fields);
+  free(line);
+  free(w.tile);
+  free(w.tiles);
+
+  return status;
+}
+
+
+/***********************************************************************************************************************
+ * cone
+ */
+
+/** output column: stored column or propagated position */
+typedef
+struct cone_column {
+  char name[SSA_REFCAT_NAME_MAX];
+  const ssa_refcat_column * col;  /*< NULL for rat and dect */
+  int kind;                       /*< 0 stored, 1 ra, 2 dec, 3 rat, 4 dect */
+} cone_column;
+
+typedef
+struct cone_output {
+  FILE * fp;
+  const cone_column * cols;
+  int ncols;
+  double units;                   /*< radians to output units */
+  double dt;                      /*< years of proper motion */
+  const ssa_refcat_column * mura, * mudec;
+  size_t count;
+} cone_output;
+
+
+static void print_value( FILE * fp, double v, ssa_refcat_type_t type )
+{
+  if ( isnan(v) ) {
+    fputs("NaN", fp);
+  }
+  else if ( type == ssa_refcat_float4 ) {
+    fprintf(fp, "%.7g", v);
+  }
+  else if ( type == ssa_refcat_float8 ) {
+    fprintf(fp, "%.15g", v);
+  }
+  else {
+    fprintf(fp, "%.0f", v);
+  }
+}
+
+/** prints stored column, int8 directly since ids do not fit into double */
+static void print_column( FILE * fp, const void * rec, const ssa_refcat_column * col )
+{
+  int64_t i8;
+
+  if ( col->type != ssa_refcat_int8 ) {
+    print_value(fp, ssa_refcat_value(rec, col), col->type);
+  }
+  else if ( memcpy(&i8, (const uint8_t *) rec + col->offset, sizeof(i8)), i8 == SSA_REFCAT_NULL_INT8 ) {
+    fputs("NaN", fp);
+  }
+  else {
+    fprintf(fp, "%" PRId64, i8);
+  }
+}
+
+static int print_star( const void * rec, void * arg )
+{
+  cone_output * out = arg;
+  double ra, dec, rat = 0, dect = 0;
+  int i;
+
+  ssa_refcat_radec(rec, &ra, &dec);
+
+  if ( out->mura ) {
+    /* mas/year, mura includes cos(dec) */
+    dect = dec + out->dt * ssa_refcat_value(rec, out->mudec) * M_PI / (1000.0 * 3600 * 180);
+    rat = ra + out->dt * ssa_refcat_value(rec, out->mura) * M_PI / (1000.0 * 3600 * 180 * cos(dec));
+  }
+
+  for ( i = 0; i < out->ncols; ++i )
+  {
+    const cone_column * c = &out->cols[i];
+
+    if ( i > 0 ) {
+      fputc('\t', out->fp);
+    }
+
+    switch ( c->kind ) {
+    case 1:
+      print_value(out->fp, ra * out->units, ssa_refcat_float8);
+      break;
+    case 2:
+      print_value(out->fp, dec * out->units, ssa_refcat_float8);
+      break;
+    case 3:
+      print_value(out->fp, rat * out->units, ssa_refcat_float8);
+      break;
+    case 4:
+      print_value(out->fp, dect * out->units, ssa_refcat_float8);
+      break;
+    default:
+      print_column(out->fp, rec, c->col);
+      break;
+    }
+  }
+
+  fputc('\n', out->fp);
+  ++out->count;
+
+  return ferror(out->fp) ? -1 : 0;
+}
+
+
+/** adds output column "[alias=]name" */
+static int add_cone_column( const ssa_refcat * cat, const char * spec, int pm, cone_column cols[], int * ncols )
+{
+  const char * name = strchr(spec, '=');
+  cone_column * c = &cols[*ncols];
+  size_t aliaslen;
+  int k;
+
+  if ( *ncols >= MAX_COLUMNS + 2 ) {
+    fprintf(stderr, "Too many columns\n");
+    return -1;
+  }
+
+  aliaslen = name ? (size_t) (name - spec) : strlen(spec);
+  name = name ? name + 1 : spec;
+
+  if ( aliaslen == 0 || aliaslen >= SSA_REFCAT_NAME_MAX ) {
+    fprintf(stderr, "Invalid column name '%s'\n", spec);
+    return -1;
+  }
+
+  memset(c, 0, sizeof(*c));
+  memcpy(c->name, spec, aliaslen);
+
+  if ( pm && strcmp(name, "rat") == 0 ) {
+    c->kind = 3;
+  }
+  else if ( pm && strcmp(name, "dect") == 0 ) {
+    c->kind = 4;
+  }
+  else if ( (k = ssa_refcat_find_column(cat, name)) < 0 ) {
+    fprintf(stderr, "No '%s' column in catalog\n", name);
+    return -1;
+  }
+  else {
+    c->col = &cat->cols[k];
+    c->kind = k < 2 ? k + 1 : 0;
+  }
+
+  ++*ncols;
+  return 0;
+}
+
+
+static int refcat_cone( int argc, char * argv[] )
+{
+  cone_column cols[MAX_COLUMNS + 2];
+  cone_output out;
+  const char * colspec = NULL, * pmspec = NULL, * args[4];
+  double epoch = NAN, epoch0 = 2000, ra, dec, radius;
+  int degrees = 0, nargs = 0, ncols = 0, i, k;
+  char path[PATH_MAX], * s, * save = NULL;
+  ssa_refcat * cat;
+  int status = 1;
+
+  for ( i = 1; i < argc; ++i )
+  {
+    if ( *argv[i] == '-' && argv[i][1] != 0 && !(argv[i][1] >= '0' && argv[i][1] <= '9') && argv[i][1] != '.' )
+    {
+      if ( i + 1 >= argc ) {
+        fprintf(stderr, "Missing argument after %s switch\n", argv[i]);
+        return 1;
+      }
+
+      if ( strcmp(argv[i], "-u") == 0 ) {
+        if ( strcmp(argv[++i], "deg") == 0 ) {
+          degrees = 1;
+        }
+        else if ( strcmp(argv[i], "rad") == 0 ) {
+          degrees = 0;
+        }
+        else {
+          fprintf(stderr, "Invalid units: %s\n", argv[i]);
+          return 1;
+        }
+      }
+      else if ( strcmp(argv[i], "-c") == 0 ) {
+        colspec = argv[++i];
+      }
+      else if ( strcmp(argv[i], "-pm") == 0 ) {
+        pmspec = argv[++i];
+      }
+      else if ( strcmp(argv[i], "-e") == 0 || strcmp(argv[i], "-e0") == 0 ) {
+        if ( sscanf(argv[i + 1], "%lf", strcmp(argv[i], "-e") == 0 ? &epoch : &epoch0) != 1 ) {
+          fprintf(stderr, "Invalid epoch: %s\n", argv[i + 1]);
+          return 1;
+        }
+        ++i;
+      }
+      else {
+        fprintf(stderr, "Invalid argument: %s\n", argv[i]);
+        return 1;
+      }
+    }
+    else if ( nargs < 4 ) {
+      args[nargs++] = argv[i];
+    }
+    else {
+      fprintf(stderr, "Invalid argument: %s\n", argv[i]);
+      return 1;
+    }
+  }
+
+  if ( nargs != 4 ) {
+    fprintf(stderr, "CATALOG RA DEC RADIUS expected\n");
+    return 1;
+  }
+
+  if ( sscanf(args[1], "%lf", &ra) != 1 || sscanf(args[2], "%lf", &dec) != 1 || sscanf(args[3], "%lf", &radius) != 1
+      || radius < 0 ) {
+    fprintf(stderr, "Invalid cone: %s %s %s\n", args[1], args[2], args[3]);
+    return 1;
+  }
+
+  if ( isnan(epoch) != !pmspec ) {
+    fprintf(stderr, "-e and -pm must be given together\n");
+    return 1;
+  }
+
+  if ( degrees ) {
+    ra *= M_PI / 180, dec *= M_PI / 180;
+  }
+  radius *= M_PI / 180;
+
+  ssa_refcat_path(args[0], path, sizeof(path));
+
+  if ( !(cat = ssa_refcat_open(path)) ) {
+    fprintf(stderr, "Can't open catalog '%s': %s\n", path, strerror(errno));
+    return 1;
+  }
+
+  memset(&out, 0, sizeof(out));
+  out.fp = stdout;
+  out.units = degrees ? 180 / M_PI : 1;
+
+  if ( pmspec )
+  {
+    char mura[SSA_REFCAT_NAME_MAX] = "";
+    const char * comma = strchr(pmspec, ',');
+
+    if ( !comma || (size_t) (comma - pmspec) >= sizeof(mura) ) {
+      fprintf(stderr, "Invalid proper motion columns: %s\n", pmspec);
+      goto end;
+    }
+
+    memcpy(mura, pmspec, comma - pmspec);
+
+    if ( (k = ssa_refcat_find_column(cat, mura)) < 0 ) {
+      fprintf(stderr, "No '%s' column in catalog\n", mura);
+      goto end;
+    }
+    out.mura = &cat->cols[k];
+
+    if ( (k = ssa_refcat_find_column(cat, comma + 1)) < 0 ) {
+      fprintf(stderr, "No '%s' column in catalog\n", comma + 1);
+      goto end;
+    }
+    out.mudec = &cat->cols[k];
+
+    out.dt = epoch - epoch0;
+  }
+
+  if ( colspec )
+  {
+    char * spec = strdup(colspec);
+
+    for ( s = strtok_r(spec, ",", &save); s; s = strtok_r(NULL, ",", &save) ) {
+      if ( add_cone_column(cat, s, pmspec != NULL, cols, &ncols) != 0 ) {
+        free(spec);
+        goto end;
+      }
+    }
+
+    free(spec);
+  }
+  else
+  {
+    if ( pmspec ) {
+      add_cone_column(cat, "rat", 1, cols, &ncols);
+      add_cone_column(cat, "dect", 1, cols, &ncols);
+    }
+
+    for ( k = 0; k < (int) cat->hdr->ncols; ++k ) {
+      char name[SSA_REFCAT_NAME_MAX + 1] = "";
+      memcpy(name, cat->cols[k].name, SSA_REFCAT_NAME_MAX);
+      if ( add_cone_column(cat, name, 0, cols, &ncols) != 0 ) {
+        goto end;
+      }
+    }
+  }
+
+  out.cols = cols;
+  out.ncols = ncols;
+
+  setvbuf(stdout, NULL, _IOFBF, 1 << 20);
+
+  for ( i = 0; i < ncols; ++i ) {
+    printf("%s%s", i ? "\t" : "", cols[i].name);
+  }
+  putchar('\n');
+
+  if ( ssa_refcat_cone(cat, ra, dec, radius, print_star, &out) != 0 || fflush(stdout) != 0 ) {
+    fprintf(stderr, "Write error: %s\n", strerror(errno));
+    goto end;
+  }
+
+  status = 0;
+
+end:
+  ssa_refcat_close(cat);
+
+  return status;
+}
+
+
+/***********************************************************************************************************************
+ * info
+ */
+
+static int refcat_info( int argc, char * argv[] )
+{
+  char path[PATH_MAX];
+  ssa_refcat * cat;
+  uint64_t t, maxcount = 0;
+  double maxradius = 0;
+  uint32_t i;
+
+  if ( argc != 2 ) {
+    fprintf(stderr, "CATALOG expected\n");
+    return 1;
+  }
+
+  ssa_refcat_path(argv[1], path, sizeof(path));
+
+  if ( !(cat = ssa_refcat_open(path)) ) {
+    fprintf(stderr, "Can't open catalog '%s': %s\n", path, strerror(errno));
+    return 1;
+  }
+
+  for ( t = 0; t < cat->hdr->ntiles; ++t ) {
+    if ( cat->tiles[t].count > maxcount ) {
+      maxcount = cat->tiles[t].count;
+    }
+    if ( cat->tiles[t].radius > maxradius ) {
+      maxradius = cat->tiles[t].radius;
+    }
+  }
+
+  printf("catalog: %s\n", path);
+  printf("stars  : %" PRIu64 "\n", cat->hdr->nrecs);
+  printf("order  : %u (%" PRId64 " tiles, %" PRIu64 " not empty, max %" PRIu64 " stars, max radius %.3f deg)\n",
+      cat->hdr->order, healpix_npix(cat->hdr->order), cat->hdr->ntiles, maxcount, maxradius * 180 / M_PI);
+  printf("record : %u bytes\n", cat->hdr->recsize);
+
+  for ( i = 0; i < cat->hdr->ncols; ++i ) {
+    printf("  %-*.*s %s%s\n", SSA_REFCAT_NAME_MAX, SSA_REFCAT_NAME_MAX, cat->cols[i].name,
+        ssa_refcat_type_name(cat->cols[i].type), i < 2 ? " (radians)" : "");
+  }
+
+  ssa_refcat_close(cat);
+
+  return 0;
+}
+
+
+int main( int argc, char * argv[] )
+{
+  if ( argc < 2 || strcmp(argv[1], "-help") == 0 || strcmp(argv[1], "--help") == 0 ) {
+    show_usage(argc < 2 ? stderr : stdout);
+    return argc < 2;
+  }
+
+  if ( strcmp(argv[1], "import") == 0 ) {
+    return refcat_import(argc - 1, argv + 1);
+  }
+
+  if ( strcmp(argv[1], "cone") == 0 ) {
+    return refcat_cone(argc - 1, argv + 1);
+  }
+
+  if ( strcmp(argv[1], "info") == 0 ) {
+    return refcat_info(argc - 1, argv + 1);
+  }
+
+  fprintf(stderr, "Invalid command: %s\n", argv[1]);
+  show_usage(stderr);
+
+  return 1;
+}
@@ -8,6 +8,7 @@
 
 #include "ssa-source.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -19,16 +20,58 @@
 #define PI                      M_PI
 #define INCLUDE_COLUMNS_HEADER  1
 #define INCLUDE_RECORD_INDEX    2
-#define CHECK_RAMIN    			4
-#define CHECK_RAMAX    			8
-#define CHECK_DECMIN    		16
-#define CHECK_DECMAX    		32
-#define CHECK_MAGMIN    		64
-#define CHECK_MAGMAX    		128
+
+/** Number of records processed at once */
+#define BATCH_SIZE              65536
+
+/** Magnitudes below this value are default (missing) values */
+#define MISSING_MAG             -99
+
+
+/** Column types available for range selection */
+enum {
+  column_float8,
+  column_float4,
+  column_int8,
+};
+
+/** Columns available for range selection */
+static const struct {
+  const char * name;
+  size_t offset;
+  int type;
+} columns[] = {
+  { "ra",         offsetof(ssa_source, ra),         column_float8 },
+  { "dec",        offsetof(ssa_source, dec),        column_float8 },
+  { "muAcosD",    offsetof(ssa_source, muAcosD),    column_float4 },
+  { "muD",        offsetof(ssa_source, muD),        column_float4 },
+  { "Nplates",    offsetof(ssa_source, Nplates),    column_int8   },
+  { "classMagB",  offsetof(ssa_source, classMagB),  column_float4 },
+  { "classMagR1", offsetof(ssa_source, classMagR1), column_float4 },
+  { "classMagR2", offsetof(ssa_source, classMagR2), column_float4 },
+  { "classMagI",  offsetof(ssa_source, classMagI),  column_float4 },
+  { "sCorMagB",   offsetof(ssa_source, sCorMagB),   column_float4 },
+  { "sCorMagR1",  offsetof(ssa_source, sCorMagR1),  column_float4 },
+  { "sCorMagR2",  offsetof(ssa_source, sCorMagR2),  column_float4 },
+  { "sCorMagI",   offsetof(ssa_source, sCorMagI),   column_float4 },
+};
+
+#define NUM_COLUMNS   (sizeof(columns) / sizeof(columns[0]))
+
+/** Range predicate lo <= column <= hi, applied if active; NaN passes if keepnan is set */
+typedef
+struct range_s {
+  double lo, hi;
+  int active;
+  int keepnan;
+} range_s;
+
 
 
 static void show_usage( FILE * output )
 {
+  size_t i;
+
   fprintf(output,"Dump SuperCOSMOS binary 'source' file to stdout as text\n");
   fprintf(output,"USAGE:\n");
   fprintf(output,"   ssa-source-dump [OPTIONS] [FILE]\n");
@@ -37,9 +80,120 @@ static void show_usage( FILE * output )
   fprintf(output,"   -r  include (one-based) record index\n");
   fprintf(output,"   minmag=float  minimal (bright) output magnitude\n");
   fprintf(output,"   maxmag=float  maximal (faint) output magnitude\n");
+  fprintf(output,"       The minmag/maxmag range is applied to sCorMag of all measured bands,\n");
+  fprintf(output,"       the record is selected if any band falls into range\n");
+  fprintf(output,"   <column>min=float  minimal value of column\n");
+  fprintf(output,"   <column>max=float  maximal value of column\n");
+  fprintf(output,"       Supported columns are:");
+  for ( i = 0; i < NUM_COLUMNS; ++i ) {
+    fprintf(output," %s", columns[i].name);
+  }
+  fprintf(output,"\n");
+  fprintf(output,"       Records with |muAcosD| or |muD| above 10000 are dropped unless explicit range given\n");
   fprintf(output,"If no input file is given then read plate file from stdin (to allow piped processing)\n");
   fprintf(output,"Examples:\n");
   fprintf(output," ssa-source-dump -h ssaSource000ra030.bin\n");
+  fprintf(output," ssa-source-dump sCorMagBmax=18 Nplatesmin=3 ssaSource000ra030.bin\n");
+}
+
+
+/** read up to maxcount whole records, returns number of records read */
+static size_t read_batch( int input, ssa_source * batch, size_t maxcount )
+{
+  const size_t size = maxcount * sizeof(*batch);
+  size_t total = 0;
+  ssize_t cb;
+
+  while ( total < size && (cb = read(input, (uint8_t*) batch + total, size - total)) > 0 ) {
+    total += cb;
+  }
+
+  return total / sizeof(*batch);
+}
+
+/** gather single column of the batch into contiguous vector */
+static void gather_column( size_t n, const ssa_source * batch, size_t col, double v[] )
+{
+  const uint8_t * p = (const uint8_t *) batch + columns[col].offset;
+  size_t i;
+
+  switch ( columns[col].type )
+  {
+  case column_float8:
+    for ( i = 0; i < n; ++i, p += sizeof(*batch) ) {
+      float8 x;
+      memcpy(&x, p, sizeof(x));
+      v[i] = x;
+    }
+    break;
+
+  case column_float4:
+    for ( i = 0; i < n; ++i, p += sizeof(*batch) ) {
+      float4 x;
+      memcpy(&x, p, sizeof(x));
+      v[i] = x;
+    }
+    break;
+
+  case column_int8:
+    for ( i = 0; i < n; ++i, p += sizeof(*batch) ) {
+      v[i] = *(const int8_t *) p;
+    }
+    break;
+  }
+}
+
+/** sel[i] &= lo <= v[i] <= hi. Branch-free to allow the compiler vectorize this loop */
+static void select_range( size_t n, const double v[], double lo, double hi, uint8_t sel[] )
+{
+  size_t i;
+  for ( i = 0; i < n; ++i ) {
+    sel[i] &= (v[i] >= lo) & (v[i] <= hi);
+  }
+}
+
+/** sel[i] &= !(v[i] < lo || v[i] > hi): drops out-of-range values only, NaN passes */
+static void reject_range( size_t n, const double v[], double lo, double hi, uint8_t sel[] )
+{
+  size_t i;
+  for ( i = 0; i < n; ++i ) {
+    sel[i] &= !((v[i] < lo) | (v[i] > hi));
+  }
+}
+
+/** any[i] |= lo <= v[i] <= hi for measured magnitudes only */
+static void select_any_mag( size_t n, const double v[], double lo, double hi, uint8_t any[] )
+{
+  size_t i;
+  for ( i = 0; i < n; ++i ) {
+    any[i] |= (v[i] > MISSING_MAG) & (v[i] >= lo) & (v[i] <= hi);
+  }
+}
+
+/** parse 'min=' or 'max=' value into the range */
+static int parse_range( const char * arg, const char * value, int ismax, range_s * range )
+{
+  double x;
+
+  if ( sscanf(value, "%lf", &x) != 1 ) {
+    fprintf(stderr,"Invalid value of %s.\n", arg);
+    return -1;
+  }
+
+  if ( !range->active ) {
+    range->lo = -INFINITY;
+    range->hi = +INFINITY;
+    range->active = 1;
+  }
+
+  if ( ismax ) {
+    range->hi = x;
+  }
+  else {
+    range->lo = x;
+  }
+
+  return 0;
 }
 
 
@@ -51,10 +205,16 @@ int main(int argc, char *argv[])
   int output_options = 0;
   int i;
 
-  ssa_source obj;
+  ssa_source * batch = NULL;
+  double * v = NULL;
+  uint8_t * sel = NULL;
+  uint8_t * any = NULL;
+  size_t n, k, col;
 
-  double ramin, ramax, decmin, decmax;
-//  double minmag, maxmag;
+  range_s ranges[NUM_COLUMNS];
+  range_s magrange = { -INFINITY, +INFINITY, 0, 0 };
+
+  memset(ranges, 0, sizeof(ranges));
 
 
 
@@ -84,37 +244,39 @@ int main(int argc, char *argv[])
         }
       }
     }
-    else if ( strncmp(argv[i],"ramin=",6) == 0)
-    {
-		if ( sscanf(argv[i]+6,"%lf", &ramin) != 1 ) {
-			fprintf(stderr,"Invalid value of %s.\n", argv[i]);
-			return -1;
-		}
-		output_options |= CHECK_RAMIN;
-    }
-    else if ( strncmp(argv[i],"ramax=",6) == 0)
+    else if ( strncmp(argv[i],"minmag=",7) == 0 )
     {
-		if ( sscanf(argv[i]+6,"%lf", &ramax) != 1 ) {
-			fprintf(stderr,"Invalid value of %s.\n", argv[i]);
-			return -1;
-		}
-		output_options |= CHECK_RAMAX;
+      if ( parse_range(argv[i], argv[i] + 7, 0, &magrange) != 0 ) {
+        return -1;
+      }
     }
-    else if ( strncmp(argv[i],"decmin=",7) == 0)
+    else if ( strncmp(argv[i],"maxmag=",7) == 0 )
     {
-		if ( sscanf(argv[i]+7,"%lf", &decmin) != 1 ) {
-			fprintf(stderr,"Invalid value of %s.\n", argv[i]);
-			return -1;
-		}
-		output_options |= CHECK_DECMIN;
+      if ( parse_range(argv[i], argv[i] + 7, 1, &magrange) != 0 ) {
+        return -1;
+      }
     }
-    else if ( strncmp(argv[i],"decmax=",7) == 0)
+    else if ( strchr(argv[i], '=') )
     {
-		if ( sscanf(argv[i]+7,"%lf", &decmax) != 1 ) {
-			fprintf(stderr,"Invalid value of %s.\n", argv[i]);
-			return -1;
-		}
-		output_options |= CHECK_DECMAX;
+      const char * eq = strchr(argv[i], '=');
+      const size_t len = eq - argv[i];
+
+      for ( col = 0; col < NUM_COLUMNS; ++col ) {
+        const size_t nlen = strlen(columns[col].name);
+        if ( len == nlen + 3 && strncmp(argv[i], columns[col].name, nlen) == 0 &&
+            (strncmp(argv[i] + nlen, "min", 3) == 0 || strncmp(argv[i] + nlen, "max", 3) == 0) ) {
+          break;
+        }
+      }
+
+      if ( col == NUM_COLUMNS ) {
+        fprintf(stderr, "Invalid argument '%s'.\n", argv[i]);
+        return -1;
+      }
+
+      if ( parse_range(argv[i], eq + 1, argv[i][len - 2] == 'a', &ranges[col]) != 0 ) {
+        return -1;
+      }
     }
     else if ( !inputfilename )
     {
@@ -126,6 +288,27 @@ int main(int argc, char *argv[])
     }
   }
 
+  /* drop records with invalid proper motions unless explicit range is requested,
+   * records without proper motions (NaN) are kept as before */
+  for ( col = 0; col < NUM_COLUMNS; ++col ) {
+    if ( !ranges[col].active && (strcmp(columns[col].name, "muAcosD") == 0 || strcmp(columns[col].name, "muD") == 0) ) {
+      ranges[col].lo = -10000;
+      ranges[col].hi = +10000;
+      ranges[col].active = 1;
+      ranges[col].keepnan = 1;
+    }
+  }
+
+  /* allocate batch buffers */
+  batch = malloc(BATCH_SIZE * sizeof(*batch));
+  v = malloc(BATCH_SIZE * sizeof(*v));
+  sel = malloc(BATCH_SIZE * sizeof(*sel));
+  any = malloc(BATCH_SIZE * sizeof(*any));
+  if ( !batch || !v || !sel || !any ) {
+    fprintf(stderr, "malloc() fails: %s\n", strerror(errno));
+    return -1;
+  }
+
   /* open input file if requested */
   if ( inputfilename && (input = open(inputfilename, O_RDONLY)) == -1 ) {
     fprintf(stderr, "Can't read '%s': %s\n", inputfilename, strerror(errno));
@@ -194,149 +377,174 @@ int main(int argc, char *argv[])
   );
 
 
-  while ( read(input, &obj, sizeof(obj)) == sizeof(obj) )
+  while ( (n = read_batch(input, batch, BATCH_SIZE)) > 0 )
   {
-    if ((output_options & CHECK_RAMIN) && obj.ra < ramin) {
-      continue;
-    }
+    /* evaluate range predicates column-wise over whole batch */
+    memset(sel, 1, n);
 
-    if ((output_options & CHECK_RAMAX) && obj.ra > ramax) {
-      continue;
+    for ( col = 0; col < NUM_COLUMNS; ++col ) {
+      if ( ranges[col].active ) {
+        gather_column(n, batch, col, v);
+        if ( ranges[col].keepnan ) {
+          reject_range(n, v, ranges[col].lo, ranges[col].hi, sel);
+        }
+        else {
+          select_range(n, v, ranges[col].lo, ranges[col].hi, sel);
+        }
+      }
     }
 
-    if ((output_options & CHECK_DECMIN) && obj.dec < decmin) {
-      continue;
-    }
+    if ( magrange.active )
+    {
+      memset(any, 0, n);
 
-    if ((output_options & CHECK_DECMAX) && obj.dec > decmax) {
-      continue;
+      for ( col = 0; col < NUM_COLUMNS; ++col ) {
+        if ( strncmp(columns[col].name, "sCorMag", 7) == 0 ) {
+          gather_column(n, batch, col, v);
+          select_any_mag(n, v, magrange.lo, magrange.hi, any);
+        }
+      }
+
+      for ( k = 0; k < n; ++k ) {
+        sel[k] &= any[k];
+      }
     }
 
-    if ( fabs(obj.muAcosD) > 10000 || fabs(obj.muD) > 10000)
+    /* print selected records */
+    for ( k = 0; k < n; ++k )
     {
-      continue;
-    }
+      const ssa_source * obj = &batch[k];
 
-    printf(
-      "%16"PRId64"\t"   /* objID */
-      "%16"PRId64"\t"   /* objIDB */
-      "%16"PRId64"\t"   /* objIDR1 */
-      "%16"PRId64"\t"   /* objIDR2 */
-      "%16"PRId64"\t"   /* objIDI */
-      //    "%16"PRId64"\t" /* htmId */
-      "%8.3f\t"         /* epoch */
-      "%15.9f\t"        /* ra */
-      "%+15.9f\t"       /* dec */
-      "%+8.3e\t"        /* sigRA */
-      "%+8.3e\t"        /* sigDec */
-      //    "float8\t"      /* cx */
-      //    "float8\t"      /* cy */
-      //    "float8\t"      /* cz */
-      "%+9.3e\t"        /* muAcosD */
-      "%+9.3e\t"        /* muD */
-      "%+9.3e\t"        /* sigMuAcosD */
-      "%+9.3e\t"        /* sigMuD */
-      "%+9.5e\t"        /* chi2 */
-      "%3d\t"           /* Nplates */
-      "%+8.3f\t"        /* classMagB */
-      "%+8.3f\t"        /* classMagR1 */
-      "%+8.3f\t"        /* classMagR2 */
-      "%+8.3f\t"        /* classMagI */
-      "%+8.3f\t"        /* gCorMagB */
-      "%+8.3f\t"        /* gCorMagR1 */
-      "%+8.3f\t"        /* gCorMagR2 */
-      "%+8.3f\t"        /* gCorMagI */
-      "%+8.3f\t"        /* sCorMagB */
-      "%+8.3f\t"        /* sCorMagR1 */
-      "%+8.3f\t"        /* sCorMagR2 */
-      "%+8.3f\t"        /* sCorMagI */
-      "%2d\t"           /* meanClass */
-      "%2d\t"           /* classB */
-      "%2d\t"           /* classR1 */
-      "%2d\t"           /* classR2 */
-      "%2d\t"           /* classI */
-      "%+12.9e\t"       /* ellipB */
-      "%+12.9e\t"       /* ellipR1 */
-      "%+12.9e\t"       /* ellipR2 */
-      "%+12.9e\t"       /* ellipI */
-      "%+9d\t"           /* qualB */
-      "%+9d\t"           /* qualR1 */
-      "%+9d\t"           /* qualR2 */
-      "%+9d\t"           /* qualI */
-      "%+9d\t"           /* blendB */
-      "%+9d\t"           /* blendR1 */
-      "%+9d\t"           /* blendR2 */
-      "%+9d\t"           /* blendI */
-      "%+12.9e\t"       /* prfStatB */
-      "%+12.9e\t"       /* prfStatR1 */
-      "%+12.9e\t"       /* prfStatR2 */
-      "%+12.9e\t"       /* prfStatI */
-      "%+15.9f\t"       /* l */
-      "%+15.9f\t"       /* b */
-      "%+15.9f\t"       /* d */
-      "%+8.3f\n",       /* Ebmv */
-
-      obj.objID,
-      obj.objIDB,
-      obj.objIDR1,
-      obj.objIDR2,
-      obj.objIDI,
-      //      obj.htmId,
-      obj.epoch,
-      obj.ra * PI / 180,
-      obj.dec * PI / 180,
-      obj.sigRA * 3600 * cos(obj.dec * PI / 180),
-      obj.sigDec * 3600,
-      //      obj.cx,
-      //      obj.cy,
-      //      obj.cz,
-      obj.muAcosD,
-      obj.muD,
-      obj.sigMuAcosD,
-      obj.sigMuD,
-      obj.chi2,
-      obj.Nplates,
-      obj.classMagB,
-      obj.classMagR1,
-      obj.classMagR2,
-      obj.classMagI,
-      obj.gCorMagB,
-      obj.gCorMagR1,
-      obj.gCorMagR2,
-      obj.gCorMagI,
-      obj.sCorMagB,
-      obj.sCorMagR1,
-      obj.sCorMagR2,
-      obj.sCorMagI,
-      obj.meanClass,
-      obj.classB,
-      obj.classR1,
-      obj.classR2,
-      obj.classI,
-      obj.ellipB,
-      obj.ellipR1,
-      obj.ellipR2,
-      obj.ellipI,
-      obj.qualB,
-      obj.qualR1,
-      obj.qualR2,
-      obj.qualI,
-      obj.blendB,
-      obj.blendR1,
-      obj.blendR2,
-      obj.blendI,
-      obj.prfStatB,
-      obj.prfStatR1,
-      obj.prfStatR2,
-      obj.prfStatI,
-      obj.l,
-      obj.b,
-      obj.d,
-      obj.Ebmv
-    );
+      if ( !sel[k] ) {
+        continue;
+      }
+
+      printf(
+        "%16"PRId64"\t"   /* objID */
+        "%16"PRId64"\t"   /* objIDB */
+        "%16"PRId64"\t"   /* objIDR1 */
+        "%16"PRId64"\t"   /* objIDR2 */
+        "%16"PRId64"\t"   /* objIDI */
+        //    "%16"PRId64"\t" /* htmId */
+        "%8.3f\t"         /* epoch */
+        "%15.9f\t"        /* ra */
+        "%+15.9f\t"       /* dec */
+        "%+8.3e\t"        /* sigRA */
+        "%+8.3e\t"        /* sigDec */
+        //    "float8\t"      /* cx */
+        //    "float8\t"      /* cy */
+        //    "float8\t"      /* cz */
+        "%+9.3e\t"        /* muAcosD */
+        "%+9.3e\t"        /* muD */
+        "%+9.3e\t"        /* sigMuAcosD */
+        "%+9.3e\t"        /* sigMuD */
+        "%+9.5e\t"        /* chi2 */
+        "%3d\t"           /* Nplates */
+        "%+8.3f\t"        /* classMagB */
+        "%+8.3f\t"        /* classMagR1 */
+        "%+8.3f\t"        /* classMagR2 */
+        "%+8.3f\t"        /* classMagI */
+        "%+8.3f\t"        /* gCorMagB */
+        "%+8.3f\t"        /* gCorMagR1 */
+        "%+8.3f\t"        /* gCorMagR2 */
+        "%+8.3f\t"        /* gCorMagI */
+        "%+8.3f\t"        /* sCorMagB */
+        "%+8.3f\t"        /* sCorMagR1 */
+        "%+8.3f\t"        /* sCorMagR2 */
+        "%+8.3f\t"        /* sCorMagI */
+        "%2d\t"           /* meanClass */
+        "%2d\t"           /* classB */
+        "%2d\t"           /* classR1 */
+        "%2d\t"           /* classR2 */
+        "%2d\t"           /* classI */
+        "%+12.9e\t"       /* ellipB */
+        "%+12.9e\t"       /* ellipR1 */
+        "%+12.9e\t"       /* ellipR2 */
+        "%+12.9e\t"       /* ellipI */
+        "%+9d\t"           /* qualB */
+        "%+9d\t"           /* qualR1 */
+        "%+9d\t"           /* qualR2 */
+        "%+9d\t"           /* qualI */
+        "%+9d\t"           /* blendB */
+        "%+9d\t"           /* blendR1 */
+        "%+9d\t"           /* blendR2 */
+        "%+9d\t"           /* blendI */
+        "%+12.9e\t"       /* prfStatB */
+        "%+12.9e\t"       /* prfStatR1 */
+        "%+12.9e\t"       /* prfStatR2 */
+        "%+12.9e\t"       /* prfStatI */
+        "%+15.9f\t"       /* l */
+        "%+15.9f\t"       /* b */
+        "%+15.9f\t"       /* d */
+        "%+8.3f\n",       /* Ebmv */
+
+        obj->objID,
+        obj->objIDB,
+        obj->objIDR1,
+        obj->objIDR2,
+        obj->objIDI,
+        //      obj->htmId,
+        obj->epoch,
+        obj->ra * PI / 180,
+        obj->dec * PI / 180,
+        obj->sigRA * 3600 * cos(obj->dec * PI / 180),
+        obj->sigDec * 3600,
+        //      obj->cx,
+        //      obj->cy,
+        //      obj->cz,
+        obj->muAcosD,
+        obj->muD,
+        obj->sigMuAcosD,
+        obj->sigMuD,
+        obj->chi2,
+        obj->Nplates,
+        obj->classMagB,
+        obj->classMagR1,
+        obj->classMagR2,
+        obj->classMagI,
+        obj->gCorMagB,
+        obj->gCorMagR1,
+        obj->gCorMagR2,
+        obj->gCorMagI,
+        obj->sCorMagB,
+        obj->sCorMagR1,
+        obj->sCorMagR2,
+        obj->sCorMagI,
+        obj->meanClass,
+        obj->classB,
+        obj->classR1,
+        obj->classR2,
+        obj->classI,
+        obj->ellipB,
+        obj->ellipR1,
+        obj->ellipR2,
+        obj->ellipI,
+        obj->qualB,
+        obj->qualR1,
+        obj->qualR2,
+        obj->qualI,
+        obj->blendB,
+        obj->blendR1,
+        obj->blendR2,
+        obj->blendI,
+        obj->prfStatB,
+        obj->prfStatR1,
+        obj->prfStatR2,
+        obj->prfStatI,
+        obj->l,
+        obj->b,
+        obj->d,
+        obj->Ebmv
+      );
 
+    }
   }
 
+  free(any);
+  free(sel);
+  free(v);
+  free(batch);
+
   if ( input != STDIN_FILENO ) {
     close (input);
   }
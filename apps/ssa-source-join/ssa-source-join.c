@@ -0,0 +1,936 @@
+/*
+ * ssa-source-join.c
+ *
+ *  Join of SuperCOSMOS merged sources (ssaSource) to their per-band detections
+ *  (ssadetection) without external database.
+ *
+ *  The build side is the set of objIDB/objIDR1/objIDR2/objIDI references read from
+ *  source files. It is hash-partitioned on detection objID; partitions which do not fit
+ *  into memory budget are spilled to temporary files (hybrid hash join). The probe side
+ *  streams detection files, emitting joined rows for in-memory partitions and spilling
+ *  detections of spilled partitions to be joined after the scan.
+ */
+
+#define _LARGEFILE64_SOURCE
+#define _FILE_OFFSET_BITS     64  /* See man fseeko */
+
+#include "ssa-source.h"
+#include "ssa-detection.h"
+#include "popen-decompress.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <math.h>
+
+#define NUM_PARTITIONS    64
+#define NUM_BANDS         4
+#define EMPTY_SLOT        ((uint32_t)(-1))
+#define MAX_SPILL_LEVEL   4
+
+/** Supported file compression types */
+typedef
+enum compression_t {
+  compression_unknown = -1,
+  compression_none,
+  compression_bzip,
+  compression_gzip
+} compression_t;
+
+static const char * band_names[NUM_BANDS] = {
+  "B", "R1", "R2", "I"
+};
+
+/** Build side record: reference from merged source to one of its band detections */
+typedef
+struct build_entry_s {
+  int64_t objID;      /*< detection objID (the join key) */
+  int64_t sourceID;   /*< objID of merged source */
+  double  ra, dec;    /*< source position, degrees */
+  float   epoch;
+  float   muAcosD;
+  float   muD;
+  float   sCorMag;    /*< source sCorMag in this band */
+  int8_t  band;
+  int8_t  Nplates;
+} build_entry;
+
+/** Probe side record: subset of detection columns used for output */
+typedef
+struct probe_entry_s {
+  int64_t objID;
+  double  ra, dec;    /*< detection position converted to degrees, as in build_entry */
+  double  xCen, yCen;
+  int32_t plateID;
+  int32_t quality;
+  float   ipeak;
+  float   cosmag;
+  float   sMag;
+  int8_t  surveyID;
+  uint8_t class;
+} probe_entry;
+
+/** Hash partition of the build side */
+typedef
+struct partition_s {
+  build_entry * items;  /*< in-memory entries */
+  size_t count;
+  size_t capacity;
+  uint32_t * table;     /*< open addressing table of indexes into items */
+  size_t table_size;    /*< power of two */
+  FILE * build_spill;   /*< not NULL if partition is spilled to disk */
+  FILE * probe_spill;
+  size_t spilled_count;
+} partition;
+
+
+static partition partitions[NUM_PARTITIONS];
+static size_t memory_used;
+static size_t memory_budget = (size_t) 1024 * 1024 * 1024;
+static const char * tmpdir = NULL;
+static int beverbose = 0;
+static size_t num_output_rows = 0;
+
+
+
+/** show usage info. */
+static void show_usage( FILE * output )
+{
+  fprintf(output,"Join SuperCOSMOS source files to per-band detections\n");
+  fprintf(output,"USAGE:\n");
+  fprintf(output,"   ssa-source-join [OPTIONS] -s SOURCE-FILE [...] -d DETECTION-FILE [...]\n");
+  fprintf(output,"\n");
+  fprintf(output,"OPTIONS:\n");
+  fprintf(output,"   -h  include columns header\n");
+  fprintf(output,"   -v  print some diagnostics to stderr\n");
+  fprintf(output,"   -o  set output file name from next argument\n");
+  fprintf(output,"   -s  the following arguments are ssaSource files\n");
+  fprintf(output,"   -d  the following arguments are ssadetection files\n");
+  fprintf(output,"   mem=size_t     memory budget for build side in MB (default 1024)\n");
+  fprintf(output,"   tmpdir=path    directory for spill files (default $TMPDIR or /tmp)\n");
+  fprintf(output,"   bands=B,R1,R2,I  comma separated list of bands to join\n");
+  fprintf(output,"\n");
+  fprintf(output,"Compressed (.bz2, .gz) input files are accepted\n");
+  fprintf(output,"\n");
+  fprintf(output,"Examples:\n");
+  fprintf(output,"  ssa-source-join -h -s ssaSource000ra030.bin -d ssadetection000ra030.bin\n");
+  fprintf(output,"  ssa-source-join mem=4096 bands=B,R2 -s ssaSource*.bin -d ssadetection*.bin -o joined.tsv\n");
+}
+
+
+/** uses fopen() for uncompressed streams, and popen() for compressed ones */
+static FILE * open_file( const char * fname, compression_t * compression )
+{
+  FILE * input = NULL;
+
+  if ( *compression == compression_unknown )
+  {
+    const char * suffix;
+
+    if ( (suffix = strstr(fname, ".bz2")) && *(suffix + 4) == 0 ) {
+      *compression = compression_bzip;
+    }
+    else if ( (suffix = strstr(fname, ".bz")) && *(suffix + 3) == 0 ) {
+      *compression = compression_bzip;
+    }
+    else if ( (suffix = strstr(fname, ".gz")) && *(suffix + 3) == 0 ) {
+      *compression = compression_gzip;
+    }
+    else {
+      *compression = compression_none;
+    }
+  }
+
+  switch ( *compression )
+  {
+  case compression_bzip:
+    if ( !(input = popen_decompress("bzip2", fname)) ) {
+      fprintf(stderr, "popen('bzip2 -dc %s') fails: %s\n", fname, strerror(errno));
+    }
+    break;
+
+  case compression_gzip:
+    if ( !(input = popen_decompress("gzip", fname)) ) {
+      fprintf(stderr, "popen('gzip -dc %s') fails: %s\n", fname, strerror(errno));
+    }
+    break;
+
+  case compression_none:
+    if ( !(input = fopen(fname, "r"))) {
+      fprintf(stderr, "fopen('%s') fails: %s\n", fname, strerror(errno));
+    }
+    break;
+
+  default:
+    fprintf(stderr, "BUG IN CODE: invalid compression tag=%d\n", *compression);
+    break;
+  }
+
+  return input;
+}
+
+/** uses fclose() for uncompressed streams, and pclose() for compressed ones */
+static void close_file( FILE * input, compression_t compression )
+{
+  if ( input && input != stdin ) {
+    if ( compression > compression_none ) {
+      pclose(input);
+    }
+    else {
+      fclose(input);
+    }
+  }
+}
+
+/** create anonymous temporary file in tmpdir */
+static FILE * create_spill_file( void )
+{
+  char fname[PATH_MAX];
+  FILE * fp = NULL;
+  int fd;
+
+  snprintf(fname, sizeof(fname), "%s/ssa-source-join.XXXXXX", tmpdir);
+
+  if ( (fd = mkstemp(fname)) == -1 ) {
+    fprintf(stderr, "mkstemp('%s') fails: %s\n", fname, strerror(errno));
+  }
+  else {
+    unlink(fname);
+    if ( !(fp = fdopen(fd, "w+b")) ) {
+      fprintf(stderr, "fdopen('%s') fails: %s\n", fname, strerror(errno));
+      close(fd);
+    }
+  }
+
+  return fp;
+}
+
+/** 64-bit mix function (splitmix64 finalizer) */
+static inline uint64_t hash64( uint64_t x )
+{
+  x ^= x >> 30;
+  x *= UINT64_C(0xbf58476d1ce4e5b9);
+  x ^= x >> 27;
+  x *= UINT64_C(0x94d049bb133111eb);
+  x ^= x >> 31;
+  return x;
+}
+
+/** partition of join key at repartitioning level, level 0 is the primary partitioning */
+static inline int partition_of( int64_t objID, int level )
+{
+  return (int) (hash64((uint64_t) objID ^ (UINT64_C(0x9e3779b97f4a7c15) * (uint64_t) level)) % NUM_PARTITIONS);
+}
+
+/** Approximate memory footprint of single in-memory build entry including hash table slots */
+static inline size_t entry_footprint( void )
+{
+  return sizeof(build_entry) + 2 * sizeof(uint32_t);
+}
+
+/** write whole in-memory content of partition to spill file and release memory */
+static int spill_partition( partition * p )
+{
+  if ( !p->build_spill && !(p->build_spill = create_spill_file()) ) {
+    return -1;
+  }
+
+  if ( p->count && fwrite(p->items, sizeof(*p->items), p->count, p->build_spill) != p->count ) {
+    fprintf(stderr, "Can't write spill file: %s\n", strerror(errno));
+    return -1;
+  }
+
+  if ( beverbose ) {
+    fprintf(stderr, "spill partition %d: %zu entries\n", (int) (p - partitions), p->count);
+  }
+
+  memory_used -= p->count * entry_footprint();
+  p->spilled_count += p->count;
+  free(p->items), p->items = NULL;
+  p->count = p->capacity = 0;
+
+  return 0;
+}
+
+/** spill largest in-memory partitions until memory usage fits the budget */
+static int enforce_memory_budget( void )
+{
+  while ( memory_used > memory_budget )
+  {
+    partition * largest = NULL;
+    int i;
+
+    for ( i = 0; i < NUM_PARTITIONS; ++i ) {
+      if ( partitions[i].count && (!largest || partitions[i].count > largest->count) ) {
+        largest = &partitions[i];
+      }
+    }
+
+    if ( !largest || spill_partition(largest) != 0 ) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+/** add single entry to the build side */
+static int add_build_entry( const build_entry * e )
+{
+  partition * p = &partitions[partition_of(e->objID, 0)];
+
+  if ( p->build_spill ) {
+    if ( fwrite(e, sizeof(*e), 1, p->build_spill) != 1 ) {
+      fprintf(stderr, "Can't write spill file: %s\n", strerror(errno));
+      return -1;
+    }
+    ++p->spilled_count;
+    return 0;
+  }
+
+  if ( p->count == p->capacity )
+  {
+    size_t capacity = p->capacity ? 2 * p->capacity : 1024;
+    build_entry * items = realloc(p->items, capacity * sizeof(*items));
+    if ( !items ) {
+      fprintf(stderr, "realloc() fails: %s\n", strerror(errno));
+      return -1;
+    }
+    p->items = items;
+    p->capacity = capacity;
+  }
+
+  p->items[p->count++] = *e;
+  memory_used += entry_footprint();
+
+  return enforce_memory_budget();
+}
+
+/** build open addressing hash table over in-memory entries of partition */
+static int build_hash_table( partition * p )
+{
+  size_t i, size = 16;
+
+  while ( size < 2 * p->count ) {
+    size *= 2;
+  }
+
+  if ( !(p->table = malloc(size * sizeof(*p->table))) ) {
+    fprintf(stderr, "malloc(table) fails: %s\n", strerror(errno));
+    return -1;
+  }
+
+  memset(p->table, 0xFF, size * sizeof(*p->table));
+  p->table_size = size;
+
+  for ( i = 0; i < p->count; ++i )
+  {
+    size_t pos = (hash64(p->items[i].objID) / NUM_PARTITIONS) & (size - 1);
+    while ( p->table[pos] != EMPTY_SLOT ) {
+      pos = (pos + 1) & (size - 1);
+    }
+    p->table[pos] = (uint32_t) i;
+  }
+
+  return 0;
+}
+
+static void free_hash_table( partition * p )
+{
+  free(p->table), p->table = NULL;
+  p->table_size = 0;
+  free(p->items), p->items = NULL;
+  p->count = p->capacity = 0;
+}
+
+
+/** print header line */
+static void dump_header_line( FILE * output )
+{
+  fprintf(output,
+      "sourceID\t"
+      "band\t"
+      "sra\t"
+      "sdec\t"
+      "epoch\t"
+      "muAcosD\t"
+      "muD\t"
+      "Nplates\t"
+      "sCorMag\t"
+      "objID\t"
+      "surveyID\t"
+      "plateID\t"
+      "ra\t"
+      "dec\t"
+      "x\t"
+      "y\t"
+      "ipeak\t"
+      "cosmag\t"
+      "sMag\t"
+      "class\t"
+      "quality\n");
+}
+
+/** print joined row */
+static int dump_row( FILE * output, const build_entry * s, const probe_entry * d )
+{
+  int n = fprintf(output,
+      "%16"PRId64"\t"
+      "%s\t"
+      "%15.9f\t"
+      "%+15.9f\t"
+      "%8.3f\t"
+      "%+9.3e\t"
+      "%+9.3e\t"
+      "%3d\t"
+      "%+8.3f\t"
+      "%16"PRId64"\t"
+      "%2d\t"
+      "%8d\t"
+      "%15.9f\t"
+      "%+15.9f\t"
+      "%12.2f\t"
+      "%12.2f\t"
+      "%9.1f\t"
+      "%9.3f\t"
+      "%9.3f\t"
+      "%3u\t"
+      "%9d\n",
+      s->sourceID,
+      band_names[s->band],
+      s->ra,
+      s->dec,
+      s->epoch,
+      s->muAcosD,
+      s->muD,
+      s->Nplates,
+      s->sCorMag,
+      d->objID,
+      d->surveyID,
+      d->plateID,
+      d->ra,
+      d->dec,
+      d->xCen,
+      d->yCen,
+      d->ipeak,
+      d->cosmag,
+      d->sMag,
+      d->class,
+      d->quality);
+
+  if ( n <= 0 ) {
+    fprintf(stderr,"Can't write output: %d (%s)\n", errno, strerror(errno));
+    return -1;
+  }
+
+  ++num_output_rows;
+  return 0;
+}
+
+/** emit all build entries matching the probe record */
+static int probe_partition( FILE * output, const partition * p, const probe_entry * d )
+{
+  size_t pos = (hash64(d->objID) / NUM_PARTITIONS) & (p->table_size - 1);
+  uint32_t index;
+
+  while ( (index = p->table[pos]) != EMPTY_SLOT )
+  {
+    if ( p->items[index].objID == d->objID && dump_row(output, &p->items[index], d) != 0 ) {
+      return -1;
+    }
+    pos = (pos + 1) & (p->table_size - 1);
+  }
+
+  return 0;
+}
+
+
+/** read source file and add references to requested band detections into build side */
+static int load_sources( const char * fname, const int bands[NUM_BANDS] )
+{
+  compression_t compression = compression_unknown;
+  FILE * input;
+  ssa_source obj;
+  build_entry e;
+  size_t count = 0;
+  int b;
+
+  if ( !(input = open_file(fname, &compression)) ) {
+    return -1;
+  }
+
+  memset(&e, 0, sizeof(e));
+
+  while ( fread(&obj, sizeof(obj), 1, input) == 1 )
+  {
+    const int64_t ids[NUM_BANDS] = { obj.objIDB, obj.objIDR1, obj.objIDR2, obj.objIDI };
+    const float4 mags[NUM_BANDS] = { obj.sCorMagB, obj.sCorMagR1, obj.sCorMagR2, obj.sCorMagI };
+
+    e.sourceID = obj.objID;
+    e.ra = obj.ra;
+    e.dec = obj.dec;
+    e.epoch = obj.epoch;
+    e.muAcosD = obj.muAcosD;
+    e.muD = obj.muD;
+    e.Nplates = obj.Nplates;
+
+    for ( b = 0; b < NUM_BANDS; ++b )
+    {
+      if ( bands[b] && ids[b] != 0 )
+      {
+        e.objID = ids[b];
+        e.band = b;
+        e.sCorMag = mags[b];
+
+        if ( add_build_entry(&e) != 0 ) {
+          close_file(input, compression);
+          return -1;
+        }
+      }
+    }
+
+    ++count;
+  }
+
+  close_file(input, compression);
+
+  if ( beverbose ) {
+    fprintf(stderr, "%s: %zu sources, memory used %zu MB\n", fname, count, memory_used >> 20);
+  }
+
+  return 0;
+}
+
+/** stream detection file, join in-memory partitions and spill the rest */
+static int probe_detections( FILE * output, const char * fname )
+{
+  compression_t compression = compression_unknown;
+  FILE * input;
+  ssa_detection obj;
+  probe_entry d;
+  size_t count = 0;
+
+  if ( !(input = open_file(fname, &compression)) ) {
+    return -1;
+  }
+
+  memset(&d, 0, sizeof(d));
+
+  while ( fread(&obj, sizeof(obj), 1, input) == 1 )
+  {
+    partition * p = &partitions[partition_of(obj.objID, 0)];
+
+    ++count;
+
+    if ( !p->build_spill && !p->count ) {
+      continue;
+    }
+
+    d.objID = obj.objID;
+    d.surveyID = obj.surveyID;
+    d.plateID = obj.plateID;
+    d.ra = obj.ra * 180 / M_PI;    /* detection files store radians */
+    d.dec = obj.dec * 180 / M_PI;
+    d.xCen = obj.xCen;
+    d.yCen = obj.yCen;
+    d.ipeak = obj.ipeak;
+    d.cosmag = obj.cosmag;
+    d.sMag = obj.sMag;
+    d.class = obj.class;
+    d.quality = obj.quality;
+
+    if ( !p->build_spill ) {
+      if ( probe_partition(output, p, &d) != 0 ) {
+        close_file(input, compression);
+        return -1;
+      }
+    }
+    else if ( fwrite(&d, sizeof(d), 1, p->probe_spill) != 1 ) {
+      fprintf(stderr, "Can't write spill file: %s\n", strerror(errno));
+      close_file(input, compression);
+      return -1;
+    }
+  }
+
+  close_file(input, compression);
+
+  if ( beverbose ) {
+    fprintf(stderr, "%s: %zu detections\n", fname, count);
+  }
+
+  return 0;
+}
+
+static int join_spill_files( FILE * output, FILE * build, size_t build_count, FILE * probe, int level );
+
+/**
+ * join spilled build entries in blocks fitting the memory budget, rescanning spilled
+ * probe records for each block. Used when repartitioning can not split the build side.
+ */
+static int join_spill_blocks( FILE * output, FILE * build, size_t build_count, FILE * probe )
+{
+  size_t block = memory_budget / entry_footprint();
+  partition p;
+  probe_entry d;
+
+  memset(&p, 0, sizeof(p));
+
+  if ( block < 1 ) {
+    block = 1;
+  }
+  if ( block > build_count ) {
+    block = build_count;
+  }
+
+  if ( !(p.items = malloc((block ? block : 1) * sizeof(*p.items))) ) {
+    fprintf(stderr, "malloc(%zu entries) fails: %s\n", block, strerror(errno));
+    return -1;
+  }
+
+  rewind(build);
+
+  while ( build_count > 0 )
+  {
+    p.count = build_count < block ? build_count : block;
+
+    if ( fread(p.items, sizeof(*p.items), p.count, build) != p.count ) {
+      fprintf(stderr, "Can't read spill file: %s\n", strerror(errno));
+      free(p.items);
+      return -1;
+    }
+
+    build_count -= p.count;
+
+    if ( build_hash_table(&p) != 0 ) {
+      free(p.items);
+      return -1;
+    }
+
+    rewind(probe);
+    while ( fread(&d, sizeof(d), 1, probe) == 1 ) {
+      if ( probe_partition(output, &p, &d) != 0 ) {
+        free_hash_table(&p);
+        return -1;
+      }
+    }
+
+    free(p.table), p.table = NULL;
+  }
+
+  free_hash_table(&p);
+
+  return 0;
+}
+
+/**
+ * split spilled build and probe files into NUM_PARTITIONS sub-partitions by the join key
+ * hash of next level and join each of them
+ */
+static int repartition_spill_files( FILE * output, FILE * build, FILE * probe, int level )
+{
+  FILE * sub_build[NUM_PARTITIONS] = { NULL };
+  FILE * sub_probe[NUM_PARTITIONS] = { NULL };
+  size_t sub_count[NUM_PARTITIONS] = { 0 };
+  build_entry e;
+  probe_entry d;
+  int i, k, status = -1;
+
+  rewind(build);
+  while ( fread(&e, sizeof(e), 1, build) == 1 )
+  {
+    k = partition_of(e.objID, level);
+
+    if ( !sub_build[k] && !(sub_build[k] = create_spill_file()) ) {
+      goto end;
+    }
+    if ( fwrite(&e, sizeof(e), 1, sub_build[k]) != 1 ) {
+      fprintf(stderr, "Can't write spill file: %s\n", strerror(errno));
+      goto end;
+    }
+    ++sub_count[k];
+  }
+
+  rewind(probe);
+  while ( fread(&d, sizeof(d), 1, probe) == 1 )
+  {
+    k = partition_of(d.objID, level);
+
+    if ( !sub_build[k] ) {
+      continue;
+    }
+    if ( !sub_probe[k] && !(sub_probe[k] = create_spill_file()) ) {
+      goto end;
+    }
+    if ( fwrite(&d, sizeof(d), 1, sub_probe[k]) != 1 ) {
+      fprintf(stderr, "Can't write spill file: %s\n", strerror(errno));
+      goto end;
+    }
+  }
+
+  for ( i = 0; i < NUM_PARTITIONS; ++i )
+  {
+    if ( sub_build[i] && sub_probe[i] )
+    {
+      if ( beverbose ) {
+        fprintf(stderr, "  level %d sub-partition %d: %zu entries\n", level, i, sub_count[i]);
+      }
+
+      if ( join_spill_files(output, sub_build[i], sub_count[i], sub_probe[i], level + 1) != 0 ) {
+        goto end;
+      }
+    }
+
+    if ( sub_build[i] ) {
+      fclose(sub_build[i]), sub_build[i] = NULL;
+    }
+    if ( sub_probe[i] ) {
+      fclose(sub_probe[i]), sub_probe[i] = NULL;
+    }
+  }
+
+  status = 0;
+
+end:
+  for ( i = 0; i < NUM_PARTITIONS; ++i ) {
+    if ( sub_build[i] ) {
+      fclose(sub_build[i]);
+    }
+    if ( sub_probe[i] ) {
+      fclose(sub_probe[i]);
+    }
+  }
+
+  return status;
+}
+
+/**
+ * join spilled build and probe files: partitions larger than the memory budget are
+ * repartitioned recursively with other hash slices, and joined in budget-sized blocks
+ * if MAX_SPILL_LEVEL is reached (heavily skewed keys)
+ */
+static int join_spill_files( FILE * output, FILE * build, size_t build_count, FILE * probe, int level )
+{
+  if ( build_count * entry_footprint() > memory_budget && level < MAX_SPILL_LEVEL ) {
+    return repartition_spill_files(output, build, probe, level);
+  }
+
+  return join_spill_blocks(output, build, build_count, probe);
+}
+
+/** join spilled partition */
+static int join_spilled_partition( FILE * output, partition * p )
+{
+  int status = join_spill_files(output, p->build_spill, p->spilled_count, p->probe_spill, 1);
+
+  fclose(p->build_spill), p->build_spill = NULL;
+  fclose(p->probe_spill), p->probe_spill = NULL;
+
+  return status;
+}
+
+static int parse_bands( const char * s, int bands[NUM_BANDS] )
+{
+  char buf[256];
+  char * tok;
+  int b;
+
+  memset(bands, 0, NUM_BANDS * sizeof(*bands));
+  strncpy(buf, s, sizeof(buf) - 1);
+  buf[sizeof(buf) - 1] = 0;
+
+  for ( tok = strtok(buf, ","); tok; tok = strtok(NULL, ",") )
+  {
+    for ( b = 0; b < NUM_BANDS; ++b ) {
+      if ( strcmp(tok, band_names[b]) == 0 ) {
+        break;
+      }
+    }
+    if ( b == NUM_BANDS ) {
+      return -1;
+    }
+    bands[b] = 1;
+  }
+
+  return 0;
+}
+
+
+/** main() */
+int main(int argc, char *argv[])
+{
+  const char * outputfilename = NULL;
+  FILE * output = stdout;
+
+  const char ** sources = NULL;
+  const char ** detections = NULL;
+  int num_sources = 0;
+  int num_detections = 0;
+
+  int bands[NUM_BANDS] = { 1, 1, 1, 1 };
+  int print_header = 0;
+  int sel = 0;
+  size_t mem;
+  int i;
+
+  if ( !(sources = calloc(argc, sizeof(*sources))) || !(detections = calloc(argc, sizeof(*detections))) ) {
+    fprintf(stderr, "calloc() fails: %s\n", strerror(errno));
+    return 1;
+  }
+
+  if ( !(tmpdir = getenv("TMPDIR")) ) {
+    tmpdir = "/tmp";
+  }
+
+  /* parse command line */
+  for ( i = 1; i < argc; ++i )
+  {
+    if ( strcmp(argv[i],"--help") == 0 || strcmp(argv[i],"-help") == 0 ) {
+      show_usage(stdout);
+      return 0;
+    }
+
+    if ( strncmp(argv[i], "mem=", 4) == 0 )
+    {
+      if ( sscanf(argv[i] + 4, "%zu", &mem) != 1 || mem < 1 ) {
+        fprintf(stderr, "Invalid value of %s\n", argv[i]);
+        return 1;
+      }
+      memory_budget = mem << 20;
+    }
+    else if ( strncmp(argv[i], "tmpdir=", 7) == 0 )
+    {
+      tmpdir = argv[i] + 7;
+    }
+    else if ( strncmp(argv[i], "bands=", 6) == 0 )
+    {
+      if ( parse_bands(argv[i] + 6, bands) != 0 ) {
+        fprintf(stderr, "Invalid value of %s\n", argv[i]);
+        return 1;
+      }
+    }
+    else if ( strcmp(argv[i], "-o") == 0 )
+    {
+      if ( ++i >= argc ) {
+        fprintf(stderr, "ERROR: output file name expected after '-o' command line switch\n");
+        return 1;
+      }
+      outputfilename = argv[i];
+    }
+    else if ( strcmp(argv[i], "-s") == 0 ) {
+      sel = 1;
+    }
+    else if ( strcmp(argv[i], "-d") == 0 ) {
+      sel = 2;
+    }
+    else if ( *argv[i] == '-' )
+    {
+      const char * opt = argv[i] + 1;
+      for ( ; *opt; ++opt )
+      {
+        switch ( *opt ) {
+        case 'h': print_header = 1; break;
+        case 'v': beverbose = 1; break;
+        default : fprintf(stderr, "Invalid key '%c' in argument '%s'\n", *opt, argv[i]); return 1;
+        }
+      }
+    }
+    else if ( sel == 1 ) {
+      sources[num_sources++] = argv[i];
+    }
+    else if ( sel == 2 ) {
+      detections[num_detections++] = argv[i];
+    }
+    else {
+      fprintf(stderr, "Invalid argument '%s'. Use -s or -d to specify input files\n", argv[i]);
+      show_usage(stderr);
+      return 1;
+    }
+  }
+
+  if ( !num_sources || !num_detections ) {
+    fprintf(stderr, "Both source and detection files are required\n");
+    show_usage(stderr);
+    return 1;
+  }
+
+  if ( outputfilename && !(output = fopen(outputfilename, "w")) ) {
+    fprintf(stderr, "Can't create '%s': %d (%s)\n", outputfilename, errno, strerror(errno));
+    return 1;
+  }
+
+
+  /* build phase */
+  for ( i = 0; i < num_sources; ++i ) {
+    if ( load_sources(sources[i], bands) != 0 ) {
+      fprintf(stderr, "load_sources('%s') fails\n", sources[i]);
+      return 1;
+    }
+  }
+
+  for ( i = 0; i < NUM_PARTITIONS; ++i )
+  {
+    partition * p = &partitions[i];
+
+    if ( p->build_spill ) {
+      /* flush remaining in-memory entries so the whole partition is on disk */
+      if ( spill_partition(p) != 0 || !(p->probe_spill = create_spill_file()) ) {
+        return 1;
+      }
+    }
+    else if ( p->count && build_hash_table(p) != 0 ) {
+      return 1;
+    }
+  }
+
+
+  /* probe phase */
+  if ( print_header ) {
+    dump_header_line(output);
+  }
+
+  for ( i = 0; i < num_detections; ++i ) {
+    if ( probe_detections(output, detections[i]) != 0 ) {
+      fprintf(stderr, "probe_detections('%s') fails\n", detections[i]);
+      return 1;
+    }
+  }
+
+  for ( i = 0; i < NUM_PARTITIONS; ++i ) {
+    if ( !partitions[i].build_spill ) {
+      free_hash_table(&partitions[i]);
+    }
+  }
+
+
+  /* join spilled partitions one by one */
+  for ( i = 0; i < NUM_PARTITIONS; ++i )
+  {
+    if ( partitions[i].build_spill )
+    {
+      if ( beverbose ) {
+        fprintf(stderr, "join spilled partition %d: %zu entries\n", i, partitions[i].spilled_count);
+      }
+
+      if ( join_spilled_partition(output, &partitions[i]) != 0 ) {
+        fprintf(stderr, "join_spilled_partition(%d) fails\n", i);
+        return 1;
+      }
+    }
+  }
+
+  if ( beverbose ) {
+    fprintf(stderr, "%zu rows joined\n", num_output_rows);
+  }
+
+  if ( output != stdout ) {
+    fclose(output);
+  }
+
+  free(sources);
+  free(detections);
+
+  return 0;
+}
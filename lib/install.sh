@@ -8,6 +8,7 @@
 prefix=/usr/local
 libdir=$prefix/lib/scosmos
 olss=0
+scosmos=0
 
 function show_usage()
 {
@@ -20,6 +21,7 @@ function show_usage()
     echo "  prefix=custom/install/prefix (default is $prefix)"
     echo "  libdir=custom/path/to/scosmos/octave/directoty (default is $libdir)"
     echo "  olss    will install octave-olss package into octave"
+    echo "  scosmos will install octave-scosmos package (native tan2cs, cs2tan, eq2gal, precession, tsvread, ssa_plate_read, ssa_plate_meta) into octave"
     echo ""
 }
 
@@ -30,6 +32,7 @@ while [ -n "$1" ] ; do
          prefix=*) prefix=${arg:7}  ;; 
          libdir=*) libdir=${arg:7}  ;;
          olss)     olss=1 ;;
+         scosmos)  scosmos=1 ;;
          *) show_usage ; exit 1 ;;
     esac
     shift;
@@ -57,6 +60,24 @@ EOF
 
 fi
 
+
+if (( ${scosmos} )) ; then 
+echo ""
+echo "Installing octave-scosmos..."
+echo ""
+
+make -C octave-scosmos/src clean && tar cf octave-scosmos.tar octave-scosmos/ || exit 1
+tar rf octave-scosmos.tar -C ../apps/include --transform 's,^,octave-scosmos/src/,' \
+  ssa-detection.h ssa-junk.h ssa-plate-meta.h ccarray.h ccarray-psort.h popen-decompress.h || exit 1
+gzip -f octave-scosmos.tar || exit 1
+{ cat << EOF
+    pkg uninstall -verbose octave-scosmos
+    pkg install -verbose octave-scosmos.tar.gz
+EOF
+} | octave -qf || exit 1
+
+fi
+
    
 echo ""
 echo ""
@@ -0,0 +1,148 @@
+/*
+ * kahan-bench.c
+ *
+ *  Speed and accuracy of the compensated summation variants from kahan.h
+ *  and of libogm tuple accumulation on long synthetic streams.
+ *
+ *  make bench && ./kahan-bench [n=100000000] [np=4]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "kahan.h"
+#include "libogm.h"
+
+#define CHUNK (1 << 20)
+
+/* the pre-inline calling convention: one out-of-line call per term */
+__attribute__((noinline))
+static void safe_add_call( double * sum, double * c, double x )
+{
+  safe_add(sum, c, x);
+}
+
+static double now( void )
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + 1e-9 * t.tv_nsec;
+}
+
+static unsigned long long rng = 88172645463325252ULL;
+
+static double rnd( void )
+{
+  rng ^= rng << 13, rng ^= rng >> 7, rng ^= rng << 17;
+  return (rng >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* exact (double-double) reference sum via TwoSum */
+static void dd_add( double * hi, double * lo, double x )
+{
+  double s = *hi + x;
+  double bb = s - *hi;
+  double e = (*hi - (s - bb)) + (x - bb);
+  *hi = s;
+  *lo += e;
+}
+
+int main( int argc, char * argv[] )
+{
+  size_t n = 100000000, np = 4;
+  size_t i, k, m;
+  double * x;
+  double hi = 0, lo = 0, ref;
+  double t0;
+  int a;
+
+  for ( a = 1; a < argc; ++a ) {
+    if ( strncmp(argv[a], "n=", 2) == 0 ) {
+      n = strtoul(argv[a] + 2, NULL, 10);
+    }
+    else if ( strncmp(argv[a], "np=", 3) == 0 ) {
+      np = strtoul(argv[a] + 3, NULL, 10);
+    }
+    else {
+      fprintf(stderr, "usage: kahan-bench [n=N] [np=NP]\n");
+      return 1;
+    }
+  }
+
+  /* ill-conditioned terms: random sign, magnitudes over 16 decades */
+  if ( !(x = malloc(CHUNK * sizeof(*x))) ) {
+    fprintf(stderr, "malloc() fails\n");
+    return 1;
+  }
+  for ( i = 0; i < CHUNK; ++i ) {
+    x[i] = (rnd() - 0.5) * pow(10, 16 * rnd() - 8);
+  }
+  for ( k = 0; k < n; k += m ) {
+    m = n - k < CHUNK ? n - k : CHUNK;
+    for ( i = 0; i < m; ++i ) {
+      dd_add(&hi, &lo, x[i]);
+    }
+  }
+  ref = hi + lo;
+
+  printf("method\tn\tseconds\tGterms/s\trelerr\n");
+
+#define RUN(name, init, step, result) \
+  do { \
+    double s, c; kahan_lanes kl; double r, dt; \
+    (void) s; (void) c; (void) kl; \
+    init; \
+    t0 = now(); \
+    for ( k = 0; k < n; k += m ) { \
+      m = n - k < CHUNK ? n - k : CHUNK; \
+      step; \
+    } \
+    r = result; \
+    dt = now() - t0; \
+    printf("%s\t%zu\t%.3f\t%.3f\t%.3e\n", name, n, dt, n / dt * 1e-9, fabs(r - ref) / fabs(ref)); \
+  } while ( 0 )
+
+  RUN("naive", s = 0, for ( i = 0; i < m; ++i ) s += x[i], s);
+  RUN("safe_add_call", (s = 0, c = 0), for ( i = 0; i < m; ++i ) safe_add_call(&s, &c, x[i]), s);
+  RUN("safe_add", (s = 0, c = 0), for ( i = 0; i < m; ++i ) safe_add(&s, &c, x[i]), s);
+  RUN("neumaier_add", (s = 0, c = 0), for ( i = 0; i < m; ++i ) neumaier_add(&s, &c, x[i]), neumaier_sum(s, c));
+  RUN("kahan_lanes", kahan_lanes_init(&kl),
+      for ( i = 0; i + KAHAN_LANES <= m; i += KAHAN_LANES ) kahan_lanes_add(&kl, x + i), kahan_lanes_sum(&kl));
+  RUN("kahan_sum", (s = 0, c = 0), neumaier_add(&s, &c, kahan_sum(m, x)), neumaier_sum(s, c));
+
+#undef RUN
+
+  /* normal equations accumulation of n tuples with np parameters */
+  if ( np > 0 && np < CHUNK ) {
+    ogmctx_t * ctx;
+    double sol[np];
+    size_t nt = CHUNK / (np + 1) * (np + 1);
+
+    for ( int blk = 0; blk < 2; ++blk ) {
+      if ( !(ctx = ogm_solver_create(np)) ) {
+        fprintf(stderr, "ogm_solver_create(%zu) fails\n", np);
+        return 1;
+      }
+      t0 = now();
+      for ( k = 0; k < n; k += m ) {
+        m = n - k < nt / (np + 1) ? n - k : nt / (np + 1);
+        if ( blk ) {
+          ogm_solver_append_block(ctx, x, x + m * np, m, OGM_ROW_MAJOR);
+        }
+        else {
+          for ( i = 0; i < m; ++i ) {
+            ogm_solver_append_tuple(ctx, x + i * np, x[m * np + i]);
+          }
+        }
+      }
+      printf("%s\t%zu\t%.3f\t%.3f\tnp=%zu rc=%d\n", blk ? "append_block" : "append_tuple", n, now() - t0,
+          n / (now() - t0) * 1e-9, np, ogm_solve(ctx, sol, NULL, NULL, NULL, NULL));
+      ogm_solver_destroy(ctx);
+    }
+  }
+
+  free(x);
+  return 0;
+}
@@ -4,20 +4,166 @@
  *  Created on: Sep 17, 2012
  *      Author: amyznikov
  *
+ * Compensated summation, header-only so that the accumulators inline into
+ * the caller loops and vectorize there.
+ *
  * @see http://en.wikipedia.org/wiki/Kahan_summation_algorithm
  *
+ * The compensation terms rely on strict IEEE evaluation order:
+ *  -ffast-math (-fassociative-math) folds (t - sum) - y to zero and silently
+ *  turns every function here into a plain sum, so such builds are refused.
+ *  x87 excess precision (FLT_EVAL_METHOD != 0) breaks it as well, use -mfpmath=sse.
  */
 
 #ifndef __kahan_sum_h__
 #define __kahan_sum_h__
 
+#include <stddef.h>
+#include <float.h>
+
+#if defined(__FAST_MATH__) || defined(__ASSOCIATIVE_MATH__)
+# error "kahan.h: compensated summation requires strict FP semantics, do not compile with -ffast-math"
+#endif
+
+#if defined(__FLT_EVAL_METHOD__) && (__FLT_EVAL_METHOD__ == 1 || __FLT_EVAL_METHOD__ == 2)
+# warning "kahan.h: excess FP precision (x87?) degrades compensated summation, compile with -mfpmath=sse"
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 
-void safe_add( double * sum, double * c, double x );
-void safe_addf( float * sum, float *c, float x );
+/**
+ * Kahan step: *sum += x, *c keeps the (negated) lost low-order part.
+ *  *sum alone is the best estimate of the total.
+ */
+static inline void safe_add( double * sum, double * c, double x )
+{
+  double y = x - *c;
+  double t = *sum + y;
+  *c = (t - *sum) - y;
+  *sum = t;
+}
+
+static inline void safe_addf( float * sum, float *c, float x )
+{
+  float y = x - *c;
+  float t = *sum + y;
+  *c = (t - *sum) - y;
+  *sum = t;
+}
+
+
+/**
+ * Neumaier (improved Kahan-Babuska) step: also exact when |x| > |sum|.
+ *  The total is *sum + *c, read it with neumaier_sum().
+ */
+static inline void neumaier_add( double * sum, double * c, double x )
+{
+  double t = *sum + x;
+  if ( (*sum >= 0 ? *sum : -*sum) >= (x >= 0 ? x : -x) ) {
+    *c += (*sum - t) + x;
+  }
+  else {
+    *c += (x - t) + *sum;
+  }
+  *sum = t;
+}
+
+static inline double neumaier_sum( double sum, double c )
+{
+  return sum + c;
+}
+
+
+/**
+ * SIMD-lane Kahan accumulator: KAHAN_LANES independent sums each with its own
+ *  compensation, so that the lane loop maps onto vector registers;
+ *  the lanes are reduced with Neumaier steps at the end.
+ */
+#define KAHAN_LANES 4
+
+typedef struct kahan_lanes {
+  double s[KAHAN_LANES];
+  double c[KAHAN_LANES];
+} kahan_lanes;
+
+static inline void kahan_lanes_init( kahan_lanes * k )
+{
+  int l;
+  for ( l = 0; l < KAHAN_LANES; ++l ) {
+    k->s[l] = k->c[l] = 0;
+  }
+}
+
+static inline void kahan_lanes_add( kahan_lanes * k, const double x[KAHAN_LANES] )
+{
+  int l;
+  for ( l = 0; l < KAHAN_LANES; ++l ) {
+    double y = x[l] - k->c[l];
+    double t = k->s[l] + y;
+    k->c[l] = (t - k->s[l]) - y;
+    k->s[l] = t;
+  }
+}
+
+static inline double kahan_lanes_sum( const kahan_lanes * k )
+{
+  double s = 0, c = 0;
+  int l;
+  for ( l = 0; l < KAHAN_LANES; ++l ) {
+    neumaier_add(&s, &c, k->s[l]);
+    neumaier_add(&s, &c, -k->c[l]);
+  }
+  return neumaier_sum(s, c);
+}
+
+
+/**
+ * Compensated sum of x[0..n-1]
+ */
+static inline double kahan_sum( size_t n, const double x[/*n*/] )
+{
+  kahan_lanes k;
+  double tail[KAHAN_LANES] = { 0 };
+  size_t i, l;
+
+  kahan_lanes_init(&k);
+  for ( i = 0; i + KAHAN_LANES <= n; i += KAHAN_LANES ) {
+    kahan_lanes_add(&k, x + i);
+  }
+  for ( l = 0; i < n; ++i, ++l ) {
+    tail[l] = x[i];
+  }
+  kahan_lanes_add(&k, tail);
+
+  return kahan_lanes_sum(&k);
+}
+
+/**
+ * Compensated dot product a' * b (products are rounded, their sum is compensated)
+ */
+static inline double kahan_dot( size_t n, const double a[/*n*/], const double b[/*n*/] )
+{
+  kahan_lanes k;
+  double p[KAHAN_LANES];
+  size_t i, l;
+
+  kahan_lanes_init(&k);
+  for ( i = 0; i + KAHAN_LANES <= n; i += KAHAN_LANES ) {
+    for ( l = 0; l < KAHAN_LANES; ++l ) {
+      p[l] = a[i + l] * b[i + l];
+    }
+    kahan_lanes_add(&k, p);
+  }
+  for ( l = 0; l < KAHAN_LANES; ++l, ++i ) {
+    p[l] = i < n ? a[i] * b[i] : 0;
+  }
+  kahan_lanes_add(&k, p);
+
+  return kahan_lanes_sum(&k);
+}
 
 
 #ifdef __cplusplus
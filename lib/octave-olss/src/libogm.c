@@ -7,24 +7,52 @@
 
 #include "libogm.h"
 #include "kahan.h"
+#include <stdlib.h>
 #include <malloc.h>
 #include <string.h>
 #include <errno.h>
 #include <math.h>
+#include <float.h>
+
+#if defined(__AVX__) && defined(__FMA__)
+# include <immintrin.h>
+#endif
 
 #define DEBUG 0
 
+/** Number of rows packed into the panel by ogm_solver_append_block(), multiple of 4 */
+#define OGM_BLOCK_ROWS  128
+
 struct ogmctx_t {
-  double ll;    /*< The sum of RHS^2 of source equations, for least squares error estimation */
-  double cll;   /*< The running compensation for lost low-order bits of ll */
+  double * ll;  /*< The sums of RHS^2 of source equations [nrhs], for least squares error estimation */
+  double * cll; /*< The running compensation for lost low-order bits of ll[] */
 
-  double * y;   /*< RHS vector of normal equation C*X=Y */
+  double * y;   /*< RHS vectors of normal equations C*X=Y, np x nrhs, one right-hand side after another */
   double * cy;  /*< The running compensation for lost low-order bits of y[] */
 
   size_t n;     /*< Number of equations (individual measurements points) */
   size_t np;    /*< Number of system parameters to be found */
+  size_t nrhs;  /*< Number of right-hand sides sharing the normal matrix */
   double * c;   /* < matrix of normal equations */
   double * ci;  /*< inverse matrix of c */
+
+  double * u;   /*< upper triangular Cholesky factor of scaled c */
+  double * s;   /*< equilibration scale vector */
+  double * w;   /*< work vector */
+  double * x;   /*< solution when the caller does not need it, np x nrhs */
+  double * panel; /*< column-major [A | rhs] panel of OGM_BLOCK_ROWS rows for ogm_solver_append_block() */
+  size_t npanel;  /*< number of panel columns, np + nrhs rounded up to even */
+  size_t rank;  /*< numerical rank found by last ogm_solve() */
+  double rcond; /*< reciprocal condition number estimate found by last ogm_solve() */
+
+  /* OGM_RETAIN_ROWS: compact copy of the equations currently in the fit, for ogm_solve_kclip() */
+  unsigned flags;
+  double * ra;    /*< retained rows of A, row-major nrows x np */
+  double * rr;    /*< retained rhs, row-major nrows x nrhs */
+  size_t * ridx;  /*< ordinal of each retained row among all appended rows */
+  size_t nrows;   /*< number of retained rows */
+  size_t maxrows; /*< allocated capacity of ra, rr, ridx */
+  size_t nseen;   /*< total number of rows ever appended */
 };
 
 
@@ -69,176 +97,235 @@ static void free_matrix( double * a )
 }
 
 /**
- * Multiply Matrix To Vector
- *  Y = M * X
- * @param nr  number of rows of matrix M, and size of vector Y
- * @param nc  number of columns of matrix M, and size of vector X
- * @param m   [input] matrix of size [nr x nc]
- * @param x   [input] vector of size nc
- * @param y   [output] vector of size nr
+ * Vector Scalar product
  */
-static void mmv( size_t nr, size_t nc, const double m[/*nr*nc*/], const double x[/*nc*/], double y[/*nr*/] )
+static inline double mvv( size_t n, const double v1[/*n*/], const double v2[/*n*/] )
 {
-  size_t i, j;
-
-  for ( i = 0; i < nr; ++i )
-  {
-    double s = 0, cs = 0;
-    for ( j = 0; j < nc; ++j ) {
-      /* s += m[i * nc + j] * x[j]; */
-      safe_add(&s, &cs, m[i * nc + j] * x[j]);
-    }
-    y[i] = s;
-  }
+  return kahan_dot(n, v1, v2);
 }
 
+
 /**
- * Vector Scalar product
+ * Symmetric matrix to vector product Y = M * X using upper triangle of M only
  */
-static double mvv( size_t n, const double v1[/*n*/], const double v2[/*n*/] )
+static void msv( size_t n, const double m[/*n*n*/], const double x[/*n*/], double y[/*n*/] )
 {
-  double s = 0, cs = 0;
-  while ( n-- ) {
-    safe_add(&s, &cs, *v1++ * *v2++);
+  size_t i, j;
+
+  for ( i = 0; i < n; ++i )
+  {
+    double s = 0, cs = 0;
+    for ( j = 0; j < i; ++j ) {
+      neumaier_add(&s, &cs, m[j * n + i] * x[j]);
+    }
+    neumaier_add(&s, &cs, kahan_dot(n - i, m + i * n + i, x + i));
+    y[i] = neumaier_sum(s, cs);
   }
-  return s;
 }
 
 
 /**
- * Invert square matrix m[]
- * @param n     The size of matrix m[]
- * @param m     [Input] square matrix of size [n x n] to be inverted
- * @param mi    [Output] inverse matrix of size [n x n]
- * @return      0 on success, status code on error
+ * Cholesky factorization  S*C*S = U' * U  of symmetric positive definite matrix C.
+ *
+ * Only the upper triangle of C is accessed. The matrix is equilibrated by
+ * S = diag(1/sqrt(C[i,i])) before factorization, which makes the pivots
+ * comparable for polynomial models with wildly different column scales.
+ * The pivots smaller than tolerance are treated as linearly dependent columns:
+ * the corresponding row of U is set to zero and the rank is decremented.
+ *
+ * @param n     The size of matrix c[]
+ * @param c     [Input] square matrix of size [n x n], upper triangle is used
+ * @param u     [Output] upper triangular factor of size [n x n]
+ * @param s     [Output] scale vector of size [n]
+ * @param rank  [Output] numerical rank estimate
+ * @param rcond [Output] reciprocal condition number estimate of S*C*S
+ * @return      OGM_SUCCESS if rank == n, OGM_SINGULAR_MATRIX otherwise
  */
-static int invert_matrix( ssize_t n, const double m[], double mi[] )
+static int cholesky( size_t n, const double c[], double u[], double s[], size_t * rank, double * rcond )
 {
-  const ssize_t n2 = 2 * n;
-  ssize_t i, j, k;
-  int status = OGM_SUCCESS;
-
-  const ssize_t lda = n2;
-  const ssize_t ldm = n;
-
-  /* Allocate temporary work matrix of size [n x 2n] */
-  double * a = 0;
-  if ( !( a = alloc_matrix(n, n2) ) ) {
-#if DEBUG
-    fprintf(stderr,"alloc_matrix(%zd x %zd) fails: %s\n",n, n2, strerror(errno));
-#endif
-    return (status = OGM_MALLOC);
-  }
+  const double tol = n * DBL_EPSILON;
+  double dmin = 1, dmax = 0;
+  size_t i, j, k, r = 0;
 
-  /* Copy source matrix into left half of work matrix */
   for ( i = 0; i < n; ++i ) {
-    memcpy(a + i * lda, m + i * ldm, n * sizeof(double));
+    s[i] = c[i * n + i] > 0 ? 1 / sqrt(c[i * n + i]) : 0;
   }
 
-  /* Setup diagonal elements of right half of work matrix */
-  for ( i = 0; i < n; ++i ) {
-    a[i * lda + n + i] = 1;
+  for ( i = 0; i < n; ++i )
+  {
+    memset(u + i * n, 0, i * sizeof(*u));
+    for ( j = i; j < n; ++j ) {
+      u[i * n + j] = s[i] * c[i * n + j] * s[j];
+    }
   }
 
-  /* Invert matrix */
-  for ( i = 0; i < n; ++i )
+  /* right-looking variant: row k of U updates trailing upper triangle, inner loops are contiguous */
+  for ( k = 0; k < n; ++k )
   {
-    k = i;
+    double * uk = u + k * n;
+    const double d = uk[k];
 
-    while ( k < n && a[k * lda + i] == 0 ) {
-      ++k;
+    if ( !(d > tol) )
+    {
+      memset(uk + k, 0, (n - k) * sizeof(*uk));
+      dmin = 0;
+      continue;
     }
 
-    if ( k == n ) {
-      break;
-    }
+    ++r;
 
-    if ( k != i )
-    {
-      for ( j = 0; j < n2; ++j ) {
-        double temp = a[k * lda + j];
-        a[k * lda + j] = a[i * lda + j];
-        a[i * lda + j] = temp;
-      }
+    if ( d < dmin ) {
+      dmin = d;
     }
+    if ( d > dmax ) {
+      dmax = d;
+    }
+
+    uk[k] = sqrt(d);
 
-    for ( j = n2 - 1; j >= i; --j ) {
-      a[i * lda + j] /= a[i * lda + i];
+    for ( j = k + 1; j < n; ++j ) {
+      uk[j] /= uk[k];
     }
 
-    for ( k = 0; k < n; ++k ) {
-      if ( k != i ) {
-        for ( j = n2 - 1; j >= i; --j ) {
-          a[k * lda + j] = a[k * lda + j] - a[i * lda + j] * a[k * lda + i];
+    for ( i = k + 1; i < n; ++i )
+    {
+      const double uki = uk[i];
+      double * ui = u + i * n;
+
+      if ( uki != 0 ) {
+        for ( j = i; j < n; ++j ) {
+          ui[j] -= uki * uk[j];
         }
       }
     }
-
   }
 
-  if ( i != n )
+  *rank = r;
+  *rcond = dmax > 0 ? dmin / dmax : 0;
+
+  return r == n ? OGM_SUCCESS : OGM_SINGULAR_MATRIX;
+}
+
+/**
+ * Solve S*C*S * (X/S) = S*Y using Cholesky factor U computed by cholesky()
+ */
+static void cholesky_solve( size_t n, const double u[], const double s[], const double y[], double x[] )
+{
+  ssize_t i, j;
+
+  /* U' * z = S * Y */
+  for ( i = 0; i < (ssize_t) n; ++i )
   {
-#if DEBUG
-    fprintf(stderr, "Singular matrix ?\n i=%zd n=%zd\n", i, n);
-    pmatrix(n, n2, a);
-#endif
-    status = OGM_SIGNULAR_MATRIX;
+    double sum = s[i] * y[i];
+    for ( j = 0; j < i; ++j ) {
+      sum -= u[j * n + i] * x[j];
+    }
+    x[i] = sum / u[i * n + i];
   }
-  else
+
+  /* U * w = z */
+  for ( i = n - 1; i >= 0; --i )
   {
-    /* Ok, copy and return */
-    for ( i = 0; i < n; ++i ) {
-      memcpy(mi + i * ldm, a + i * lda + n, n * sizeof(double));
+    double sum = x[i];
+    for ( j = i + 1; j < (ssize_t) n; ++j ) {
+      sum -= u[i * n + j] * x[j];
     }
+    x[i] = sum / u[i * n + i];
   }
 
-  free_matrix(a);
-  return status;
+  /* X = S * w */
+  for ( i = 0; i < (ssize_t) n; ++i ) {
+    x[i] *= s[i];
+  }
 }
 
-/*
- * Solves a general system of linear equations C * X = Y.
+/**
+ * Compute inverse of the triangular factor in place: U := inv(U)
+ */
+static void invert_upper( size_t n, double u[] )
+{
+  ssize_t i, j, k;
+
+  for ( i = n - 1; i >= 0; --i )
+  {
+    u[i * n + i] = 1 / u[i * n + i];
+
+    for ( j = n - 1; j > i; --j )
+    {
+      double sum = 0;
+      for ( k = i + 1; k <= j; ++k ) {
+        sum += u[i * n + k] * u[k * n + j];
+      }
+      u[i * n + j] = -sum * u[i * n + i];
+    }
+  }
+}
+
+/**
+ * Solves symmetric positive definite system of linear equations C * X = Y.
  *
- * @param n The size of square matrix C and vectors X and Y
- * @param c Input square matrix of size [n x n]
- * @param y RHS vector of size [n]
- * @param x Output vector of size [n]
- * @param ci Output inverse matrix of c
+ * @param ctx   solver context, factor and scale are left in ctx->u and ctx->s
+ * @param x     Output vectors of size [np], one per right-hand side
  * @return 0 on success, integer error code on error
- *
- * @note Consider BLAS level3 to solve the system and get the inverse matrix
  */
-static int lsolve( size_t n, const double * c, const double y[], double x[], double ci[] )
+static int lsolve( ogmctx_t * ctx, double x[] )
 {
+  const size_t n = ctx->np;
+  size_t i, k;
   int status;
 
-  /* CI = invert(C) */
-
 #if DEBUG
   fprintf(stderr, "-------------------------------------\n");
   fprintf(stderr, "source matrix: %zu x %zu\n", n, n);
-  pmatrix(n, n, c);
+  pmatrix(n, n, ctx->c);
   fprintf(stderr, "-------------------------------------\n");
 #endif
 
-  if ( ( status = invert_matrix(n, c, ci) ) != 0 ) {
+  if ( (status = cholesky(n, ctx->c, ctx->u, ctx->s, &ctx->rank, &ctx->rcond)) != OGM_SUCCESS ) {
 #if DEBUG
-    fprintf(stderr,"invert_matrix() fails: %d. Matrix size: %zu x %zu\n", status, n, n);
+    fprintf(stderr,"cholesky() fails: rank %zu of %zu, rcond=%g\n", ctx->rank, n, ctx->rcond);
 #endif
+    return status;
   }
-  else {
-    /* X = CI * Y */
-    mmv(n, n, ci, y, x);
+
+  /* one factorization serves all right-hand sides */
+  for ( k = 0; k < ctx->nrhs; ++k )
+  {
+    const double * y = ctx->y + k * n;
+    double * xk = x + k * n;
+
+    cholesky_solve(n, ctx->u, ctx->s, y, xk);
+
+    /* one step of iterative refinement: R = Y - C * X with compensated sums */
+    msv(n, ctx->c, xk, ctx->w);
+    for ( i = 0; i < n; ++i ) {
+      ctx->w[i] = y[i] - ctx->w[i];
+    }
+
+    cholesky_solve(n, ctx->u, ctx->s, ctx->w, ctx->w);
+    for ( i = 0; i < n; ++i ) {
+      xk[i] += ctx->w[i];
+    }
   }
 
   return status;
 }
 
 ogmctx_t * ogm_solver_create( size_t np )
+{
+  return ogm_solver_create_ex(np, 1, 0);
+}
+
+ogmctx_t * ogm_solver_create_multi( size_t np, size_t nrhs )
+{
+  return ogm_solver_create_ex(np, nrhs, 0);
+}
+
+ogmctx_t * ogm_solver_create_ex( size_t np, size_t nrhs, unsigned flags )
 {
   ogmctx_t * ctx = 0;
 
-  if ( np < 1 ) {
+  if ( np < 1 || nrhs < 1 ) {
     errno = EINVAL;
     return NULL;
   }
@@ -246,6 +333,8 @@ ogmctx_t * ogm_solver_create( size_t np )
   if ( ( ctx = (ogmctx_t *) calloc(1, sizeof(ogmctx_t)) ) )
   {
     ctx->np = np;
+    ctx->nrhs = nrhs;
+    ctx->flags = flags;
 
     if ( !( ctx->c = alloc_matrix(np, np) ) ) {
       ogm_solver_destroy(ctx), ctx = 0;
@@ -253,12 +342,43 @@ ogmctx_t * ogm_solver_create( size_t np )
     else if ( !( ctx->ci = alloc_matrix(np, np) ) ) {
       ogm_solver_destroy(ctx), ctx = 0;
     }
-    else if ( !( ctx->y = alloc_vector(np) ) ) {
+    else if ( !( ctx->y = alloc_matrix(nrhs, np) ) ) {
+      ogm_solver_destroy(ctx), ctx = 0;
+    }
+    else if ( !( ctx->cy = alloc_matrix(nrhs, np) ) ) {
+      ogm_solver_destroy(ctx), ctx = 0;
+    }
+    else if ( !( ctx->ll = alloc_vector(nrhs) ) ) {
+      ogm_solver_destroy(ctx), ctx = 0;
+    }
+    else if ( !( ctx->cll = alloc_vector(nrhs) ) ) {
+      ogm_solver_destroy(ctx), ctx = 0;
+    }
+    else if ( !( ctx->u = alloc_matrix(np, np) ) ) {
+      ogm_solver_destroy(ctx), ctx = 0;
+    }
+    else if ( !( ctx->s = alloc_vector(np) ) ) {
       ogm_solver_destroy(ctx), ctx = 0;
     }
-    else if ( !( ctx->cy = alloc_vector(np) ) ) {
+    else if ( !( ctx->w = alloc_vector(np) ) ) {
       ogm_solver_destroy(ctx), ctx = 0;
     }
+    else if ( !( ctx->x = alloc_matrix(nrhs, np) ) ) {
+      ogm_solver_destroy(ctx), ctx = 0;
+    }
+    else
+    {
+      ctx->npanel = (np + nrhs + 1) & ~(size_t) 1;
+
+      /* 32-byte aligned for SIMD loads, the padding columns stay zero */
+      if ( posix_memalign((void **) &ctx->panel, 32, ctx->npanel * OGM_BLOCK_ROWS * sizeof(double)) != 0 ) {
+        ctx->panel = NULL;
+        ogm_solver_destroy(ctx), ctx = 0;
+      }
+      else {
+        memset(ctx->panel, 0, ctx->npanel * OGM_BLOCK_ROWS * sizeof(double));
+      }
+    }
   }
 
   return ctx;
@@ -267,10 +387,20 @@ ogmctx_t * ogm_solver_create( size_t np )
 void ogm_solver_destroy( ogmctx_t * ctx )
 {
   if ( ctx ) {
-    free_vector(ctx->y);
-    free_vector(ctx->cy);
+    free_matrix(ctx->y);
+    free_matrix(ctx->cy);
+    free_vector(ctx->ll);
+    free_vector(ctx->cll);
+    free_vector(ctx->s);
+    free_vector(ctx->w);
+    free_matrix(ctx->x);
+    free_matrix(ctx->u);
+    free_matrix(ctx->panel);
     free_matrix(ctx->ci);
     free_matrix(ctx->c);
+    free_matrix(ctx->ra);
+    free_vector(ctx->rr);
+    free(ctx->ridx);
     free(ctx);
   }
 }
@@ -285,78 +415,788 @@ size_t ogm_solver_get_n(ogmctx_t * ctx )
   return ctx->n;
 }
 
-int ogm_solver_append_tuple( ogmctx_t * ctx, const double a[/*np*/], double rhs )
+size_t ogm_solver_get_rank(ogmctx_t * ctx )
 {
-  size_t i, j;
+  return ctx->rank;
+}
+
+double ogm_solver_get_rcond(ogmctx_t * ctx )
+{
+  return ctx->rcond;
+}
+
+size_t ogm_solver_get_nrhs(ogmctx_t * ctx )
+{
+  return ctx->nrhs;
+}
+
+static void accumulate_tuple( ogmctx_t * ctx, const double a[/*np*/], const double rhs[/*nrhs*/] )
+{
+  size_t i, j, k;
   const size_t ldc = ctx->np;
 
-  safe_add(&ctx->ll, &ctx->cll, rhs * rhs); /* ctx->ll += rhs * rhs */
   ++ctx->n;
 
+  for ( k = 0; k < ctx->nrhs; ++k )
+  {
+    double * y = ctx->y + k * ldc, * cy = ctx->cy + k * ldc;
+
+    safe_add(&ctx->ll[k], &ctx->cll[k], rhs[k] * rhs[k]); /* ctx->ll += rhs * rhs */
+
+    /* independent per-element compensation, vectorizes across i */
+    for ( i = 0; i < ctx->np; ++i ) {
+      safe_add(&y[i], &cy[i], a[i] * rhs[k]); /* ctx->y[i] += a[i] * rhs; */
+    }
+  }
+
+  /* only upper triangle of symmetric c is maintained */
   for ( i = 0; i < ctx->np; ++i )
   {
-    safe_add(&ctx->y[i], &ctx->cy[i], a[i] * rhs); /* ctx->y[i] += a[i] * rhs; */
+    const double ai = a[i];
+    double * ci = ctx->c + i * ldc;
+
+    for ( j = i; j < ctx->np; ++j ) {
+      ci[j] += ai * a[j];
+    }
+  }
+}
+
+/**
+ * Rank-1 downdate: remove the contribution of one equation from the normal equations
+ */
+static void downdate_tuple( ogmctx_t * ctx, const double a[/*np*/], const double rhs[/*nrhs*/] )
+{
+  size_t i, j, k;
+  const size_t ldc = ctx->np;
+
+  --ctx->n;
+
+  for ( k = 0; k < ctx->nrhs; ++k )
+  {
+    double * y = ctx->y + k * ldc, * cy = ctx->cy + k * ldc;
 
-    for ( j = 0; j < ctx->np; ++j ) {
-      ctx->c[i * ldc + j] += a[i] * a[j];
+    safe_add(&ctx->ll[k], &ctx->cll[k], -rhs[k] * rhs[k]);
+
+    for ( i = 0; i < ctx->np; ++i ) {
+      safe_add(&y[i], &cy[i], -a[i] * rhs[k]);
     }
   }
 
-  return 0;
+  for ( i = 0; i < ctx->np; ++i )
+  {
+    const double ai = a[i];
+    double * ci = ctx->c + i * ldc;
+
+    for ( j = i; j < ctx->np; ++j ) {
+      ci[j] -= ai * a[j];
+    }
+  }
+}
+
+/**
+ * Append copy of nrows equations to the retained rows buffer, growing it on demand.
+ *  Element k of rhs for row r is rhs[k * ks + r * rs].
+ */
+static int retain_rows( ogmctx_t * ctx, const double a[], const double rhs[], size_t ks, size_t rs, size_t nrows,
+    enum ogm_layout layout )
+{
+  const size_t np = ctx->np;
+  const size_t nrhs = ctx->nrhs;
+  size_t r, j;
+
+  if ( ctx->nrows + nrows > ctx->maxrows )
+  {
+    size_t maxrows = ctx->maxrows + ctx->maxrows / 2;
+    double * ra, * rr;
+    size_t * ridx;
+
+    if ( maxrows < ctx->nrows + nrows ) {
+      maxrows = ctx->nrows + nrows;
+    }
+    if ( maxrows < 1024 ) {
+      maxrows = 1024;
+    }
+
+    if ( !(ra = realloc(ctx->ra, maxrows * np * sizeof(*ra))) ) {
+      return OGM_MALLOC;
+    }
+    ctx->ra = ra;
+
+    if ( !(rr = realloc(ctx->rr, maxrows * nrhs * sizeof(*rr))) ) {
+      return OGM_MALLOC;
+    }
+    ctx->rr = rr;
+
+    if ( !(ridx = realloc(ctx->ridx, maxrows * sizeof(*ridx))) ) {
+      return OGM_MALLOC;
+    }
+    ctx->ridx = ridx;
+
+    ctx->maxrows = maxrows;
+  }
+
+  if ( layout == OGM_ROW_MAJOR ) {
+    memcpy(ctx->ra + ctx->nrows * np, a, nrows * np * sizeof(*a));
+  }
+  else {
+    for ( r = 0; r < nrows; ++r ) {
+      double * dst = ctx->ra + (ctx->nrows + r) * np;
+      for ( j = 0; j < np; ++j ) {
+        dst[j] = a[j * nrows + r];
+      }
+    }
+  }
+
+  for ( r = 0; r < nrows; ++r ) {
+    for ( j = 0; j < nrhs; ++j ) {
+      ctx->rr[(ctx->nrows + r) * nrhs + j] = rhs[j * ks + r * rs];
+    }
+  }
+
+  for ( r = 0; r < nrows; ++r ) {
+    ctx->ridx[ctx->nrows + r] = ctx->nseen + r;
+  }
+
+  ctx->nrows += nrows;
+  ctx->nseen += nrows;
+
+  return OGM_SUCCESS;
 }
 
-int ogm_solve(ogmctx_t * ctx, double x[/*np*/], double e[/*np*/], double c[/*np * np */], double ci[/*np * np */],
-    double * sigma)
+int ogm_solver_append_tuple_multi( ogmctx_t * ctx, const double a[/*np*/], const double rhs[/*nrhs*/] )
 {
   int status;
 
+  if ( (ctx->flags & OGM_RETAIN_ROWS) && (status = retain_rows(ctx, a, rhs, 1, 1, 1, OGM_ROW_MAJOR)) ) {
+    return status;
+  }
+
+  accumulate_tuple(ctx, a, rhs);
+
+  return 0;
+}
+
+int ogm_solver_append_tuple( ogmctx_t * ctx, const double a[/*np*/], double rhs )
+{
+  if ( ctx->nrhs != 1 ) {
+    return OGM_INVALID_ARGUMENT;
+  }
+  return ogm_solver_append_tuple_multi(ctx, a, &rhs);
+}
+
+
+/**
+ * Dot products of column pairs: d = [a0'*b0, a0'*b1, a1'*b0, a1'*b1],
+ * n must be multiple of 4 and columns 32-byte aligned
+ */
+#if defined(__AVX__) && defined(__FMA__)
+static inline void dot2x2( size_t n, const double a0[], const double a1[], const double b0[], const double b1[],
+    double d[4] )
+{
+  __m256d s00 = _mm256_setzero_pd(), s01 = _mm256_setzero_pd();
+  __m256d s10 = _mm256_setzero_pd(), s11 = _mm256_setzero_pd();
+  __m128d lo, hi;
+  size_t k;
+
+  for ( k = 0; k < n; k += 4 )
+  {
+    const __m256d x0 = _mm256_load_pd(a0 + k), x1 = _mm256_load_pd(a1 + k);
+    const __m256d y0 = _mm256_load_pd(b0 + k), y1 = _mm256_load_pd(b1 + k);
+    s00 = _mm256_fmadd_pd(x0, y0, s00);
+    s01 = _mm256_fmadd_pd(x0, y1, s01);
+    s10 = _mm256_fmadd_pd(x1, y0, s10);
+    s11 = _mm256_fmadd_pd(x1, y1, s11);
+  }
+
+  /* horizontal sums: [s00 s01 s10 s11] */
+  s00 = _mm256_hadd_pd(s00, s01);
+  s10 = _mm256_hadd_pd(s10, s11);
+  lo = _mm_add_pd(_mm256_castpd256_pd128(s00), _mm256_extractf128_pd(s00, 1));
+  hi = _mm_add_pd(_mm256_castpd256_pd128(s10), _mm256_extractf128_pd(s10, 1));
+  _mm_storeu_pd(d, lo);
+  _mm_storeu_pd(d + 2, hi);
+}
+#else
+static inline void dot2x2( size_t n, const double a0[], const double a1[], const double b0[], const double b1[],
+    double d[4] )
+{
+  double s00[4] = { 0 }, s01[4] = { 0 }, s10[4] = { 0 }, s11[4] = { 0 };
+  size_t k, l;
+
+  for ( k = 0; k < n; k += 4 ) {
+    for ( l = 0; l < 4; ++l ) {
+      s00[l] += a0[k + l] * b0[k + l];
+      s01[l] += a0[k + l] * b1[k + l];
+      s10[l] += a1[k + l] * b0[k + l];
+      s11[l] += a1[k + l] * b1[k + l];
+    }
+  }
+
+  d[0] = (s00[0] + s00[1]) + (s00[2] + s00[3]);
+  d[1] = (s01[0] + s01[1]) + (s01[2] + s01[3]);
+  d[2] = (s10[0] + s10[1]) + (s10[2] + s10[3]);
+  d[3] = (s11[0] + s11[1]) + (s11[2] + s11[3]);
+}
+#endif
+
+/**
+ * Add value to element (i, j), i <= j, of normal matrix C, the products with
+ *  the padding column are dropped
+ */
+static inline void accumulate( ogmctx_t * ctx, size_t i, size_t j, double v )
+{
   const size_t np = ctx->np;
 
-  if ( c != NULL ) {
-    memcpy(c, ctx->c, np * np * sizeof( *c ));
+  if ( j < np ) {
+    ctx->c[i * np + j] += v;
   }
+}
 
-  /* Solve the C * X = Y */
-  if ( ( status = lsolve(np, ctx->c, ctx->y, x, ctx->ci) ) == OGM_SUCCESS )
+/**
+ * Rank-k update of upper triangle of normal matrix C by the panel of OGM_BLOCK_ROWS rows.
+ *  The panel is column-major [A | rhs] of ctx->npanel columns, zero padded.
+ *  The y and ll row products are summed over the panel with compensated kahan_dot()
+ *  and the panel totals are added through safe_add(), so that each row contribution
+ *  is compensated, not only the panel totals.
+ */
+static void syrk_panel( ogmctx_t * ctx, size_t nr )
+{
+  const size_t np = ctx->np;
+  const size_t ncols = (np + 1) & ~(size_t) 1;
+  const size_t ldp = OGM_BLOCK_ROWS;
+  const double * p = ctx->panel;
+  double d[4];
+  size_t i, j, k;
+
+  for ( i = 0; i < np; i += 2 )
+  {
+    for ( j = i; j < ncols; j += 2 )
+    {
+      dot2x2(ldp, p + i * ldp, p + (i + 1) * ldp, p + j * ldp, p + (j + 1) * ldp, d);
+
+      accumulate(ctx, i, j, d[0]);
+      accumulate(ctx, i, j + 1, d[1]);
+      if ( j > i && i + 1 < np ) { /* (i+1, i) is below the diagonal */
+        accumulate(ctx, i + 1, j, d[2]);
+      }
+      if ( i + 1 < np ) {
+        accumulate(ctx, i + 1, j + 1, d[3]);
+      }
+    }
+  }
+
+  for ( k = 0; k < ctx->nrhs; ++k )
+  {
+    const double * pk = p + (np + k) * ldp;
+    double * y = ctx->y + k * np, * cy = ctx->cy + k * np;
+
+    safe_add(&ctx->ll[k], &ctx->cll[k], kahan_dot(nr, pk, pk));
+
+    for ( i = 0; i < np; ++i ) {
+      safe_add(&y[i], &cy[i], kahan_dot(nr, p + i * ldp, pk));
+    }
+  }
+}
+
+/**
+ * Accumulate nrows equations, element k of rhs for row r is rhs[k * ks + r * rs]
+ */
+static void accumulate_block( ogmctx_t * ctx, const double a[], const double rhs[], size_t ks, size_t rs,
+    size_t nrows, enum ogm_layout layout )
+{
+  const size_t np = ctx->np;
+  const size_t ldp = OGM_BLOCK_ROWS;
+  size_t r0, r, j, k, nr;
+
+  for ( r0 = 0; r0 < nrows; r0 += nr )
   {
-    if ( ci != NULL ) {
-      memcpy(ci, ctx->ci, np * np * sizeof( *ci ));
+    double * p = ctx->panel;
+
+    nr = nrows - r0 < ldp ? nrows - r0 : ldp;
+
+    /* pack [A | rhs] rows r0..r0+nr into column-major panel */
+    if ( layout == OGM_COL_MAJOR ) {
+      for ( j = 0; j < np; ++j ) {
+        memcpy(p + j * ldp, a + j * nrows + r0, nr * sizeof(*p));
+      }
+    }
+    else {
+      for ( r = 0; r < nr; ++r ) {
+        const double * ar = a + (r0 + r) * np;
+        for ( j = 0; j < np; ++j ) {
+          p[j * ldp + r] = ar[j];
+        }
+      }
     }
 
-    if ( e != NULL || sigma != NULL )
+    for ( k = 0; k < ctx->nrhs; ++k )
     {
-      double ss, vv;
-      size_t i;
+      double * pk = p + (np + k) * ldp;
+      const double * rk = rhs + k * ks + r0 * rs;
+
+      if ( rs == 1 ) {
+        memcpy(pk, rk, nr * sizeof(*p));
+      }
+      else {
+        for ( r = 0; r < nr; ++r ) {
+          pk[r] = rk[r * rs];
+        }
+      }
+    }
+
+    /* zero the tail rows of the last partial panel */
+    if ( nr < ldp ) {
+      for ( j = 0; j < ctx->npanel; ++j ) {
+        memset(p + j * ldp + nr, 0, (ldp - nr) * sizeof(*p));
+      }
+    }
+
+    syrk_panel(ctx, nr);
+    ctx->n += nr;
+  }
+}
+
+int ogm_solver_append_block( ogmctx_t * ctx, const double a[], const double rhs[], size_t nrows,
+    enum ogm_layout layout )
+{
+  int status;
+
+  if ( (ctx->flags & OGM_RETAIN_ROWS) && (status = retain_rows(ctx, a, rhs, nrows, 1, nrows, layout)) ) {
+    return status;
+  }
+
+  accumulate_block(ctx, a, rhs, nrows, 1, nrows, layout);
+
+  return 0;
+}
+
+int ogm_solver_merge( ogmctx_t * dst, const ogmctx_t * src )
+{
+  const size_t np = dst->np;
+  size_t i, j;
+
+  if ( src->np != np || src->nrhs != dst->nrhs ) {
+    return OGM_INVALID_ARGUMENT;
+  }
+
+  /* clipping on dst needs every equation it has accumulated */
+  if ( dst->flags & OGM_RETAIN_ROWS )
+  {
+    const size_t base = dst->nrows, nseen = dst->nseen;
+    int status;
+
+    if ( !(src->flags & OGM_RETAIN_ROWS) ) {
+      return OGM_INVALID_ARGUMENT;
+    }
+    if ( src->nrows && (status = retain_rows(dst, src->ra, src->rr, 1, src->nrhs, src->nrows, OGM_ROW_MAJOR)) ) {
+      return status;
+    }
+    for ( i = 0; i < src->nrows; ++i ) {
+      dst->ridx[base + i] = nseen + src->ridx[i];
+    }
+    dst->nseen = nseen + src->nseen;
+  }
+
+  /* the true src values are y - cy, ll - cll */
+  for ( i = 0; i < dst->nrhs; ++i ) {
+    safe_add(&dst->ll[i], &dst->cll[i], src->ll[i]);
+    safe_add(&dst->ll[i], &dst->cll[i], -src->cll[i]);
+  }
+
+  for ( i = 0; i < np * dst->nrhs; ++i ) {
+    safe_add(&dst->y[i], &dst->cy[i], src->y[i]);
+    safe_add(&dst->y[i], &dst->cy[i], -src->cy[i]);
+  }
+
+  for ( i = 0; i < np; ++i ) {
+    for ( j = i; j < np; ++j ) {
+      dst->c[i * np + j] += src->c[i * np + j];
+    }
+  }
 
-      const size_t n = ctx->n;
-      const size_t ldc = np;
+  dst->n += src->n;
+
+  return OGM_SUCCESS;
+}
+
+
+/**
+ * Serialized state header, followed by ll[nrhs], cll[nrhs], y[np * nrhs], cy[np * nrhs]
+ * and upper triangle of c row by row
+ */
+struct ogm_state_hdr {
+  char magic[4];        /*< "OGM1" */
+  uint32_t byteorder;   /*< OGM_BYTEORDER as written by the host */
+  uint64_t np;
+  uint64_t nrhs;
+  uint64_t n;
+};
+
+#define OGM_STATE_MAGIC "OGM1"
+#define OGM_BYTEORDER   0x01020304U
+
+static size_t state_size( size_t np, size_t nrhs )
+{
+  return sizeof(struct ogm_state_hdr) + (2 * nrhs + 2 * np * nrhs + np * (np + 1) / 2) * sizeof(double);
+}
+
+/* the byte buffer has no alignment guarantee, doubles are copied in and out with memcpy */
+static inline char * put_doubles( char * p, const double v[], size_t n )
+{
+  memcpy(p, v, n * sizeof(*v));
+  return p + n * sizeof(*v);
+}
+
+static inline const char * get_doubles( const char * p, double v[], size_t n )
+{
+  memcpy(v, p, n * sizeof(*v));
+  return p + n * sizeof(*v);
+}
+
+size_t ogm_solver_serialize( const ogmctx_t * ctx, void * buf, size_t size )
+{
+  const size_t np = ctx->np;
+  const size_t nrhs = ctx->nrhs;
+  const size_t required = state_size(np, nrhs);
+  struct ogm_state_hdr hdr;
+  char * p;
+  size_t i;
+
+  if ( buf != NULL && size >= required )
+  {
+    memcpy(hdr.magic, OGM_STATE_MAGIC, sizeof(hdr.magic));
+    hdr.byteorder = OGM_BYTEORDER;
+    hdr.np = np;
+    hdr.nrhs = nrhs;
+    hdr.n = ctx->n;
+    memcpy(buf, &hdr, sizeof(hdr));
+
+    p = (char *) buf + sizeof(hdr);
+    p = put_doubles(p, ctx->ll, nrhs);
+    p = put_doubles(p, ctx->cll, nrhs);
+    p = put_doubles(p, ctx->y, np * nrhs);
+    p = put_doubles(p, ctx->cy, np * nrhs);
+    for ( i = 0; i < np; ++i ) {
+      p = put_doubles(p, ctx->c + i * np + i, np - i);
+    }
+  }
+
+  return required;
+}
+
+ogmctx_t * ogm_solver_deserialize( const void * buf, size_t size )
+{
+  struct ogm_state_hdr hdr;
+  const char * p;
+  ogmctx_t * ctx;
+  size_t np, nrhs, i;
+
+  if ( buf == NULL || size < sizeof(hdr) ) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  memcpy(&hdr, buf, sizeof(hdr));
+
+  if ( memcmp(hdr.magic, OGM_STATE_MAGIC, sizeof(hdr.magic)) != 0 || hdr.byteorder != OGM_BYTEORDER ) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  /* reject np and nrhs which would overflow the size computation before trusting them */
+  if ( hdr.np < 1 || hdr.np > (1U << 20) || hdr.nrhs < 1 || hdr.nrhs > (1U << 20)
+      || size != state_size(np = hdr.np, nrhs = hdr.nrhs) ) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  if ( !(ctx = ogm_solver_create_multi(np, nrhs)) ) {
+    errno = ENOMEM;
+    return NULL;
+  }
+
+  ctx->n = hdr.n;
+
+  p = (const char *) buf + sizeof(hdr);
+  p = get_doubles(p, ctx->ll, nrhs);
+  p = get_doubles(p, ctx->cll, nrhs);
+  p = get_doubles(p, ctx->y, np * nrhs);
+  p = get_doubles(p, ctx->cy, np * nrhs);
+  for ( i = 0; i < np; ++i ) {
+    p = get_doubles(p, ctx->c + i * np + i, np - i);
+  }
+
+  return ctx;
+}
+
+
+/**
+ * Residual variance of right-hand side q from the normal equations, (ll - x' * C * x) / (n - np);
+ *  0 for an exact fit, when the residual sum of squares is lost in the rounding of ll
+ */
+static double sigma2( ogmctx_t * ctx, size_t q, const double x[/*np*/] )
+{
+  const size_t np = ctx->np;
+  const size_t n = ctx->n;
+  double vv;
 
-      mmv(np, np, ctx->c, x, e);
+  msv(np, ctx->c, x, ctx->w);
 
-      vv = mvv(np, x, e);
+  vv = mvv(np, x, ctx->w);
 
 #if DEBUG
-      if (ctx->ll < vv ) {
-        fprintf(stderr,"warning: ll < vv; ll:%.16f vv:%.16f\n",ctx->ll, vv);
+  if (ctx->ll[q] < vv ) {
+    fprintf(stderr,"warning: ll < vv; ll:%.16f vv:%.16f\n",ctx->ll[q], vv);
+  }
+  else if (ctx->ll[q] == vv ) {
+    fprintf(stderr,"warning: ll == vv; ll:%.16f vv:%.16f\n",ctx->ll[q], vv);
+  }
+#endif
+
+  return ctx->ll[q] > vv && n > np ? ( ctx->ll[q] - vv ) / ( n - np ) : 0;
+}
+
+
+int ogm_solve(ogmctx_t * ctx, double x[/*np*nrhs*/], double e[/*np*nrhs*/], double c[/*np * np */],
+    double ci[/*np * np */], double sigma[/*nrhs*/])
+{
+  int status;
+
+  const size_t np = ctx->np;
+  const size_t ldc = np;
+  size_t i, j, k;
+
+  if ( c != NULL ) {
+    /* symmetrize from the upper triangle */
+    for ( i = 0; i < np; ++i ) {
+      for ( j = i; j < np; ++j ) {
+        c[i * ldc + j] = c[j * ldc + i] = ctx->c[i * ldc + j];
       }
-      else if (ctx->ll == vv ) {
-        fprintf(stderr,"warning: ll == vv; ll:%.16f vv:%.16f\n",ctx->ll, vv);
+    }
+  }
+
+  if ( x == NULL ) {
+    x = ctx->x;
+  }
+
+  /* Solve the C * X = Y */
+  if ( ( status = lsolve(ctx, x) ) == OGM_SUCCESS )
+  {
+    double ss[ctx->nrhs];
+
+    for ( k = 0; k < ctx->nrhs; ++k )
+    {
+      ss[k] = 0;
+
+      if ( e == NULL && sigma == NULL ) {
+        continue;
       }
-#endif
 
-      ss = ctx->ll > vv ? ( ctx->ll - vv ) / ( n - np ) : 0;
+      ss[k] = sigma2(ctx, k, x + k * np);
 
       if ( sigma != NULL ) {
-        *sigma = ss;
+        sigma[k] = ss[k];
+      }
+    }
+
+    /* The inverse is formed only if requested: CI = S * inv(U) * inv(U)' * S */
+    if ( e != NULL || ci != NULL )
+    {
+      invert_upper(np, ctx->u);
+
+      for ( i = 0; i < np; ++i )
+      {
+        /* only the diagonal is needed for errors */
+        const size_t jend = ci != NULL ? np : i + 1;
+
+        for ( j = i; j < jend; ++j )
+        {
+          double sum = 0;
+
+          for ( k = j; k < np; ++k ) {
+            sum += ctx->u[i * ldc + k] * ctx->u[j * ldc + k];
+          }
+
+          ctx->ci[i * ldc + j] = ctx->ci[j * ldc + i] = ctx->s[i] * sum * ctx->s[j];
+        }
+      }
+
+      if ( ci != NULL ) {
+        memcpy(ci, ctx->ci, np * np * sizeof( *ci ));
       }
 
       if ( e != NULL ) {
-        for ( i = 0; i < np; ++i) {
-          e[i] = sqrt(ctx->ci[i * ldc + i] * ss);
+        for ( k = 0; k < ctx->nrhs; ++k ) {
+          for ( i = 0; i < np; ++i) {
+            e[k * np + i] = sqrt(ctx->ci[i * ldc + i] * ss[k]);
+          }
+        }
+      }
+    }
+  }
+
+  return status;
+}
+
+
+/**
+ * Residuals r = rhs - A * x of retained rows for right-hand side q (r is row-major nrows x nrhs),
+ *  returns their standard deviation
+ */
+static double residuals( const ogmctx_t * ctx, size_t q, const double x[], double r[] )
+{
+  const size_t np = ctx->np;
+  const size_t nrhs = ctx->nrhs;
+  const size_t nrows = ctx->nrows;
+  double s = 0, cs = 0, ss = 0, css = 0, m;
+  size_t k, j;
+
+  for ( k = 0; k < nrows; ++k )
+  {
+    const double * a = ctx->ra + k * np;
+    double v = 0;
+
+    for ( j = 0; j < np; ++j ) {
+      v += a[j] * x[j];
+    }
+
+    r[k * nrhs + q] = ctx->rr[k * nrhs + q] - v;
+    neumaier_add(&s, &cs, r[k * nrhs + q]);
+  }
+
+  m = nrows > 0 ? neumaier_sum(s, cs) / nrows : 0;
+
+  for ( k = 0; k < nrows; ++k ) {
+    neumaier_add(&ss, &css, (r[k * nrhs + q] - m) * (r[k * nrhs + q] - m));
+  }
+
+  return nrows > 1 ? sqrt(neumaier_sum(ss, css) / (nrows - 1)) : 0;
+}
+
+/**
+ * The row is rejected when any of its residuals is beyond the threshold of its right-hand side
+ */
+static inline int rejected( size_t nrhs, const double r[/*nrhs*/], const double thr[/*nrhs*/] )
+{
+  size_t q;
+  for ( q = 0; q < nrhs; ++q ) {
+    if ( !(fabs(r[q]) < thr[q]) ) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int ogm_solve_kclip( ogmctx_t * ctx, double K, int npass, double x[/*np*nrhs*/], double e[/*np*nrhs*/],
+    double c[/*np * np */], double ci[/*np * np */], double sigma[/*nrhs*/], int * passes )
+{
+  const size_t np = ctx->np;
+  const size_t nrhs = ctx->nrhs;
+  double * r = NULL;
+  double thr[nrhs];
+  size_t k, m, q, nrej, nexact;
+  int pass, status;
+
+  if ( !(ctx->flags & OGM_RETAIN_ROWS) ) {
+    return OGM_INVALID_ARGUMENT;
+  }
+
+  if ( x == NULL ) {
+    x = ctx->x;
+  }
+
+  for ( pass = 1; ; ++pass )
+  {
+    if ( (status = lsolve(ctx, x)) != OGM_SUCCESS || K <= 0 || pass >= npass ) {
+      break;
+    }
+
+    if ( !r && !(r = malloc(ctx->nrows * nrhs * sizeof(*r))) ) {
+      status = OGM_MALLOC;
+      break;
+    }
+
+    /*
+     * Exact fit has nothing to clip: its residuals are rounding noise, and K times their deviation
+     *  would drop good rows. Such right-hand sides get no threshold, the same sigma == 0 test
+     *  as of ogm_solve() stops the multi-pass fits re-reading their input.
+     */
+    for ( q = 0, nexact = 0; q < nrhs; ++q ) {
+      thr[q] = K * residuals(ctx, q, x + q * np, r);
+      if ( thr[q] == 0 || sigma2(ctx, q, x + q * np) == 0 ) {
+        thr[q] = INFINITY;
+        ++nexact;
+      }
+    }
+
+    if ( nexact == nrhs ) {
+      break;
+    }
+
+    for ( k = 0, nrej = 0; k < ctx->nrows; ++k ) {
+      nrej += rejected(nrhs, r + k * nrhs, thr);
+    }
+
+    /* nothing to drop, or nothing would be left */
+    if ( nrej == 0 || nrej == ctx->nrows ) {
+      break;
+    }
+
+    /* few rejected: rank-1 downdates, otherwise rebuild from the survivors */
+    if ( nrej * 4 < ctx->nrows ) {
+      for ( k = 0; k < ctx->nrows; ++k ) {
+        if ( rejected(nrhs, r + k * nrhs, thr) ) {
+          downdate_tuple(ctx, ctx->ra + k * np, ctx->rr + k * nrhs);
+        }
+      }
+    }
+
+    /* compact the retained rows in place */
+    for ( k = 0, m = 0; k < ctx->nrows; ++k )
+    {
+      if ( !rejected(nrhs, r + k * nrhs, thr) )
+      {
+        if ( m != k ) {
+          memcpy(ctx->ra + m * np, ctx->ra + k * np, np * sizeof(*ctx->ra));
+          memcpy(ctx->rr + m * nrhs, ctx->rr + k * nrhs, nrhs * sizeof(*ctx->rr));
+          ctx->ridx[m] = ctx->ridx[k];
         }
+        ++m;
       }
     }
+
+    if ( nrej * 4 >= ctx->nrows )
+    {
+      memset(ctx->c, 0, np * np * sizeof(*ctx->c));
+      memset(ctx->y, 0, np * nrhs * sizeof(*ctx->y));
+      memset(ctx->cy, 0, np * nrhs * sizeof(*ctx->cy));
+      memset(ctx->ll, 0, nrhs * sizeof(*ctx->ll));
+      memset(ctx->cll, 0, nrhs * sizeof(*ctx->cll));
+      ctx->n = 0;
+      accumulate_block(ctx, ctx->ra, ctx->rr, 1, nrhs, m, OGM_ROW_MAJOR);
+    }
+
+    ctx->nrows = m;
+  }
+
+  free(r);
+
+  if ( passes ) {
+    *passes = pass;
+  }
+
+  /* final solve with the requested statistics */
+  if ( status == OGM_SUCCESS && (e != NULL || c != NULL || ci != NULL || sigma != NULL) ) {
+    status = ogm_solve(ctx, x, e, c, ci, sigma);
   }
 
   return status;
 }
+
+size_t ogm_solver_get_rows( ogmctx_t * ctx, size_t idx[] )
+{
+  if ( idx != NULL && ctx->nrows > 0 ) {
+    memcpy(idx, ctx->ridx, ctx->nrows * sizeof(*idx));
+  }
+  return ctx->nrows;
+}
@@ -22,20 +22,109 @@ extern "C" {
 #define OGM_SUCCESS           0
 #define OGM_MALLOC            1
 #define OGM_SIGNULAR_MATRIX   2
+#define OGM_SINGULAR_MATRIX   OGM_SIGNULAR_MATRIX
+#define OGM_INVALID_ARGUMENT  3
 
 /**
  * Opaque typedef for ogm solver context
  */
 typedef struct ogmctx_t ogmctx_t;
 
+/**
+ * Memory layout of the blocks passed to ogm_solver_append_block():
+ *  OGM_ROW_MAJOR: nrows tuples of np elements each, one after another (C style)
+ *  OGM_COL_MAJOR: np columns of nrows elements each (Fortran/Octave style)
+ */
+enum ogm_layout {
+  OGM_ROW_MAJOR,
+  OGM_COL_MAJOR
+};
+
+/**
+ * ogm_solver_create_ex() flags:
+ *  OGM_RETAIN_ROWS: keep a copy of every appended equation, required by ogm_solve_kclip()
+ */
+#define OGM_RETAIN_ROWS       0x1
+
+/**
+ * Create solver for np parameters. ogm_solver_create_multi() makes nrhs right-hand sides
+ *  share one normal matrix: it is accumulated and factored once, each right-hand side gets
+ *  its own Y, LL, solution, sigma and parameter errors.
+ */
 ogmctx_t * ogm_solver_create(size_t np);
+ogmctx_t * ogm_solver_create_multi(size_t np, size_t nrhs);
+ogmctx_t * ogm_solver_create_ex(size_t np, size_t nrhs, unsigned flags);
 void ogm_solver_destroy(ogmctx_t * ctx);
+
+/**
+ * Append equations. ogm_solver_append_tuple() is for single right-hand side solvers only.
+ *  For ogm_solver_append_block() the nrhs right-hand sides come one after another, nrows values each.
+ */
 int ogm_solver_append_tuple(ogmctx_t * ctx, const double a[/*np*/], double rhs);
-int ogm_solve(ogmctx_t * ctx, double x[/*np*/], double e[/*np*/], double c[/*np * np */], double ci[/*np * np */],
-    double * ss);
+int ogm_solver_append_tuple_multi(ogmctx_t * ctx, const double a[/*np*/], const double rhs[/*nrhs*/]);
+int ogm_solver_append_block(ogmctx_t * ctx, const double a[/*nrows*np*/], const double rhs[/*nrhs*nrows*/],
+    size_t nrows, enum ogm_layout layout);
+
+/**
+ * Solve. Solutions x and errors e are np x nrhs, one right-hand side after another,
+ *  sigma has nrhs elements; c and ci are shared by all right-hand sides
+ *  (ci is to be scaled by sigma[k] for the covariance of solution k).
+ */
+int ogm_solve(ogmctx_t * ctx, double x[/*np*nrhs*/], double e[/*np*nrhs*/], double c[/*np * np */],
+    double ci[/*np * np */], double sigma[/*nrhs*/]);
+
+/**
+ * Add accumulated normal equations of src to dst: both must have the same np and nrhs.
+ *  Partial solvers fed from disjoint data chunks (threads, plates, files)
+ *  merge into the same state as a single solver fed with all the data;
+ *  the running compensations of y and ll are carried over.
+ */
+int ogm_solver_merge(ogmctx_t * dst, const ogmctx_t * src);
+
+/**
+ * Serialize accumulated state (np, n, upper triangle of C, Y, LL and their compensations)
+ *  into buf of size bytes; retained rows are not included. Returns the number of bytes required; nothing is written
+ *  if buf is NULL or size is less than that. Byte order and double format are those of the host,
+ *  ogm_solver_deserialize() refuses foreign ones.
+ */
+size_t ogm_solver_serialize(const ogmctx_t * ctx, void * buf, size_t size);
+
+/**
+ * Create new solver from the bytes produced by ogm_solver_serialize().
+ *  Returns NULL with errno set to EINVAL on malformed input or ENOMEM.
+ */
+ogmctx_t * ogm_solver_deserialize(const void * buf, size_t size);
+
+/**
+ * Iterative K-sigma clipping, the same scheme as -K/-NP of scosmos scripts:
+ *  up to npass solves; after each but the last, the equations with |residual| >= K * std(residuals)
+ *  for any of right-hand sides are removed from the normal equations (rank-1 downdates, or rebuild from the survivors when many)
+ *  and the solve is repeated, stopping early when nothing is rejected or all would be. Right-hand sides with zero
+ *  ogm_solve() sigma (exact fit) are not clipped. K <= 0 or npass <= 1 is plain ogm_solve().
+ *  Outputs are those of ogm_solve() for the final set, *passes (if not NULL) receives the number of solves done.
+ *  Requires the solver created with OGM_RETAIN_ROWS, otherwise returns OGM_INVALID_ARGUMENT.
+ */
+int ogm_solve_kclip(ogmctx_t * ctx, double K, int npass, double x[/*np*nrhs*/], double e[/*np*nrhs*/],
+    double c[/*np * np */], double ci[/*np * np */], double sigma[/*nrhs*/], int * passes);
+
+/**
+ * Number of retained equations still in the fit (OGM_RETAIN_ROWS);
+ *  if idx is not NULL it receives their 0-based ordinals in order of appending.
+ */
+size_t ogm_solver_get_rows(ogmctx_t * ctx, size_t idx[]);
+
 size_t ogm_solver_get_np(ogmctx_t * ctx );
+size_t ogm_solver_get_nrhs(ogmctx_t * ctx );
 size_t ogm_solver_get_n(ogmctx_t * ctx );
 
+/**
+ * Diagnostics of last ogm_solve() call:
+ *  numerical rank of normal matrix (equals to np on success)
+ *  and estimate of reciprocal condition number of equilibrated normal matrix
+ */
+size_t ogm_solver_get_rank(ogmctx_t * ctx );
+double ogm_solver_get_rcond(ogmctx_t * ctx );
+
 #ifdef __cplusplus
 }
 #endif
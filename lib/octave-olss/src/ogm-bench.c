@@ -0,0 +1,303 @@
+/*
+ * ogm-bench.c
+ *
+ *  Throughput and accuracy of libogm over sweeps of np and n.
+ *
+ *  Design rows are 2-D monomials ordered by total degree (1, x, y, x^2, xy, y^2, ...),
+ *  the kind of ill-conditioned basis fitted by xy2tan.m, with x, y uniform in [-1, 1];
+ *  basis=rand uses uniform [0, 1) columns instead. Right-hand side is A * c + noise.
+ *  Each (np, n) is streamed through ogm_solver_append_block() and solved;
+ *  the solution is compared against a long double reference
+ *  (normal equations accumulated and Cholesky-solved in long double from the same rows).
+ *
+ *  Output is TSV, one row per (np, n), to track regressions across builds:
+ *    make bench && ./ogm-bench > ogm-bench.tsv
+ *    ./ogm-bench np=4,16,64 n=1e6,1e7 tag=$(git rev-parse --short HEAD)
+ *
+ *  Combinations with n * np^2 above maxops= (default 2e11) are skipped,
+ *  the reference is computed only while n * np^2 <= refops= (default 2e10); 0 lifts the limits.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "libogm.h"
+
+/** Rows generated and appended per chunk */
+#define CHUNK     4096
+
+/** Max sweep list length */
+#define MAX_LIST  64
+
+#if defined(__AVX__) && defined(__FMA__)
+# define KERNEL "avx-fma"
+#else
+# define KERNEL "generic"
+#endif
+
+static double now( void )
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + 1e-9 * t.tv_nsec;
+}
+
+static unsigned long long rng;
+
+static double rnd( void )
+{
+  rng ^= rng << 13, rng ^= rng >> 7, rng ^= rng << 17;
+  return (rng >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* comma separated list of numbers, 1e6 style accepted */
+static int parse_list( const char * s, double v[], int maxn )
+{
+  char * e;
+  int n = 0;
+
+  while ( n < maxn ) {
+    v[n] = strtod(s, &e);
+    if ( e == s || v[n] < 1 ) {
+      return -1;
+    }
+    ++n;
+    if ( *e == 0 ) {
+      return n;
+    }
+    if ( *e != ',' ) {
+      return -1;
+    }
+    s = e + 1;
+  }
+
+  return -1;
+}
+
+/* exponents of the first np monomials by total degree */
+static void monomials( size_t np, unsigned px[], unsigned py[] )
+{
+  size_t j = 0;
+  unsigned d, k;
+
+  for ( d = 0; j < np; ++d ) {
+    for ( k = 0; k <= d && j < np; ++k, ++j ) {
+      px[j] = d - k;
+      py[j] = k;
+    }
+  }
+}
+
+/* Cholesky solve of the long double normal equations, upper triangle of c is used */
+static int ref_solve( size_t np, long double c[], const long double y[], long double x[] )
+{
+  size_t i, j, k;
+
+  for ( i = 0; i < np; ++i ) {
+    for ( j = i; j < np; ++j ) {
+      long double s = c[i * np + j];
+      for ( k = 0; k < i; ++k ) {
+        s -= c[k * np + i] * c[k * np + j];
+      }
+      if ( i == j ) {
+        if ( !(s > 0) ) {
+          return -1;
+        }
+        c[i * np + i] = sqrtl(s);
+      }
+      else {
+        c[i * np + j] = s / c[i * np + i];
+      }
+    }
+  }
+
+  /* U' * z = y */
+  for ( i = 0; i < np; ++i ) {
+    long double s = y[i];
+    for ( k = 0; k < i; ++k ) {
+      s -= c[k * np + i] * x[k];
+    }
+    x[i] = s / c[i * np + i];
+  }
+
+  /* U * x = z */
+  for ( i = np; i-- > 0; ) {
+    long double s = x[i];
+    for ( k = i + 1; k < np; ++k ) {
+      s -= c[i * np + k] * x[k];
+    }
+    x[i] = s / c[i * np + i];
+  }
+
+  return 0;
+}
+
+static void run( size_t np, size_t n, int poly, double refops, const char * tag )
+{
+  unsigned px[np], py[np];
+  double coef[np], sol[np], err[np], sigma = 0;
+  double * a = NULL, * rhs = NULL;
+  long double * lc = NULL, * ly = NULL, * lx = NULL;
+  double xp[CHUNK], yp[CHUNK];
+  double t_append = 0, t_solve, t0, relerr = NAN;
+  const int ref = refops <= 0 || (double) n * np * np <= refops;
+  ogmctx_t * ctx = NULL;
+  size_t r0, m, i, j, k;
+  int status;
+
+  if ( !(ctx = ogm_solver_create(np)) || !(a = malloc(CHUNK * np * sizeof(*a)))
+      || !(rhs = malloc(CHUNK * sizeof(*rhs))) ) {
+    fprintf(stderr, "ogm-bench: out of memory for np=%zu\n", np);
+    goto end;
+  }
+
+  if ( ref && (!(lc = calloc(np * np, sizeof(*lc))) || !(ly = calloc(np, sizeof(*ly)))
+      || !(lx = calloc(np, sizeof(*lx)))) ) {
+    fprintf(stderr, "ogm-bench: out of memory for np=%zu\n", np);
+    goto end;
+  }
+
+  monomials(np, px, py);
+
+  rng = 88172645463325252ULL;
+  for ( j = 0; j < np; ++j ) {
+    coef[j] = 1.0 / (j + 1);
+  }
+
+  for ( r0 = 0; r0 < n; r0 += m )
+  {
+    m = n - r0 < CHUNK ? n - r0 : CHUNK;
+
+    for ( i = 0; i < m; ++i )
+    {
+      double * ai = a + i * np;
+      double v = 0;
+
+      if ( poly ) {
+        xp[i] = 2 * rnd() - 1;
+        yp[i] = 2 * rnd() - 1;
+        for ( j = 0; j < np; ++j ) {
+          ai[j] = pow(xp[i], px[j]) * pow(yp[i], py[j]);
+        }
+      }
+      else {
+        for ( j = 0; j < np; ++j ) {
+          ai[j] = rnd();
+        }
+      }
+
+      for ( j = 0; j < np; ++j ) {
+        v += ai[j] * coef[j];
+      }
+      rhs[i] = v + 1e-3 * (rnd() - 0.5);
+    }
+
+    t0 = now();
+    ogm_solver_append_block(ctx, a, rhs, m, OGM_ROW_MAJOR);
+    t_append += now() - t0;
+
+    if ( ref ) {
+      for ( i = 0; i < m; ++i ) {
+        const double * ai = a + i * np;
+        for ( j = 0; j < np; ++j ) {
+          const long double aj = ai[j];
+          for ( k = j; k < np; ++k ) {
+            lc[j * np + k] += aj * ai[k];
+          }
+          ly[j] += aj * rhs[i];
+        }
+      }
+    }
+  }
+
+  t0 = now();
+  status = ogm_solve(ctx, sol, err, NULL, NULL, &sigma);
+  t_solve = now() - t0;
+
+  if ( ref && status == OGM_SUCCESS && ref_solve(np, lc, ly, lx) == 0 ) {
+    long double dmax = 0, xmax = 0;
+    for ( j = 0; j < np; ++j ) {
+      if ( fabsl(sol[j] - lx[j]) > dmax ) {
+        dmax = fabsl(sol[j] - lx[j]);
+      }
+      if ( fabsl(lx[j]) > xmax ) {
+        xmax = fabsl(lx[j]);
+      }
+    }
+    relerr = (double) (dmax / xmax);
+  }
+
+  printf("%s\t%s\t%s\t%zu\t%zu\t%.6f\t%.4e\t%.6e\t%zu\t%.3e\t%.3e\t%.3e\t%d\n", tag, KERNEL,
+      poly ? "poly" : "rand", np, n, t_append, n / t_append, t_solve, ogm_solver_get_rank(ctx),
+      ogm_solver_get_rcond(ctx), sqrt(sigma), relerr, status);
+  fflush(stdout);
+
+end:
+  ogm_solver_destroy(ctx);
+  free(a);
+  free(rhs);
+  free(lc);
+  free(ly);
+  free(lx);
+}
+
+int main( int argc, char * argv[] )
+{
+  double nps[MAX_LIST] = { 2, 4, 8, 16, 32, 64, 100, 200 };
+  double ns[MAX_LIST] = { 1e3, 1e4, 1e5, 1e6, 1e7, 1e8 };
+  int nnp = 8, nn = 6;
+  double maxops = 2e11, refops = 2e10;
+  const char * tag = "-";
+  int poly = 1;
+  int a, i, k;
+
+  for ( a = 1; a < argc; ++a ) {
+    if ( strncmp(argv[a], "np=", 3) == 0 ) {
+      if ( (nnp = parse_list(argv[a] + 3, nps, MAX_LIST)) < 1 ) {
+        fprintf(stderr, "ogm-bench: invalid %s\n", argv[a]);
+        return 1;
+      }
+    }
+    else if ( strncmp(argv[a], "n=", 2) == 0 ) {
+      if ( (nn = parse_list(argv[a] + 2, ns, MAX_LIST)) < 1 ) {
+        fprintf(stderr, "ogm-bench: invalid %s\n", argv[a]);
+        return 1;
+      }
+    }
+    else if ( strncmp(argv[a], "maxops=", 7) == 0 ) {
+      maxops = strtod(argv[a] + 7, NULL);
+    }
+    else if ( strncmp(argv[a], "refops=", 7) == 0 ) {
+      refops = strtod(argv[a] + 7, NULL);
+    }
+    else if ( strncmp(argv[a], "tag=", 4) == 0 ) {
+      tag = argv[a] + 4;
+    }
+    else if ( strcmp(argv[a], "basis=poly") == 0 ) {
+      poly = 1;
+    }
+    else if ( strcmp(argv[a], "basis=rand") == 0 ) {
+      poly = 0;
+    }
+    else {
+      fprintf(stderr, "usage: ogm-bench [np=2,4,...] [n=1e3,1e4,...] [basis=poly|rand] "
+          "[maxops=2e11] [refops=2e10] [tag=TAG]\n");
+      return 1;
+    }
+  }
+
+  printf("tag\tkernel\tbasis\tnp\tn\tappend_s\ttuples_per_s\tsolve_s\trank\trcond\tsigma\trelerr_ref\tstatus\n");
+
+  for ( i = 0; i < nnp; ++i ) {
+    for ( k = 0; k < nn; ++k ) {
+      const size_t np = (size_t) nps[i], n = (size_t) ns[k];
+      if ( maxops <= 0 || (double) n * np * np <= maxops ) {
+        run(np, n, poly, refops, tag);
+      }
+    }
+  }
+
+  return 0;
+}
@@ -8,46 +8,95 @@
 #include <stddef.h>
 #include <sys/types.h>
 #include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <errno.h>
 #include <iomanip>
+#include <vector>
+#include <algorithm>
 #include <oct.h> // octave/
 #include <octave/version.h>
 #include "libogm.h"
+#include "platemodel.h"
 
 #define UNUSED(x)     ((void)(x))
-#define CTX_MAX       128
 
-static ogmctx_t * ctx[ CTX_MAX ];
+/*
+ * Solver handle table: sid is an index into ctxtab, grown on demand.
+ *  Guarded by ctxlock; solvers referenced by running batch workers
+ *  are resolved to pointers before the workers start.
+ */
+static ogmctx_t ** ctxtab;
+static int nctxtab;
+static int firstfree;  /*< no free slots below this index */
+static pthread_mutex_t ctxlock = PTHREAD_MUTEX_INITIALIZER;
 
-static int olss_create(int np)
+static int olss_register(ogmctx_t * c)
 {
   int sid;
 
-  for ( sid = 0; sid < CTX_MAX; ++sid  )
+  pthread_mutex_lock(&ctxlock);
+
+  for ( sid = firstfree; sid < nctxtab && ctxtab[sid] != NULL; ++sid ) {
+  }
+
+  if ( sid == nctxtab )
   {
-    if ( ctx[sid] == NULL )
-    {
-      if ( !(ctx[sid] = ogm_solver_create(np)) ) {
-        octave_stdout << "error: memory allocation fails in ogm_solver_create()\n";
-        std::flush(octave_stdout);
-        sid = -1;
-      }
-      break;
+    const int n = nctxtab ? 2 * nctxtab : 128;
+    ogmctx_t ** tab = (ogmctx_t **) realloc(ctxtab, n * sizeof(*tab));
+
+    if ( !tab ) {
+      sid = -1;
     }
+    else {
+      memset(tab + nctxtab, 0, (n - nctxtab) * sizeof(*tab));
+      ctxtab = tab;
+      nctxtab = n;
+    }
+  }
+
+  if ( sid >= 0 ) {
+    ctxtab[sid] = c;
+    firstfree = sid + 1;
   }
 
-  if ( sid == CTX_MAX ) {
-    octave_stdout << "error: too many olss solvers\n";
+  pthread_mutex_unlock(&ctxlock);
+
+  if ( sid < 0 ) {
+    octave_stdout << "error: memory allocation fails for olss handle table\n";
     std::flush(octave_stdout);
-    sid = -1;
+    ogm_solver_destroy(c);
   }
 
   return sid;
 }
 
+static int olss_create(int np, int nrhs, unsigned flags)
+{
+  ogmctx_t * c;
+
+  if ( !(c = ogm_solver_create_ex(np, nrhs, flags)) ) {
+    octave_stdout << "error: memory allocation fails in ogm_solver_create()\n";
+    std::flush(octave_stdout);
+    return -1;
+  }
+
+  return olss_register(c);
+}
+
 static void olss_destroy(int sid)
 {
-  ogm_solver_destroy(ctx[sid]);
-  ctx[sid] = NULL;
+  ogmctx_t * c;
+
+  pthread_mutex_lock(&ctxlock);
+  c = ctxtab[sid];
+  ctxtab[sid] = NULL;
+  if ( sid < firstfree ) {
+    firstfree = sid;
+  }
+  pthread_mutex_unlock(&ctxlock);
+
+  ogm_solver_destroy(c);
 }
 
 static int getsid( const octave_value & arg )
@@ -55,55 +104,149 @@ static int getsid( const octave_value & arg )
   int sid = -1;
   if ( arg.is_scalar_type() ) {
     double v = arg.double_value();
-    if ( ((sid = D_NINT(v)) != v) || sid < 0 || sid >= CTX_MAX || ctx[sid] == NULL ) {
+    pthread_mutex_lock(&ctxlock);
+    if ( ((sid = D_NINT(v)) != v) || sid < 0 || sid >= nctxtab || ctxtab[sid] == NULL ) {
       sid = -1;
     }
+    pthread_mutex_unlock(&ctxlock);
   }
   return sid;
 }
 
-static int olss_tuple(ogmctx_t * ctx, const NDArray & m, const NDArray & rhs)
+static ogmctx_t * getctx( const octave_value & arg )
 {
-  const int np = ogm_solver_get_np(ctx);
-  const int nr = m.dim1();
-  const double * pm = m.data();
-  const double * pr = rhs.data();
+  ogmctx_t * c = NULL;
+  if ( arg.is_scalar_type() ) {
+    double v = arg.double_value();
+    int sid = D_NINT(v);
+    pthread_mutex_lock(&ctxlock);
+    if ( sid == v && sid >= 0 && sid < nctxtab ) {
+      c = ctxtab[sid];
+    }
+    pthread_mutex_unlock(&ctxlock);
+  }
+  return c;
+}
 
-  double tup[ np ];
+/*
+ * Minimal thread pool: fn(arg, i) for i in [0, n) on up to nthreads threads,
+ *  the calling thread included. fn must not touch the interpreter.
+ */
+struct olss_pool {
+  void (*fn)(void * arg, int i);
+  void * arg;
+  int n, next;
+  pthread_mutex_t lock;
+};
+
+static void * olss_pool_worker(void * p)
+{
+  olss_pool * pool = (olss_pool *) p;
+  int i;
 
-  for ( int i = 0; i < nr; ++i )
+  while ( 1 )
   {
-    /* F2C */
-    for ( int j = 0; j < np; ++j ) {
-      tup[j] = pm[j * nr + i];
+    pthread_mutex_lock(&pool->lock);
+    i = pool->next++;
+    pthread_mutex_unlock(&pool->lock);
+
+    if ( i >= pool->n ) {
+      break;
     }
 
-    ogm_solver_append_tuple(ctx, tup, pr[i]);
+    pool->fn(pool->arg, i);
   }
 
-  return 0;
+  return NULL;
 }
 
-static int olss_ctuple(ogmctx_t * ctx, const NDArray & m, const NDArray & rhs)
+static void olss_parallel_for(int n, int nthreads, void (*fn)(void * arg, int i), void * arg)
 {
-  const int np = ogm_solver_get_np(ctx);
-  const int nr = m.dim2();
-  const double * pm = m.data();
-  const double * pr = rhs.data();
+  olss_pool pool;
+  std::vector<pthread_t> tids;
+  int k;
+
+  if ( nthreads < 1 && (nthreads = sysconf(_SC_NPROCESSORS_ONLN)) < 1 ) {
+    nthreads = 1;
+  }
+  if ( nthreads > n ) {
+    nthreads = n;
+  }
+
+  pool.fn = fn;
+  pool.arg = arg;
+  pool.n = n;
+  pool.next = 0;
+  pthread_mutex_init(&pool.lock, NULL);
+
+  /* if pthread_create() fails the remaining work is done by the threads already started */
+  for ( k = 1; k < nthreads; ++k ) {
+    pthread_t tid;
+    if ( pthread_create(&tid, NULL, olss_pool_worker, &pool) != 0 ) {
+      break;
+    }
+    tids.push_back(tid);
+  }
+
+  olss_pool_worker(&pool);
 
-  for ( int i = 0; i < nr; ++i, pm += np ) {
-    ogm_solver_append_tuple(ctx, pm, pr[i]);
+  for ( k = 0; k < (int) tids.size(); ++k ) {
+    pthread_join(tids[k], NULL);
   }
 
-  return 0;
+  pthread_mutex_destroy(&pool.lock);
 }
 
-static inline int olss_solve(ogmctx_t * ctx, double x[/*np*/], double e[/*np*/], double c[/*np * np */],
-    double ci[/*np * np */], double * ss)
+/*
+ * Resolve array of handles to distinct solvers, so that each can be given to its own thread
+ */
+static bool getctxs( const octave_value & arg, std::vector<ogmctx_t *> & ctxs )
+{
+  const NDArray sids = arg.array_value();
+  std::vector<ogmctx_t *> sorted;
+
+  ctxs.resize(sids.numel());
+
+  for ( octave_idx_type i = 0; i < sids.numel(); ++i ) {
+    if ( !(ctxs[i] = getctx(octave_value(sids(i)))) ) {
+      return false;
+    }
+  }
+
+  sorted = ctxs;
+  std::sort(sorted.begin(), sorted.end());
+
+  return std::adjacent_find(sorted.begin(), sorted.end()) == sorted.end();
+}
+
+static int olss_tuple(ogmctx_t * ctx, const NDArray & m, const NDArray & rhs)
+{
+  /* m is column-major (nr x np), fed to the panel packer directly; rhs (nr x nrhs) has each right-hand side contiguous */
+  return ogm_solver_append_block(ctx, m.data(), rhs.data(), m.dim1(), OGM_COL_MAJOR);
+}
+
+static int olss_ctuple(ogmctx_t * ctx, const NDArray & m, const Matrix & rhs)
+{
+  /* m is (np x nr), i.e. each column is one tuple: row-major from the solver's point of view;
+   * rhs (nrhs x nr) is transposed so that each right-hand side is contiguous */
+  if ( rhs.rows() > 1 ) {
+    return ogm_solver_append_block(ctx, m.data(), rhs.transpose().data(), m.dim2(), OGM_ROW_MAJOR);
+  }
+  return ogm_solver_append_block(ctx, m.data(), rhs.data(), m.dim2(), OGM_ROW_MAJOR);
+}
+
+static inline int olss_solve(ogmctx_t * ctx, double x[/*np*nrhs*/], double e[/*np*nrhs*/], double c[/*np * np */],
+    double ci[/*np * np */], double ss[/*nrhs*/])
 {
   return ogm_solve(ctx, x, e, c, ci, ss);
 }
 
+static inline int olss_solve_kclip(ogmctx_t * ctx, double K, int npass, double x[/*np*nrhs*/], double e[/*np*nrhs*/],
+    double c[/*np * np */], double ci[/*np * np */], double ss[/*nrhs*/])
+{
+  return ogm_solve_kclip(ctx, K, npass, x, e, c, ci, ss, NULL);
+}
+
 
 
 
@@ -115,9 +258,11 @@ static inline int olss_solve(ogmctx_t * ctx, double x[/*np*/], double e[/*np*/],
  **********************************************************************************************************************/
 DEFUN_DLD( olss_create, args, nargout,
 "-*- texinfo -*-\n"
-"@deftypefn {Function} {@var{sid}} = olss_create(@var{NP})\n"
+"@deftypefn {Function} {@var{sid}} = olss_create(@var{NP} [, @var{RETAIN}])\n"
 "\n"
 "Create stream-oriented linear least squares solver.\n\n"
+"If @var{RETAIN} is true the solver keeps a copy of appended tuples,\n"
+"which is required by olss_solve_kclip().\n\n"
 "\n"
 "Usage:\n"
 "\n"
@@ -135,10 +280,12 @@ DEFUN_DLD( olss_create, args, nargout,
 "\n"
 "% Solve equations: \n\n"
 "[X,EX,S,C,CI] = olss_solve(sid)\n\n"
+"% Or, for the solver created with RETAIN, solve with 3-sigma clipping in up to 5 passes: \n\n"
+"[X,EX,S,C,CI,IDX] = olss_solve_kclip(sid, 3, 5)\n\n"
 "% Destroy solver: \n\n"
 "olss_destroy(sid);\n\n"
 ""
-"@seealso{ olss_destroy(), olss_solve(), olss_tuple(), olss_ctuple() }\n\n\
+"@seealso{ olss_destroy(), olss_solve(), olss_solve_kclip(), olss_tuple(), olss_ctuple(), olss_merge(), olss_serialize() }\n\n\
    Copyright (c) 2013, Andrey Myznikov <andrey.myznikov@@gmail.com>\n\
 @end deftypefn\n"
 )
@@ -146,8 +293,8 @@ DEFUN_DLD( olss_create, args, nargout,
   int NP, sid = -1;
   octave_value_list retlist;
 
-  if ( args.length() != 1 ) {
-    error("olss_create(NP): missing mandatory argument NP");
+  if ( args.length() != 1 && args.length() != 2 ) {
+    error("olss_create(NP [,RETAIN]): missing mandatory argument NP");
   }
   else if ( !args(0).is_scalar_type() ) {
     error("olss_create(NP): NP must be positive integer scalar");
@@ -159,7 +306,7 @@ DEFUN_DLD( olss_create, args, nargout,
       error( "olss_create(): NP must be positive integer scalar" );
     }
     else {
-      sid = olss_create(NP);
+      sid = olss_create(NP, 1, args.length() > 1 && args(1).is_true() ? OGM_RETAIN_ROWS : 0);
     }
   }
 
@@ -169,6 +316,54 @@ DEFUN_DLD( olss_create, args, nargout,
   return retlist;
 }
 
+/***********************************************************************************************************************
+ *
+ * function sid = olss_create_multi(NP, NRHS)
+ *
+ **********************************************************************************************************************/
+DEFUN_DLD( olss_create_multi, args, nargout,
+"-*- texinfo -*-\n\
+@deftypefn {Function} {@var{sid}} = olss_create_multi(@var{NP}, @var{NRHS} [, @var{RETAIN}])\n\
+\n\
+Create solver for @var{NRHS} right-hand sides sharing the same design matrix.\n\
+The normal matrix is accumulated and factored once for all of them.\n\
+olss_tuple() takes RHS as (N x NRHS) matrix, olss_ctuple() as (NRHS x N) matrix;\n\
+olss_solve() returns X and EX as (NP x NRHS) matrices and S as (1 x NRHS) row.\n\
+\n\
+\n\
+Example:\n\n\
+  sid = olss_create_multi(NP, 2);\n\
+  olss_ctuple(sid, B, [X; Y]);\n\
+  [P, EP, S] = olss_solve(sid); % P(:,1) for X, P(:,2) for Y\n\
+\n\
+@seealso{ olss_create(), olss_solve() }\n\n\
+   Copyright (c) 2013, Andrey Myznikov <andrey.myznikov@@gmail.com>\n\
+@end deftypefn\n"
+)
+{
+  int NP, NRHS, sid = -1;
+
+  if ( args.length() != 2 && args.length() != 3 ) {
+    error("olss_create_multi(NP, NRHS [,RETAIN]): expected 2 or 3 arguments");
+  }
+  else if ( !args(0).is_scalar_type() || !args(1).is_scalar_type() ) {
+    error("olss_create_multi(): NP and NRHS must be positive integer scalars");
+  }
+  else
+  {
+    const double v = args(0).double_value(), w = args(1).double_value();
+    if ( ((NP = D_NINT(v)) != v) || (NP <= 0) || ((NRHS = D_NINT(w)) != w) || (NRHS <= 0) ) {
+      error( "olss_create_multi(): NP and NRHS must be positive integer scalars" );
+    }
+    else {
+      sid = olss_create(NP, NRHS, args.length() > 2 && args(2).is_true() ? OGM_RETAIN_ROWS : 0);
+    }
+  }
+
+  UNUSED(nargout);
+  return octave_value_list(1, sid);
+}
+
 /***********************************************************************************************************************
  *
  * function olss_destroy(N)
@@ -225,20 +420,21 @@ Example:\n\n\
 @end deftypefn\n"
 )
 {
-  int status = -1, sid, np;
+  int status = -1, np;
   ogmctx_t * ctx;
 
   if ( args.length() != 3 ) {
     error("olss_tuple(sid,m,rhs): expected 3 arguments");
   }
-  else if ( (sid = getsid(args(0))) == -1 || !(ctx = ::ctx[sid]) ) {
+  else if ( !(ctx = getctx(args(0))) ) {
     error("olss_tuple(): invalid olss handle");
   }
   else if ( !args(1).is_float_type() || args(1).rows() < 1 ) {
     error("olss_tuple(): m must be non-empty real matrix");
   }
-  else if ( !args(2).is_float_type() || args(2).columns() != 1 ) {
-    error("olss_tuple(): rhs must be real column-vector");
+  else if ( !args(2).is_float_type() || args(2).columns() != (int) ogm_solver_get_nrhs(ctx) ) {
+    error("olss_tuple(): rhs must be real column-vector, or matrix with NRHS (=%d) columns",
+        (int) ogm_solver_get_nrhs(ctx));
   }
   else if ( args(2).rows() != args(1).rows() ) {
     error("olss_tuple(): number of rows of matrix m and vector rhs must match");
@@ -246,7 +442,7 @@ Example:\n\n\
   else if ( args(1).columns() != (np = ogm_solver_get_np(ctx)) ) {
     error("olss_tuple(): number of columns of matrix m must match to NP (=%d)", np);
   }
-  else if ( (status = olss_tuple(ctx, args(1).float_array_value(), args(2).float_array_value())) ) {
+  else if ( (status = olss_tuple(ctx, args(1).array_value(), args(2).array_value())) ) {
     error("olss_tuple() fails");
   }
 
@@ -274,20 +470,21 @@ Example:\n\n\
 @end deftypefn\n"
 )
 {
-  int status = -1, sid, np;
+  int status = -1, np;
   ogmctx_t * ctx;
 
   if ( args.length() != 3 ) {
     error("olss_ctuple(sid,m,rhs): expected 3 arguments");
   }
-  else if ( (sid = getsid(args(0))) == -1 || !(ctx = ::ctx[sid]) ) {
+  else if ( !(ctx = getctx(args(0))) ) {
     error("olss_ctuple(): invalid olss handle");
   }
   else if ( !args(1).is_float_type() || args(1).columns() < 1 ) {
     error("olss_ctuple(): m must be non-empty real matrix");
   }
-  else if ( !args(2).is_float_type() || args(2).rows() != 1 ) {
-    error("olss_ctuple(): rhs must be real row-vector");
+  else if ( !args(2).is_float_type() || args(2).rows() != (int) ogm_solver_get_nrhs(ctx) ) {
+    error("olss_ctuple(): rhs must be real row-vector, or matrix with NRHS (=%d) rows",
+        (int) ogm_solver_get_nrhs(ctx));
   }
   else if ( args(2).columns() != args(1).columns() ) {
     error("olss_ctuple(): number of columns of matrix m and vector rhs must match");
@@ -295,7 +492,7 @@ Example:\n\n\
   else if ( args(1).rows() != (np = ogm_solver_get_np(ctx)) ) {
     error("olss_ctuple(): number of rows of matrix m must match to NP (=%d)", np);
   }
-  else if ( (status = olss_ctuple(ctx, args(1).float_array_value(), args(2).float_array_value())) ) {
+  else if ( (status = olss_ctuple(ctx, args(1).array_value(), args(2).matrix_value())) ) {
     error("olss_ctuple() fails");
   }
 
@@ -324,14 +521,14 @@ Example:\n\n\
 @end deftypefn\n"
 )
 {
-  int status, sid, n, np;
+  int status, n, np;
   ogmctx_t * ctx;
   octave_value_list outargs;
 
   if ( args.length() != 1 ) {
     error("olss_solve(sid): expected 1 argument");
   }
-  else if ( (sid = getsid(args(0))) == -1 || !(ctx = ::ctx[sid]) ) {
+  else if ( !(ctx = getctx(args(0))) ) {
     error("olss_solve(): invalid olss handle");
   }
   else if ( (n = ogm_solver_get_n(ctx)) < (np = ogm_solver_get_np(ctx)) ) {
@@ -339,9 +536,10 @@ Example:\n\n\
   }
   else
   {
-    double x[np], * px = 0;
-    double e[np], * pe = 0;
-    double ss, * pss = 0;
+    const int nrhs = ogm_solver_get_nrhs(ctx);
+    double x[np * nrhs], * px = 0;
+    double e[np * nrhs], * pe = 0;
+    double ss[nrhs], * pss = 0;
     double c[np * np], * pc = 0;
     double ci[np * np], * pci = 0;
 
@@ -352,7 +550,7 @@ Example:\n\n\
       pe = e;
     }
     if ( nargout > 2 ) {
-      pss = &ss;
+      pss = ss;
     }
     if ( nargout > 3 ) {
       pc = c;
@@ -366,17 +564,19 @@ Example:\n\n\
     {
     case OGM_SUCCESS:
       if ( nargout > 0 ) {
-        Matrix v(np, 1);
+        Matrix v(np, nrhs);
         memcpy(v.fortran_vec(), x, sizeof(x));
         outargs(0) = v;
       }
       if ( nargout > 1 ) {
-        Matrix v(np, 1);
+        Matrix v(np, nrhs);
         memcpy(v.fortran_vec(), e, sizeof(e));
         outargs(1) = v;
       }
       if ( nargout > 2 ) {
-        outargs(2) = ss;
+        Matrix v(1, nrhs);
+        memcpy(v.fortran_vec(), ss, sizeof(ss));
+        outargs(2) = v;
       }
       if ( nargout > 3 ) {
         Matrix v(np, np);
@@ -396,8 +596,9 @@ Example:\n\n\
       error("olss_solve() fails: not enough memory");
       break;
 
-    case OGM_SIGNULAR_MATRIX:
-      error("olss_solve() fails: singular matrix");
+    case OGM_SINGULAR_MATRIX:
+      error("olss_solve() fails: singular matrix (rank %d of NP=%d, rcond=%g)",
+          (int) ogm_solver_get_rank(ctx), np, ogm_solver_get_rcond(ctx));
       break;
 
     default:
@@ -410,3 +611,659 @@ Example:\n\n\
   return outargs;
 }
 
+
+
+/***********************************************************************************************************************
+ *
+ * function olss_merge(dst, src)
+ *
+ **********************************************************************************************************************/
+DEFUN_DLD( olss_merge, args, nargout,
+"-*- texinfo -*-\n\
+@deftypefn {Function} olss_merge(@var{dst}, @var{src})\n\
+\n\
+Add normal equations accumulated by solver @var{src} to solver @var{dst}.\n\
+Both solvers must have the same NP, @var{src} is left unchanged.\n\
+\n\
+\n\
+Example:\n\n\
+  a = olss_create(2); b = olss_create(2);\n\
+  olss_tuple(a, M(1:2:end,:), R(1:2:end));\n\
+  olss_tuple(b, M(2:2:end,:), R(2:2:end));\n\
+  olss_merge(a, b); olss_destroy(b);\n\
+  X = olss_solve(a);\n\
+\n\
+@seealso{ olss_create(), olss_serialize(), olss_deserialize(), olss_solve() }\n\n\
+   Copyright (c) 2013, Andrey Myznikov <andrey.myznikov@@gmail.com>\n\
+@end deftypefn\n"
+)
+{
+  ogmctx_t * dst, * src;
+  int status;
+
+  if ( args.length() != 2 ) {
+    error("olss_merge(dst,src): expected 2 arguments");
+  }
+  else if ( !(dst = getctx(args(0))) || !(src = getctx(args(1))) ) {
+    error("olss_merge(): invalid olss handle");
+  }
+  else if ( dst == src ) {
+    error("olss_merge(): dst and src must be different solvers");
+  }
+  else if ( ogm_solver_get_np(dst) != ogm_solver_get_np(src) ) {
+    error("olss_merge(): NP mismatch (%d and %d)", (int) ogm_solver_get_np(dst),
+        (int) ogm_solver_get_np(src));
+  }
+  else if ( (status = ogm_solver_merge(dst, src)) == OGM_MALLOC ) {
+    error("olss_merge() fails: not enough memory");
+  }
+  else if ( status != OGM_SUCCESS ) {
+    error("olss_merge(): src must retain tuples when dst does");
+  }
+
+  UNUSED(nargout);
+  return octave_value_list();
+}
+
+/***********************************************************************************************************************
+ *
+ * function bytes = olss_serialize(sid)
+ *
+ **********************************************************************************************************************/
+DEFUN_DLD( olss_serialize, args, nargout,
+"-*- texinfo -*-\n\
+@deftypefn {Function} {@var{bytes}} = olss_serialize(@var{sid})\n\
+\n\
+Return accumulated state of the solver as uint8 row vector, suitable for save()\n\
+or fwrite() and later restore with olss_deserialize().\n\
+\n\
+\n\
+Example:\n\n\
+  bytes = olss_serialize(sid);\n\
+  fid = fopen(\"plate.olss\", \"w\"); fwrite(fid, bytes, \"uint8\"); fclose(fid);\n\
+\n\
+@seealso{ olss_deserialize(), olss_merge() }\n\n\
+   Copyright (c) 2013, Andrey Myznikov <andrey.myznikov@@gmail.com>\n\
+@end deftypefn\n"
+)
+{
+  ogmctx_t * ctx;
+  octave_value_list outargs;
+
+  if ( args.length() != 1 ) {
+    error("olss_serialize(sid): expected 1 argument");
+  }
+  else if ( !(ctx = getctx(args(0))) ) {
+    error("olss_serialize(): invalid olss handle");
+  }
+  else {
+    const size_t size = ogm_solver_serialize(ctx, NULL, 0);
+    uint8NDArray bytes(dim_vector(1, size));
+    ogm_solver_serialize(ctx, bytes.fortran_vec(), size);
+    outargs(0) = bytes;
+  }
+
+  UNUSED(nargout);
+  return outargs;
+}
+
+/***********************************************************************************************************************
+ *
+ * function sid = olss_deserialize(bytes)
+ *
+ **********************************************************************************************************************/
+DEFUN_DLD( olss_deserialize, args, nargout,
+"-*- texinfo -*-\n\
+@deftypefn {Function} {@var{sid}} = olss_deserialize(@var{bytes})\n\
+\n\
+Create new solver from the uint8 vector returned by olss_serialize().\n\
+\n\
+\n\
+Example:\n\n\
+  fid = fopen(\"plate.olss\"); sid = olss_deserialize(fread(fid, Inf, \"uint8=>uint8\")); fclose(fid);\n\
+\n\
+@seealso{ olss_serialize(), olss_merge(), olss_destroy() }\n\n\
+   Copyright (c) 2013, Andrey Myznikov <andrey.myznikov@@gmail.com>\n\
+@end deftypefn\n"
+)
+{
+  int sid = -1;
+  ogmctx_t * c;
+
+  if ( args.length() != 1 ) {
+    error("olss_deserialize(bytes): expected 1 argument");
+  }
+  else if ( !args(0).is_uint8_type() ) {
+    error("olss_deserialize(): bytes must be uint8 vector");
+  }
+  else {
+    const uint8NDArray bytes = args(0).uint8_array_value();
+    if ( !(c = ogm_solver_deserialize(bytes.data(), bytes.numel())) ) {
+      error("olss_deserialize(): %s", errno == ENOMEM ? "not enough memory" : "malformed or foreign solver state");
+    }
+    else {
+      sid = olss_register(c);
+    }
+  }
+
+  UNUSED(nargout);
+  return octave_value_list(1, sid);
+}
+
+/***********************************************************************************************************************
+ *
+ * function [X,EX,S,C,CI,IDX] = olss_solve_kclip(sid, K, NP)
+ *
+ **********************************************************************************************************************/
+DEFUN_DLD( olss_solve_kclip, args, nargout,
+"-*- texinfo -*-\n\
+@deftypefn {Function} {@var{X},@var{EX},@var{S},@var{C},@var{CI},@var{IDX}} = olss_solve_kclip(@var{sid}, @var{K}, @var{NP})\n\
+\n\
+Solve equation system [A] * X = RHS in least squares sense with iterative K-sigma clipping:\n\
+up to @var{NP} passes, after each but the last the tuples with abs(residual) >= @var{K} * std(residuals)\n\
+are removed from the normal equations. Outputs are those of olss_solve() for the final set of tuples,\n\
+@var{IDX} is the column of 1-based ordinals of the tuples kept, in order of appending.\n\
+The solver must be created with olss_create(NP, true); removed tuples stay removed.\n\
+\n\
+\n\
+Example:\n\n\
+  See help olss_create();\n\
+\n\
+@seealso{ olss_create(), olss_solve() }\n\n\
+   Copyright (c) 2013, Andrey Myznikov <andrey.myznikov@@gmail.com>\n\
+@end deftypefn\n"
+)
+{
+  int status, n, np, npass;
+  double K;
+  ogmctx_t * ctx;
+  octave_value_list outargs;
+
+  if ( args.length() != 3 ) {
+    error("olss_solve_kclip(sid,K,NP): expected 3 arguments");
+  }
+  else if ( !(ctx = getctx(args(0))) ) {
+    error("olss_solve_kclip(): invalid olss handle");
+  }
+  else if ( !args(1).is_real_scalar() || !args(2).is_real_scalar() ) {
+    error("olss_solve_kclip(): K and NP must be real scalars");
+  }
+  else if ( (n = ogm_solver_get_n(ctx)) < (np = ogm_solver_get_np(ctx)) ) {
+    error("olss_solve_kclip(): not enough tuples (%d). need at least NP=%d", n, np );
+  }
+  else
+  {
+    const int nrhs = ogm_solver_get_nrhs(ctx);
+    double x[np * nrhs];
+    double e[np * nrhs], * pe = 0;
+    double ss[nrhs], * pss = 0;
+    double c[np * np], * pc = 0;
+    double ci[np * np], * pci = 0;
+
+    K = args(1).double_value();
+    npass = D_NINT(args(2).double_value());
+
+    if ( nargout > 1 ) {
+      pe = e;
+    }
+    if ( nargout > 2 ) {
+      pss = ss;
+    }
+    if ( nargout > 3 ) {
+      pc = c;
+    }
+    if ( nargout > 4 ) {
+      pci = ci;
+    }
+
+    switch ( status = olss_solve_kclip(ctx, K, npass, x, pe, pc, pci, pss) )
+    {
+    case OGM_SUCCESS:
+      if ( nargout > 0 ) {
+        Matrix v(np, nrhs);
+        memcpy(v.fortran_vec(), x, sizeof(x));
+        outargs(0) = v;
+      }
+      if ( nargout > 1 ) {
+        Matrix v(np, nrhs);
+        memcpy(v.fortran_vec(), e, sizeof(e));
+        outargs(1) = v;
+      }
+      if ( nargout > 2 ) {
+        Matrix v(1, nrhs);
+        memcpy(v.fortran_vec(), ss, sizeof(ss));
+        outargs(2) = v;
+      }
+      if ( nargout > 3 ) {
+        Matrix v(np, np);
+        memcpy(v.fortran_vec(), c, sizeof(c));
+        v.transpose();
+        outargs(3) = v;
+      }
+      if ( nargout > 4 ) {
+        Matrix v(np, np);
+        memcpy(v.fortran_vec(), ci, sizeof(ci));
+        v.transpose();
+        outargs(4) = v;
+      }
+      if ( nargout > 5 ) {
+        const size_t nrows = ogm_solver_get_rows(ctx, NULL);
+        size_t * idx = new size_t[nrows > 0 ? nrows : 1];
+        Matrix v(nrows, 1);
+        ogm_solver_get_rows(ctx, idx);
+        for ( size_t i = 0; i < nrows; ++i ) {
+          v(i) = idx[i] + 1;
+        }
+        delete[] idx;
+        outargs(5) = v;
+      }
+      break;
+
+    case OGM_MALLOC:
+      error("olss_solve_kclip() fails: not enough memory");
+      break;
+
+    case OGM_SINGULAR_MATRIX:
+      error("olss_solve_kclip() fails: singular matrix (rank %d of NP=%d, rcond=%g)",
+          (int) ogm_solver_get_rank(ctx), np, ogm_solver_get_rcond(ctx));
+      break;
+
+    case OGM_INVALID_ARGUMENT:
+      error("olss_solve_kclip() fails: solver must be created with olss_create(NP, true)");
+      break;
+
+    default:
+      error("olss_solve_kclip() fails: unknown error");
+      break;
+    }
+  }
+
+  return outargs;
+}
+
+/***********************************************************************************************************************
+ *
+ * function [X,EX,S,ST] = olss_solve_batch(sids [, nthreads])
+ *
+ **********************************************************************************************************************/
+
+struct olss_batch {
+  ogmctx_t ** ctxs;
+  int ldx, lds;
+  double * x, * e, * s, * st;
+};
+
+static void olss_solve_batch_job(void * arg, int i)
+{
+  olss_batch * b = (olss_batch *) arg;
+  double * e = b->e ? b->e + (size_t) i * b->ldx : NULL;
+  double * s = b->s ? b->s + (size_t) i * b->lds : NULL;
+
+  b->st[i] = olss_solve(b->ctxs[i], b->x + (size_t) i * b->ldx, e, NULL, NULL, s);
+}
+
+DEFUN_DLD( olss_solve_batch, args, nargout,
+"-*- texinfo -*-\n\
+@deftypefn {Function} {@var{X},@var{EX},@var{S},@var{ST}} = olss_solve_batch(@var{sids} [, @var{nthreads}])\n\
+\n\
+Solve several independent systems concurrently on @var{nthreads} threads (default: number of CPUs).\n\
+Column i of @var{X}, @var{EX} and @var{S} are the olss_solve() outputs for @var{sids}(i),\n\
+(solutions of multiple right-hand sides stacked one after another), padded with NaN\n\
+to the largest NP * NRHS. @var{ST}(i) is 0 on success or nonzero error code\n\
+(2 for singular matrix), failed systems do not raise an error and have NaN outputs.\n\
+\n\
+\n\
+Example:\n\n\
+  [P, EP, S, ST] = olss_solve_batch([sidx, sidy]);\n\
+\n\
+@seealso{ olss_solve(), olss_ctuple_multi() }\n\n\
+   Copyright (c) 2013, Andrey Myznikov <andrey.myznikov@@gmail.com>\n\
+@end deftypefn\n"
+)
+{
+  std::vector<ogmctx_t *> ctxs;
+  octave_value_list outargs;
+  int nthreads = 0;
+
+  if ( args.length() != 1 && args.length() != 2 ) {
+    error("olss_solve_batch(sids [,nthreads]): expected 1 or 2 arguments");
+  }
+  else if ( args.length() > 1 && !args(1).is_real_scalar() ) {
+    error("olss_solve_batch(): nthreads must be integer scalar");
+  }
+  else if ( !args(0).is_real_type() || args(0).numel() < 1 ) {
+    error("olss_solve_batch(): sids must be non-empty array of olss handles");
+  }
+  else if ( !getctxs(args(0), ctxs) ) {
+    error("olss_solve_batch(): invalid or duplicate olss handle");
+  }
+  else
+  {
+    const int nsids = ctxs.size();
+    int npmax = 0, nrhsmax = 0;
+
+    for ( int i = 0; i < nsids; ++i ) {
+      npmax = std::max(npmax, (int) (ogm_solver_get_np(ctxs[i]) * ogm_solver_get_nrhs(ctxs[i])));
+      nrhsmax = std::max(nrhsmax, (int) ogm_solver_get_nrhs(ctxs[i]));
+    }
+
+    if ( args.length() > 1 ) {
+      nthreads = D_NINT(args(1).double_value());
+    }
+
+    Matrix x(npmax, nsids, octave_NaN);
+    Matrix e(npmax, nsids, octave_NaN);
+    Matrix s(nrhsmax, nsids, octave_NaN);
+    Matrix st(1, nsids, 0);
+
+    olss_batch b;
+    b.ctxs = &ctxs[0];
+    b.ldx = npmax;
+    b.lds = nrhsmax;
+    b.x = x.fortran_vec();
+    b.e = nargout > 1 ? e.fortran_vec() : NULL;
+    b.s = nargout > 2 ? s.fortran_vec() : NULL;
+    b.st = st.fortran_vec();
+
+    olss_parallel_for(nsids, nthreads, olss_solve_batch_job, &b);
+
+    /* outputs of failed systems may be partially written */
+    for ( int i = 0; i < nsids; ++i ) {
+      if ( st(i) != OGM_SUCCESS ) {
+        for ( int j = 0; j < npmax; ++j ) {
+          x(j, i) = e(j, i) = octave_NaN;
+        }
+        for ( int j = 0; j < nrhsmax; ++j ) {
+          s(j, i) = octave_NaN;
+        }
+      }
+    }
+
+    outargs(0) = x;
+    if ( nargout > 1 ) {
+      outargs(1) = e;
+    }
+    if ( nargout > 2 ) {
+      outargs(2) = s;
+    }
+    if ( nargout > 3 ) {
+      outargs(3) = st;
+    }
+  }
+
+  return outargs;
+}
+
+/***********************************************************************************************************************
+ *
+ * function olss_ctuple_multi(sids, M, RHS [, nthreads])
+ *
+ **********************************************************************************************************************/
+
+struct olss_multi {
+  ogmctx_t ** ctxs;
+  const double * m;
+  const double * rhs;
+  int nr;
+  int * st;
+};
+
+static void olss_ctuple_multi_job(void * arg, int i)
+{
+  olss_multi * b = (olss_multi *) arg;
+  b->st[i] = ogm_solver_append_block(b->ctxs[i], b->m, b->rhs + (size_t) i * b->nr, b->nr, OGM_ROW_MAJOR);
+}
+
+DEFUN_DLD( olss_ctuple_multi, args, nargout,
+"-*- texinfo -*-\n\
+@deftypefn {Function} olss_ctuple_multi(@var{sids}, @var{m}, @var{rhs} [, @var{nthreads}])\n\
+\n\
+Append the same column-wise (C-style) design block @var{m} (NP x N) to several solvers,\n\
+row i of @var{rhs} (K x N) being the right-hand side for @var{sids}(i).\n\
+Solvers are fed concurrently on @var{nthreads} threads (default: number of CPUs).\n\
+\n\
+\n\
+Example:\n\n\
+  % x and y plate axes share the same basis\n\
+  olss_ctuple_multi([sidx, sidy], B, [X; Y]);\n\
+\n\
+@seealso{ olss_ctuple(), olss_solve_batch() }\n\n\
+   Copyright (c) 2013, Andrey Myznikov <andrey.myznikov@@gmail.com>\n\
+@end deftypefn\n"
+)
+{
+  std::vector<ogmctx_t *> ctxs;
+  int status = -1, nthreads = 0;
+
+  if ( args.length() != 3 && args.length() != 4 ) {
+    error("olss_ctuple_multi(sids,m,rhs [,nthreads]): expected 3 or 4 arguments");
+  }
+  else if ( args.length() > 3 && !args(3).is_real_scalar() ) {
+    error("olss_ctuple_multi(): nthreads must be integer scalar");
+  }
+  else if ( !args(0).is_real_type() || args(0).numel() < 1 ) {
+    error("olss_ctuple_multi(): sids must be non-empty array of olss handles");
+  }
+  else if ( !getctxs(args(0), ctxs) ) {
+    error("olss_ctuple_multi(): invalid or duplicate olss handle");
+  }
+  else if ( !args(1).is_float_type() || args(1).columns() < 1 ) {
+    error("olss_ctuple_multi(): m must be non-empty real matrix");
+  }
+  else if ( !args(2).is_float_type() || args(2).rows() != (int) ctxs.size() ) {
+    error("olss_ctuple_multi(): rhs must be real matrix with one row per sid");
+  }
+  else if ( args(2).columns() != args(1).columns() ) {
+    error("olss_ctuple_multi(): number of columns of matrix m and rhs must match");
+  }
+  else
+  {
+    const int np = args(1).rows();
+    const int nsids = ctxs.size();
+
+    for ( int i = 0; i < nsids; ++i ) {
+      if ( ogm_solver_get_nrhs(ctxs[i]) != 1 ) {
+        error("olss_ctuple_multi(): solvers must have single right-hand side, use olss_ctuple() for NRHS > 1");
+        return octave_value_list(1, status);
+      }
+      if ( (int) ogm_solver_get_np(ctxs[i]) != np ) {
+        error("olss_ctuple_multi(): number of rows of matrix m must match to NP (=%d) of all solvers",
+            (int) ogm_solver_get_np(ctxs[i]));
+        return octave_value_list(1, status);
+      }
+    }
+
+    if ( args.length() > 3 ) {
+      nthreads = D_NINT(args(3).double_value());
+    }
+
+    const NDArray m = args(1).array_value();
+    const Matrix rhs = args(2).matrix_value().transpose(); /* each right-hand side contiguous */
+    std::vector<int> st(nsids);
+
+    olss_multi b;
+    b.ctxs = &ctxs[0];
+    b.m = m.data();
+    b.rhs = rhs.data();
+    b.nr = m.dim2();
+    b.st = &st[0];
+
+    olss_parallel_for(nsids, nthreads, olss_ctuple_multi_job, &b);
+
+    status = *std::max_element(st.begin(), st.end());
+    if ( status ) {
+      error("olss_ctuple_multi() fails");
+    }
+  }
+
+  UNUSED(nargout);
+  return octave_value_list(1, status);
+}
+
+
+/***********************************************************************************************************************
+ *
+ * Plate polynomial models
+ *
+ **********************************************************************************************************************/
+
+/* terms table T is NT x 2 matrix of [px py] exponent pairs */
+static platemodel * getmodel( const octave_value & arg )
+{
+  platemodel * pm = NULL;
+
+  if ( arg.is_real_type() && arg.columns() == 2 && arg.rows() > 0 ) {
+
+    const Matrix t = arg.matrix_value();
+    const int nt = t.rows();
+    std::vector<unsigned> px(nt), py(nt);
+    bool ok = true;
+
+    for ( int j = 0; j < nt && ok; ++j ) {
+      if ( t(j, 0) < 0 || t(j, 1) < 0 || t(j, 0) != D_NINT(t(j, 0)) || t(j, 1) != D_NINT(t(j, 1)) ) {
+        ok = false;
+      }
+      else {
+        px[j] = (unsigned) t(j, 0);
+        py[j] = (unsigned) t(j, 1);
+      }
+    }
+
+    if ( ok ) {
+      pm = pm_create(nt, &px[0], &py[0]);
+    }
+  }
+
+  return pm;
+}
+
+/***********************************************************************************************************************
+ *
+ * function olss_pmtuple(sid, T, x, y, rhs)
+ *
+ **********************************************************************************************************************/
+DEFUN_DLD( olss_pmtuple, args, nargout,
+"-*- texinfo -*-\n\
+@deftypefn {Function} olss_pmtuple(@var{sid}, @var{T}, @var{x}, @var{y}, @var{rhs})\n\
+\n\
+Append equations of polynomial plate model to olss solver without building the design matrix.\n\
+Row j of @var{T} (NP x 2) is the exponent pair [px py] of term x^px * y^py (up to 15),\n\
+@var{x}, @var{y} are N-element vectors of plate coordinates,\n\
+@var{rhs} is N x NRHS matrix of right-hand sides.\n\
+\n\
+\n\
+Example:\n\n\
+  % xtan model of xy2tan.m\n\
+  T = [0 0; 0 1; 0 2; 0 3; 1 0; 1 1; 1 2; 1 4; 2 0; 3 0; 3 2];\n\
+  sid = olss_create(rows(T));\n\
+  olss_pmtuple(sid, T, x, y, xtan);\n\
+  c = olss_solve(sid);\n\
+  olss_destroy(sid);\n\
+  r = xtan - olss_pmeval(T, c, x, y);\n\
+\n\
+@seealso{ olss_pmeval(), olss_tuple(), olss_create() }\n\n\
+   Copyright (c) 2013, Andrey Myznikov <andrey.myznikov@@gmail.com>\n\
+@end deftypefn\n"
+)
+{
+  int status = -1;
+  ogmctx_t * ctx;
+  platemodel * pm = NULL;
+
+  if ( args.length() != 5 ) {
+    error("olss_pmtuple(sid,T,x,y,rhs): expected 5 arguments");
+  }
+  else if ( !(ctx = getctx(args(0))) ) {
+    error("olss_pmtuple(): invalid olss handle");
+  }
+  else if ( !(pm = getmodel(args(1))) ) {
+    error("olss_pmtuple(): T must be NP x 2 matrix of non-negative integer exponents not above %d", PM_MAX_POWER);
+  }
+  else if ( pm_get_nterms(pm) != ogm_solver_get_np(ctx) ) {
+    error("olss_pmtuple(): number of rows of T must match to NP (=%d)", (int) ogm_solver_get_np(ctx));
+  }
+  else if ( !args(2).is_float_type() || !args(3).is_float_type() || args(2).numel() != args(3).numel() ) {
+    error("olss_pmtuple(): x and y must be real vectors of the same length");
+  }
+  else if ( !args(4).is_float_type() || args(4).rows() != args(2).numel()
+      || args(4).columns() != (int) ogm_solver_get_nrhs(ctx) ) {
+    error("olss_pmtuple(): rhs must be real column-vector, or matrix with NRHS (=%d) columns, one row per point",
+        (int) ogm_solver_get_nrhs(ctx));
+  }
+  else
+  {
+    const NDArray x = args(2).array_value();
+    const NDArray y = args(3).array_value();
+    const NDArray rhs = args(4).array_value();
+
+    if ( (status = pm_append(pm, ctx, x.numel(), x.data(), y.data(), rhs.data())) ) {
+      error("olss_pmtuple() fails");
+    }
+  }
+
+  pm_destroy(pm);
+
+  UNUSED(nargout);
+  return octave_value_list(1, status);
+}
+
+/***********************************************************************************************************************
+ *
+ * function v = olss_pmeval(T, c, x, y)
+ *
+ **********************************************************************************************************************/
+DEFUN_DLD( olss_pmeval, args, nargout,
+"-*- texinfo -*-\n\
+@deftypefn {Function} {@var{V}} = olss_pmeval(@var{T}, @var{c}, @var{x}, @var{y})\n\
+\n\
+Evaluate polynomial plate model with terms @var{T} (NP x 2 exponent pairs, see olss_pmtuple())\n\
+and coefficients @var{c} (NP x K) at points @var{x}, @var{y}.\n\
+Returns N x K matrix, one column per column of @var{c}.\n\
+\n\
+\n\
+Example:\n\n\
+  See help olss_pmtuple();\n\
+\n\
+@seealso{ olss_pmtuple(), olss_solve() }\n\n\
+   Copyright (c) 2013, Andrey Myznikov <andrey.myznikov@@gmail.com>\n\
+@end deftypefn\n"
+)
+{
+  octave_value_list retval;
+  platemodel * pm = NULL;
+
+  if ( args.length() != 4 ) {
+    error("olss_pmeval(T,c,x,y): expected 4 arguments");
+  }
+  else if ( !(pm = getmodel(args(0))) ) {
+    error("olss_pmeval(): T must be NP x 2 matrix of non-negative integer exponents not above %d", PM_MAX_POWER);
+  }
+  else if ( !args(1).is_float_type() || args(1).rows() != (int) pm_get_nterms(pm) || args(1).columns() < 1 ) {
+    error("olss_pmeval(): c must be real matrix with one row per row of T");
+  }
+  else if ( !args(2).is_float_type() || !args(3).is_float_type() || args(2).numel() != args(3).numel() ) {
+    error("olss_pmeval(): x and y must be real vectors of the same length");
+  }
+  else
+  {
+    const Matrix c = args(1).matrix_value();
+    const NDArray x = args(2).array_value();
+    const NDArray y = args(3).array_value();
+    const int n = x.numel(), k = c.columns();
+    Matrix v(n, k);
+
+    for ( int i = 0; i < k; ++i ) {
+      if ( pm_eval(pm, c.data() + (size_t) i * c.rows(), n, x.data(), y.data(), v.fortran_vec() + (size_t) i * n) ) {
+        error("olss_pmeval() fails");
+        break;
+      }
+    }
+
+    retval(0) = v;
+  }
+
+  pm_destroy(pm);
+
+  UNUSED(nargout);
+  return retval;
+}
@@ -0,0 +1,263 @@
+/*
+ * platemodel.c
+ *
+ *  Polynomial plate models streamed into libogm
+ */
+
+#include "platemodel.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+/** Rows per generated chunk, multiple of the libogm panel height */
+#define PM_CHUNK  512
+
+struct platemodel {
+  size_t nterms;
+  unsigned char * px;   /*< exponents of x */
+  unsigned char * py;   /*< exponents of y */
+  unsigned maxpx;       /*< max of px[] */
+  unsigned maxpy;       /*< max of py[] */
+};
+
+/** Work space of one chunk: power tables and column-major design */
+struct pm_chunk {
+  double * xp;  /*< x^k for k = 0..maxpx, PM_CHUNK values each */
+  double * yp;  /*< y^k for k = 0..maxpy */
+  double * d;   /*< column-major PM_CHUNK x nterms design */
+  double * r;   /*< right-hand sides, PM_CHUNK values each */
+};
+
+platemodel * pm_create( size_t nterms, const unsigned px[], const unsigned py[] )
+{
+  platemodel * pm;
+  size_t j;
+
+  if ( nterms < 1 ) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  for ( j = 0; j < nterms; ++j ) {
+    if ( px[j] > PM_MAX_POWER || py[j] > PM_MAX_POWER ) {
+      errno = EINVAL;
+      return NULL;
+    }
+  }
+
+  if ( !(pm = calloc(1, sizeof(*pm))) ) {
+    errno = ENOMEM;
+    return NULL;
+  }
+
+  if ( !(pm->px = malloc(nterms)) || !(pm->py = malloc(nterms)) ) {
+    pm_destroy(pm);
+    errno = ENOMEM;
+    return NULL;
+  }
+
+  pm->nterms = nterms;
+
+  for ( j = 0; j < nterms; ++j )
+  {
+    pm->px[j] = px[j];
+    pm->py[j] = py[j];
+
+    if ( px[j] > pm->maxpx ) {
+      pm->maxpx = px[j];
+    }
+    if ( py[j] > pm->maxpy ) {
+      pm->maxpy = py[j];
+    }
+  }
+
+  return pm;
+}
+
+void pm_destroy( platemodel * pm )
+{
+  if ( pm ) {
+    free(pm->px);
+    free(pm->py);
+    free(pm);
+  }
+}
+
+size_t pm_get_nterms( const platemodel * pm )
+{
+  return pm->nterms;
+}
+
+
+static void free_chunk( struct pm_chunk * w )
+{
+  free(w->xp);
+  free(w->yp);
+  free(w->d);
+  free(w->r);
+}
+
+static int alloc_chunk( const platemodel * pm, struct pm_chunk * w, size_t nrhs )
+{
+  memset(w, 0, sizeof(*w));
+
+  if ( !(w->xp = malloc((pm->maxpx + 1) * PM_CHUNK * sizeof(double)))
+      || !(w->yp = malloc((pm->maxpy + 1) * PM_CHUNK * sizeof(double)))
+      || !(w->d = malloc(pm->nterms * PM_CHUNK * sizeof(double)))
+      || (nrhs > 0 && !(w->r = malloc(nrhs * PM_CHUNK * sizeof(double)))) ) {
+    free_chunk(w);
+    return OGM_MALLOC;
+  }
+
+  return OGM_SUCCESS;
+}
+
+/**
+ * Power table t[k * PM_CHUNK + i] = v[i]^k, k = 0..maxp
+ */
+static void powers( size_t m, const double v[], unsigned maxp, double t[] )
+{
+  size_t i;
+  unsigned k;
+
+  for ( i = 0; i < m; ++i ) {
+    t[i] = 1;
+  }
+
+  for ( k = 1; k <= maxp; ++k )
+  {
+    const double * prev = t + (k - 1) * PM_CHUNK;
+    double * cur = t + k * PM_CHUNK;
+
+    for ( i = 0; i < m; ++i ) {
+      cur[i] = prev[i] * v[i];
+    }
+  }
+}
+
+/**
+ * Column-major design of m <= PM_CHUNK points into w->d
+ */
+static void design_chunk( const platemodel * pm, struct pm_chunk * w, size_t m, const double x[], const double y[] )
+{
+  size_t i, j;
+
+  powers(m, x, pm->maxpx, w->xp);
+  powers(m, y, pm->maxpy, w->yp);
+
+  for ( j = 0; j < pm->nterms; ++j )
+  {
+    const double * xp = w->xp + pm->px[j] * PM_CHUNK;
+    const double * yp = w->yp + pm->py[j] * PM_CHUNK;
+    double * d = w->d + j * m;
+
+    for ( i = 0; i < m; ++i ) {
+      d[i] = xp[i] * yp[i];
+    }
+  }
+}
+
+int pm_design( const platemodel * pm, size_t n, const double x[], const double y[], double a[] )
+{
+  const size_t nt = pm->nterms;
+  struct pm_chunk w;
+  size_t r0, m, i, j;
+
+  if ( alloc_chunk(pm, &w, 0) != OGM_SUCCESS ) {
+    return OGM_MALLOC;
+  }
+
+  for ( r0 = 0; r0 < n; r0 += m )
+  {
+    m = n - r0 < PM_CHUNK ? n - r0 : PM_CHUNK;
+
+    design_chunk(pm, &w, m, x + r0, y + r0);
+
+    for ( i = 0; i < m; ++i ) {
+      for ( j = 0; j < nt; ++j ) {
+        a[(r0 + i) * nt + j] = w.d[j * m + i];
+      }
+    }
+  }
+
+  free_chunk(&w);
+
+  return OGM_SUCCESS;
+}
+
+int pm_append( const platemodel * pm, ogmctx_t * ctx, size_t n, const double x[], const double y[],
+    const double rhs[] )
+{
+  const size_t nrhs = ogm_solver_get_nrhs(ctx);
+  struct pm_chunk w;
+  size_t r0, m, k;
+  int status = OGM_SUCCESS;
+
+  if ( ogm_solver_get_np(ctx) != pm->nterms ) {
+    return OGM_INVALID_ARGUMENT;
+  }
+
+  if ( alloc_chunk(pm, &w, nrhs > 1 ? nrhs : 0) != OGM_SUCCESS ) {
+    return OGM_MALLOC;
+  }
+
+  for ( r0 = 0; r0 < n && status == OGM_SUCCESS; r0 += m )
+  {
+    const double * r = rhs + r0;
+
+    m = n - r0 < PM_CHUNK ? n - r0 : PM_CHUNK;
+
+    design_chunk(pm, &w, m, x + r0, y + r0);
+
+    /* gather the chunk of each right-hand side into one block */
+    if ( nrhs > 1 ) {
+      for ( k = 0; k < nrhs; ++k ) {
+        memcpy(w.r + k * m, rhs + k * n + r0, m * sizeof(*rhs));
+      }
+      r = w.r;
+    }
+
+    status = ogm_solver_append_block(ctx, w.d, r, m, OGM_COL_MAJOR);
+  }
+
+  free_chunk(&w);
+
+  return status;
+}
+
+int pm_eval( const platemodel * pm, const double c[], size_t n, const double x[], const double y[], double v[] )
+{
+  struct pm_chunk w;
+  size_t r0, m, i, j;
+
+  if ( alloc_chunk(pm, &w, 0) != OGM_SUCCESS ) {
+    return OGM_MALLOC;
+  }
+
+  for ( r0 = 0; r0 < n; r0 += m )
+  {
+    double * vr = v + r0;
+
+    m = n - r0 < PM_CHUNK ? n - r0 : PM_CHUNK;
+
+    powers(m, x + r0, pm->maxpx, w.xp);
+    powers(m, y + r0, pm->maxpy, w.yp);
+
+    memset(vr, 0, m * sizeof(*vr));
+
+    for ( j = 0; j < pm->nterms; ++j )
+    {
+      const double * xp = w.xp + pm->px[j] * PM_CHUNK;
+      const double * yp = w.yp + pm->py[j] * PM_CHUNK;
+      const double cj = c[j];
+
+      for ( i = 0; i < m; ++i ) {
+        vr[i] += cj * xp[i] * yp[i];
+      }
+    }
+  }
+
+  free_chunk(&w);
+
+  return OGM_SUCCESS;
+}
@@ -0,0 +1,59 @@
+/*
+ * platemodel.h
+ *
+ *  Polynomial plate models: sums of monomials x^px * y^py given by exponent pairs,
+ *  e.g. the xy2tan.m model for xtan is
+ *    {0,0} {0,1} {0,2} {0,3} {1,0} {1,1} {1,2} {1,4} {2,0} {3,0} {3,2}
+ *
+ *  The design rows are generated in chunks from shared power tables
+ *  and streamed into libogm, the full n x nterms design matrix is never formed.
+ */
+
+#ifndef __platemodel_h__
+#define __platemodel_h__
+
+#include "libogm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Max exponent of x or y in a term */
+#define PM_MAX_POWER  15
+
+/**
+ * Opaque typedef for plate model
+ */
+typedef struct platemodel platemodel;
+
+/**
+ * Create model of nterms terms x^px[i] * y^py[i].
+ *  Returns NULL with errno set to EINVAL if an exponent exceeds PM_MAX_POWER, ENOMEM on allocation failure.
+ */
+platemodel * pm_create(size_t nterms, const unsigned px[/*nterms*/], const unsigned py[/*nterms*/]);
+void pm_destroy(platemodel * pm);
+size_t pm_get_nterms(const platemodel * pm);
+
+/**
+ * Design matrix of n points, row-major n x nterms
+ */
+int pm_design(const platemodel * pm, size_t n, const double x[/*n*/], const double y[/*n*/], double a[/*n*nterms*/]);
+
+/**
+ * Append n equations sum(c[j] * term_j(x[i], y[i])) = rhs[i] to the solver, which must have np == nterms.
+ *  For the solvers with multiple right-hand sides they come one after another, n values each.
+ */
+int pm_append(const platemodel * pm, ogmctx_t * ctx, size_t n, const double x[/*n*/], const double y[/*n*/],
+    const double rhs[/*nrhs*n*/]);
+
+/**
+ * Evaluate model with coefficients c[nterms]: v[i] = sum(c[j] * term_j(x[i], y[i]))
+ */
+int pm_eval(const platemodel * pm, const double c[/*nterms*/], size_t n, const double x[/*n*/], const double y[/*n*/],
+    double v[/*n*/]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __platemodel_h__ */
@@ -0,0 +1,624 @@
+/*
+ * scosmos.cc
+ *
+ *  Octave bindings of sctrans.c: tan2cs(), cs2tan(), eq2gal() and precession()
+ *  with the calling conventions of the same-named .m files in lib/octave,
+ *  which they take over once the package is loaded; tsvread() of tsvread.c,
+ *  ssa_plate_read() of ssaplate.c and ssa_plate_meta() over the ssa-plate-meta.h snapshot.
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <string>
+#include <vector>
+#include <oct.h> // octave/
+#include "sctrans.h"
+#include "tsvread.h"
+#include "ssaplate.h"
+#include "ssa-plate-meta.h"
+
+#define UNUSED(x)     ((void)(x))
+
+/*
+ * Coordinate pair arguments: arrays of equal number of elements,
+ *  a scalar is expanded to the size of the other argument
+ */
+static bool getpair(const octave_value & a, const octave_value & b, NDArray & x, NDArray & y)
+{
+  if ( !a.is_real_type() || !b.is_real_type() ) {
+    return false;
+  }
+
+  if ( a.numel() == b.numel() ) {
+    x = a.array_value();
+    y = b.array_value();
+  }
+  else if ( a.numel() == 1 ) {
+    y = b.array_value();
+    x = NDArray(y.dims(), a.double_value());
+  }
+  else if ( b.numel() == 1 ) {
+    x = a.array_value();
+    y = NDArray(x.dims(), b.double_value());
+  }
+  else {
+    return false;
+  }
+
+  return true;
+}
+
+
+/*
+ * function [ra, dec] = tan2cs(A0, D0, xtan, ytan)
+ */
+DEFUN_DLD( tan2cs, args, nargout,
+"-*- texinfo -*-\n\
+@deftypefn {Function} {[@var{ra}, @var{dec}]} = tan2cs(@var{A0}, @var{D0}, @var{xtan}, @var{ytan})\n\
+\n\
+Convert tangential plane coordinates @var{xtan}, @var{ytan} with tangent point\n\
+@var{A0}, @var{D0} to celestial sphere. All angles are radians, @var{ra} is wrapped below 2*pi.\n\
+Native array version of tan2cs.m.\n\
+\n\
+@seealso{ cs2tan(), precession(), eq2gal() }\n\n\
+   Copyright (c) 2013, Andrey Myznikov <andrey.myznikov@@gmail.com>\n\
+@end deftypefn\n"
+)
+{
+  octave_value_list retval;
+  NDArray x, y;
+
+  if ( args.length() != 4 ) {
+    error("tan2cs(A0, D0, xtan, ytan): expected 4 arguments");
+  }
+  else if ( !args(0).is_real_scalar() || !args(1).is_real_scalar() ) {
+    error("tan2cs(): A0 and D0 must be real scalars");
+  }
+  else if ( !getpair(args(2), args(3), x, y) ) {
+    error("tan2cs(): xtan and ytan must be real arrays of the same size");
+  }
+  else
+  {
+    NDArray ra(x.dims()), dec(x.dims());
+
+    sc_tan2cs(args(0).double_value(), args(1).double_value(), x.numel(), x.data(), y.data(),
+        ra.fortran_vec(), dec.fortran_vec());
+
+    retval(1) = dec;
+    retval(0) = ra;
+  }
+
+  UNUSED(nargout);
+  return retval;
+}
+
+
+/*
+ * function [xtan, ytan] = cs2tan(A0, D0, ra, dec)
+ */
+DEFUN_DLD( cs2tan, args, nargout,
+"-*- texinfo -*-\n\
+@deftypefn {Function} {[@var{xtan}, @var{ytan}]} = cs2tan(@var{A0}, @var{D0}, @var{ra}, @var{dec})\n\
+\n\
+Convert celestial sphere coordinates @var{ra}, @var{dec} to tangential plane\n\
+with tangent point @var{A0}, @var{D0}. All angles are radians.\n\
+Native array version of cs2tan.m.\n\
+\n\
+@seealso{ tan2cs() }\n\n\
+   Copyright (c) 2013, Andrey Myznikov <andrey.myznikov@@gmail.com>\n\
+@end deftypefn\n"
+)
+{
+  octave_value_list retval;
+  NDArray ra, dec;
+
+  if ( args.length() != 4 ) {
+    error("cs2tan(A0, D0, ra, dec): expected 4 arguments");
+  }
+  else if ( !args(0).is_real_scalar() || !args(1).is_real_scalar() ) {
+    error("cs2tan(): A0 and D0 must be real scalars");
+  }
+  else if ( !getpair(args(2), args(3), ra, dec) ) {
+    error("cs2tan(): ra and dec must be real arrays of the same size");
+  }
+  else
+  {
+    NDArray x(ra.dims()), y(ra.dims());
+
+    sc_cs2tan(args(0).double_value(), args(1).double_value(), ra.numel(), ra.data(), dec.data(),
+        x.fortran_vec(), y.fortran_vec());
+
+    retval(1) = y;
+    retval(0) = x;
+  }
+
+  UNUSED(nargout);
+  return retval;
+}
+
+
+/*
+ * function [l, b] = eq2gal(ra, dec)
+ */
+DEFUN_DLD( eq2gal, args, nargout,
+"-*- texinfo -*-\n\
+@deftypefn {Function} {[@var{l}, @var{b}]} = eq2gal(@var{ra}, @var{dec})\n\
+\n\
+Convert J2000 equatorial coordinates to galactic, @var{l} in [0, 2*pi).\n\
+All angles are radians. Native array version of eq2gal.m.\n\
+\n\
+@seealso{ precession() }\n\n\
+   Copyright (c) 2013, Andrey Myznikov <andrey.myznikov@@gmail.com>\n\
+@end deftypefn\n"
+)
+{
+  octave_value_list retval;
+  NDArray ra, dec;
+
+  if ( args.length() != 2 ) {
+    error("eq2gal(ra, dec): expected 2 arguments");
+  }
+  else if ( !getpair(args(0), args(1), ra, dec) ) {
+    error("eq2gal(): ra and dec must be real arrays of the same size");
+  }
+  else
+  {
+    NDArray l(ra.dims());
+
+    if ( nargout > 1 ) {
+      NDArray b(ra.dims());
+      sc_eq2gal(ra.numel(), ra.data(), dec.data(), l.fortran_vec(), b.fortran_vec());
+      retval(1) = b;
+    }
+    else {
+      sc_eq2gal(ra.numel(), ra.data(), dec.data(), l.fortran_vec(), NULL);
+    }
+
+    retval(0) = l;
+  }
+
+  return retval;
+}
+
+
+/*
+ * function [ra2, dec2] = precession(tdb1, tdb2, ra, dec)
+ */
+DEFUN_DLD( precession, args, nargout,
+"-*- texinfo -*-\n\
+@deftypefn {Function} {[@var{ra2}, @var{dec2}]} = precession(@var{tdb1}, @var{tdb2}, @var{ra}, @var{dec})\n\
+\n\
+Precess @var{ra}, @var{dec} from epoch @var{tdb1} to @var{tdb2}, given as TDB Julian dates\n\
+or as years when below 10000. One of the epochs must be J2000.0.\n\
+The rotation matrices are cached per epoch pair. All angles are radians, @var{ra2} in [0, 2*pi).\n\
+Native array version of precession.m (NOVAS C 3.1).\n\
+\n\
+@seealso{ eq2gal(), tan2cs() }\n\n\
+   Copyright (c) 2013, Andrey Myznikov <andrey.myznikov@@gmail.com>\n\
+@end deftypefn\n"
+)
+{
+  octave_value_list retval;
+  NDArray ra, dec;
+
+  if ( args.length() != 4 ) {
+    error("precession(tdb1, tdb2, ra, dec): expected 4 arguments");
+  }
+  else if ( !args(0).is_real_scalar() || !args(1).is_real_scalar() ) {
+    error("precession(): tdb1 and tdb2 must be real scalars");
+  }
+  else if ( !getpair(args(2), args(3), ra, dec) ) {
+    error("precession(): ra and dec must be real arrays of the same size");
+  }
+  else
+  {
+    NDArray ra2(ra.dims()), dec2(ra.dims());
+
+    if ( sc_precession(args(0).double_value(), args(1).double_value(), ra.numel(), ra.data(), dec.data(),
+        ra2.fortran_vec(), dec2.fortran_vec()) != 0 ) {
+      error("precession(): one of tdb1 or tdb2 must be TDB Julian date of epoch J2000.0");
+    }
+    else {
+      retval(1) = dec2;
+      retval(0) = ra2;
+    }
+  }
+
+  UNUSED(nargout);
+  return retval;
+}
+
+
+
+/*
+ * Splits list of names separated by commas, semicolons or blanks
+ */
+static std::vector<std::string> split_names(const std::string & s)
+{
+  const char * delims = " \t\r\n;,";
+  std::vector<std::string> names;
+
+  for ( size_t b = s.find_first_not_of(delims), e; b != std::string::npos; b = s.find_first_not_of(delims, e) ) {
+    e = s.find_first_of(delims, b);
+    names.push_back(s.substr(b, e == std::string::npos ? e : e - b));
+  }
+
+  return names;
+}
+
+
+/*
+ * function [c1, c2, ...] = tsvread(fname, columns [, nthreads])
+ */
+DEFUN_DLD( tsvread, args, nargout,
+"-*- texinfo -*-\n\
+@deftypefn {Function} {@var{v}} = tsvread(@var{fname}, @var{columns} [, @var{nthreads}])\n\
+@deftypefnx {Function} {[@var{c1}, @var{c2}, ...]} = tsvread(@var{fname}, @var{columns} [, @var{nthreads}])\n\
+\n\
+Load numeric @var{columns} (names separated by commas or blanks, as for popenq()) of the\n\
+whitespace separated table @var{fname} with a header line. .bz2 and .gz files are decompressed.\n\
+With one output returns N x K matrix, otherwise each column as separate N x 1 vector.\n\
+Blank lines are skipped, missing and non-numeric fields are NaN.\n\
+The file is parsed by @var{nthreads} threads, all online CPUs by default.\n\
+\n\
+Example:\n\
+@example\n\
+[ra, dec, x, y] = tsvread('refs/1/ucac4/66378.dat', 'ra,dec,x,y');\n\
+@end example\n\
+\n\
+@seealso{ popenq() }\n\n\
+   Copyright (c) 2013, Andrey Myznikov <andrey.myznikov@@gmail.com>\n\
+@end deftypefn\n"
+)
+{
+  octave_value_list retval;
+
+  if ( args.length() < 2 || args.length() > 3 ) {
+    error("tsvread(fname, columns [, nthreads]): expected 2 or 3 arguments");
+    return retval;
+  }
+
+  if ( !args(0).is_string() || !args(1).is_string() ) {
+    error("tsvread(): fname and columns must be strings");
+    return retval;
+  }
+
+  if ( args.length() > 2 && !args(2).is_real_scalar() ) {
+    error("tsvread(): nthreads must be real scalar");
+    return retval;
+  }
+
+  const std::string fname = args(0).string_value();
+  const std::string columns = args(1).string_value();
+  const int nthreads = args.length() > 2 ? (int) args(2).double_value() : 0;
+  const std::vector<std::string> names = split_names(columns);
+
+  if ( names.empty() ) {
+    error("tsvread(): no columns specified");
+    return retval;
+  }
+
+  if ( nargout > 1 && (size_t) nargout > names.size() ) {
+    error("tsvread(): %d outputs requested for %zu columns", nargout, names.size());
+    return retval;
+  }
+
+  tsv_t * tsv = tsv_open(fname.c_str());
+  if ( !tsv ) {
+    error("tsvread('%s'): %s", fname.c_str(), strerror(errno));
+    return retval;
+  }
+
+  const size_t ncols = names.size();
+  std::vector<int> fields(ncols);
+
+  for ( size_t k = 0; k < ncols; ++k ) {
+    if ( (fields[k] = tsv_column(tsv, names[k].c_str())) < 0 ) {
+      tsv_close(tsv);
+      error("tsvread(): no column '%s' found in '%s'", names[k].c_str(), fname.c_str());
+      return retval;
+    }
+  }
+
+  const size_t nrows = tsv_nrows(tsv, nthreads);
+  std::vector<double *> out(ncols);
+  int status;
+
+  if ( nargout <= 1 )
+  {
+    Matrix v(nrows, ncols);
+    for ( size_t k = 0; k < ncols; ++k ) {
+      out[k] = v.fortran_vec() + k * nrows;
+    }
+    if ( (status = tsv_parse(tsv, ncols, &fields[0], &out[0])) == 0 ) {
+      retval(0) = v;
+    }
+  }
+  else
+  {
+    std::vector<Matrix> c;
+    c.reserve(ncols);
+    for ( size_t k = 0; k < ncols; ++k ) {
+      c.push_back(Matrix(nrows, 1));
+      out[k] = c[k].fortran_vec();
+    }
+    if ( (status = tsv_parse(tsv, ncols, &fields[0], &out[0])) == 0 ) {
+      for ( size_t k = ncols; k-- > 0; ) {
+        retval(k) = c[k];
+      }
+    }
+  }
+
+  tsv_close(tsv);
+
+  if ( status != 0 ) {
+    error("tsvread('%s'): %s", fname.c_str(), strerror(errno));
+  }
+
+  return retval;
+}
+
+
+
+/*
+ * Column of plate objects as Octave array of the field storage type
+ */
+template<class ArrayType>
+static octave_value plate_column(const ssa_plate_t * plate, const ssa_field_t * field)
+{
+  ArrayType a(dim_vector(ssa_plate_size(plate), 1));
+  ssa_plate_column(plate, field, a.fortran_vec());
+  return a;
+}
+
+
+/*
+ * function [c1, c2, ...] = ssa_plate_read(fname, columns [, filter])
+ */
+DEFUN_DLD( ssa_plate_read, args, nargout,
+"-*- texinfo -*-\n\
+@deftypefn {Function} {[@var{c1}, @var{c2}, ...]} = ssa_plate_read(@var{fname}, @var{columns} [, @var{filter}])\n\
+\n\
+Read SuperCOSMOS binary plate file (ssa_detection2 records, .bz2 and .gz are decompressed)\n\
+and return the requested @var{columns} as column vectors of the record field types:\n\
+int64 objID and parentID; int32 area, ap1..ap8, blend and quality; int16 thetaU, thetaI and pa;\n\
+uint8 class; double ra, dec, xmin, xmax, ymin, ymax, x (xCen) and y (yCen); single for the rest.\n\
+Column names are those of ssa-plate-dump -h, separated by commas or blanks.\n\
+\n\
+@var{filter} is a string of ssa-plate-dump options:\n\
+@table @code\n\
+@item f\n\
+apply junk filter, objects are returned sorted by objID\n\
+@item c\n\
+drop parents of deblends\n\
+@end table\n\
+\n\
+Example:\n\
+@example\n\
+[ra, dec, x, y, mag] = ssa_plate_read('1/66378.dat.bz2', 'ra,dec,x,y,sMag', 'cf');\n\
+@end example\n\
+\n\
+@seealso{ tsvread() }\n\n\
+   Copyright (c) 2013, Andrey Myznikov <andrey.myznikov@@gmail.com>\n\
+@end deftypefn\n"
+)
+{
+  octave_value_list retval;
+  int filter = 0;
+
+  if ( args.length() < 2 || args.length() > 3 ) {
+    error("ssa_plate_read(fname, columns [, filter]): expected 2 or 3 arguments");
+    return retval;
+  }
+
+  if ( !args(0).is_string() || !args(1).is_string() || (args.length() > 2 && !args(2).is_string()) ) {
+    error("ssa_plate_read(): fname, columns and filter must be strings");
+    return retval;
+  }
+
+  if ( args.length() > 2 )
+  {
+    const std::string opts = args(2).string_value();
+
+    for ( size_t i = 0; i < opts.size(); ++i )
+    {
+      switch ( opts[i] ) {
+      case 'f':
+        filter |= SSA_PLATE_FJUNK;
+        break;
+      case 'c':
+        filter |= SSA_PLATE_DROP_PARENTS;
+        break;
+      case '-':
+        break;
+      default:
+        error("ssa_plate_read(): invalid filter option '%c'", opts[i]);
+        return retval;
+      }
+    }
+  }
+
+  const std::string fname = args(0).string_value();
+  const std::vector<std::string> names = split_names(args(1).string_value());
+  std::vector<const ssa_field_t *> fields(names.size());
+
+  if ( names.empty() ) {
+    error("ssa_plate_read(): no columns specified");
+    return retval;
+  }
+
+  if ( (size_t) nargout > names.size() ) {
+    error("ssa_plate_read(): %d outputs requested for %zu columns", nargout, names.size());
+    return retval;
+  }
+
+  for ( size_t k = 0; k < names.size(); ++k ) {
+    if ( !(fields[k] = ssa_plate_field(names[k].c_str())) ) {
+      error("ssa_plate_read(): unknown column '%s'", names[k].c_str());
+      return retval;
+    }
+  }
+
+  ssa_plate_t * plate = ssa_plate_load(fname.c_str(), filter);
+  if ( !plate ) {
+    error("ssa_plate_read('%s'): %s", fname.c_str(), strerror(errno));
+    return retval;
+  }
+
+  for ( size_t k = names.size(); k-- > 0; )
+  {
+    switch ( fields[k]->type ) {
+    case ssa_field_int64:
+      retval(k) = plate_column<int64NDArray>(plate, fields[k]);
+      break;
+    case ssa_field_int32:
+      retval(k) = plate_column<int32NDArray>(plate, fields[k]);
+      break;
+    case ssa_field_int16:
+      retval(k) = plate_column<int16NDArray>(plate, fields[k]);
+      break;
+    case ssa_field_uint8:
+      retval(k) = plate_column<uint8NDArray>(plate, fields[k]);
+      break;
+    case ssa_field_float4:
+      retval(k) = plate_column<FloatNDArray>(plate, fields[k]);
+      break;
+    case ssa_field_float8:
+      retval(k) = plate_column<NDArray>(plate, fields[k]);
+      break;
+    }
+  }
+
+  ssa_plate_close(plate);
+
+  return retval;
+}
+
+
+
+/*
+ * Snapshot stays mapped between calls, remapped when 'ssa-plate-meta export' replaces the file
+ */
+static ssa_plate_meta_db * plate_meta_db = NULL;
+
+static const ssa_plate_meta_db * plate_meta_open()
+{
+  if ( plate_meta_db && ssa_plate_meta_changed(plate_meta_db, NULL) ) {
+    ssa_plate_meta_close(plate_meta_db);
+    plate_meta_db = NULL;
+  }
+
+  if ( !plate_meta_db ) {
+    plate_meta_db = ssa_plate_meta_open(NULL);
+  }
+
+  return plate_meta_db;
+}
+
+
+/*
+ * function [c1, c2, ...] = ssa_plate_meta(plateids, columns)
+ */
+DEFUN_DLD( ssa_plate_meta, args, nargout,
+"-*- texinfo -*-\n\
+@deftypefn {Function} {@var{v}} = ssa_plate_meta(@var{plateids}, @var{columns})\n\
+@deftypefnx {Function} {[@var{c1}, @var{c2}, ...]} = ssa_plate_meta(@var{plateids}, @var{columns})\n\
+\n\
+Return ssa_plates @var{columns} (names separated by commas or blanks, case insensitive)\n\
+of @var{plateids} from the local snapshot written by 'ssa-plate-meta export'\n\
+($SSA_PLATE_META or /usr/local/lib/scosmos/ssa-plates.meta), without database access.\n\
+Empty @var{plateids} selects all plates in plateID order. Values are in the table units,\n\
+raPnt and decPnt in degrees; rows of unknown plates are NaN.\n\
+With one output returns N x K matrix, otherwise each column as separate N x 1 vector.\n\
+\n\
+Example:\n\
+@example\n\
+[ra0, dec0, epoch] = ssa_plate_meta(65537, 'rapnt,decpnt,epoch');\n\
+@end example\n\
+\n\
+@seealso{ ssa_plate_info(), ssa_plate_list() }\n\n\
+   Copyright (c) 2013, Andrey Myznikov <andrey.myznikov@@gmail.com>\n\
+@end deftypefn\n"
+)
+{
+  octave_value_list retval;
+
+  if ( args.length() != 2 ) {
+    error("ssa_plate_meta(plateids, columns): expected 2 arguments");
+    return retval;
+  }
+
+  if ( !args(0).is_real_type() || !args(1).is_string() ) {
+    error("ssa_plate_meta(): plateids must be numeric and columns a string");
+    return retval;
+  }
+
+  const NDArray plateids = args(0).array_value();
+  const std::vector<std::string> names = split_names(args(1).string_value());
+  std::vector<const ssa_plate_meta_field *> fields(names.size());
+
+  if ( names.empty() ) {
+    error("ssa_plate_meta(): no columns specified");
+    return retval;
+  }
+
+  if ( nargout > 1 && (size_t) nargout > names.size() ) {
+    error("ssa_plate_meta(): %d outputs requested for %zu columns", nargout, names.size());
+    return retval;
+  }
+
+  for ( size_t k = 0; k < names.size(); ++k ) {
+    if ( !(fields[k] = ssa_plate_meta_find_field(names[k].c_str())) ) {
+      error("ssa_plate_meta(): unknown column '%s'", names[k].c_str());
+      return retval;
+    }
+  }
+
+  const ssa_plate_meta_db * db = plate_meta_open();
+  if ( !db ) {
+    error("ssa_plate_meta(): can't open '%s': %s; run 'ssa-plate-meta export' to create it",
+        ssa_plate_meta_path(), strerror(errno));
+    return retval;
+  }
+
+  const size_t ncols = names.size();
+  const size_t nrows = plateids.numel() ? plateids.numel() : db->count;
+  std::vector<double *> out(ncols);
+  std::vector<Matrix> c;
+  Matrix v;
+
+  if ( nargout <= 1 ) {
+    v = Matrix(nrows, ncols);
+    for ( size_t k = 0; k < ncols; ++k ) {
+      out[k] = v.fortran_vec() + k * nrows;
+    }
+  }
+  else {
+    c.reserve(ncols);
+    for ( size_t k = 0; k < ncols; ++k ) {
+      c.push_back(Matrix(nrows, 1));
+      out[k] = c[k].fortran_vec();
+    }
+  }
+
+  for ( size_t i = 0; i < nrows; ++i )
+  {
+    const ssa_plate_meta * rec = plateids.numel() ? ssa_plate_meta_lookup(db, (int32_t) plateids(i)) : &db->recs[i];
+
+    for ( size_t k = 0; k < ncols; ++k ) {
+      out[k][i] = rec ? ssa_plate_meta_value(rec, fields[k]) : octave_NaN;
+    }
+  }
+
+  if ( nargout <= 1 ) {
+    retval(0) = v;
+  }
+  else {
+    for ( size_t k = ncols; k-- > 0; ) {
+      retval(k) = c[k];
+    }
+  }
+
+  return retval;
+}
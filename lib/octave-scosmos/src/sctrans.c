@@ -0,0 +1,397 @@
+/*
+ * sctrans.c
+ *
+ *  Array coordinate transforms, see sctrans.h.
+ *
+ *  ksincos() and katan2() are fdlibm's __kernel_sin/__kernel_cos and atan polynomials
+ *  with Cody-Waite argument reduction; quadrant and branch selection is done with
+ *  conditional moves so that the loops calling them are vectorized (-O3 -fno-math-errno).
+ *  No -ffast-math: the rounding tricks below depend on strict IEEE arithmetic.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include "sctrans.h"
+
+/** Largest |x| reduced by ksincos(), libm is used above */
+#define SC_MAX_REDUCE   1e6
+
+/** Cached precession matrices */
+#define SC_PCACHE       8
+
+#define TWOPI           6.28318530717958647692
+
+/* round to nearest integer for |x| < 2^51 */
+#define RSHIFT          0x1.8p52
+/* round to multiple of 2^-20 */
+#define QSHIFT          0x1.8p32
+
+#define TWO_OVER_PI     6.36619772367581382433e-01
+#define PIO2_1          1.57079632673412561417e+00  /* first 33 bits of pi/2 */
+#define PIO2_2          6.07710050630396597660e-11  /* next 33 bits */
+#define PIO2_3          2.02226624871116645580e-21  /* next 33 bits */
+#define PIO2_3T         8.47842766036889956997e-32  /* pi/2 - (PIO2_1 + PIO2_2 + PIO2_3) */
+
+#define S1  -1.66666666666666324348e-01
+#define S2   8.33333333332248946124e-03
+#define S3  -1.98412698298579493134e-04
+#define S4   2.75573137070700676789e-06
+#define S5  -2.50507602534068634195e-08
+#define S6   1.58969099521155010221e-10
+
+#define C1   4.16666666666666019037e-02
+#define C2  -1.38888888888741095749e-03
+#define C3   2.48015872894767294178e-05
+#define C4  -2.75573143513906633035e-07
+#define C5   2.08757232129817482790e-09
+#define C6  -1.13596475577881948265e-11
+
+#define AT0   3.33333333333329318027e-01
+#define AT1  -1.99999999998764832476e-01
+#define AT2   1.42857142725034663711e-01
+#define AT3  -1.11111104054623557880e-01
+#define AT4   9.09088713343650656196e-02
+#define AT5  -7.69187620504482999495e-02
+#define AT6   6.66107313738753120669e-02
+#define AT7  -5.83357013379057348645e-02
+#define AT8   4.97687799461593236017e-02
+#define AT9  -3.65315727442169155270e-02
+#define AT10  1.62858201153657823623e-02
+
+#define TAN_PI_8   4.14213562373095034e-01
+#define PIO4_HI    7.85398163397448278999e-01
+#define PIO4_LO    3.06161699786838301793e-17
+#define PIO2_HI    1.57079632679489655800e+00
+#define PIO2_LO    6.12323399573676603587e-17
+#define PI_HI      3.14159265358979311600e+00
+#define PI_LO      1.22464679914735317720e-16
+
+
+/**
+ * sin and cos for |x| <= SC_MAX_REDUCE. Other arguments (NaN, Inf, huge) are replaced
+ *  by 0 before the reduction so that the integer conversion of the quadrant stays defined;
+ *  sc_sincos() overwrites their results with libm ones.
+ */
+static inline void ksincos( double x, double * s, double * c )
+{
+  const double xr = fabs(x) <= SC_MAX_REDUCE ? x : 0;
+  const double kd = (xr * TWO_OVER_PI + RSHIFT) - RSHIFT;
+  const int q = (int) kd;
+  const double r = (((xr - kd * PIO2_1) - kd * PIO2_2) - kd * PIO2_3) - kd * PIO2_3T;
+  const double z = r * r;
+
+  const double sr = r + z * r * (S1 + z * (S2 + z * (S3 + z * (S4 + z * (S5 + z * S6)))));
+
+  /* 1 - z/2 + z^2 * p(z) as (1 - qx) - (z/2 - qx - ...), 1 - qx is exact */
+  const double p = z * (C1 + z * (C2 + z * (C3 + z * (C4 + z * (C5 + z * C6)))));
+  const double qx = (0.25 * z + QSHIFT) - QSHIFT;
+  const double cr = (1 - qx) - ((0.5 * z - qx) - z * p);
+
+  /* quadrants 0..3: (s,c) = (sr,cr), (cr,-sr), (-sr,-cr), (-cr,sr) */
+  const double ss = (q & 1) ? cr : sr;
+  const double cc = (q & 1) ? sr : cr;
+
+  *s = (q & 2) ? -ss : ss;
+  *c = ((q + 1) & 2) ? -cc : cc;
+}
+
+static inline double katan2( double y, double x )
+{
+  const double ax = fabs(x), ay = fabs(y);
+  const int swap = ay > ax;
+  const double mx = swap ? ay : ax, mn = swap ? ax : ay;
+  const double a = mn == mx ? (mx > 0 ? 1 : 0) : mn / mx;
+
+  /* atan(a) = pi/4 + atan((a - 1) / (a + 1)) above tan(pi/8) */
+  const int big = a > TAN_PI_8;
+  const double t = big ? (a - 1) / (a + 1) : a;
+  const double z = t * t, w = z * z;
+  const double s1 = z * (AT0 + w * (AT2 + w * (AT4 + w * (AT6 + w * (AT8 + w * AT10)))));
+  const double s2 = w * (AT1 + w * (AT3 + w * (AT5 + w * (AT7 + w * AT9))));
+
+  double r = big ? PIO4_HI - ((t * (s1 + s2) - PIO4_LO) - t) : t - t * (s1 + s2);
+
+  r = swap ? PIO2_HI - (r - PIO2_LO) : r;
+  r = copysign(1, x) < 0 ? PI_HI - (r - PI_LO) : r;  /* signbit() blocks vectorization */
+  r = copysign(r, y);
+
+  return x != x || y != y ? x + y : r;
+}
+
+void sc_sincos( size_t n, const double x[], double s[], double c[] )
+{
+  size_t i;
+
+  for ( i = 0; i < n; ++i ) {
+    ksincos(x[i], &s[i], &c[i]);
+  }
+
+  for ( i = 0; i < n; ++i ) {
+    if ( !(fabs(x[i]) <= SC_MAX_REDUCE) ) {
+      s[i] = sin(x[i]);
+      c[i] = cos(x[i]);
+    }
+  }
+}
+
+void sc_atan2( size_t n, const double y[], const double x[], double r[] )
+{
+  size_t i;
+
+  for ( i = 0; i < n; ++i ) {
+    r[i] = katan2(y[i], x[i]);
+  }
+}
+
+void sc_tan2cs( double A0, double D0, size_t n, const double xtan[], const double ytan[], double ra[],
+    double dec[] )
+{
+  const double sD0 = sin(D0), cD0 = cos(D0);
+  size_t i;
+
+  /*
+   * ra = atan2(x / cos(D0), 1 - y tan(D0)) + A0,
+   * dec = asin((sin(D0) + y cos(D0)) / sqrt(1 + x^2 + y^2)) written as atan2()
+   */
+  for ( i = 0; i < n; ++i )
+  {
+    const double x = xtan[i], y = ytan[i];
+    const double u = cD0 - y * sD0;
+    const double v = sD0 + y * cD0;
+    const double a = katan2(x, u) + A0;
+
+    ra[i] = a >= TWOPI ? a - TWOPI : a;
+    dec[i] = katan2(v, sqrt(x * x + u * u));
+  }
+}
+
+void sc_cs2tan( double A0, double D0, size_t n, const double ra[], const double dec[], double xtan[],
+    double ytan[] )
+{
+  const double sD0 = sin(D0), cD0 = cos(D0);
+  double da[SC_BLOCK], sa[SC_BLOCK], ca[SC_BLOCK], sd[SC_BLOCK], cd[SC_BLOCK];
+  size_t i, j, m;
+
+  for ( i = 0; i < n; i += m )
+  {
+    m = n - i < SC_BLOCK ? n - i : SC_BLOCK;
+
+    for ( j = 0; j < m; ++j ) {
+      da[j] = ra[i + j] - A0;
+    }
+
+    sc_sincos(m, da, sa, ca);
+    sc_sincos(m, dec + i, sd, cd);
+
+    for ( j = 0; j < m; ++j ) {
+      const double a = cd[j] * ca[j];
+      const double den = sd[j] * sD0 + a * cD0;
+      xtan[i + j] = cd[j] * sa[j] / den;
+      ytan[i + j] = (cD0 * sd[j] - a * sD0) / den;
+    }
+  }
+}
+
+void sc_eq2gal( size_t n, const double ra[], const double dec[], double l[], double b[] )
+{
+  const double RAGP = 192.85948 * M_PI / 180;   /* R.A. of NGP, J2000 */
+  const double DEGP = +27.12825 * M_PI / 180;   /* Decl. of NGP, J2000 */
+  const double LNGAN = +32.93192 * M_PI / 180;  /* Galactic longitude of ascending node on equator */
+  const double sdegp = sin(DEGP), cdegp = cos(DEGP);
+
+  double da[SC_BLOCK], sa[SC_BLOCK], ca[SC_BLOCK], sy[SC_BLOCK], cy[SC_BLOCK], sq[SC_BLOCK];
+  size_t i, j, m;
+
+  for ( i = 0; i < n; i += m )
+  {
+    m = n - i < SC_BLOCK ? n - i : SC_BLOCK;
+
+    for ( j = 0; j < m; ++j ) {
+      da[j] = ra[i + j] - RAGP;
+    }
+
+    sc_sincos(m, da, sa, ca);
+    sc_sincos(m, dec + i, sy, cy);
+
+    for ( j = 0; j < m; ++j ) {
+      const double q = cy[j] * cdegp * ca[j] + sy[j] * sdegp;
+      const double c = sy[j] - q * sdegp;
+      const double d = cy[j] * sa[j] * cdegp;
+      const double g = katan2(c, d) + LNGAN;
+      l[i + j] = g < 0 ? g + TWOPI : (g >= TWOPI ? g - TWOPI : g);
+      sq[j] = q;
+    }
+
+    if ( b ) {
+      for ( j = 0; j < m; ++j ) {
+        const double cb2 = (1 - sq[j]) * (1 + sq[j]);
+        b[i + j] = katan2(sq[j], sqrt(cb2 > 0 ? cb2 : 0));
+      }
+    }
+  }
+}
+
+
+/*
+ * Precession, translated from the NOVAS C 3.1 precession() as precession.m
+ */
+
+static struct {
+  double tdb1, tdb2;
+  double R[9];
+} pcache[SC_PCACHE];
+
+static int npcache, nextpcache;
+static pthread_mutex_t pcache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void precession_matrix( double tdb1, double tdb2, double R[9] )
+{
+  /* Angle conversion constant */
+  const double ASEC2RAD = 4.848136811095359935899141e-6;
+  const double eps0 = 84381.406 * ASEC2RAD;
+
+  double t, psia, omegaa, chia;
+  double sa, ca, sb, cb, sc, cc, sd, cd;
+  double xx, yx, zx, xy, yy, zy, xz, yz, zz;
+
+  /* 't' is time in TDB centuries between the two epochs. */
+  t = (tdb2 - tdb1) / 36525.0;
+  if ( tdb2 == SC_T0 ) {
+    t = -t;
+  }
+
+  /*
+   * Numerical coefficients of psi_a, omega_a, and chi_a, along with epsilon_0,
+   * the obliquity at J2000.0, are 4-angle formulation from Capitaine et al. (2003), eqs. (4), (37), & (39).
+   */
+  psia   = ((((-    0.0000000951  * t
+               +    0.000132851 ) * t
+               -    0.00114045  ) * t
+               -    1.0790069   ) * t
+               + 5038.481507    ) * t;
+
+  omegaa = ((((+    0.0000003337  * t
+               -    0.000000467 ) * t
+               -    0.00772503  ) * t
+               +    0.0512623   ) * t
+               -    0.025754    ) * t + 84381.406;
+
+  chia   = ((((-    0.0000000560  * t
+               +    0.000170663 ) * t
+               -    0.00121197  ) * t
+               -    2.3814292   ) * t
+               +   10.556403    ) * t;
+
+  psia *= ASEC2RAD;
+  omegaa *= ASEC2RAD;
+  chia *= ASEC2RAD;
+
+  sa = sin(eps0);
+  ca = cos(eps0);
+  sb = sin(-psia);
+  cb = cos(-psia);
+  sc = sin(-omegaa);
+  cc = cos(-omegaa);
+  sd = sin(chia);
+  cd = cos(chia);
+
+  /* R3(chi_a) R1(-omega_a) R3(-psi_a) R1(epsilon_0) */
+  xx =  cd * cb - sb * sd * cc;
+  yx =  cd * sb * ca + sd * cc * cb * ca - sa * sd * sc;
+  zx =  cd * sb * sa + sd * cc * cb * sa + ca * sd * sc;
+  xy = -sd * cb - sb * cd * cc;
+  yy = -sd * sb * ca + cd * cc * cb * ca - sa * cd * sc;
+  zy = -sd * sb * sa + cd * cc * cb * sa + ca * cd * sc;
+  xz =  sb * sc;
+  yz = -sc * cb * ca - sa * cc;
+  zz = -sc * cb * sa + cc * ca;
+
+  if ( tdb2 == SC_T0 ) {
+    /* from epoch to J2000.0 */
+    R[0] = xx, R[1] = xy, R[2] = xz;
+    R[3] = yx, R[4] = yy, R[5] = yz;
+    R[6] = zx, R[7] = zy, R[8] = zz;
+  }
+  else {
+    /* from J2000.0 to epoch */
+    R[0] = xx, R[1] = yx, R[2] = zx;
+    R[3] = xy, R[4] = yy, R[5] = zy;
+    R[6] = xz, R[7] = yz, R[8] = zz;
+  }
+}
+
+int sc_precession_matrix( double tdb1, double tdb2, double R[9] )
+{
+  int i;
+
+  /* If necessary, compute Julian dates. */
+  if ( tdb1 < 10000.0 ) {
+    tdb1 = SC_T0 + (tdb1 - 2000.0) * 365.25;
+  }
+  if ( tdb2 < 10000.0 ) {
+    tdb2 = SC_T0 + (tdb2 - 2000.0) * 365.25;
+  }
+
+  if ( tdb1 != SC_T0 && tdb2 != SC_T0 ) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  pthread_mutex_lock(&pcache_lock);
+
+  for ( i = 0; i < npcache; ++i ) {
+    if ( pcache[i].tdb1 == tdb1 && pcache[i].tdb2 == tdb2 ) {
+      break;
+    }
+  }
+
+  if ( i == npcache ) {
+    i = npcache < SC_PCACHE ? npcache++ : nextpcache++ % SC_PCACHE;
+    pcache[i].tdb1 = tdb1;
+    pcache[i].tdb2 = tdb2;
+    precession_matrix(tdb1, tdb2, pcache[i].R);
+  }
+
+  memcpy(R, pcache[i].R, sizeof(pcache[i].R));
+
+  pthread_mutex_unlock(&pcache_lock);
+
+  return 0;
+}
+
+int sc_precession( double tdb1, double tdb2, size_t n, const double ra[], const double dec[], double ra2[],
+    double dec2[] )
+{
+  double R[9];
+  double sa[SC_BLOCK], ca[SC_BLOCK], sd[SC_BLOCK], cd[SC_BLOCK];
+  size_t i, j, m;
+
+  if ( sc_precession_matrix(tdb1, tdb2, R) != 0 ) {
+    return -1;
+  }
+
+  for ( i = 0; i < n; i += m )
+  {
+    m = n - i < SC_BLOCK ? n - i : SC_BLOCK;
+
+    sc_sincos(m, ra + i, sa, ca);
+    sc_sincos(m, dec + i, sd, cd);
+
+    for ( j = 0; j < m; ++j ) {
+      const double x = ca[j] * cd[j], y = sa[j] * cd[j], z = sd[j];
+      const double x2 = R[0] * x + R[1] * y + R[2] * z;
+      const double y2 = R[3] * x + R[4] * y + R[5] * z;
+      const double z2 = R[6] * x + R[7] * y + R[8] * z;
+      const double xyproj = sqrt(x2 * x2 + y2 * y2);
+      const double a = xyproj == 0 ? 0 : katan2(y2, x2);
+
+      dec2[i + j] = katan2(z2, xyproj);
+      ra2[i + j] = a < 0 ? a + TWOPI : a;
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,75 @@
+/*
+ * sctrans.h
+ *
+ *  Array coordinate transforms used by plate reductions: gnomonic projection
+ *  (tan2cs.m, cs2tan.m), equatorial to galactic (eq2gal.m) and precession (precession.m).
+ *
+ *  The transcendental functions are branch-free polynomial kernels (fdlibm coefficients;
+ *  sin/cos within 2.5 ulp for |x| <= 1e6, libm above) written so that the compiler vectorizes
+ *  the array loops; arguments are processed in blocks of SC_BLOCK points.
+ *  All angles are radians.
+ */
+
+#ifndef __sctrans_h__
+#define __sctrans_h__
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Points per block of the array kernels */
+#define SC_BLOCK    256
+
+/** TDB Julian date of epoch J2000.0 */
+#define SC_T0       2451545.0
+
+/**
+ * s[i] = sin(x[i]), c[i] = cos(x[i]).
+ *  |x| above 1e6 falls back to libm.
+ */
+void sc_sincos(size_t n, const double x[/*n*/], double s[/*n*/], double c[/*n*/]);
+
+/**
+ * r[i] = atan2(y[i], x[i])
+ */
+void sc_atan2(size_t n, const double y[/*n*/], const double x[/*n*/], double r[/*n*/]);
+
+/**
+ * Tangential plane coordinates of tangent point (A0, D0) to celestial sphere,
+ *  RA is wrapped below 2 pi as tan2cs.m does
+ */
+void sc_tan2cs(double A0, double D0, size_t n, const double xtan[/*n*/], const double ytan[/*n*/],
+    double ra[/*n*/], double dec[/*n*/]);
+
+/**
+ * Celestial sphere to tangential plane of tangent point (A0, D0)
+ */
+void sc_cs2tan(double A0, double D0, size_t n, const double ra[/*n*/], const double dec[/*n*/],
+    double xtan[/*n*/], double ytan[/*n*/]);
+
+/**
+ * Equatorial J2000 to galactic coordinates, l in [0, 2 pi); b may be NULL
+ */
+void sc_eq2gal(size_t n, const double ra[/*n*/], const double dec[/*n*/], double l[/*n*/], double b[/*n*/]);
+
+/**
+ * Precession rotation matrix (row-major 3x3, applied as pos2 = R * pos1) between TDB Julian dates
+ *  or years (values below 10000); one of the epochs must be J2000.0.
+ *  Matrices are cached per epoch pair. Returns 0 on success, -1 with errno EINVAL otherwise.
+ */
+int sc_precession_matrix(double tdb1, double tdb2, double R[9]);
+
+/**
+ * Precess (ra, dec) from tdb1 to tdb2 (see sc_precession_matrix()), ra2 in [0, 2 pi).
+ *  Returns 0 on success, -1 with errno EINVAL if neither epoch is J2000.0.
+ */
+int sc_precession(double tdb1, double tdb2, size_t n, const double ra[/*n*/], const double dec[/*n*/],
+    double ra2[/*n*/], double dec2[/*n*/]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __sctrans_h__ */
@@ -0,0 +1,289 @@
+/*
+ * ssaplate.c
+ *
+ *  ssa_detection2 plate reader, see ssaplate.h.
+ *
+ *  The loading and filtering follows ssa-plate-dump: the whole plate is read into ccarray_t,
+ *  sorted by objID in parallel when the junk filter needs parent lookups, marked with
+ *  ssa_isjunk() and compacted in place. Fields are then copied out of the packed
+ *  records with their storage types, no text conversion is involved.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include "ccarray-psort.h"
+#include "ssa-detection.h"
+#include "ssa-junk.h"
+#include "ssaplate.h"
+#include "popen-decompress.h"
+
+struct ssa_plate_t {
+  ccarray_t * objects;
+};
+
+#define FIELD(name, member, type) \
+  { name, offsetof(ssa_detection2, member), ssa_field_##type }
+
+static const ssa_field_t fields[] = {
+  FIELD("objID",    objID,    int64),
+  FIELD("parentID", parentID, int64),
+  FIELD("ra",       ra,       float8),
+  FIELD("dec",      dec,      float8),
+  FIELD("xmin",     xmin,     float8),
+  FIELD("xmax",     xmax,     float8),
+  FIELD("ymin",     ymin,     float8),
+  FIELD("ymax",     ymax,     float8),
+  FIELD("area",     area,     int32),
+  FIELD("ipeak",    ipeak,    float4),
+  FIELD("cosmag",   cosmag,   float4),
+  FIELD("isky",     isky,     float4),
+  FIELD("x",        xCen,     float8),
+  FIELD("y",        yCen,     float8),
+  FIELD("xCen",     xCen,     float8),
+  FIELD("yCen",     yCen,     float8),
+  FIELD("aU",       aU,       float4),
+  FIELD("bU",       bU,       float4),
+  FIELD("thetaU",   thetaU,   int16),
+  FIELD("aI",       aI,       float4),
+  FIELD("bI",       bI,       float4),
+  FIELD("thetaI",   thetaI,   int16),
+  FIELD("class",    class,    uint8),
+  FIELD("pa",       pa,       int16),
+  FIELD("ap1",      ap1,      int32),
+  FIELD("ap2",      ap2,      int32),
+  FIELD("ap3",      ap3,      int32),
+  FIELD("ap4",      ap4,      int32),
+  FIELD("ap5",      ap5,      int32),
+  FIELD("ap6",      ap6,      int32),
+  FIELD("ap7",      ap7,      int32),
+  FIELD("ap8",      ap8,      int32),
+  FIELD("blend",    blend,    int32),
+  FIELD("quality",  quality,  int32),
+  FIELD("prfStat",  prfStat,  float4),
+  FIELD("prfMag",   prfMag,   float4),
+  FIELD("gMag",     gMag,     float4),
+  FIELD("sMag",     sMag,     float4),
+};
+
+
+const ssa_field_t * ssa_plate_field( const char * name )
+{
+  size_t i;
+
+  for ( i = 0; i < sizeof(fields) / sizeof(fields[0]); ++i ) {
+    if ( strcmp(fields[i].name, name) == 0 ) {
+      return &fields[i];
+    }
+  }
+
+  return NULL;
+}
+
+
+static int has_suffix( const char * s, const char * suffix )
+{
+  size_t n = strlen(s), m = strlen(suffix);
+  return n >= m && strcmp(s + n - m, suffix) == 0;
+}
+
+
+/** load objects into array from input stream, same as ssa-plate-dump does */
+static int load_objects( FILE * input, ccarray_t * objects )
+{
+  struct stat st;
+  size_t size, want, count;
+  int c;
+
+  /* plain files are loaded into exactly sized array */
+  if ( fstat(fileno(input), &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 ) {
+    if ( ccarray_reserve(objects, st.st_size / sizeof(ssa_detection2)) != 0 ) {
+      return -1;
+    }
+  }
+
+  while ( 1 )
+  {
+    size = ccarray_size(objects);
+
+    /* full array grows only if there is more to read */
+    if ( size == ccarray_capacity(objects) ) {
+      if ( (c = getc(input)) == EOF ) {
+        break;
+      }
+      ungetc(c, input);
+      if ( ccarray_reserve(objects, 2 * size + 1024) != 0 ) {
+        return -1;
+      }
+    }
+
+    want = ccarray_capacity(objects) - size;
+    count = fread(ccarray_peek_end(objects), sizeof(ssa_detection2), want, input);
+    ccarray_set_size(objects, size + count);
+
+    /* short read is end of file or error */
+    if ( count < want ) {
+      break;
+    }
+  }
+
+  if ( ferror(input) ) {
+    errno = EIO;
+    return -1;
+  }
+
+  return 0;
+}
+
+
+ssa_plate_t * ssa_plate_load( const char * fname, int filter )
+{
+  static const ccarray_sortkey_t objid_key = { offsetof(ssa_detection2, objID), ccarray_key_int64 };
+
+  const char * program = NULL;
+  ssa_plate_t * plate = NULL;
+  ccarray_t * objects = NULL;
+  uint8_t * keep = NULL;
+  FILE * input;
+  size_t i, size;
+  int status;
+
+  if ( has_suffix(fname, ".bz2") || has_suffix(fname, ".bz") ) {
+    program = "bzip2";
+  }
+  else if ( has_suffix(fname, ".gz") ) {
+    program = "gzip";
+  }
+
+  if ( !(input = program ? popen_decompress(program, fname) : fopen(fname, "rb")) ) {
+    return NULL;
+  }
+
+  if ( !(objects = ccarray_create(0, sizeof(ssa_detection2))) ) {
+    status = -1;
+  }
+  else {
+    status = load_objects(input, objects);
+  }
+
+  if ( program ) {
+    if ( pclose(input) != 0 && status == 0 ) {
+      errno = EIO;
+      status = -1;
+    }
+  }
+  else {
+    fclose(input);
+  }
+
+  if ( status != 0 ) {
+    goto fail;
+  }
+
+  size = ccarray_size(objects);
+
+  if ( filter & (SSA_PLATE_FJUNK | SSA_PLATE_DROP_PARENTS) )
+  {
+    const ssa_detection2 * objs;
+
+    /* the junk tester needs the whole list sorted by objID (parents lookup) */
+    if ( (filter & SSA_PLATE_FJUNK) && ccarray_sort_parallel_keys(objects, 0, size, &objid_key, 1, 0) != 0 ) {
+      ccarray_sort(objects, 0, size, ssa_cmp_objid);
+    }
+
+    if ( !(keep = calloc((size + 7) / 8 + 1, 1)) ) {
+      goto fail;
+    }
+
+    objs = ccarray_peek(objects, 0);
+
+    for ( i = 0; i < size; ++i )
+    {
+      if ( (filter & SSA_PLATE_FJUNK) && ssa_isjunk(&objs[i], objs, size) ) {
+        continue;
+      }
+
+      if ( (filter & SSA_PLATE_DROP_PARENTS) && objs[i].blend < 0 ) {
+        continue;
+      }
+
+      keep[i >> 3] |= 1 << (i & 7);
+    }
+
+    ccarray_compact(objects, keep);
+    free(keep);
+  }
+
+  if ( !(plate = malloc(sizeof(*plate))) ) {
+    goto fail;
+  }
+
+  plate->objects = objects;
+  return plate;
+
+fail:
+  if ( objects ) {
+    ccarray_destroy(objects);
+  }
+  return NULL;
+}
+
+
+void ssa_plate_close( ssa_plate_t * plate )
+{
+  if ( plate ) {
+    ccarray_destroy(plate->objects);
+    free(plate);
+  }
+}
+
+
+size_t ssa_plate_size( const ssa_plate_t * plate )
+{
+  return ccarray_size(plate->objects);
+}
+
+
+const void * ssa_plate_objects( const ssa_plate_t * plate )
+{
+  return ccarray_peek(plate->objects, 0);
+}
+
+
+#define COPY_COLUMN(ctype) \
+  for ( i = 0; i < n; ++i ) { \
+    memcpy((ctype *) out + i, (const uint8_t *) (objs + i) + field->offset, sizeof(ctype)); \
+  }
+
+void ssa_plate_column( const ssa_plate_t * plate, const ssa_field_t * field, void * out )
+{
+  const ssa_detection2 * objs = ccarray_peek(plate->objects, 0);
+  const size_t n = ccarray_size(plate->objects);
+  size_t i;
+
+  switch ( field->type )
+  {
+  case ssa_field_int64:
+    COPY_COLUMN(int64_t);
+    break;
+  case ssa_field_int32:
+    COPY_COLUMN(int32_t);
+    break;
+  case ssa_field_int16:
+    COPY_COLUMN(int16_t);
+    break;
+  case ssa_field_uint8:
+    COPY_COLUMN(uint8_t);
+    break;
+  case ssa_field_float4:
+    COPY_COLUMN(float);
+    break;
+  case ssa_field_float8:
+    COPY_COLUMN(double);
+    break;
+  }
+}
@@ -0,0 +1,79 @@
+/*
+ * ssaplate.h
+ *
+ *  Direct reader of SuperCOSMOS ssa_detection2 binary plate files (apps/include/ssa-detection.h),
+ *  with the junk and parent filters of ssa-plate-dump (apps/include/ssa-junk.h).
+ */
+
+#ifndef __ssaplate_h__
+#define __ssaplate_h__
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** ssa_plate_load() filter bits, see ssa-plate-dump -f and -c */
+enum {
+  SSA_PLATE_FJUNK        = 1,
+  SSA_PLATE_DROP_PARENTS = 2,
+};
+
+/** storage types of ssa_detection2 fields */
+typedef
+enum ssa_field_type_t {
+  ssa_field_int64,
+  ssa_field_int32,
+  ssa_field_int16,
+  ssa_field_uint8,
+  ssa_field_float4,
+  ssa_field_float8,
+} ssa_field_type_t;
+
+typedef struct ssa_plate_t ssa_plate_t;
+
+typedef
+struct ssa_field_t {
+  const char * name;
+  size_t offset;
+  ssa_field_type_t type;
+} ssa_field_t;
+
+/**
+ * Field descriptor by ssa-plate-dump column name (x and y are xCen and yCen), NULL if unknown
+ */
+const ssa_field_t * ssa_plate_field(const char * name);
+
+/**
+ * Load plate file, .bz2/.bz and .gz are decompressed with bzip2/gzip.
+ *  With SSA_PLATE_FJUNK the objects are sorted by objID (as ssa-plate-dump -f outputs them),
+ *  otherwise file order is kept. Returns NULL with errno set on error.
+ */
+ssa_plate_t * ssa_plate_load(const char * fname, int filter);
+
+/**
+ * Release plate
+ */
+void ssa_plate_close(ssa_plate_t * plate);
+
+/**
+ * Number of objects kept by the filter
+ */
+size_t ssa_plate_size(const ssa_plate_t * plate);
+
+/**
+ * Packed ssa_detection2 records (apps/include/ssa-detection.h) of the objects kept by the filter
+ */
+const void * ssa_plate_objects(const ssa_plate_t * plate);
+
+/**
+ * Copy field of all objects into out[], which must be of the field storage type
+ */
+void ssa_plate_column(const ssa_plate_t * plate, const ssa_field_t * field, void * out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ssaplate_h__ */
@@ -0,0 +1,534 @@
+/*
+ * tsvread.c
+ *
+ *  Numeric column loader, see tsvread.h.
+ *
+ *  Fields are separated by runs of blanks (as awk splits them), the first line is the header.
+ *  The whole file is kept in memory and always ends with '\n', so that strtod() and the
+ *  field scanners never run past the buffer. tsv_nrows() cuts the data rows into chunks
+ *  and counts rows per chunk in parallel; tsv_parse() then knows the first output row
+ *  of each chunk and fills the columns without any locking.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "tsvread.h"
+#include "popen-decompress.h"
+
+/** Minimal chunk size worth a thread */
+#define TSV_MIN_CHUNK   (1 << 20)
+
+/** Initial buffer size for decompressed input */
+#define TSV_READ_BUF    (16 << 20)
+
+#define isblank_(c)     ((c) == ' ' || (c) == '\t' || (c) == '\r')
+
+/** Exact powers of ten for parse_double() */
+static const double pow10_[23] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+typedef
+struct tsv_chunk_t {
+  const char * begin, * end;    /*< whole lines, end points past '\n' */
+  size_t row0, nrows;
+  /* tsv_parse() job */
+  size_t ncols;
+  int maxfield;
+  const int * head, * next;
+  double ** out;
+} tsv_chunk_t;
+
+struct tsv_t {
+  char * data;
+  size_t size;
+  int mapped;
+  const char * body;
+  char * header;
+  char ** names;
+  int nnames;
+  tsv_chunk_t * chunks;
+  int nchunks;
+  size_t nrows;
+};
+
+
+/** reads whole stream into malloc-ed buffer with trailing '\n' */
+static char * read_stream( FILE * fp, size_t * size )
+{
+  size_t capacity = TSV_READ_BUF, n = 0, cb;
+  char * buf, * tmp;
+
+  if ( !(buf = malloc(capacity)) ) {
+    return NULL;
+  }
+
+  while ( (cb = fread(buf + n, 1, capacity - n - 1, fp)) > 0 )
+  {
+    if ( (n += cb) == capacity - 1 )
+    {
+      if ( !(tmp = realloc(buf, capacity *= 2)) ) {
+        free(buf);
+        return NULL;
+      }
+      buf = tmp;
+    }
+  }
+
+  if ( ferror(fp) ) {
+    free(buf);
+    errno = EIO;
+    return NULL;
+  }
+
+  if ( n == 0 || buf[n - 1] != '\n' ) {
+    buf[n++] = '\n';
+  }
+
+  *size = n;
+  return buf;
+}
+
+
+/** decompresses file with bzip2 or gzip */
+static char * read_compressed( const char * program, const char * fname, size_t * size )
+{
+  FILE * fp;
+  char * buf;
+  int status;
+
+  if ( !(fp = popen_decompress(program, fname)) ) {
+    return NULL;
+  }
+
+  buf = read_stream(fp, size);
+
+  if ( (status = pclose(fp)) != 0 && buf ) {
+    free(buf);
+    buf = NULL;
+    errno = EIO;
+  }
+
+  return buf;
+}
+
+
+/** maps plain file; falls back to read_stream() if the file does not end with '\n' */
+static char * read_plain( const char * fname, size_t * size, int * mapped )
+{
+  struct stat st;
+  char * buf = NULL;
+  FILE * fp;
+  int fd;
+
+  if ( (fd = open(fname, O_RDONLY)) == -1 ) {
+    return NULL;
+  }
+
+  if ( fstat(fd, &st) == -1 ) {
+    close(fd);
+    return NULL;
+  }
+
+  if ( st.st_size > 0 )
+  {
+    buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    if ( buf == MAP_FAILED ) {
+      buf = NULL;
+    }
+    else if ( buf[st.st_size - 1] == '\n' ) {
+      madvise(buf, st.st_size, MADV_WILLNEED);
+      close(fd);
+      *size = st.st_size;
+      *mapped = 1;
+      return buf;
+    }
+    else {
+      munmap(buf, st.st_size);
+      buf = NULL;
+    }
+  }
+
+  if ( (fp = fdopen(fd, "r")) ) {
+    buf = read_stream(fp, size);
+    fclose(fp);
+  }
+  else {
+    close(fd);
+  }
+
+  return buf;
+}
+
+
+static int has_suffix( const char * s, const char * suffix )
+{
+  size_t n = strlen(s), m = strlen(suffix);
+  return n >= m && strcmp(s + n - m, suffix) == 0;
+}
+
+
+tsv_t * tsv_open( const char * fname )
+{
+  tsv_t * tsv;
+  const char * eol;
+  char * s;
+  int capacity = 0;
+
+  if ( !(tsv = calloc(1, sizeof(*tsv))) ) {
+    return NULL;
+  }
+
+  if ( has_suffix(fname, ".bz2") || has_suffix(fname, ".bz") ) {
+    tsv->data = read_compressed("bzip2", fname, &tsv->size);
+  }
+  else if ( has_suffix(fname, ".gz") ) {
+    tsv->data = read_compressed("gzip", fname, &tsv->size);
+  }
+  else {
+    tsv->data = read_plain(fname, &tsv->size, &tsv->mapped);
+  }
+
+  if ( !tsv->data ) {
+    free(tsv);
+    return NULL;
+  }
+
+  /* split header line into names */
+  eol = memchr(tsv->data, '\n', tsv->size);
+  tsv->body = eol + 1;
+
+  if ( !(tsv->header = strndup(tsv->data, eol - tsv->data)) ) {
+    goto fail;
+  }
+
+  for ( s = strtok(tsv->header, " \t\r"); s; s = strtok(NULL, " \t\r") )
+  {
+    if ( tsv->nnames == capacity )
+    {
+      char ** tmp = realloc(tsv->names, (capacity = 2 * capacity + 64) * sizeof(*tmp));
+      if ( !tmp ) {
+        goto fail;
+      }
+      tsv->names = tmp;
+    }
+    tsv->names[tsv->nnames++] = s;
+  }
+
+  return tsv;
+
+fail:
+  tsv_close(tsv);
+  errno = ENOMEM;
+  return NULL;
+}
+
+
+void tsv_close( tsv_t * tsv )
+{
+  if ( tsv )
+  {
+    if ( tsv->mapped ) {
+      munmap(tsv->data, tsv->size);
+    }
+    else {
+      free(tsv->data);
+    }
+
+    free(tsv->header);
+    free(tsv->names);
+    free(tsv->chunks);
+    free(tsv);
+  }
+}
+
+
+int tsv_column( const tsv_t * tsv, const char * name )
+{
+  int i;
+
+  for ( i = 0; i < tsv->nnames; ++i ) {
+    if ( strcmp(tsv->names[i], name) == 0 ) {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+
+
+/**
+ * Parses decimal number in [s, e).
+ *  Mantissas below 2^53 with decimal exponents within +-22 are converted exactly
+ *  by a single multiplication or division (Clinger's fast path), which covers the
+ *  catalog columns; everything else goes to strtod(). Returns NaN on garbage.
+ */
+static double parse_double( const char * s, const char * e )
+{
+  const char * p = s;
+  unsigned long long m = 0;
+  int neg = 0, ndigits = 0, exp10 = 0, x = 0, xneg = 0;
+  char * end;
+  double v;
+
+  if ( *p == '-' || *p == '+' ) {
+    neg = *p++ == '-';
+  }
+
+  for ( ; *p >= '0' && *p <= '9'; ++p, ++ndigits ) {
+    m = m * 10 + (*p - '0');
+  }
+
+  if ( *p == '.' ) {
+    for ( ++p; *p >= '0' && *p <= '9'; ++p, ++ndigits, --exp10 ) {
+      m = m * 10 + (*p - '0');
+    }
+  }
+
+  if ( ndigits > 0 && (*p == 'e' || *p == 'E') )
+  {
+    const char * q = ++p;
+
+    if ( *p == '-' || *p == '+' ) {
+      xneg = *p++ == '-';
+    }
+    for ( ; *p >= '0' && *p <= '9' && x < 10000; ++p ) {
+      x = x * 10 + (*p - '0');
+    }
+    if ( p == q || p[-1] < '0' || p[-1] > '9' ) {
+      p = e + 1; /* malformed exponent */
+    }
+
+    exp10 += xneg ? -x : x;
+  }
+
+  if ( p == e && ndigits > 0 && ndigits <= 15 && exp10 >= -22 && exp10 <= 22 ) {
+    v = exp10 < 0 ? (double) m / pow10_[-exp10] : (double) m * pow10_[exp10];
+    return neg ? -v : v;
+  }
+
+  v = strtod(s, &end);
+  return end == e ? v : NAN;
+}
+
+
+static void * count_rows( void * arg )
+{
+  tsv_chunk_t * chunk = arg;
+  const char * p = chunk->begin;
+  size_t nrows = 0;
+
+  while ( p < chunk->end )
+  {
+    while ( isblank_(*p) ) {
+      ++p;
+    }
+
+    if ( *p != '\n' ) {
+      ++nrows;
+      p = memchr(p, '\n', chunk->end - p);
+    }
+
+    ++p;
+  }
+
+  chunk->nrows = nrows;
+  return NULL;
+}
+
+
+/** runs func() over all chunks, chunk 0 in the calling thread */
+static void run_chunks( tsv_t * tsv, void * (*func)(void *) )
+{
+  pthread_t tid[tsv->nchunks];
+  int started[tsv->nchunks];
+  int i;
+
+  for ( i = 1; i < tsv->nchunks; ++i ) {
+    started[i] = pthread_create(&tid[i], NULL, func, &tsv->chunks[i]) == 0;
+    if ( !started[i] ) {
+      func(&tsv->chunks[i]);
+    }
+  }
+
+  func(&tsv->chunks[0]);
+
+  for ( i = 1; i < tsv->nchunks; ++i ) {
+    if ( started[i] ) {
+      pthread_join(tid[i], NULL);
+    }
+  }
+}
+
+
+size_t tsv_nrows( tsv_t * tsv, int nthreads )
+{
+  const char * end = tsv->data + tsv->size;
+  const char * p;
+  size_t chunksize;
+  int i, n;
+
+  if ( tsv->chunks ) {
+    return tsv->nrows;
+  }
+
+  if ( nthreads <= 0 && (nthreads = sysconf(_SC_NPROCESSORS_ONLN)) < 1 ) {
+    nthreads = 1;
+  }
+
+  if ( (n = (end - tsv->body) / TSV_MIN_CHUNK) < nthreads ) {
+    nthreads = n > 0 ? n : 1;
+  }
+
+  if ( !(tsv->chunks = calloc(nthreads, sizeof(*tsv->chunks))) ) {
+    return 0;
+  }
+
+  chunksize = (end - tsv->body) / nthreads;
+
+  for ( i = 0, p = tsv->body; i < nthreads && p < end; ++i )
+  {
+    tsv->chunks[i].begin = p;
+
+    if ( i == nthreads - 1 || (size_t) (end - p) <= chunksize ) {
+      p = end;
+    }
+    else {
+      p = (const char *) memchr(p + chunksize, '\n', end - p - chunksize) + 1;
+    }
+
+    tsv->chunks[i].end = p;
+  }
+
+  if ( (tsv->nchunks = i) > 0 )
+  {
+    run_chunks(tsv, count_rows);
+
+    for ( i = 0; i < tsv->nchunks; ++i ) {
+      tsv->chunks[i].row0 = tsv->nrows;
+      tsv->nrows += tsv->chunks[i].nrows;
+    }
+  }
+
+  return tsv->nrows;
+}
+
+
+
+static void * parse_rows( void * arg )
+{
+  tsv_chunk_t * chunk = arg;
+  double ** out = chunk->out;
+  const char * p = chunk->begin, * q;
+  size_t row = chunk->row0;
+  size_t k;
+  int field, c;
+  double v;
+
+  while ( p < chunk->end )
+  {
+    while ( isblank_(*p) ) {
+      ++p;
+    }
+
+    if ( *p == '\n' ) {
+      ++p;
+      continue;
+    }
+
+    for ( k = 0; k < chunk->ncols; ++k ) {
+      out[k][row] = NAN;
+    }
+
+    for ( field = 0; *p != '\n' && field <= chunk->maxfield; ++field )
+    {
+      for ( q = p; !isblank_(*p) && *p != '\n'; ++p ) {}
+
+      if ( (c = chunk->head[field]) >= 0 )
+      {
+        v = parse_double(q, p);
+
+        for ( ; c >= 0; c = chunk->next[c] ) {
+          out[c][row] = v;
+        }
+      }
+
+      while ( isblank_(*p) ) {
+        ++p;
+      }
+    }
+
+    if ( *p != '\n' ) {
+      p = memchr(p, '\n', chunk->end - p);
+    }
+
+    ++p, ++row;
+  }
+
+  return NULL;
+}
+
+
+int tsv_parse( tsv_t * tsv, size_t ncols, const int fields[], double * out[] )
+{
+  int head[tsv->nnames + 1];
+  int * next = NULL;
+  size_t k;
+  int i, maxfield = -1;
+
+  if ( !tsv->chunks ) {
+    tsv_nrows(tsv, 0);
+  }
+
+  for ( k = 0; k < ncols; ++k ) {
+    if ( fields[k] < 0 || fields[k] >= tsv->nnames ) {
+      errno = EINVAL;
+      return -1;
+    }
+    if ( fields[k] > maxfield ) {
+      maxfield = fields[k];
+    }
+  }
+
+  if ( ncols == 0 || tsv->nrows == 0 ) {
+    return 0;
+  }
+
+  if ( !(next = malloc(ncols * sizeof(*next))) ) {
+    return -1;
+  }
+
+  for ( i = 0; i < tsv->nnames; ++i ) {
+    head[i] = -1;
+  }
+
+  for ( k = ncols; k-- > 0; ) {
+    next[k] = head[fields[k]];
+    head[fields[k]] = k;
+  }
+
+  for ( i = 0; i < tsv->nchunks; ++i ) {
+    tsv->chunks[i].ncols = ncols;
+    tsv->chunks[i].maxfield = maxfield;
+    tsv->chunks[i].head = head;
+    tsv->chunks[i].next = next;
+    tsv->chunks[i].out = out;
+  }
+
+  run_chunks(tsv, parse_rows);
+
+  free(next);
+  return 0;
+}
@@ -0,0 +1,55 @@
+/*
+ * tsvread.h
+ *
+ *  Numeric column loader for whitespace separated text tables with a header line,
+ *  as written by ssa-* apps and ccut. Plain files are mmap()-ed, .bz2/.gz are decompressed
+ *  into memory. Data rows are split into chunks at line boundaries and parsed by threads
+ *  directly into caller-supplied column arrays.
+ */
+
+#ifndef __tsvread_h__
+#define __tsvread_h__
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct tsv_t tsv_t;
+
+/**
+ * Open table file, .bz2/.bz and .gz are decompressed with bzip2/gzip.
+ *  Returns NULL with errno set on error.
+ */
+tsv_t * tsv_open(const char * fname);
+
+/**
+ * Release table
+ */
+void tsv_close(tsv_t * tsv);
+
+/**
+ * Field index of header column name, -1 if not found
+ */
+int tsv_column(const tsv_t * tsv, const char * name);
+
+/**
+ * Number of data rows (non-blank lines below header).
+ *  nthreads <= 0 selects number of online CPUs.
+ */
+size_t tsv_nrows(tsv_t * tsv, int nthreads);
+
+/**
+ * Parse fields[0..ncols-1] of each data row into out[k][row], k = 0..ncols-1.
+ *  Each out[k] must have tsv_nrows() elements.
+ *  Missing or non-numeric fields are stored as NaN.
+ *  Returns 0 on success, -1 with errno set on error.
+ */
+int tsv_parse(tsv_t * tsv, size_t ncols, const int fields[/*ncols*/], double * out[/*ncols*/]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __tsvread_h__ */
@@ -3,6 +3,7 @@
 %  
 %  Convert equatorial coordinates to galactic.
 %  All units are radians.
+%  The octave-scosmos package provides a native array version of this function.
 %
 %  A.Myznikov, 
 %   20 July 2013  
@@ -20,33 +21,22 @@ function [l,b] = eq2gal( ra, dec )
   cy = cos(dec);
   sa = sin(ra-RAGP);
   ca = cos(ra-RAGP);
-  sq = cy * cdegp * ca  + sy * sdegp;
+  sq = cy .* ca * cdegp + sy * sdegp;
 
   if ( nargout > 1 )
     b = asin(sq);
   end
 
   c = sy - sq * sdegp;
-  d = cy * sa * cdegp;
-  
-  index = abs(d) < eps;
-  d(index & d < 0 ) = -eps; 
-  d(index & d >= 0 ) = +eps; 
-  l = atan(c / d) + LNGAN;
-  
-  if ( any(index = d < 0) )
-    l(index) += pi;
-  end
-  
-  if ( any(index = d < 0) )
-    l(index) += pi;
-  end
+  d = cy .* sa * cdegp;
+
+  l = atan2(c, d) + LNGAN;
 
   if ( any(index = l < 0) )
     l(index) += 2 * pi;
   end
 
-  if ( any(index = l > 2 * pi) )
+  if ( any(index = l >= 2 * pi) )
     l(index) -= 2 * pi;
   end
 
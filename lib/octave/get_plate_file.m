@@ -0,0 +1,30 @@
+%
+% [fname, filter] = get_plate_file( plateid )
+%   Locate binary plate file for plateid in ssa_data_location().
+%   Cleaned plates (<plateid>.clean.dat[.bz2]) are preferred, for them the filter is empty,
+%   for original plates (<plateid>.dat[.bz2]) the filter is 'c' (drop parents of deblends).
+%   The filter is ssa-plate-dump options string accepted by ssa_plate_read().
+%   Returns empty fname if no plate file found.
+%
+function [fname, filter] = get_plate_file( plateid )
+
+  path = ssa_data_location( plateid );
+  if ( strcmp(path,"") )
+    error("ssa_data_location() fails");
+  end
+
+  names   = { '%s/%d.clean.dat', '%s/%d.clean.dat.bz2', '%s/%d.dat', '%s/%d.dat.bz2' };
+  filters = { '', '', 'c', 'c' };
+
+  for i = 1 : numel(names)
+    fname = sprintf(names{i}, path, plateid);
+    if ( exist(fname,'file') )
+      filter = filters{i};
+      return;
+    end
+  end
+
+  fname = '';
+  filter = '';
+
+end
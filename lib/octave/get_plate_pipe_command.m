@@ -7,35 +7,14 @@ function cmd = get_plate_pipe_command( plateid, opts )
     opts = "";
   end
 
-  path = ssa_data_location( plateid );
-  if ( strcmp(path,"") )
-    error("ssa_data_location() fails");
-  end
+  [fname, filter] = get_plate_file( plateid );
 
-  fname = sprintf('%s/%d.clean.dat', path, plateid);
-  if ( exist(fname,'file') )
+  if ( strcmp(fname,'') )
+    cmd = '';
+  elseif ( strcmp(filter,'') )
     cmd = sprintf('ssa-plate-dump %s %s -F', fname, opts);
-    return;
+  else
+    cmd = sprintf('ssa-plate-dump %s -%s %s', fname, filter, opts);
   end
 
-  fname = sprintf('%s/%d.clean.dat.bz2', path,  plateid);
-  if ( exist(fname,'file') )
-    cmd = sprintf('ssa-plate-dump %s %s -F', fname, opts);
-    return;
-  end
-
-  fname = sprintf('%s/%d.dat', path,  plateid);
-  if ( exist(fname,'file') )
-    cmd = sprintf('ssa-plate-dump %s -c %s', fname, opts);
-    return;
-  end
-
-  fname = sprintf('%s/%d.dat.bz2', path,  plateid);
-  if ( exist(fname,'file') )
-    cmd = sprintf('ssa-plate-dump %s -c %s', fname, opts);
-    return;
-  end
-
-  cmd = '';
-
 end
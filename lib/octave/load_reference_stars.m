@@ -19,32 +19,26 @@ function [x, y, mag, xtan, ytan, ra, dec] = load_reference_stars( refname, plate
   ytan= [];
 
 
-  % Use popenq() for more flexibility and reduce memory pressure
-
   fname = sprintf('refs/%d/%s/%d.dat', ssa_surveyid(plateid), refname, plateid);
-  fid = popenq(fname, 'ra,dec,x,y,class,sMag,gMag' );
-  if ( fid == -1 )
-    fprintf(stderr, 'popenq(%s) fails\n', fname);
+  if ( ~exist(fname, 'file') )
+    fprintf(stderr, '%s: no such file\n', fname);
     return;
   end
 
-  v  = fscanf(fid, '%lf', [7, Inf])';
-  pclose(fid);
+  [ra, dec, x, y, cls, sMag, gMag] = tsvread(fname, 'ra,dec,x,y,class,sMag,gMag');
 
-  if ( size(v,1) < 1 || size(v,2) < 1 )
+  if ( isempty(ra) )
     fprintf(stderr, '%s: empty file\n', fname);
     return;
   end
 
   [A0, D0, ~, X0, Y0] = ssa_plate_info( plateid );
 
-  ra     = v(:,1);
-  dec    = v(:,2);
-  x      = v(:,3) - X0;
-  y      = v(:,4) - Y0;
-  galaxy = v(:,5)==1;
-  mag    = v(:,6);
-  mag(galaxy) = v(galaxy,7);
+  x      = x - X0;
+  y      = y - Y0;
+  galaxy = cls==1;
+  mag    = sMag;
+  mag(galaxy) = gMag(galaxy);
 
   if ( nargin > 3 )
     cond = mag >= minmag;
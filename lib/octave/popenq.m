@@ -4,6 +4,8 @@
 %  Returns pipe id, or -1 on error.
 %  Use pclose() to close the pipe.
 %
+%  Superseded by tsvread(), which loads the columns directly into arrays.
+%
 %  Example:
 %   pid = popenq("somefile.dat","x,y,z");
 %   if ( pid == -1 )
@@ -31,10 +31,13 @@ function prepare_reference_stars( plateid, refnames )
 
     if ( strcmp(refname,'ucac4') )
       selectCmd = generate_select_ucac4(A0, D0, EPOCH);
+      coneOpts = sprintf('-e %.3f -pm mura,mudec -c ra=rat,dec=dect,cdf,objt', EPOCH);
     elseif ( strcmp(refname,'xsc') )
       selectCmd = generate_select_xsc(A0, D0);
+      coneOpts = '-c ra,dec,ext_key,g_score';
     elseif ( strcmp(refname,'psc') )
       selectCmd = generate_select_psc(A0, D0);
+      coneOpts = '-c ra,dec,pts_key,ext_key,j_m,h_m,k_m,j_msigcom,h_msigcom,k_msigcom,prox,epoch,use_src';
     else
       fprintf(stderr,'prepare_reference_stars() not implemented for "%s"\n', refname);
       continue;
@@ -53,7 +56,12 @@ function prepare_reference_stars( plateid, refnames )
       stmp_ready = 1;
     end # stmp_ready
 
-    cmd = sprintf('psql wsdb -c \\\\"copy(%s) to stdout with csv header delimiter E''\\t'' null ''NA'' \\\\" > %s', selectCmd, rtmp);
+    % local ssa-refcat catalog if imported, the database otherwise
+    if ( system(sprintf('ssa-refcat info %s > /dev/null 2>&1', refname)) == 0 )
+      cmd = sprintf('ssa-refcat cone %s %s %.9f %.9f 6 > %s', coneOpts, refname, A0, D0, rtmp);
+    else
+      cmd = sprintf('psql wsdb -c \\\\"copy(%s) to stdout with csv header delimiter E''\\t'' null ''NA'' \\\\" > %s', selectCmd, rtmp);
+    end
     disp(cmd);
     syscall(cmd);
 
@@ -7,7 +7,13 @@
 %
 function [ xmin, xmax, ymin, ymax ] = ssa_plate_bounds( surveyid )
 
-  A = sscanf(pgquery('select max(axmin),min(axmax),max(aymin),min(aymax) from ssa_plates where surveyid=%d', surveyid),'%lf');
+  if ( ssa_plate_meta_available() )
+    P = ssa_plate_meta([], 'surveyid, axmin, axmax, aymin, aymax');
+    P = P(P(:, 1) == surveyid, :);
+    A = [max(P(:, 2)), min(P(:, 3)), max(P(:, 4)), min(P(:, 5))];
+  else
+    A = sscanf(pgquery('select max(axmin),min(axmax),max(aymin),min(aymax) from ssa_plates where surveyid=%d', surveyid),'%lf');
+  end
   
   % Warning  : it seems that the columns are bugly reordered in original SSA database
   xmin = A(1);
@@ -18,12 +18,19 @@
 
 function [A0, D0, EPOCH, X0, Y0] = ssa_plate_info( plateid )
 
-  sqlCmd = sprintf('select rapnt, decpnt, epoch, xpnt, ypnt from ssa_plates where plateid=%d', plateid);
+  if ( ssa_plate_meta_available() )
+    A = ssa_plate_meta(plateid, 'rapnt, decpnt, epoch, xpnt, ypnt');
+  else
+    A = sscanf(pgquery('select rapnt, decpnt, epoch, xpnt, ypnt from ssa_plates where plateid=%d', plateid), '%lf');
+  end
 
-  A = sscanf( pgquery(sqlCmd) , '%lf' );
-  A0 = A(1,1) * pi / 180;
-  D0 = A(2,1) * pi / 180;
-  EPOCH = A(3,1);
-  X0 = A(4,1);
-  Y0 = A(5,1);
+  if ( numel(A) ~= 5 || any(isnan(A)) )
+    error('ssa_plate_info(): plateid %d not found', plateid);
+  end
+
+  A0 = A(1) * pi / 180;
+  D0 = A(2) * pi / 180;
+  EPOCH = A(3);
+  X0 = A(4);
+  Y0 = A(5);
 end
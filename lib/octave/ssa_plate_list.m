@@ -9,5 +9,10 @@
 %       platelist = ssa_plate_list(1);
 %
 function platelist = ssa_plate_list(surveyid)
-  platelist = sscanf( pgquery('select plateid from ssa_plates where surveyid=%d', surveyid), '%d');
+  if ( ssa_plate_meta_available() )
+    P = ssa_plate_meta([], 'plateid, surveyid');
+    platelist = P(P(:, 2) == surveyid, 1);
+  else
+    platelist = sscanf( pgquery('select plateid from ssa_plates where surveyid=%d', surveyid), '%d');
+  end
 end
@@ -0,0 +1,53 @@
+%
+% v = ssa_plate_meta( plateids, columns )
+% [c1, c2, ...] = ssa_plate_meta( plateids, columns )
+%  Return ssa_plates columns (names separated by commas or blanks, case insensitive)
+%  of given plates from the local snapshot written by 'ssa-plate-meta export',
+%  without database access. Empty plateids selects all plates in plateID order.
+%  Values are in the table units, raPnt and decPnt in degrees; rows of unknown
+%  plates are NaN. With one output returns N x K matrix, otherwise separate columns.
+%
+%  This is the portable ssa-plate-meta based version; the octave-scosmos package
+%  (lib/install.sh scosmos) provides native ssa_plate_meta() which maps the snapshot
+%  file directly and takes over once loaded.
+%
+%  Example:
+%   [ra0, dec0, epoch] = ssa_plate_meta(65537, 'rapnt,decpnt,epoch');
+%
+function varargout = ssa_plate_meta( plateids, columns )
+
+  cnames = strsplit(columns, " \t\r\n;,", 1);
+  cnames = cnames(~cellfun('isempty', cnames));
+
+  if ( isempty(cnames) )
+    error('ssa_plate_meta(): no columns specified');
+  end
+  if ( nargout > 1 && nargout > numel(cnames) )
+    error('ssa_plate_meta(): %d outputs requested for %d columns', nargout, numel(cnames));
+  end
+
+  cmd = sprintf('ssa-plate-meta -c plateid%s', sprintf(',%s', cnames{:}));
+  [status, out] = system(cmd);
+  if ( status ~= 0 )
+    error('ssa_plate_meta(): subprocess (%s) fails with status %d', cmd, status);
+  end
+
+  A = sscanf(out, '%lf', [numel(cnames) + 1, Inf])';
+
+  if ( isempty(plateids) )
+    v = A(:, 2 : end);
+  else
+    v = nan(numel(plateids), numel(cnames));
+    [found, idx] = ismember(plateids(:), A(:, 1));
+    v(found, :) = A(idx(found), 2 : end);
+  end
+
+  if ( nargout <= 1 )
+    varargout{1} = v;
+  else
+    for i = 1 : nargout
+      varargout{i} = v(:, i);
+    end
+  end
+
+end
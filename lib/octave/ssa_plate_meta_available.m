@@ -0,0 +1,19 @@
+%
+% tf = ssa_plate_meta_available()
+%   True if the local ssa_plates snapshot written by 'ssa-plate-meta export' can be read.
+%   ssa_plate_info(), ssa_plate_list() and ssa_plate_bounds() query wsdb with pgquery()
+%   when it can not. A found snapshot is remembered, a missing one is looked up again
+%   on the next call.
+%
+%   Example :
+%       if ( ~ssa_plate_meta_available() ) disp('run ssa-plate-meta export'); end
+%
+function tf = ssa_plate_meta_available()
+  persistent available = false;
+
+  if ( ~available )
+    available = system('ssa-plate-meta -c plateid survey=1 > /dev/null 2>&1') == 0;
+  end
+
+  tf = available;
+end
@@ -0,0 +1,74 @@
+%
+% [c1, c2, ...] = ssa_plate_read( fname, columns [, filter] )
+%  Read SuperCOSMOS binary plate file and return the requested columns
+%  (names of ssa-plate-dump -h, separated by commas or blanks) as column vectors
+%  of the record field types (int64, int32, int16, uint8, single or double).
+%  filter is a string of ssa-plate-dump options: 'f' applies junk filter,
+%  'c' drops parents of deblends.
+%
+%  This is the portable ssa-plate-dump based version; the octave-scosmos package
+%  (lib/install.sh scosmos) provides native ssa_plate_read() which reads the binary
+%  records directly and takes over once loaded.
+%
+%  Example:
+%   [ra, dec, x, y, mag] = ssa_plate_read('1/66378.dat.bz2', 'ra,dec,x,y,sMag', 'cf');
+%
+function varargout = ssa_plate_read( fname, columns, filter )
+
+  if ( nargin < 3 )
+    filter = '';
+  end
+
+  fields = { 'objID', 'parentID', 'ra', 'dec', 'xmin', 'xmax', 'ymin', 'ymax', 'area', 'ipeak', ...
+             'cosmag', 'isky', 'x', 'y', 'aU', 'bU', 'thetaU', 'aI', 'bI', 'thetaI', 'class', 'pa', ...
+             'ap1', 'ap2', 'ap3', 'ap4', 'ap5', 'ap6', 'ap7', 'ap8', ...
+             'blend', 'quality', 'prfStat', 'prfMag', 'gMag', 'sMag' };
+  types  = { 'int64', 'int64', 'double', 'double', 'double', 'double', 'double', 'double', 'int32', 'single', ...
+             'single', 'single', 'double', 'double', 'single', 'single', 'int16', 'single', 'single', 'int16', 'uint8', 'int16', ...
+             'int32', 'int32', 'int32', 'int32', 'int32', 'int32', 'int32', 'int32', ...
+             'int32', 'int32', 'single', 'single', 'single', 'single' };
+
+  cnames = strsplit(columns, " \t\r\n;,", 1);
+  cnames = cnames(~cellfun('isempty', cnames));
+  cnames(strcmp(cnames, 'xCen')) = { 'x' };
+  cnames(strcmp(cnames, 'yCen')) = { 'y' };
+
+  if ( nargout > numel(cnames) )
+    error('ssa_plate_read(): %d outputs requested for %d columns', nargout, numel(cnames));
+  end
+
+  idx = zeros(1, numel(cnames));
+  for i = 1 : numel(cnames)
+    j = find(strcmp(fields, cnames{i}), 1);
+    if ( isempty(j) )
+      error('ssa_plate_read(): unknown column ''%s''', cnames{i});
+    end
+    idx(i) = j;
+  end
+
+  if ( any(filter == 'f') )
+    opts = '-f';
+  else
+    opts = '-F';
+  end
+  if ( any(filter == 'c') )
+    opts = cstrcat(opts, ' -c');
+  end
+
+  cmd = sprintf('ssa-plate-dump %s ''%s''', opts, fname);
+  pid = popen(cmd, 'r');
+  if ( pid == -1 )
+    error('ssa_plate_read(): popen(''%s'') fails', cmd);
+  end
+  v = fscanf(pid, '%lf', [numel(fields), Inf])';
+  pclose(pid);
+
+  if ( isempty(v) )
+    v = zeros(0, numel(fields));
+  end
+
+  for i = 1 : numel(cnames)
+    varargout{i} = cast(v(:, idx(i)), types{idx(i)});
+  end
+
+end
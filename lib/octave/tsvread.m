@@ -0,0 +1,74 @@
+%
+% v = tsvread( fname, columns [, nthreads] )
+% [c1, c2, ...] = tsvread( fname, columns [, nthreads] )
+%  Load named numeric columns of tsv file with header line.
+%  With one output returns N x K matrix, otherwise each column as separate vector.
+%  .bz2 and .gz files are decompressed.
+%
+%  This is the portable popenq() based version; the octave-scosmos package
+%  (lib/install.sh scosmos) provides native mmap-ed parallel tsvread() which
+%  takes over once loaded. nthreads is ignored here.
+%
+%  Example:
+%   [ra, dec, x, y] = tsvread('refs/1/ucac4/66378.dat', 'ra,dec,x,y');
+%
+function varargout = tsvread( fname, columns, nthreads )
+
+  cnames = strsplit(columns, " \t\r\n;,", 1);
+  cnames = cnames(~cellfun('isempty', cnames));
+  ncols  = size(cnames, 2);
+
+  if ( nargout > 1 && nargout > ncols )
+    error('tsvread(): %d outputs requested for %d columns', nargout, ncols);
+  end
+
+  if ( regexp(fname, '\.bz2?$') )
+    src = sprintf('bzip2 -dc ''%s''', fname);
+  elseif ( regexp(fname, '\.gz$') )
+    src = sprintf('gzip -dc ''%s''', fname);
+  else
+    src = sprintf('cat ''%s''', fname);
+  end
+
+  pid = popen(sprintf('%s | head -n 1', src), 'r');
+  if ( pid == -1 )
+    error('tsvread(''%s''): can not read file', fname);
+  end
+  headline = fgets(pid);
+  pclose(pid);
+
+  if ( ~ischar(headline) )
+    error('tsvread(''%s''): can not read file', fname);
+  end
+
+  headers = strsplit(headline, " \t\n\r", 1);
+
+  cmd = sprintf('%s | awk ''NR > 1 && NF > 0 { print ', src);
+  for i = 1 : ncols
+    j = find(strcmp(headers, cnames{i}), 1);
+    if ( isempty(j) )
+      error('tsvread(): no column ''%s'' found in ''%s''', cnames{i}, fname);
+    end
+    cmd = cstrcat(cmd, sprintf('$%d', j));
+    if ( i < ncols )
+      cmd = cstrcat(cmd, '"\t"');
+    end
+  end
+  cmd = cstrcat(cmd, ' }''');
+
+  pid = popen(cmd, 'r');
+  if ( pid == -1 )
+    error('tsvread(''%s''): popen() fails', fname);
+  end
+  v = fscanf(pid, '%lf', [ncols, Inf])';
+  pclose(pid);
+
+  if ( nargout <= 1 )
+    varargout{1} = v;
+  else
+    for i = 1 : ncols
+      varargout{i} = v(:, i);
+    end
+  end
+
+end
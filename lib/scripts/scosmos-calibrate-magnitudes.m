@@ -18,19 +18,16 @@ end
 
 function [cosmag, isky, x, y, el, Bc, C,ra,dec] = loadmagrefs( filename )
 
-  columns = 'cosmag,isky,x,y,el:(1.0-@bI/@aI),Bc,C,ra,dec';
-  cond = '@bI/@aI>0.5 && (@class==2 || @C==1)';
-
-  cmd = sprintf('ccut -f \"%s\" -x \"%s\" %s', columns, cond, filename);
-  fid = popen(cmd,'r');
-  if ( fid == -1 )
+  if ( ~exist(filename, 'file') )
     fprintf(stderr,'Error: can not read %s\n',filename);
     return;
   end
 
-  fgets(fid);
-  v = transpose(fscanf(fid,'%lf',[9,Inf])); 
-  pclose(fid);
+  % columns: cosmag isky x y aI bI Bc C class ra dec
+  v = tsvread(filename, 'cosmag,isky,x,y,aI,bI,Bc,C,class,ra,dec');
+  ba = v(:,6) ./ v(:,5);
+  keep = ba > 0.5 & (v(:,9) == 2 | v(:,8) == 1);
+  v = [v(keep,1:4), 1.0 - ba(keep), v(keep,7:8), v(keep,10:11)];
 
   % remove bad isky
   smin1 = min( v(:,2) ) + 1e6;